@@ -0,0 +1,191 @@
+#include "BindlessTextures.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+bool queryBindlessSupport(VkPhysicalDevice physicalDevice, uint32_t instanceApiVersion,
+                          VkPhysicalDeviceDescriptorIndexingFeaturesEXT& descriptorIndexingFeatures)
+{
+	// vkGetPhysicalDeviceFeatures2 and vkGetPhysicalDeviceProperties2 are core from 1.1 on
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	if (instanceApiVersion < VK_API_VERSION_1_1 || deviceProperties.apiVersion < VK_API_VERSION_1_1)
+	{
+		return false;
+	}
+
+	uint32_t extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> extensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data());
+	for (const char* required : bindlessDeviceExtensions)
+	{
+		bool found = std::any_of(extensions.begin(), extensions.end(), [&](const VkExtensionProperties& extension)
+		{
+			return strcmp(extension.extensionName, required) == 0;
+		});
+		if (!found)
+		{
+			return false;
+		}
+	}
+
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT supportedFeatures = {};
+	supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	VkPhysicalDeviceFeatures2 features = {};
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features.pNext = &supportedFeatures;
+	vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+	// Only enable what the table uses
+	descriptorIndexingFeatures = {};
+	descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	descriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+	descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	descriptorIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+	descriptorIndexingFeatures.descriptorBindingVariableDescriptorCount = VK_TRUE;
+	descriptorIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+
+	return supportedFeatures.shaderSampledImageArrayNonUniformIndexing &&
+		supportedFeatures.descriptorBindingSampledImageUpdateAfterBind &&
+		supportedFeatures.descriptorBindingPartiallyBound &&
+		supportedFeatures.descriptorBindingVariableDescriptorCount &&
+		supportedFeatures.runtimeDescriptorArray;
+}
+
+BindlessTextureTable::BindlessTextureTable(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t capacity,
+                                           uint32_t framesInFlight)
+	: device(device), framesInFlight(framesInFlight)
+{
+	VkPhysicalDeviceDescriptorIndexingPropertiesEXT descriptorIndexingProperties = {};
+	descriptorIndexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+	VkPhysicalDeviceProperties2 properties = {};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties.pNext = &descriptorIndexingProperties;
+	vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+	// A combined image sampler counts as both a sampler and a sampled image, in the stage and in the set
+	this->capacity = std::min({
+		capacity,
+		descriptorIndexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers,
+		descriptorIndexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		descriptorIndexingProperties.maxPerStageUpdateAfterBindResources,
+		descriptorIndexingProperties.maxDescriptorSetUpdateAfterBindSamplers,
+		descriptorIndexingProperties.maxDescriptorSetUpdateAfterBindSampledImages
+	});
+
+	VkDescriptorSetLayoutBinding binding = {};
+	binding.binding = 0;
+	binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	binding.descriptorCount = this->capacity;
+	binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkDescriptorBindingFlagsEXT bindingFlags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT |
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT |
+		VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT;
+	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsCreateInfo = {};
+	bindingFlagsCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+	bindingFlagsCreateInfo.bindingCount = 1;
+	bindingFlagsCreateInfo.pBindingFlags = &bindingFlags;
+
+	VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo = {};
+	setLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	setLayoutCreateInfo.pNext = &bindingFlagsCreateInfo;
+	setLayoutCreateInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+	setLayoutCreateInfo.bindingCount = 1;
+	setLayoutCreateInfo.pBindings = &binding;
+	if (vkCreateDescriptorSetLayout(device, &setLayoutCreateInfo, nullptr, &setLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create bindless descriptor set layout");
+	}
+
+	VkDescriptorPoolSize poolSize = {};
+	poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSize.descriptorCount = this->capacity;
+
+	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {};
+	descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolCreateInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+	descriptorPoolCreateInfo.poolSizeCount = 1;
+	descriptorPoolCreateInfo.pPoolSizes = &poolSize;
+	descriptorPoolCreateInfo.maxSets = 1;
+	if (vkCreateDescriptorPool(device, &descriptorPoolCreateInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create bindless descriptor pool");
+	}
+
+	VkDescriptorSetVariableDescriptorCountAllocateInfoEXT variableCountInfo = {};
+	variableCountInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO_EXT;
+	variableCountInfo.descriptorSetCount = 1;
+	variableCountInfo.pDescriptorCounts = &this->capacity;
+
+	VkDescriptorSetAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocateInfo.pNext = &variableCountInfo;
+	allocateInfo.descriptorPool = descriptorPool;
+	allocateInfo.descriptorSetCount = 1;
+	allocateInfo.pSetLayouts = &setLayout;
+	if (vkAllocateDescriptorSets(device, &allocateInfo, &descriptorSet) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate bindless descriptor set");
+	}
+}
+
+BindlessTextureTable::~BindlessTextureTable()
+{
+	vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+}
+
+uint32_t BindlessTextureTable::add(VkImageView imageView, VkSampler sampler)
+{
+	uint32_t index;
+	if (!freeSlots.empty())
+	{
+		index = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else if (nextSlot < capacity)
+	{
+		index = nextSlot++;
+	}
+	else
+	{
+		throw std::runtime_error("bindless texture table is full");
+	}
+
+	VkDescriptorImageInfo imageInfo = {};
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfo.imageView = imageView;
+	imageInfo.sampler = sampler;
+
+	// The set may be bound by command buffers in flight, update-after-bind makes this legal
+	VkWriteDescriptorSet descriptorWrite = {};
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = descriptorSet;
+	descriptorWrite.dstBinding = 0;
+	descriptorWrite.dstArrayElement = index;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptorWrite.pImageInfo = &imageInfo;
+	vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+
+	count++;
+	return index;
+}
+
+void BindlessTextureTable::remove(uint32_t index)
+{
+	// Frames still in flight may sample this slot, so it only returns to the free list later
+	retiredSlots.push_back({index, frameNumber});
+	count--;
+}
+
+void BindlessTextureTable::nextFrame()
+{
+	frameNumber++;
+	while (!retiredSlots.empty() && frameNumber >= retiredSlots.front().frame + framesInFlight)
+	{
+		freeSlots.push_back(retiredSlots.front().index);
+		retiredSlots.pop_front();
+	}
+}
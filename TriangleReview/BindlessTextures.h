@@ -0,0 +1,56 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <vector>
+#include <deque>
+
+/// Device extensions needed for bindless textures on a Vulkan 1.1 device.
+const std::vector<const char*> bindlessDeviceExtensions = {
+	VK_KHR_MAINTENANCE3_EXTENSION_NAME,
+	VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME
+};
+
+/// Fills descriptorIndexingFeatures with the features bindless textures rely on and returns whether
+/// the device supports all of them. Both the instance and the device need Vulkan 1.1 for the queries.
+bool queryBindlessSupport(VkPhysicalDevice physicalDevice, uint32_t instanceApiVersion,
+                          VkPhysicalDeviceDescriptorIndexingFeaturesEXT& descriptorIndexingFeatures);
+
+/// One descriptor set holding a large, partially bound array of combined image samplers. Textures are
+/// referenced by slot index from shaders, so a single bind serves every material in a frame. Slots are
+/// updated after bind and recycled through a free list once the frames that could read them retired.
+/// The capacity is clamped to the update-after-bind limits of the device.
+class BindlessTextureTable
+{
+public:
+	BindlessTextureTable(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t capacity,
+	                     uint32_t framesInFlight);
+	~BindlessTextureTable();
+
+	uint32_t add(VkImageView imageView, VkSampler sampler);
+	void remove(uint32_t index);
+	void nextFrame();
+
+	uint32_t size() const { return count; }
+	uint32_t getCapacity() const { return capacity; }
+
+	VkDescriptorSetLayout setLayout;
+	VkDescriptorPool descriptorPool;
+	VkDescriptorSet descriptorSet;
+
+private:
+	struct RetiredSlot
+	{
+		uint32_t index;
+		uint64_t frame;
+	};
+
+	VkDevice device;
+	uint32_t capacity;
+	uint32_t framesInFlight;
+	uint32_t nextSlot = 0;
+	uint32_t count = 0;
+	uint64_t frameNumber = 0;
+	std::vector<uint32_t> freeSlots;
+	std::deque<RetiredSlot> retiredSlots;
+};
@@ -119,7 +119,16 @@ void VulkanTriangle::createInstance()
 {
 	VkApplicationInfo applicationInfo = {};
 	applicationInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-	applicationInfo.apiVersion = VK_API_VERSION_1_0;
+	// 1.1 for the feature and property queries of bindless textures, a 1.0 loader rejects asking for it
+	auto enumerateInstanceVersion = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(
+		vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion"));
+	uint32_t loaderVersion = VK_API_VERSION_1_0;
+	if (enumerateInstanceVersion != nullptr)
+	{
+		enumerateInstanceVersion(&loaderVersion);
+	}
+	apiVersion = loaderVersion >= VK_API_VERSION_1_1 ? VK_API_VERSION_1_1 : VK_API_VERSION_1_0;
+	applicationInfo.apiVersion = apiVersion;
 	applicationInfo.applicationVersion = VK_MAKE_VERSION(0, 0, 1);
 	applicationInfo.engineVersion = VK_MAKE_VERSION(0, 0, 1);
 	applicationInfo.pApplicationName = "Hello Triangle";
@@ -181,6 +190,22 @@ void VulkanTriangle::pickPhysicalDevice()
 			break;
 		}
 	}
+	numSamples = getMaxUsableSampleCount();
+}
+
+VkSampleCountFlagBits VulkanTriangle::getMaxUsableSampleCount()
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	const VkSampleCountFlags counts = properties.limits.framebufferColorSampleCounts &
+		properties.limits.framebufferDepthSampleCounts;
+
+	VkSampleCountFlagBits samples = MAX_NUM_OF_SAMPLES;
+	while (samples > VK_SAMPLE_COUNT_1_BIT && !(counts & samples))
+	{
+		samples = static_cast<VkSampleCountFlagBits>(samples >> 1);
+	}
+	return samples;
 }
 
 void VulkanTriangle::createLogicalDevice()
@@ -210,8 +235,21 @@ void VulkanTriangle::createLogicalDevice()
 	float queuePriority = 1.f;
 	queueCreateInfo.pQueuePriorities = &queuePriority;
 	deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
-	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-	deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	std::vector<const char*> enabledExtensions = deviceExtensions;
+	bindless = ENABLE_BINDLESS_TEXTURES && queryBindlessSupport(physicalDevice, apiVersion,
+	                                                            descriptorIndexingFeatures);
+	if (bindless)
+	{
+		enabledExtensions.insert(enabledExtensions.end(), bindlessDeviceExtensions.begin(),
+		                         bindlessDeviceExtensions.end());
+		deviceCreateInfo.pNext = &descriptorIndexingFeatures;
+	}
+	else if (ENABLE_BINDLESS_TEXTURES)
+	{
+		std::cout << "Descriptor indexing not supported, falling back to per-set textures" << std::endl;
+	}
+	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+	deviceCreateInfo.ppEnabledExtensionNames = enabledExtensions.data();
 	VkPhysicalDeviceFeatures features = {};
 	features.samplerAnisotropy = VK_TRUE;
 	deviceCreateInfo.pEnabledFeatures = &features;
@@ -279,7 +317,7 @@ void VulkanTriangle::createShaderModule()
 
 	VkShaderModuleCreateInfo fragShaderModuleCreateInfo = {};
 	fragShaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	std::vector<char> fragShaderCode = readFile("shaders/frag.spv");
+	std::vector<char> fragShaderCode = readFile(bindless ? "shaders/frag_bindless.spv" : "shaders/frag.spv");
 	fragShaderModuleCreateInfo.codeSize = fragShaderCode.size();
 	fragShaderModuleCreateInfo.pCode = reinterpret_cast<uint32_t*>(fragShaderCode.data());
 	vkCreateShaderModule(device, &fragShaderModuleCreateInfo, nullptr, &fragShaderModule);
@@ -299,11 +337,21 @@ void VulkanTriangle::createDescriptorSetLayout()
 	samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-	std::vector<VkDescriptorSetLayoutBinding> bindings = {uboLayoutBinding, samplerLayoutBinding};
+	std::vector<VkDescriptorSetLayoutBinding> bindings = {uboLayoutBinding};
+	if (bindless)
+	{
+		// Textures live in their own set 1 instead
+		bindlessTextures = std::make_unique<BindlessTextureTable>(device, physicalDevice, MAX_BINDLESS_TEXTURES,
+		                                                          MAX_FRAMES_IN_FLIGHT);
+	}
+	else
+	{
+		bindings.push_back(samplerLayoutBinding);
+	}
 
 	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {};
 	descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	descriptorSetLayoutCreateInfo.bindingCount = 2;
+	descriptorSetLayoutCreateInfo.bindingCount = static_cast<uint32_t>(bindings.size());
 	descriptorSetLayoutCreateInfo.pBindings = bindings.data();
 	vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCreateInfo, nullptr, &descriptorSetLayout);
 }
@@ -340,8 +388,18 @@ void VulkanTriangle::createPipeline()
 
 	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
 	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutCreateInfo.setLayoutCount = 1;
-	pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayout;
+	std::vector<VkDescriptorSetLayout> setLayouts = {descriptorSetLayout};
+	VkPushConstantRange pushConstantRange = {};
+	if (bindless)
+	{
+		setLayouts.push_back(bindlessTextures->setLayout);
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		pushConstantRange.size = sizeof(PushConstants);
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+	}
+	pipelineLayoutCreateInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+	pipelineLayoutCreateInfo.pSetLayouts = setLayouts.data();
 	vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout);
 
 	pipelineCreateInfo.layout = pipelineLayout;
@@ -367,7 +425,7 @@ void VulkanTriangle::createPipeline()
 
 	VkPipelineMultisampleStateCreateInfo multisampleStateCreateInfo = {};
 	multisampleStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampleStateCreateInfo.rasterizationSamples = NUM_OF_SAMPLES;
+	multisampleStateCreateInfo.rasterizationSamples = numSamples;
 
 	pipelineCreateInfo.pMultisampleState = &multisampleStateCreateInfo;
 
@@ -437,7 +495,7 @@ void VulkanTriangle::createRenderPass()
 
 	VkAttachmentDescription colorAttachment = {};
 	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-	colorAttachment.samples = NUM_OF_SAMPLES;
+	colorAttachment.samples = numSamples;
 	colorAttachment.format = imageFormat;
 	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
@@ -451,7 +509,7 @@ void VulkanTriangle::createRenderPass()
 	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	depthAttachment.samples = NUM_OF_SAMPLES;
+	depthAttachment.samples = numSamples;
 
 	VkAttachmentDescription colorAttachmentResolve = {};
 	colorAttachmentResolve.format = imageFormat;
@@ -558,6 +616,15 @@ void VulkanTriangle::createCommandBuffers()
 		vkCmdBindIndexBuffer(commandBuffers[i], indexBuffer, 0, VK_INDEX_TYPE_UINT32);
 		vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
 		                        &descriptorSets[i], 0, nullptr);
+		if (bindless)
+		{
+			vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1,
+			                        &bindlessTextures->descriptorSet, 0, nullptr);
+			PushConstants pushConstants = {};
+			pushConstants.textureIndex = textureIndex;
+			vkCmdPushConstants(commandBuffers[i], pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+			                   sizeof(PushConstants), &pushConstants);
+		}
 		vkCmdDrawIndexed(commandBuffers[i], static_cast<uint32_t>(indices.size()),
 		                 1, 0, 0, 0);
 		vkCmdEndRenderPass(commandBuffers[i]);
@@ -750,11 +817,14 @@ void VulkanTriangle::createUniformBuffers()
 
 void VulkanTriangle::createDescriptorPool()
 {
-	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+	std::vector<VkDescriptorPoolSize> poolSizes(bindless ? 1 : 2);
 	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 	poolSizes[0].descriptorCount = swapchainImageCount;
-	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSizes[1].descriptorCount = swapchainImageCount;
+	if (!bindless)
+	{
+		poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		poolSizes[1].descriptorCount = swapchainImageCount;
+	}
 
 	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {};
 	descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -775,6 +845,11 @@ void VulkanTriangle::createDescriptorSets()
 	descriptorSets.resize(swapchainImageCount);
 	vkAllocateDescriptorSets(device, &allocateInfo, descriptorSets.data());
 
+	if (bindless)
+	{
+		textureIndex = bindlessTextures->add(textureImageView, textureSampler);
+	}
+
 	for (unsigned i = 0; i < swapchainImageCount; i++)
 	{
 		VkDescriptorBufferInfo bufferInfo = {};
@@ -799,14 +874,15 @@ void VulkanTriangle::createDescriptorSets()
 		descriptorWrites[1].pImageInfo = &imageInfo;
 		descriptorWrites[1].dstSet = descriptorSets[i];
 		descriptorWrites[1].dstBinding = 1;
-		vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(),
-		                       0, nullptr);
+		// The bindless table already holds the texture, only the UBO is per image
+		uint32_t writeCount = bindless ? 1 : static_cast<uint32_t>(descriptorWrites.size());
+		vkUpdateDescriptorSets(device, writeCount, descriptorWrites.data(), 0, nullptr);
 	}
 }
 
 void VulkanTriangle::createDepthResources()
 {
-	createImage(extent.width, extent.height, 1, NUM_OF_SAMPLES,
+	createImage(extent.width, extent.height, 1, numSamples,
 	            VK_FORMAT_D16_UNORM, VK_IMAGE_TILING_OPTIMAL,
 	            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
 	            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory);
@@ -815,7 +891,7 @@ void VulkanTriangle::createDepthResources()
 
 void VulkanTriangle::createColorResources()
 {
-	createImage(WIDTH, HEIGHT, 1, NUM_OF_SAMPLES, imageFormat, VK_IMAGE_TILING_OPTIMAL,
+	createImage(WIDTH, HEIGHT, 1, numSamples, imageFormat, VK_IMAGE_TILING_OPTIMAL,
 	            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, colorImage, colorImageMemroy);
 	colorImageView = createImageView(colorImage, imageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
 }
@@ -941,6 +1017,10 @@ void VulkanTriangle::drawFrame()
 {
 	vkWaitForFences(device, 1, &submitFences[currentFrame], VK_TRUE, UINT64_MAX);
 	vkResetFences(device, 1, &submitFences[currentFrame]);
+	if (bindless)
+	{
+		bindlessTextures->nextFrame();
+	}
 	uint32_t imageIndex;
 	vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, imageAvailableSemaphore[currentFrame], VK_NULL_HANDLE,
 	                      &imageIndex);
@@ -14,12 +14,18 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <array>
+#include <memory>
 #include <xhash>
 
+#include "BindlessTextures.h"
+
 const int WIDTH = 800;
 const int HEIGHT = 600;
 const int MAX_FRAMES_IN_FLIGHT = 2;
-const VkSampleCountFlagBits NUM_OF_SAMPLES = VK_SAMPLE_COUNT_8_BIT;
+/// Lowered to what the device supports for color and depth framebuffers
+const VkSampleCountFlagBits MAX_NUM_OF_SAMPLES = VK_SAMPLE_COUNT_8_BIT;
+const bool ENABLE_BINDLESS_TEXTURES = true;
+const uint32_t MAX_BINDLESS_TEXTURES = 16384;
 
 const std::string MODEL_PATH = "models/chalet.obj";
 const std::string TEXTURE_PATH = "textures/chalet.jpg";
@@ -60,6 +66,12 @@ struct UniformBufferObject
 	glm::mat4 proj;
 };
 
+/// Per-draw data for the bindless path, textures are looked up by their table slot
+struct PushConstants
+{
+	uint32_t textureIndex;
+};
+
 const std::vector<const char *> validationLayers = {
 	"VK_LAYER_KHRONOS_validation",
 	"VK_LAYER_LUNARG_monitor"
@@ -120,6 +132,13 @@ private:
 	VkImage colorImage;
 	VkDeviceMemory colorImageMemroy;
 	VkImageView colorImageView;
+	VkSampleCountFlagBits numSamples = VK_SAMPLE_COUNT_1_BIT;
+	/// Version the instance was created with, 1.1 where the loader supports it
+	uint32_t apiVersion = VK_API_VERSION_1_0;
+	bool bindless = false;
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures;
+	std::unique_ptr<BindlessTextureTable> bindlessTextures;
+	uint32_t textureIndex = 0;
 
 	std::vector<Vertex> vertices;
 	std::vector<uint32_t> indices;
@@ -145,6 +164,7 @@ private:
 	void createInstance();
 	void setupDebugMessenger();
 	void pickPhysicalDevice();
+	VkSampleCountFlagBits getMaxUsableSampleCount();
 	void createLogicalDevice();
 	void createSwapchain();
 	void createImageViews();
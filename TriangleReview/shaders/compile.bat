@@ -1,3 +1,4 @@
 glslc.exe shader.vert -o vert.spv
 glslc.exe shader.frag -o frag.spv
+glslc.exe shader_bindless.frag -o frag_bindless.spv
 pause
@@ -0,0 +1,581 @@
+#include "AntiAliasing.h"
+#include "VulkanBase.h"
+
+#include <stdexcept>
+
+namespace
+{
+	float halton(uint32_t index, uint32_t base)
+	{
+		float fraction = 1.f;
+		float result = 0.f;
+		while (index > 0)
+		{
+			fraction /= static_cast<float>(base);
+			result += fraction * static_cast<float>(index % base);
+			index /= base;
+		}
+		return result;
+	}
+}
+
+const char* getAntiAliasingModeName(AntiAliasingMode mode)
+{
+	switch (mode)
+	{
+	case AntiAliasingMode::Msaa:
+		return "MSAA";
+	case AntiAliasingMode::Fxaa:
+		return "FXAA";
+	case AntiAliasingMode::Taa:
+		return "TAA";
+	}
+	return "unknown";
+}
+
+AntiAliasing::AntiAliasing(VulkanBase& base)
+	: base(base)
+{
+	// TAA samples the depth of the single-sample pass, which the format picked for the base may not allow
+	depthFormat = base.findDepthFormat(VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+
+	createRenderPasses();
+	createPipelines();
+
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.minLod = 0;
+	samplerInfo.maxLod = 0;
+	if (vkCreateSampler(base.device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create anti-aliasing sampler!");
+	}
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(base.physicalDevice, &properties);
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(base.physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(base.physicalDevice, &queueFamilyCount, queueFamilies.data());
+	if (queueFamilies[base.queueFamilyIndex.graphicsFamily.value()].timestampValidBits != 0)
+	{
+		timestampPeriod = properties.limits.timestampPeriod;
+	}
+
+	addSwapchainImages();
+	createTargets();
+}
+
+void AntiAliasing::addSwapchainImages()
+{
+	const size_t imageCount = base.swapchainImages.size();
+	if (timestampPeriod > 0.f)
+	{
+		if (queryPool != VK_NULL_HANDLE)
+		{
+			// Frames in flight may still write their timestamps
+			base.retireQueryPool(queryPool);
+		}
+		VkQueryPoolCreateInfo queryPoolCreateInfo = {};
+		queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolCreateInfo.queryCount = static_cast<uint32_t>(imageCount) * TIMESTAMPS_PER_FRAME;
+		if (vkCreateQueryPool(base.device, &queryPoolCreateInfo, nullptr, &queryPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create timestamp query pool!");
+		}
+	}
+	timestampsWritten.assign(imageCount, false);
+	recordedModes.resize(imageCount, AntiAliasingMode::Msaa);
+}
+
+AntiAliasing::~AntiAliasing()
+{
+	retireTargets();
+	destroyRetired(true);
+	if (queryPool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(base.device, queryPool, nullptr);
+	}
+	vkDestroySampler(base.device, sampler, nullptr);
+	vkDestroyRenderPass(base.device, sceneRenderPass, nullptr);
+	vkDestroyRenderPass(base.device, fxaaRenderPass, nullptr);
+	vkDestroyRenderPass(base.device, taaRenderPass, nullptr);
+}
+
+VkRenderPass AntiAliasing::createRenderPass(const std::vector<VkAttachmentDescription>& attachments,
+                                            const std::vector<VkAttachmentReference>& colorRefs,
+                                            const VkAttachmentReference* depthRef,
+                                            const VkSubpassDependency* dependencies, uint32_t dependencyCount)
+{
+	VkSubpassDescription subpassDescription = {};
+	subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpassDescription.colorAttachmentCount = static_cast<uint32_t>(colorRefs.size());
+	subpassDescription.pColorAttachments = colorRefs.data();
+	subpassDescription.pDepthStencilAttachment = depthRef;
+
+	VkRenderPassCreateInfo renderPassCreateInfo = {};
+	renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	renderPassCreateInfo.pAttachments = attachments.data();
+	renderPassCreateInfo.subpassCount = 1;
+	renderPassCreateInfo.pSubpasses = &subpassDescription;
+	renderPassCreateInfo.dependencyCount = dependencyCount;
+	renderPassCreateInfo.pDependencies = dependencies;
+
+	VkRenderPass renderPass;
+	if (vkCreateRenderPass(base.device, &renderPassCreateInfo, nullptr, &renderPass) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create anti-aliasing render pass!");
+	}
+	return renderPass;
+}
+
+void AntiAliasing::createRenderPasses()
+{
+	// Single-sample scene, both attachments are left for the resolve passes to sample
+	VkAttachmentDescription colorAttachment = {};
+	colorAttachment.format = base.surfaceFormat.format;
+	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkAttachmentDescription depthAttachment = colorAttachment;
+	depthAttachment.format = depthFormat;
+	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+	const VkAttachmentReference colorRef = {0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+	const VkAttachmentReference depthRef = {1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+
+	// The last frame's resolve has to be done sampling before the scene is drawn over, and the scene
+	// has to land before this frame's resolve samples it
+	VkSubpassDependency sceneDependencies[2] = {};
+	sceneDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	sceneDependencies[0].dstSubpass = 0;
+	sceneDependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	sceneDependencies[0].srcAccessMask = 0;
+	sceneDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+		VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	sceneDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	sceneDependencies[1].srcSubpass = 0;
+	sceneDependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+	sceneDependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+		VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	sceneDependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	sceneDependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	sceneDependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	sceneRenderPass = createRenderPass({colorAttachment, depthAttachment}, {colorRef}, &depthRef, sceneDependencies,
+	                                   2);
+
+	// The resolves cover every pixel, so nothing is loaded
+	VkAttachmentDescription swapchainAttachment = colorAttachment;
+	swapchainAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	swapchainAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+	VkAttachmentDescription historyAttachment = swapchainAttachment;
+	historyAttachment.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+	historyAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	const VkAttachmentReference historyRef = {1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+
+	// Waits for the acquire semaphore's stage, and for TAA also orders the history write of the last
+	// frame before it is sampled and the sampling of the last frame before it is written again
+	VkSubpassDependency resolveDependency = {};
+	resolveDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+	resolveDependency.dstSubpass = 0;
+	resolveDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	resolveDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	resolveDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	resolveDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT;
+	fxaaRenderPass = createRenderPass({swapchainAttachment}, {colorRef}, nullptr, &resolveDependency, 1);
+	taaRenderPass = createRenderPass({swapchainAttachment, historyAttachment}, {colorRef, historyRef}, nullptr,
+	                                 &resolveDependency, 1);
+}
+
+void AntiAliasing::createPipelines()
+{
+	// Both resolves draw one triangle over the screen
+	const VkShaderModule vertShader = base.createShaderModule("shaders/upscale_vert.spv");
+	const VkShaderModule fxaaShader = base.createShaderModule("shaders/fxaa_frag.spv");
+	const VkShaderModule taaShader = base.createShaderModule("shaders/taa_frag.spv");
+
+	ReflectedPipelineLayout fxaaLayout = base.layoutCache->getPipelineLayout({
+		&base.shaderReflections.at(vertShader), &base.shaderReflections.at(fxaaShader)
+	});
+	fxaaPipelineLayout = fxaaLayout.pipelineLayout;
+	fxaaSetLayout = fxaaLayout.setLayouts[0];
+	fxaaTemplate = TypedUpdateTemplate<FxaaDescriptors>(
+		base.device, base.layoutCache->getDescriptorUpdateTemplate(fxaaSetLayout));
+
+	ReflectedPipelineLayout taaLayout = base.layoutCache->getPipelineLayout({
+		&base.shaderReflections.at(vertShader), &base.shaderReflections.at(taaShader)
+	});
+	taaPipelineLayout = taaLayout.pipelineLayout;
+	taaSetLayout = taaLayout.setLayouts[0];
+	taaTemplate = TypedUpdateTemplate<TaaDescriptors>(
+		base.device, base.layoutCache->getDescriptorUpdateTemplate(taaSetLayout));
+
+	PipelineDescription description;
+	description.vertShader = vertShader;
+	description.fragShader = fxaaShader;
+	description.cullMode = VK_CULL_MODE_NONE;
+	description.depthTestEnable = VK_FALSE;
+	description.depthWriteEnable = VK_FALSE;
+	description.layout = fxaaPipelineLayout;
+	description.renderPass = fxaaRenderPass;
+	// Both are owned by the pipeline cache
+	fxaaPipeline = base.pipelineCache->getPipelineBlocking(description);
+
+	// The resolve writes the swapchain image and the next frame's history
+	description.fragShader = taaShader;
+	description.colorAttachmentCount = 2;
+	description.layout = taaPipelineLayout;
+	description.renderPass = taaRenderPass;
+	taaPipeline = base.pipelineCache->getPipelineBlocking(description);
+	if (fxaaPipeline == VK_NULL_HANDLE || taaPipeline == VK_NULL_HANDLE)
+	{
+		throw std::runtime_error("failed to create anti-aliasing pipelines!");
+	}
+}
+
+AntiAliasing::Target AntiAliasing::createTarget(VkFormat format, VkImageUsageFlags usage,
+                                                VkImageAspectFlagBits aspect)
+{
+	Target target;
+	target.format = format;
+	if (base.createImage(base.windowWidth, base.windowHeight, 1, VK_SAMPLE_COUNT_1_BIT, format,
+	                     VK_IMAGE_TILING_OPTIMAL, usage, VMA_MEMORY_USAGE_GPU_ONLY, target.image, target.allocation) !=
+		VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create anti-aliasing target!");
+	}
+	target.view = base.createImageView(target.image, format, aspect, 1);
+	return target;
+}
+
+VkFramebuffer AntiAliasing::createFramebuffer(VkRenderPass renderPass, const std::vector<VkImageView>& attachments)
+{
+	VkFramebufferCreateInfo framebufferCreateInfo = {};
+	framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	framebufferCreateInfo.renderPass = renderPass;
+	framebufferCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	framebufferCreateInfo.pAttachments = attachments.data();
+	framebufferCreateInfo.width = base.windowWidth;
+	framebufferCreateInfo.height = base.windowHeight;
+	framebufferCreateInfo.layers = 1;
+
+	VkFramebuffer framebuffer;
+	if (vkCreateFramebuffer(base.device, &framebufferCreateInfo, nullptr, &framebuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create anti-aliasing framebuffer!");
+	}
+	return framebuffer;
+}
+
+void AntiAliasing::createTargets()
+{
+	color = createTarget(base.surfaceFormat.format, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+	                     VK_IMAGE_ASPECT_COLOR_BIT);
+	depth = createTarget(depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+	                     VK_IMAGE_ASPECT_DEPTH_BIT);
+	for (Target& target : history)
+	{
+		target = createTarget(VK_FORMAT_R16G16B16A16_SFLOAT,
+		                      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		                      VK_IMAGE_ASPECT_COLOR_BIT);
+	}
+
+	sceneFramebuffer = createFramebuffer(sceneRenderPass, {color.view, depth.view});
+	fxaaFramebuffers.resize(base.swapchainImageViews.size());
+	taaFramebuffers.resize(base.swapchainImageViews.size() * 2);
+	for (size_t i = 0; i < base.swapchainImageViews.size(); i++)
+	{
+		fxaaFramebuffers[i] = createFramebuffer(fxaaRenderPass, {base.swapchainImageViews[i]});
+		for (uint32_t written = 0; written < 2; written++)
+		{
+			taaFramebuffers[i * 2 + written] = createFramebuffer(taaRenderPass, {
+				                                                     base.swapchainImageViews[i], history[written].view
+			                                                     });
+		}
+	}
+	historyValid = false;
+}
+
+void AntiAliasing::resize()
+{
+	retireTargets();
+	createTargets();
+}
+
+void AntiAliasing::retireTargets()
+{
+	RetiredTargets retired;
+	retired.retireFrame = base.frameNumber;
+	retired.targets = {color, depth, history[0], history[1]};
+	retired.framebuffers = fxaaFramebuffers;
+	retired.framebuffers.insert(retired.framebuffers.end(), taaFramebuffers.begin(), taaFramebuffers.end());
+	retired.framebuffers.push_back(sceneFramebuffer);
+	retiredTargets.push_back(std::move(retired));
+}
+
+void AntiAliasing::destroyRetired(bool all)
+{
+	while (!retiredTargets.empty() &&
+		(all || base.frameNumber >= retiredTargets.front().retireFrame + MAX_FRAMES_IN_FLIGHT))
+	{
+		RetiredTargets& retired = retiredTargets.front();
+		for (VkFramebuffer framebuffer : retired.framebuffers)
+		{
+			vkDestroyFramebuffer(base.device, framebuffer, nullptr);
+		}
+		for (const Target& target : retired.targets)
+		{
+			vkDestroyImageView(base.device, target.view, nullptr);
+			vmaDestroyImage(base.allocator, target.image, target.allocation);
+		}
+		retiredTargets.pop_front();
+	}
+}
+
+AntiAliasingMemory AntiAliasing::getAttachmentMemory(AntiAliasingMode attachmentsOf) const
+{
+	AntiAliasingMemory memory;
+	auto add = [&](VmaAllocation allocation, VkFormat format)
+	{
+		const AttachmentMemory attachment = base.getAttachmentMemory(allocation, format);
+		memory.allocatedBytes += attachment.allocatedBytes;
+		memory.committedBytes += attachment.committedBytes;
+	};
+	switch (attachmentsOf)
+	{
+	case AntiAliasingMode::Msaa:
+		add(base.colorImageAllocation, base.surfaceFormat.format);
+		add(base.depthImageAllocation, base.depthImageFormat);
+		break;
+	case AntiAliasingMode::Taa:
+		add(history[0].allocation, history[0].format);
+		add(history[1].allocation, history[1].format);
+		// The history comes on top of the FXAA targets
+	case AntiAliasingMode::Fxaa:
+		add(color.allocation, color.format);
+		add(depth.allocation, depth.format);
+		break;
+	}
+	return memory;
+}
+
+glm::vec2 AntiAliasing::getJitter() const
+{
+	// Halton 2,3 points spread the samples of a pixel evenly over the sequence, offsets are in NDC
+	const uint32_t index = jitterIndex % JITTER_SAMPLES + 1;
+	return glm::vec2((halton(index, 2) - 0.5f) * 2.f / static_cast<float>(base.windowWidth),
+	                 (halton(index, 3) - 0.5f) * 2.f / static_cast<float>(base.windowHeight));
+}
+
+void AntiAliasing::jitterProjection(glm::mat4& proj) const
+{
+	if (mode == AntiAliasingMode::Taa)
+	{
+		// w is the negated view space z, so this shifts every point by the jitter after the divide
+		const glm::vec2 jitter = getJitter();
+		proj[2][0] -= jitter.x;
+		proj[2][1] -= jitter.y;
+	}
+}
+
+void AntiAliasing::update(uint32_t imageIndex, const glm::mat4& currentViewProj)
+{
+	uint64_t timestamps[TIMESTAMPS_PER_FRAME];
+	if (timestampsWritten[imageIndex] &&
+		vkGetQueryPoolResults(base.device, queryPool, imageIndex * TIMESTAMPS_PER_FRAME, TIMESTAMPS_PER_FRAME,
+		                      sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+	{
+		const float toMilliseconds = timestampPeriod / 1000000.f;
+		stats.gpuMilliseconds = static_cast<float>(timestamps[1] - timestamps[0]) * toMilliseconds;
+		stats.mode = recordedModes[imageIndex];
+		stats.attachmentMemory = getAttachmentMemory(stats.mode);
+	}
+
+	jitterIndex++;
+	previousViewProj = viewProj;
+	viewProj = currentViewProj;
+}
+
+void AntiAliasing::setViewport(VkCommandBuffer commandBuffer)
+{
+	VkViewport viewport = {};
+	viewport.width = static_cast<float>(base.windowWidth);
+	viewport.height = static_cast<float>(base.windowHeight);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor = {};
+	scissor.extent.width = base.windowWidth;
+	scissor.extent.height = base.windowHeight;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
+
+void AntiAliasing::beginScene(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	destroyRetired(false);
+	if (queryPool != VK_NULL_HANDLE)
+	{
+		vkCmdResetQueryPool(commandBuffer, queryPool, imageIndex * TIMESTAMPS_PER_FRAME, TIMESTAMPS_PER_FRAME);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool,
+		                    imageIndex * TIMESTAMPS_PER_FRAME);
+		timestampsWritten[imageIndex] = true;
+	}
+	recordedModes[imageIndex] = mode;
+
+	// Same clear values as the base render pass, whose resolve attachment comes first
+	VkClearValue clearValues[3] = {};
+	clearValues[0].color = {1, 1, 1};
+	clearValues[1].color = {0, 0, 0};
+	clearValues[2].depthStencil = {1, 0};
+
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderArea.offset = {0, 0};
+	renderPassInfo.renderArea.extent.width = base.windowWidth;
+	renderPassInfo.renderArea.extent.height = base.windowHeight;
+	if (mode == AntiAliasingMode::Msaa)
+	{
+		renderPassInfo.renderPass = base.renderPass;
+		renderPassInfo.framebuffer = base.swapchainFramebuffers[imageIndex];
+		renderPassInfo.clearValueCount = 3;
+		renderPassInfo.pClearValues = clearValues;
+	}
+	else
+	{
+		renderPassInfo.renderPass = sceneRenderPass;
+		renderPassInfo.framebuffer = sceneFramebuffer;
+		renderPassInfo.clearValueCount = 2;
+		renderPassInfo.pClearValues = clearValues + 1;
+	}
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	setViewport(commandBuffer);
+}
+
+void AntiAliasing::endScene(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	vkCmdEndRenderPass(commandBuffer);
+	if (mode == AntiAliasingMode::Fxaa)
+	{
+		recordFxaa(commandBuffer, imageIndex);
+	}
+	else if (mode == AntiAliasingMode::Taa)
+	{
+		recordTaa(commandBuffer, imageIndex);
+	}
+	if (mode != AntiAliasingMode::Taa)
+	{
+		// Frames without TAA leave the history behind
+		historyValid = false;
+	}
+
+	if (queryPool != VK_NULL_HANDLE)
+	{
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool,
+		                    imageIndex * TIMESTAMPS_PER_FRAME + 1);
+	}
+}
+
+void AntiAliasing::recordFxaa(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = fxaaRenderPass;
+	renderPassInfo.framebuffer = fxaaFramebuffers[imageIndex];
+	renderPassInfo.renderArea.offset = {0, 0};
+	renderPassInfo.renderArea.extent.width = base.windowWidth;
+	renderPassInfo.renderArea.extent.height = base.windowHeight;
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	setViewport(commandBuffer);
+
+	// The target views change with the swapchain size, so the set is written every frame
+	FxaaDescriptors descriptors = {};
+	descriptors.sceneColor.image = {sampler, color.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+	VkDescriptorSet descriptorSet = base.descriptorAllocator->allocate(fxaaSetLayout);
+	fxaaTemplate.update(descriptorSet, descriptors);
+
+	FxaaPushConstants pushConstants;
+	pushConstants.texelSize = glm::vec2(1.f / base.windowWidth, 1.f / base.windowHeight);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, fxaaPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, fxaaPipelineLayout, 0, 1, &descriptorSet,
+	                        0, nullptr);
+	vkCmdPushConstants(commandBuffer, fxaaPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(FxaaPushConstants),
+	                   &pushConstants);
+	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+	vkCmdEndRenderPass(commandBuffer);
+}
+
+void AntiAliasing::recordTaa(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	const uint32_t previousIndex = historyIndex ^ 1;
+	if (!historyValid)
+	{
+		// Nothing to blend with yet, but the image has to be in a layout it can be sampled in
+		VkImageMemoryBarrier historyBarrier = {};
+		historyBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		historyBarrier.srcAccessMask = 0;
+		historyBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		historyBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		historyBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		historyBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		historyBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		historyBarrier.image = history[previousIndex].image;
+		historyBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		                     VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &historyBarrier);
+	}
+
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = taaRenderPass;
+	renderPassInfo.framebuffer = taaFramebuffers[imageIndex * 2 + historyIndex];
+	renderPassInfo.renderArea.offset = {0, 0};
+	renderPassInfo.renderArea.extent.width = base.windowWidth;
+	renderPassInfo.renderArea.extent.height = base.windowHeight;
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	setViewport(commandBuffer);
+
+	TaaDescriptors descriptors = {};
+	descriptors.sceneColor.image = {sampler, color.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+	descriptors.sceneDepth.image = {sampler, depth.view, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL};
+	descriptors.history.image = {sampler, history[previousIndex].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+	VkDescriptorSet descriptorSet = base.descriptorAllocator->allocate(taaSetLayout);
+	taaTemplate.update(descriptorSet, descriptors);
+
+	TaaPushConstants pushConstants;
+	// Both camera matrices are unjittered, the jitter only moves where the scene was sampled
+	pushConstants.reprojection = previousViewProj * glm::inverse(viewProj);
+	pushConstants.texelSize = glm::vec2(1.f / base.windowWidth, 1.f / base.windowHeight);
+	pushConstants.historyWeight = historyValid ? historyWeight : 0.f;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, taaPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, taaPipelineLayout, 0, 1, &descriptorSet,
+	                        0, nullptr);
+	vkCmdPushConstants(commandBuffer, taaPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(TaaPushConstants),
+	                   &pushConstants);
+	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+	vkCmdEndRenderPass(commandBuffer);
+
+	historyIndex = previousIndex;
+	historyValid = true;
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <vk_mem_alloc.h>
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <vector>
+#include <deque>
+#include "DescriptorAllocator.h"
+
+class VulkanBase;
+
+enum class AntiAliasingMode
+{
+	Msaa,
+	Fxaa,
+	Taa,
+};
+
+const char* getAntiAliasingModeName(AntiAliasingMode mode);
+
+struct FxaaPushConstants
+{
+	glm::vec2 texelSize;
+};
+
+struct TaaPushConstants
+{
+	glm::mat4 reprojection;
+	glm::vec2 texelSize;
+	float historyWeight;
+};
+
+struct FxaaDescriptors
+{
+	DescriptorInfo sceneColor;
+};
+
+struct TaaDescriptors
+{
+	DescriptorInfo sceneColor;
+	DescriptorInfo sceneDepth;
+	DescriptorInfo history;
+};
+
+/// Attachments a mode renders with, besides the swapchain
+struct AntiAliasingMemory
+{
+	VkDeviceSize allocatedBytes = 0;
+	/// Less than allocated when the multisampled targets are lazily allocated
+	VkDeviceSize committedBytes = 0;
+};
+
+struct AntiAliasingStats
+{
+	AntiAliasingMode mode = AntiAliasingMode::Msaa;
+	/// GPU time of the scene and resolve passes of the last frame read back, zero without timestamp support
+	float gpuMilliseconds = 0.f;
+	AntiAliasingMemory attachmentMemory;
+};
+
+/// Switches the main pass between the multisampled base render pass and post-process anti-aliasing
+/// on a single-sample target. FXAA blurs along the luma edges of that target into the swapchain. TAA
+/// jitters the projection by a subpixel offset every frame and blends each pixel with the history
+/// at the position its depth reprojects to, clamped to the range of the current 3x3 neighborhood so
+/// stale history does not ghost. It writes the swapchain and the next history in one pass.
+/// Pipelines drawing the scene need a single-sample variant for getSceneRenderPass().
+class AntiAliasing
+{
+public:
+	explicit AntiAliasing(VulkanBase& base);
+	~AntiAliasing();
+
+	VkRenderPass getSceneRenderPass() const { return sceneRenderPass; }
+	/// Whether the scene is drawn with the single-sample variants, for the mode of the frame being recorded
+	bool isSingleSample() const { return mode != AntiAliasingMode::Msaa; }
+
+	/// Reads this image's last GPU time and moves the TAA jitter and camera history on, call once per
+	/// frame after its fence has signaled, with the unjittered view projection
+	void update(uint32_t imageIndex, const glm::mat4& viewProj);
+	/// Offsets the projection by this frame's subpixel jitter in TAA mode, leaves it as it is otherwise
+	void jitterProjection(glm::mat4& proj) const;
+
+	/// Begins the render pass the scene is drawn in for the current mode, with viewport and scissor set
+	void beginScene(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	/// Ends the scene pass and resolves into the swapchain image
+	void endScene(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	/// Follows the swapchain size, the old images live on until the frames using them have retired
+	void resize();
+	/// Follows a recreated swapchain that has more images, the old query pool is retired
+	void addSwapchainImages();
+
+	AntiAliasingMemory getAttachmentMemory(AntiAliasingMode attachmentsOf) const;
+	AntiAliasingStats getStats() const { return stats; }
+
+	/// Can change between any two frames
+	AntiAliasingMode mode = AntiAliasingMode::Msaa;
+	/// Share of the history in every TAA frame
+	float historyWeight = 0.9f;
+
+private:
+	static const uint32_t TIMESTAMPS_PER_FRAME = 2;
+	static const uint32_t JITTER_SAMPLES = 8;
+
+	struct Target
+	{
+		VkImage image = VK_NULL_HANDLE;
+		VmaAllocation allocation = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		VkFormat format = VK_FORMAT_UNDEFINED;
+	};
+
+	struct RetiredTargets
+	{
+		uint64_t retireFrame;
+		std::vector<Target> targets;
+		std::vector<VkFramebuffer> framebuffers;
+	};
+
+	VulkanBase& base;
+	VkRenderPass sceneRenderPass;
+	VkRenderPass fxaaRenderPass;
+	VkRenderPass taaRenderPass;
+	VkSampler sampler;
+	VkPipelineLayout fxaaPipelineLayout;
+	VkPipelineLayout taaPipelineLayout;
+	VkDescriptorSetLayout fxaaSetLayout;
+	VkDescriptorSetLayout taaSetLayout;
+	VkPipeline fxaaPipeline;
+	VkPipeline taaPipeline;
+	TypedUpdateTemplate<FxaaDescriptors> fxaaTemplate;
+	TypedUpdateTemplate<TaaDescriptors> taaTemplate;
+
+	VkFormat depthFormat;
+	Target color;
+	Target depth;
+	Target history[2];
+	VkFramebuffer sceneFramebuffer = VK_NULL_HANDLE;
+	std::vector<VkFramebuffer> fxaaFramebuffers;
+	/// One per swapchain image and history image written, history index fastest
+	std::vector<VkFramebuffer> taaFramebuffers;
+	std::deque<RetiredTargets> retiredTargets;
+
+	/// History image the next TAA frame writes, the other one holds the last frame
+	uint32_t historyIndex = 0;
+	bool historyValid = false;
+	uint32_t jitterIndex = 0;
+	glm::mat4 viewProj = glm::mat4(1.f);
+	glm::mat4 previousViewProj = glm::mat4(1.f);
+
+	VkQueryPool queryPool = VK_NULL_HANDLE;
+	float timestampPeriod = 0.f;
+	std::vector<bool> timestampsWritten;
+	std::vector<AntiAliasingMode> recordedModes;
+	AntiAliasingStats stats;
+
+	VkRenderPass createRenderPass(const std::vector<VkAttachmentDescription>& attachments,
+	                              const std::vector<VkAttachmentReference>& colorRefs,
+	                              const VkAttachmentReference* depthRef, const VkSubpassDependency* dependencies,
+	                              uint32_t dependencyCount);
+	void createRenderPasses();
+	void createPipelines();
+	Target createTarget(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlagBits aspect);
+	void createTargets();
+	VkFramebuffer createFramebuffer(VkRenderPass renderPass, const std::vector<VkImageView>& attachments);
+	void retireTargets();
+	void destroyRetired(bool all);
+	void setViewport(VkCommandBuffer commandBuffer);
+	void recordFxaa(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	void recordTaa(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	glm::vec2 getJitter() const;
+};
@@ -0,0 +1,681 @@
+#include "Bvh.h"
+#include "FrustumCulling.h"
+
+#include <algorithm>
+#include <numeric>
+#include <chrono>
+#include <stdexcept>
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	const uint32_t BIN_COUNT = 16;
+	/// Cost of visiting a node relative to testing one primitive
+	const float TRAVERSAL_COST = 1.f;
+	/// Past this depth nodes are split at the median, which bounds the tree depth on skewed input
+	const uint32_t MAX_SAH_DEPTH = 48;
+	const uint32_t INVALID_INDEX = UINT32_MAX;
+	/// Enough for 85 levels, median splits keep any tree built from 32 bit primitive counts shallower
+	const uint32_t TRAVERSAL_STACK_SIZE = 256;
+
+	using NodeComponent = float (BvhNode::*)[4];
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+	using Lanes = __m128;
+
+	inline Lanes load(const float* data) { return _mm_load_ps(data); }
+	inline Lanes splat(float value) { return _mm_set1_ps(value); }
+	inline Lanes add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+	inline Lanes sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+	inline Lanes mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+	inline Lanes min(Lanes a, Lanes b) { return _mm_min_ps(a, b); }
+	inline Lanes max(Lanes a, Lanes b) { return _mm_max_ps(a, b); }
+	inline int lessEqualMask(Lanes a, Lanes b) { return _mm_movemask_ps(_mm_cmple_ps(a, b)); }
+	inline void store(float* data, Lanes a) { _mm_storeu_ps(data, a); }
+#else
+	struct Lanes
+	{
+		float lane[4];
+	};
+
+	template <typename Operation>
+	inline Lanes apply(Lanes a, Lanes b, Operation operation)
+	{
+		Lanes result;
+		for (int i = 0; i < 4; i++)
+		{
+			result.lane[i] = operation(a.lane[i], b.lane[i]);
+		}
+		return result;
+	}
+
+	inline Lanes load(const float* data) { return {{data[0], data[1], data[2], data[3]}}; }
+	inline Lanes splat(float value) { return {{value, value, value, value}}; }
+	inline Lanes add(Lanes a, Lanes b) { return apply(a, b, [](float x, float y) { return x + y; }); }
+	inline Lanes sub(Lanes a, Lanes b) { return apply(a, b, [](float x, float y) { return x - y; }); }
+	inline Lanes mul(Lanes a, Lanes b) { return apply(a, b, [](float x, float y) { return x * y; }); }
+	inline Lanes min(Lanes a, Lanes b) { return apply(a, b, [](float x, float y) { return x < y ? x : y; }); }
+	inline Lanes max(Lanes a, Lanes b) { return apply(a, b, [](float x, float y) { return x > y ? x : y; }); }
+
+	inline int lessEqualMask(Lanes a, Lanes b)
+	{
+		int mask = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			mask |= a.lane[i] <= b.lane[i] ? 1 << i : 0;
+		}
+		return mask;
+	}
+
+	inline void store(float* data, Lanes a) { std::copy(a.lane, a.lane + 4, data); }
+#endif
+
+	inline uint32_t binIndex(float center, float min, float scale)
+	{
+		return std::min(BIN_COUNT - 1, static_cast<uint32_t>((center - min) * scale));
+	}
+
+	void clearNode(BvhNode& node)
+	{
+		for (int slot = 0; slot < 4; slot++)
+		{
+			node.minX[slot] = node.minY[slot] = node.minZ[slot] = FLT_MAX;
+			node.maxX[slot] = node.maxY[slot] = node.maxZ[slot] = -FLT_MAX;
+			node.child[slot] = INVALID_INDEX;
+			node.count[slot] = 0;
+		}
+	}
+}
+
+void Bvh::build(const std::vector<Aabb>& primitiveBounds)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	bounds = primitiveBounds;
+	triangles.clear();
+	buildHierarchy();
+
+	auto endTime = std::chrono::high_resolution_clock::now();
+	stats.buildMilliseconds = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+}
+
+void Bvh::buildTriangles(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	const size_t triangleCount = indices.size() / 3;
+	bounds.resize(triangleCount);
+	for (size_t i = 0; i < triangleCount; i++)
+	{
+		bounds[i] = Aabb();
+		for (size_t corner = 0; corner < 3; corner++)
+		{
+			bounds[i].grow(positions[indices[i * 3 + corner]]);
+		}
+	}
+	buildHierarchy();
+
+	// Store the triangles in leaf order so a leaf reads them from consecutive memory
+	triangles.resize(triangleCount * 3);
+	for (size_t i = 0; i < triangleCount; i++)
+	{
+		const uint32_t* triangle = &indices[primitiveOrder[i] * 3];
+		triangles[i * 3] = positions[triangle[0]];
+		triangles[i * 3 + 1] = positions[triangle[1]] - positions[triangle[0]];
+		triangles[i * 3 + 2] = positions[triangle[2]] - positions[triangle[0]];
+	}
+
+	auto endTime = std::chrono::high_resolution_clock::now();
+	stats.buildMilliseconds = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+}
+
+void Bvh::buildHierarchy()
+{
+	const uint32_t primitiveCount = static_cast<uint32_t>(bounds.size());
+	nodes.clear();
+	nodeParents.clear();
+	primitiveOrder.resize(primitiveCount);
+	std::iota(primitiveOrder.begin(), primitiveOrder.end(), 0);
+	primitiveSlots.assign(primitiveCount, INVALID_INDEX);
+	stats = {};
+	if (primitiveCount == 0)
+	{
+		return;
+	}
+
+	std::vector<glm::vec3> centers(primitiveCount);
+	for (uint32_t i = 0; i < primitiveCount; i++)
+	{
+		centers[i] = bounds[i].center();
+	}
+
+	std::vector<BuildNode> buildNodes;
+	buildNodes.reserve(primitiveCount * 2);
+	const uint32_t root = buildRecursive(buildNodes, centers, 0, primitiveCount, 0);
+
+	nodes.reserve(buildNodes.size() / 2 + 1);
+	if (buildNodes[root].count > 0)
+	{
+		// Everything fits in one leaf, still give it a node so queries have a root to start from
+		nodes.emplace_back();
+		clearNode(nodes[0]);
+		nodeParents.push_back(INVALID_INDEX);
+		setSlot(0, 0, buildNodes[root].bounds);
+		nodes[0].child[0] = 0;
+		nodes[0].count[0] = primitiveCount;
+		for (uint32_t i = 0; i < primitiveCount; i++)
+		{
+			primitiveSlots[i] = 0;
+		}
+		stats.leafCount = 1;
+		stats.maxDepth = 1;
+	}
+	else
+	{
+		collapse(buildNodes, root, INVALID_INDEX, 1);
+	}
+	stats.nodeCount = static_cast<uint32_t>(nodes.size());
+
+	// A visited node pushes at most three more children than it pops, so the depth bounds the stack
+	if (stats.maxDepth * 3 + 1 > TRAVERSAL_STACK_SIZE)
+	{
+		throw std::runtime_error("bvh too deep for its traversal stack!");
+	}
+}
+
+uint32_t Bvh::buildRecursive(std::vector<BuildNode>& buildNodes, const std::vector<glm::vec3>& centers,
+                             uint32_t first, uint32_t count, uint32_t depth)
+{
+	BuildNode node = {};
+	node.first = first;
+	node.count = count;
+	Aabb centerBounds;
+	for (uint32_t i = first; i < first + count; i++)
+	{
+		node.bounds.grow(bounds[primitiveOrder[i]]);
+		centerBounds.grow(centers[primitiveOrder[i]]);
+	}
+
+	const uint32_t nodeIndex = static_cast<uint32_t>(buildNodes.size());
+	buildNodes.push_back(node);
+	if (count == 1)
+	{
+		return nodeIndex;
+	}
+
+	int bestAxis = -1;
+	uint32_t bestSplit = 0;
+	float bestCost = FLT_MAX;
+	if (depth < MAX_SAH_DEPTH)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const float extent = centerBounds.max[axis] - centerBounds.min[axis];
+			if (extent <= 0.f)
+			{
+				continue;
+			}
+
+			Aabb binBounds[BIN_COUNT];
+			uint32_t binCounts[BIN_COUNT] = {};
+			const float scale = BIN_COUNT / extent;
+			for (uint32_t i = first; i < first + count; i++)
+			{
+				const uint32_t bin = binIndex(centers[primitiveOrder[i]][axis], centerBounds.min[axis], scale);
+				binCounts[bin]++;
+				binBounds[bin].grow(bounds[primitiveOrder[i]]);
+			}
+
+			// Sweep from the right to get the cost of everything right of each split plane
+			float rightCosts[BIN_COUNT];
+			Aabb rightBounds;
+			uint32_t rightCount = 0;
+			for (uint32_t bin = BIN_COUNT - 1; bin > 0; bin--)
+			{
+				rightBounds.grow(binBounds[bin]);
+				rightCount += binCounts[bin];
+				rightCosts[bin] = rightBounds.surfaceArea() * rightCount;
+			}
+
+			Aabb leftBounds;
+			uint32_t leftCount = 0;
+			for (uint32_t split = 1; split < BIN_COUNT; split++)
+			{
+				leftBounds.grow(binBounds[split - 1]);
+				leftCount += binCounts[split - 1];
+				const float cost = leftBounds.surfaceArea() * leftCount + rightCosts[split];
+				if (leftCount > 0 && leftCount < count && cost < bestCost)
+				{
+					bestAxis = axis;
+					bestSplit = split;
+					bestCost = cost;
+				}
+			}
+		}
+
+		const float nodeArea = node.bounds.surfaceArea();
+		const float leafCost = nodeArea * count;
+		if (count <= MAX_LEAF_SIZE && (bestAxis < 0 || leafCost <= TRAVERSAL_COST * nodeArea + bestCost))
+		{
+			return nodeIndex;
+		}
+	}
+	else if (count <= MAX_LEAF_SIZE)
+	{
+		return nodeIndex;
+	}
+
+	uint32_t* begin = primitiveOrder.data() + first;
+	uint32_t* end = begin + count;
+	uint32_t middle;
+	if (bestAxis >= 0)
+	{
+		const float min = centerBounds.min[bestAxis];
+		const float scale = BIN_COUNT / (centerBounds.max[bestAxis] - min);
+		uint32_t* split = std::partition(begin, end, [&](uint32_t primitive)
+		{
+			return binIndex(centers[primitive][bestAxis], min, scale) < bestSplit;
+		});
+		middle = first + static_cast<uint32_t>(split - begin);
+	}
+	else
+	{
+		// Too deep or all centers coincide, halve along the longest axis instead
+		const glm::vec3 extent = centerBounds.max - centerBounds.min;
+		const int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+		middle = first + count / 2;
+		std::nth_element(begin, primitiveOrder.data() + middle, end, [&](uint32_t a, uint32_t b)
+		{
+			return centers[a][axis] < centers[b][axis];
+		});
+	}
+
+	const uint32_t left = buildRecursive(buildNodes, centers, first, middle - first, depth + 1);
+	const uint32_t right = buildRecursive(buildNodes, centers, middle, first + count - middle, depth + 1);
+	buildNodes[nodeIndex].left = left;
+	buildNodes[nodeIndex].right = right;
+	buildNodes[nodeIndex].count = 0;
+	return nodeIndex;
+}
+
+uint32_t Bvh::collapse(const std::vector<BuildNode>& buildNodes, uint32_t buildIndex, uint32_t parentSlot,
+                       uint32_t depth)
+{
+	const uint32_t nodeIndex = static_cast<uint32_t>(nodes.size());
+	nodes.emplace_back();
+	clearNode(nodes[nodeIndex]);
+	nodeParents.push_back(parentSlot);
+	stats.maxDepth = std::max(stats.maxDepth, depth);
+
+	// Pull grandchildren up until the node is full, opening the largest inner child first
+	uint32_t children[4] = {buildNodes[buildIndex].left, buildNodes[buildIndex].right};
+	uint32_t childCount = 2;
+	while (childCount < 4)
+	{
+		int largest = -1;
+		float largestArea = -1.f;
+		for (uint32_t i = 0; i < childCount; i++)
+		{
+			const BuildNode& child = buildNodes[children[i]];
+			if (child.count == 0 && child.bounds.surfaceArea() > largestArea)
+			{
+				largest = static_cast<int>(i);
+				largestArea = child.bounds.surfaceArea();
+			}
+		}
+		if (largest < 0)
+		{
+			break;
+		}
+		const BuildNode& opened = buildNodes[children[largest]];
+		children[largest] = opened.left;
+		children[childCount++] = opened.right;
+	}
+
+	for (uint32_t slot = 0; slot < childCount; slot++)
+	{
+		const BuildNode& child = buildNodes[children[slot]];
+		setSlot(nodeIndex, slot, child.bounds);
+		if (child.count > 0)
+		{
+			nodes[nodeIndex].child[slot] = child.first;
+			nodes[nodeIndex].count[slot] = child.count;
+			for (uint32_t i = child.first; i < child.first + child.count; i++)
+			{
+				primitiveSlots[primitiveOrder[i]] = nodeIndex * 4 + slot;
+			}
+			stats.leafCount++;
+		}
+		else
+		{
+			// nodes may reallocate while the subtree is built, so index again afterwards
+			const uint32_t childNode = collapse(buildNodes, children[slot], nodeIndex * 4 + slot, depth + 1);
+			nodes[nodeIndex].child[slot] = childNode;
+		}
+	}
+	return nodeIndex;
+}
+
+void Bvh::setSlot(uint32_t node, uint32_t slot, const Aabb& slotBounds)
+{
+	BvhNode& target = nodes[node];
+	target.minX[slot] = slotBounds.min.x;
+	target.minY[slot] = slotBounds.min.y;
+	target.minZ[slot] = slotBounds.min.z;
+	target.maxX[slot] = slotBounds.max.x;
+	target.maxY[slot] = slotBounds.max.y;
+	target.maxZ[slot] = slotBounds.max.z;
+}
+
+Aabb Bvh::getNodeBounds(uint32_t node) const
+{
+	const BvhNode& source = nodes[node];
+	Aabb nodeBounds;
+	for (int slot = 0; slot < 4; slot++)
+	{
+		nodeBounds.min = glm::min(nodeBounds.min, glm::vec3(source.minX[slot], source.minY[slot], source.minZ[slot]));
+		nodeBounds.max = glm::max(nodeBounds.max, glm::vec3(source.maxX[slot], source.maxY[slot], source.maxZ[slot]));
+	}
+	return nodeBounds;
+}
+
+Aabb Bvh::getLeafBounds(uint32_t first, uint32_t count) const
+{
+	Aabb leafBounds;
+	for (uint32_t i = first; i < first + count; i++)
+	{
+		leafBounds.grow(bounds[primitiveOrder[i]]);
+	}
+	return leafBounds;
+}
+
+void Bvh::queryFrustum(const glm::mat4& viewProj, std::vector<uint32_t>& primitives) const
+{
+	if (nodes.empty())
+	{
+		return;
+	}
+
+	glm::vec4 planes[6];
+	extractFrustumPlanes(viewProj, planes);
+
+	// The corners nearest and farthest along each plane normal come from the same arrays for every node
+	NodeComponent farX[6], farY[6], farZ[6], nearX[6], nearY[6], nearZ[6];
+	Lanes planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (int p = 0; p < 6; p++)
+	{
+		farX[p] = planes[p].x > 0.f ? &BvhNode::maxX : &BvhNode::minX;
+		farY[p] = planes[p].y > 0.f ? &BvhNode::maxY : &BvhNode::minY;
+		farZ[p] = planes[p].z > 0.f ? &BvhNode::maxZ : &BvhNode::minZ;
+		nearX[p] = planes[p].x > 0.f ? &BvhNode::minX : &BvhNode::maxX;
+		nearY[p] = planes[p].y > 0.f ? &BvhNode::minY : &BvhNode::maxY;
+		nearZ[p] = planes[p].z > 0.f ? &BvhNode::minZ : &BvhNode::maxZ;
+		planeX[p] = splat(planes[p].x);
+		planeY[p] = splat(planes[p].y);
+		planeZ[p] = splat(planes[p].z);
+		planeW[p] = splat(planes[p].w);
+	}
+	const Lanes zero = splat(0.f);
+
+	uint32_t stack[TRAVERSAL_STACK_SIZE];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		const BvhNode& node = nodes[stack[--stackSize]];
+
+		int outsideMask = 0;
+		int insideMask = 0xf;
+		for (int p = 0; p < 6; p++)
+		{
+			const Lanes farDistance = add(add(mul(load(node.*farX[p]), planeX[p]), mul(load(node.*farY[p]), planeY[p])),
+			                              add(mul(load(node.*farZ[p]), planeZ[p]), planeW[p]));
+			const Lanes nearDistance = add(add(mul(load(node.*nearX[p]), planeX[p]),
+			                                   mul(load(node.*nearY[p]), planeY[p])),
+			                               add(mul(load(node.*nearZ[p]), planeZ[p]), planeW[p]));
+			outsideMask |= lessEqualMask(farDistance, zero);
+			insideMask &= ~lessEqualMask(nearDistance, zero);
+		}
+
+		for (int slot = 0; slot < 4; slot++)
+		{
+			if (outsideMask & (1 << slot))
+			{
+				continue;
+			}
+			const uint32_t child = node.child[slot];
+			const uint32_t count = node.count[slot];
+			if (insideMask & (1 << slot))
+			{
+				appendSubtree(child, count, primitives);
+			}
+			else if (count > 0)
+			{
+				for (uint32_t i = child; i < child + count; i++)
+				{
+					const Aabb& primitiveBounds = bounds[primitiveOrder[i]];
+					if (isAabbVisible(planes, primitiveBounds.min, primitiveBounds.max))
+					{
+						primitives.push_back(primitiveOrder[i]);
+					}
+				}
+			}
+			else
+			{
+				stack[stackSize++] = child;
+			}
+		}
+	}
+}
+
+void Bvh::appendSubtree(uint32_t child, uint32_t count, std::vector<uint32_t>& primitives) const
+{
+	if (count > 0)
+	{
+		primitives.insert(primitives.end(), primitiveOrder.begin() + child, primitiveOrder.begin() + child + count);
+		return;
+	}
+
+	const BvhNode& node = nodes[child];
+	for (int slot = 0; slot < 4; slot++)
+	{
+		if (node.child[slot] != INVALID_INDEX)
+		{
+			appendSubtree(node.child[slot], node.count[slot], primitives);
+		}
+	}
+}
+
+bool Bvh::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const
+{
+	if (nodes.empty())
+	{
+		return false;
+	}
+
+	const glm::vec3 inverseDirection = 1.f / direction;
+	const NodeComponent entryX = inverseDirection.x >= 0.f ? &BvhNode::minX : &BvhNode::maxX;
+	const NodeComponent entryY = inverseDirection.y >= 0.f ? &BvhNode::minY : &BvhNode::maxY;
+	const NodeComponent entryZ = inverseDirection.z >= 0.f ? &BvhNode::minZ : &BvhNode::maxZ;
+	const NodeComponent exitX = inverseDirection.x >= 0.f ? &BvhNode::maxX : &BvhNode::minX;
+	const NodeComponent exitY = inverseDirection.y >= 0.f ? &BvhNode::maxY : &BvhNode::minY;
+	const NodeComponent exitZ = inverseDirection.z >= 0.f ? &BvhNode::maxZ : &BvhNode::minZ;
+	const Lanes originX = splat(origin.x), originY = splat(origin.y), originZ = splat(origin.z);
+	const Lanes inverseX = splat(inverseDirection.x);
+	const Lanes inverseY = splat(inverseDirection.y);
+	const Lanes inverseZ = splat(inverseDirection.z);
+	const Lanes zero = splat(0.f);
+
+	bool found = false;
+	float closest = maxDistance;
+	uint32_t stack[TRAVERSAL_STACK_SIZE];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		const BvhNode& node = nodes[stack[--stackSize]];
+
+		const Lanes entry = max(max(mul(sub(load(node.*entryX), originX), inverseX),
+		                            mul(sub(load(node.*entryY), originY), inverseY)),
+		                        max(mul(sub(load(node.*entryZ), originZ), inverseZ), zero));
+		const Lanes exit = min(min(mul(sub(load(node.*exitX), originX), inverseX),
+		                           mul(sub(load(node.*exitY), originY), inverseY)),
+		                       min(mul(sub(load(node.*exitZ), originZ), inverseZ), splat(closest)));
+		const int hitMask = lessEqualMask(entry, exit);
+		if (hitMask == 0)
+		{
+			continue;
+		}
+
+		float entryDistances[4];
+		store(entryDistances, entry);
+
+		// Inner children are pushed farthest first so the nearest one is visited next
+		uint32_t innerChildren[4];
+		float innerDistances[4];
+		int innerCount = 0;
+		for (int slot = 0; slot < 4; slot++)
+		{
+			if (!(hitMask & (1 << slot)))
+			{
+				continue;
+			}
+			const uint32_t child = node.child[slot];
+			if (node.count[slot] > 0)
+			{
+				for (uint32_t i = child; i < child + node.count[slot]; i++)
+				{
+					const float distance = intersectPrimitive(i, origin, direction, inverseDirection);
+					if (distance < closest)
+					{
+						closest = distance;
+						hit.primitive = primitiveOrder[i];
+						hit.distance = distance;
+						found = true;
+					}
+				}
+			}
+			else
+			{
+				int position = innerCount++;
+				while (position > 0 && innerDistances[position - 1] < entryDistances[slot])
+				{
+					innerChildren[position] = innerChildren[position - 1];
+					innerDistances[position] = innerDistances[position - 1];
+					position--;
+				}
+				innerChildren[position] = child;
+				innerDistances[position] = entryDistances[slot];
+			}
+		}
+		for (int i = 0; i < innerCount; i++)
+		{
+			stack[stackSize++] = innerChildren[i];
+		}
+	}
+	return found;
+}
+
+float Bvh::intersectPrimitive(uint32_t index, const glm::vec3& origin, const glm::vec3& direction,
+                              const glm::vec3& inverseDirection) const
+{
+	if (triangles.empty())
+	{
+		const Aabb& primitiveBounds = bounds[primitiveOrder[index]];
+		const glm::vec3 t0 = (primitiveBounds.min - origin) * inverseDirection;
+		const glm::vec3 t1 = (primitiveBounds.max - origin) * inverseDirection;
+		const glm::vec3 entry = glm::min(t0, t1);
+		const glm::vec3 exit = glm::max(t0, t1);
+		const float entryDistance = std::max(std::max(entry.x, entry.y), std::max(entry.z, 0.f));
+		const float exitDistance = std::min(std::min(exit.x, exit.y), exit.z);
+		return entryDistance <= exitDistance ? entryDistance : FLT_MAX;
+	}
+
+	// Moller-Trumbore against the corner and edges stored for this leaf entry
+	const glm::vec3& corner = triangles[index * 3];
+	const glm::vec3& edge1 = triangles[index * 3 + 1];
+	const glm::vec3& edge2 = triangles[index * 3 + 2];
+	const glm::vec3 p = glm::cross(direction, edge2);
+	const float determinant = glm::dot(edge1, p);
+	if (determinant == 0.f)
+	{
+		return FLT_MAX;
+	}
+	const float inverseDeterminant = 1.f / determinant;
+	const glm::vec3 s = origin - corner;
+	const float u = glm::dot(s, p) * inverseDeterminant;
+	if (u < 0.f || u > 1.f)
+	{
+		return FLT_MAX;
+	}
+	const glm::vec3 q = glm::cross(s, edge1);
+	const float v = glm::dot(direction, q) * inverseDeterminant;
+	if (v < 0.f || u + v > 1.f)
+	{
+		return FLT_MAX;
+	}
+	const float distance = glm::dot(edge2, q) * inverseDeterminant;
+	return distance >= 0.f ? distance : FLT_MAX;
+}
+
+void Bvh::refit(const std::vector<Aabb>& primitiveBounds)
+{
+	if (!triangles.empty())
+	{
+		throw std::runtime_error("bvh refit only supports object bounds!");
+	}
+	if (primitiveBounds.size() != bounds.size())
+	{
+		throw std::runtime_error("bvh refit needs new bounds for every object!");
+	}
+	bounds = primitiveBounds;
+
+	// Children always come after their parent, so walking backwards sees them updated first
+	for (size_t node = nodes.size(); node-- > 0;)
+	{
+		for (uint32_t slot = 0; slot < 4; slot++)
+		{
+			const uint32_t child = nodes[node].child[slot];
+			if (nodes[node].count[slot] > 0)
+			{
+				setSlot(static_cast<uint32_t>(node), slot, getLeafBounds(child, nodes[node].count[slot]));
+			}
+			else if (child != INVALID_INDEX)
+			{
+				setSlot(static_cast<uint32_t>(node), slot, getNodeBounds(child));
+			}
+		}
+	}
+}
+
+void Bvh::updatePrimitive(uint32_t primitive, const Aabb& primitiveBounds)
+{
+	if (!triangles.empty())
+	{
+		throw std::runtime_error("bvh refit only supports object bounds!");
+	}
+	bounds[primitive] = primitiveBounds;
+
+	uint32_t node = primitiveSlots[primitive] / 4;
+	const uint32_t slot = primitiveSlots[primitive] % 4;
+	setSlot(node, slot, getLeafBounds(nodes[node].child[slot], nodes[node].count[slot]));
+
+	while (nodeParents[node] != INVALID_INDEX)
+	{
+		const uint32_t parent = nodeParents[node] / 4;
+		const uint32_t parentSlot = nodeParents[node] % 4;
+		const Aabb nodeBounds = getNodeBounds(node);
+		const BvhNode& current = nodes[parent];
+		if (current.minX[parentSlot] == nodeBounds.min.x && current.minY[parentSlot] == nodeBounds.min.y &&
+			current.minZ[parentSlot] == nodeBounds.min.z && current.maxX[parentSlot] == nodeBounds.max.x &&
+			current.maxY[parentSlot] == nodeBounds.max.y && current.maxZ[parentSlot] == nodeBounds.max.z)
+		{
+			break;
+		}
+		setSlot(parent, parentSlot, nodeBounds);
+		node = parent;
+	}
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <vector>
+#include <cfloat>
+
+struct Aabb
+{
+	glm::vec3 min = glm::vec3(FLT_MAX);
+	glm::vec3 max = glm::vec3(-FLT_MAX);
+
+	void grow(const glm::vec3& point)
+	{
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+
+	void grow(const Aabb& other)
+	{
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+
+	glm::vec3 center() const { return (min + max) * 0.5f; }
+
+	float surfaceArea() const
+	{
+		const glm::vec3 extent = glm::max(max - min, glm::vec3(0.f));
+		return 2.f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+	}
+};
+
+/// Four children stored as structure of arrays so one node is tested with 4-wide SIMD. A child is
+/// an inner node when count is 0, otherwise a leaf of count entries starting at child in the
+/// primitive order. Unused slots have inverted bounds and never pass a test.
+struct alignas(16) BvhNode
+{
+	float minX[4], minY[4], minZ[4];
+	float maxX[4], maxY[4], maxZ[4];
+	uint32_t child[4];
+	uint32_t count[4];
+};
+
+struct RayHit
+{
+	uint32_t primitive;
+	float distance;
+};
+
+struct BvhStats
+{
+	uint32_t nodeCount = 0;
+	uint32_t leafCount = 0;
+	uint32_t maxDepth = 0;
+	double buildMilliseconds = 0.0;
+};
+
+/// 4-wide bounding volume hierarchy over object bounds or triangles. Built top down with binned SAH
+/// into a binary tree, which is then collapsed into a flat array of BvhNodes with children stored
+/// after their parents. Object bounds can be refit in place as objects move; the tree shape stays
+/// the same, so rebuild after large rearrangements.
+class Bvh
+{
+public:
+	static const uint32_t MAX_LEAF_SIZE = 4;
+
+	void build(const std::vector<Aabb>& primitiveBounds);
+	/// Indexed triangle list, ray casts then hit the triangles instead of their bounds
+	void buildTriangles(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices);
+
+	/// Appends primitives whose bounds intersect the frustum, in no particular order.
+	void queryFrustum(const glm::mat4& viewProj, std::vector<uint32_t>& primitives) const;
+	/// Closest primitive along the ray within maxDistance. direction does not need to be normalized,
+	/// distances are in multiples of it.
+	bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const;
+
+	/// Recomputes every node from new bounds for all primitives.
+	void refit(const std::vector<Aabb>& primitiveBounds);
+	/// Updates a single primitive and walks up only as far as the parent bounds change.
+	void updatePrimitive(uint32_t primitive, const Aabb& bounds);
+
+	uint32_t getPrimitiveCount() const { return static_cast<uint32_t>(bounds.size()); }
+	const std::vector<BvhNode>& getNodes() const { return nodes; }
+	BvhStats getStats() const { return stats; }
+
+private:
+	struct BuildNode
+	{
+		Aabb bounds;
+		uint32_t left;
+		uint32_t right;
+		uint32_t first;
+		uint32_t count;
+	};
+
+	std::vector<BvhNode> nodes;
+	std::vector<uint32_t> primitiveOrder;
+	std::vector<Aabb> bounds;
+	/// Corner and two edges per triangle, in primitive order, empty for object bounds
+	std::vector<glm::vec3> triangles;
+	/// node * 4 + slot of the slot referencing each node, root has UINT32_MAX
+	std::vector<uint32_t> nodeParents;
+	/// node * 4 + slot of the leaf holding each primitive
+	std::vector<uint32_t> primitiveSlots;
+	BvhStats stats;
+
+	void buildHierarchy();
+	uint32_t buildRecursive(std::vector<BuildNode>& buildNodes, const std::vector<glm::vec3>& centers,
+	                        uint32_t first, uint32_t count, uint32_t depth);
+	uint32_t collapse(const std::vector<BuildNode>& buildNodes, uint32_t buildIndex, uint32_t parentSlot,
+	                  uint32_t depth);
+	void setSlot(uint32_t node, uint32_t slot, const Aabb& slotBounds);
+	Aabb getNodeBounds(uint32_t node) const;
+	Aabb getLeafBounds(uint32_t first, uint32_t count) const;
+	void appendSubtree(uint32_t child, uint32_t count, std::vector<uint32_t>& primitives) const;
+	float intersectPrimitive(uint32_t index, const glm::vec3& origin, const glm::vec3& direction,
+	                         const glm::vec3& inverseDirection) const;
+};
@@ -0,0 +1,470 @@
+#include "CascadedShadows.h"
+#include "VulkanBase.h"
+#include "data.h"
+
+#include <stdexcept>
+
+CascadedShadows::CascadedShadows(VulkanBase& base, uint32_t resolution)
+	: base(base)
+{
+	fitter.resolution = resolution;
+
+	// The cache is only ever copied from, the map is sampled by the scene once the dynamic casters are in
+	staticPass = createRenderPass(VK_ATTACHMENT_LOAD_OP_CLEAR, VK_IMAGE_LAYOUT_UNDEFINED,
+	                              VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+	                              VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+	dynamicPass = createRenderPass(VK_ATTACHMENT_LOAD_OP_LOAD, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+	                               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+	                               VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+	                               VK_ACCESS_SHADER_READ_BIT);
+	uncachedPass = createRenderPass(VK_ATTACHMENT_LOAD_OP_CLEAR, VK_IMAGE_LAYOUT_UNDEFINED,
+	                                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+	                                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+	createImages();
+	createPipelines();
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(base.physicalDevice, &properties);
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(base.physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(base.physicalDevice, &queueFamilyCount, queueFamilies.data());
+	if (queueFamilies[base.queueFamilyIndex.graphicsFamily.value()].timestampValidBits != 0)
+	{
+		timestampPeriod = properties.limits.timestampPeriod;
+	}
+
+	addSwapchainImages();
+}
+
+void CascadedShadows::addSwapchainImages()
+{
+	// The map is read by every frame in flight, each image has its own cascade matrices
+	TypedUpdateTemplate<ShadowedSceneDescriptors> sceneTemplate(
+		base.device, base.layoutCache->getDescriptorUpdateTemplate(sceneSetLayout));
+	const size_t firstImage = uniformBuffers.size();
+	const size_t imageCount = base.swapchainImages.size();
+	uniformBuffers.resize(imageCount);
+	uniformAllocations.resize(imageCount);
+	mappedUniforms.resize(imageCount);
+	sceneSets.resize(imageCount);
+	for (size_t i = firstImage; i < imageCount; i++)
+	{
+		void* data;
+		base.createBuffer(sizeof(ShadowUniforms), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU,
+		                  uniformBuffers[i], uniformAllocations[i]);
+		vmaMapMemory(base.allocator, uniformAllocations[i], &data);
+		mappedUniforms[i] = static_cast<ShadowUniforms*>(data);
+
+		ShadowedSceneDescriptors descriptors = {};
+		descriptors.frameUniforms.buffer = {base.uniformBuffers[i], 0, VK_WHOLE_SIZE};
+		descriptors.shadowUniforms.buffer = {uniformBuffers[i], 0, sizeof(ShadowUniforms)};
+		descriptors.shadowMap.image = {sampler, shadowView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+		sceneSets[i] = base.descriptorAllocator->allocatePersistent(sceneSetLayout);
+		sceneTemplate.update(sceneSets[i], descriptors);
+	}
+
+	if (timestampPeriod > 0.f)
+	{
+		if (queryPool != VK_NULL_HANDLE)
+		{
+			// Frames in flight may still write their timestamps
+			base.retireQueryPool(queryPool);
+		}
+		VkQueryPoolCreateInfo queryPoolCreateInfo = {};
+		queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolCreateInfo.queryCount = static_cast<uint32_t>(imageCount) * TIMESTAMPS_PER_FRAME;
+		if (vkCreateQueryPool(base.device, &queryPoolCreateInfo, nullptr, &queryPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create timestamp query pool!");
+		}
+	}
+	timestampsWritten.assign(imageCount, false);
+}
+
+CascadedShadows::~CascadedShadows()
+{
+	for (size_t i = 0; i < uniformBuffers.size(); i++)
+	{
+		vmaUnmapMemory(base.allocator, uniformAllocations[i]);
+		vmaDestroyBuffer(base.allocator, uniformBuffers[i], uniformAllocations[i]);
+	}
+	if (queryPool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(base.device, queryPool, nullptr);
+	}
+	for (VkFramebuffer framebuffer : cacheFramebuffers)
+	{
+		vkDestroyFramebuffer(base.device, framebuffer, nullptr);
+	}
+	for (VkFramebuffer framebuffer : shadowFramebuffers)
+	{
+		vkDestroyFramebuffer(base.device, framebuffer, nullptr);
+	}
+	for (VkImageView view : layerViews)
+	{
+		vkDestroyImageView(base.device, view, nullptr);
+	}
+	vkDestroyImageView(base.device, shadowView, nullptr);
+	vkDestroySampler(base.device, sampler, nullptr);
+	vmaDestroyImage(base.allocator, cacheImage, cacheAllocation);
+	vmaDestroyImage(base.allocator, shadowImage, shadowAllocation);
+	vkDestroyRenderPass(base.device, staticPass, nullptr);
+	vkDestroyRenderPass(base.device, dynamicPass, nullptr);
+	vkDestroyRenderPass(base.device, uncachedPass, nullptr);
+}
+
+VkRenderPass CascadedShadows::createRenderPass(VkAttachmentLoadOp loadOp, VkImageLayout initialLayout,
+                                               VkImageLayout finalLayout, VkPipelineStageFlags srcStage,
+                                               VkAccessFlags srcAccess, VkPipelineStageFlags dstStage,
+                                               VkAccessFlags dstAccess)
+{
+	// Only load op and layouts differ, so the passes are compatible and share pipelines and framebuffers
+	VkAttachmentDescription depthAttachment = {};
+	depthAttachment.format = depthFormat;
+	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	depthAttachment.loadOp = loadOp;
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.initialLayout = initialLayout;
+	depthAttachment.finalLayout = finalLayout;
+
+	VkAttachmentReference depthRef = {0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+
+	VkSubpassDescription subpass = {};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.pDepthStencilAttachment = &depthRef;
+
+	// What used the layer before, and what uses it after
+	VkSubpassDependency dependencies[2] = {};
+	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[0].dstSubpass = 0;
+	dependencies[0].srcStageMask = srcStage;
+	dependencies[0].srcAccessMask = srcAccess;
+	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+		VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[1].srcSubpass = 0;
+	dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[1].dstStageMask = dstStage;
+	dependencies[1].dstAccessMask = dstAccess;
+
+	VkRenderPassCreateInfo renderPassCreateInfo = {};
+	renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassCreateInfo.attachmentCount = 1;
+	renderPassCreateInfo.pAttachments = &depthAttachment;
+	renderPassCreateInfo.subpassCount = 1;
+	renderPassCreateInfo.pSubpasses = &subpass;
+	renderPassCreateInfo.dependencyCount = 2;
+	renderPassCreateInfo.pDependencies = dependencies;
+
+	VkRenderPass renderPass;
+	if (vkCreateRenderPass(base.device, &renderPassCreateInfo, nullptr, &renderPass) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create shadow render pass!");
+	}
+	return renderPass;
+}
+
+void CascadedShadows::createImages()
+{
+	// A layer per cascade. D16 is plenty for orthographic depth and always supports attachment use, sampling
+	// and transfers, only linear filtering is optional.
+	VkImageCreateInfo imageCreateInfo = {};
+	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.format = depthFormat;
+	imageCreateInfo.extent = {fitter.resolution, fitter.resolution, 1};
+	imageCreateInfo.mipLevels = 1;
+	imageCreateInfo.arrayLayers = SHADOW_CASCADE_COUNT;
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	VmaAllocationCreateInfo allocationCreateInfo = {};
+	allocationCreateInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+	imageCreateInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	if (vmaCreateImage(base.allocator, &imageCreateInfo, &allocationCreateInfo, &cacheImage, &cacheAllocation,
+	                   nullptr) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create shadow cache image!");
+	}
+	imageCreateInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+		VK_IMAGE_USAGE_SAMPLED_BIT;
+	if (vmaCreateImage(base.allocator, &imageCreateInfo, &allocationCreateInfo, &shadowImage, &shadowAllocation,
+	                   nullptr) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create shadow map image!");
+	}
+
+	VkImageViewCreateInfo viewCreateInfo = {};
+	viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewCreateInfo.format = depthFormat;
+	viewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+	viewCreateInfo.subresourceRange.levelCount = 1;
+
+	viewCreateInfo.image = shadowImage;
+	viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+	viewCreateInfo.subresourceRange.layerCount = SHADOW_CASCADE_COUNT;
+	if (vkCreateImageView(base.device, &viewCreateInfo, nullptr, &shadowView) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create shadow map view!");
+	}
+
+	// Each layer is rendered through its own framebuffer
+	viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewCreateInfo.subresourceRange.layerCount = 1;
+	for (VkImage image : {cacheImage, shadowImage})
+	{
+		std::vector<VkFramebuffer>& framebuffers = image == cacheImage ? cacheFramebuffers : shadowFramebuffers;
+		for (uint32_t layer = 0; layer < SHADOW_CASCADE_COUNT; layer++)
+		{
+			VkImageView view;
+			viewCreateInfo.image = image;
+			viewCreateInfo.subresourceRange.baseArrayLayer = layer;
+			if (vkCreateImageView(base.device, &viewCreateInfo, nullptr, &view) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create shadow map layer view!");
+			}
+			layerViews.push_back(view);
+
+			VkFramebufferCreateInfo framebufferCreateInfo = {};
+			framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			framebufferCreateInfo.renderPass = staticPass;
+			framebufferCreateInfo.attachmentCount = 1;
+			framebufferCreateInfo.pAttachments = &view;
+			framebufferCreateInfo.width = fitter.resolution;
+			framebufferCreateInfo.height = fitter.resolution;
+			framebufferCreateInfo.layers = 1;
+			VkFramebuffer framebuffer;
+			if (vkCreateFramebuffer(base.device, &framebufferCreateInfo, nullptr, &framebuffer) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create shadow map framebuffer!");
+			}
+			framebuffers.push_back(framebuffer);
+		}
+	}
+
+	// Compares in the sampler, with linear filtering that is 2x2 percentage closer filtering. Where the format
+	// cannot be filtered linearly each lookup is a single hard edged comparison. Outside the map is lit.
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(base.physicalDevice, depthFormat, &formatProperties);
+	const VkFilter filter = (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)
+		                        ? VK_FILTER_LINEAR
+		                        : VK_FILTER_NEAREST;
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = filter;
+	samplerInfo.minFilter = filter;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+	samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+	samplerInfo.compareEnable = VK_TRUE;
+	samplerInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+	samplerInfo.minLod = 0;
+	samplerInfo.maxLod = 0;
+	if (vkCreateSampler(base.device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create shadow map sampler!");
+	}
+}
+
+void CascadedShadows::createPipelines()
+{
+	// Depth only, biased so lit surfaces do not shadow themselves
+	PipelineDescription description;
+	description.vertShader = base.createShaderModule("shaders/shadow_vert.spv");
+	casterPipelineLayout = base.layoutCache->getPipelineLayout({
+		&base.shaderReflections.at(description.vertShader)
+	}).pipelineLayout;
+	description.cullMode = VK_CULL_MODE_NONE;
+	description.depthBiasEnable = VK_TRUE;
+	description.depthBiasConstantFactor = 2.f;
+	description.depthBiasSlopeFactor = 2.f;
+	description.colorAttachmentCount = 0;
+	description.layout = casterPipelineLayout;
+	description.renderPass = staticPass;
+	// Both are owned by the pipeline cache
+	casterPipeline = base.pipelineCache->getPipelineBlocking(description);
+
+	PipelineDescription sceneDescription;
+	sceneDescription.vertShader = base.createShaderModule("shaders/clustered_vert.spv");
+	sceneDescription.fragShader = base.createShaderModule("shaders/shadowed_frag.spv");
+	ReflectedPipelineLayout sceneLayout = base.layoutCache->getPipelineLayout({
+		&base.shaderReflections.at(sceneDescription.vertShader),
+		&base.shaderReflections.at(sceneDescription.fragShader)
+	});
+	scenePipelineLayout = sceneLayout.pipelineLayout;
+	sceneSetLayout = sceneLayout.setLayouts[0];
+	sceneDescription.sampleCount = base.sampleCount;
+	sceneDescription.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	sceneDescription.layout = scenePipelineLayout;
+	sceneDescription.renderPass = base.renderPass;
+	scenePipeline = base.pipelineCache->getPipelineBlocking(sceneDescription);
+	if (casterPipeline == VK_NULL_HANDLE || scenePipeline == VK_NULL_HANDLE)
+	{
+		throw std::runtime_error("failed to create shadow pipelines!");
+	}
+}
+
+void CascadedShadows::update(uint32_t imageIndex, const glm::mat4& view, const glm::mat4& proj,
+                             const glm::vec3& lightDirection, const glm::vec4& sceneBounds)
+{
+	uint64_t timestamps[TIMESTAMPS_PER_FRAME];
+	if (timestampsWritten[imageIndex] &&
+		vkGetQueryPoolResults(base.device, queryPool, imageIndex * TIMESTAMPS_PER_FRAME, TIMESTAMPS_PER_FRAME,
+		                      sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+	{
+		stats.gpuMilliseconds = static_cast<float>(timestamps[1] - timestamps[0]) * timestampPeriod / 1000000.f;
+	}
+
+	// Projections fitted without caching have no margin to move in
+	if (caching != wasCaching)
+	{
+		fitter.invalidate();
+		wasCaching = caching;
+	}
+	staleCascades |= fitter.update(view, proj, lightDirection, sceneBounds, caching);
+
+	ShadowUniforms* uniforms = mappedUniforms[imageIndex];
+	for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; i++)
+	{
+		uniforms->lightViewProj[i] = fitter.getCascade(i).viewProj;
+		uniforms->splitDepths[i] = fitter.getCascade(i).splitDepth;
+	}
+	uniforms->lightDirection = glm::vec4(glm::normalize(lightDirection), 0.f);
+	vmaFlushAllocation(base.allocator, uniformAllocations[imageIndex], 0, sizeof(ShadowUniforms));
+}
+
+void CascadedShadows::recordShadows(VkCommandBuffer commandBuffer, uint32_t imageIndex,
+                                    const std::vector<DrawPushConstants>& draws,
+                                    const std::vector<uint32_t>& staticCasters,
+                                    const std::vector<uint32_t>& dynamicCasters)
+{
+	const uint32_t firstQuery = imageIndex * TIMESTAMPS_PER_FRAME;
+	if (queryPool != VK_NULL_HANDLE)
+	{
+		vkCmdResetQueryPool(commandBuffer, queryPool, firstQuery, TIMESTAMPS_PER_FRAME);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, firstQuery);
+	}
+
+	stats.caching = caching;
+	stats.staticDraws = 0;
+	stats.dynamicDraws = 0;
+	stats.cascadesRedrawn = 0;
+	if (caching)
+	{
+		for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; i++)
+		{
+			if ((staleCascades & (1u << i)) == 0)
+			{
+				continue;
+			}
+			beginLayer(commandBuffer, staticPass, cacheFramebuffers[i], i);
+			drawCasters(commandBuffer, draws, staticCasters);
+			vkCmdEndRenderPass(commandBuffer);
+			stats.staticDraws += static_cast<uint32_t>(staticCasters.size());
+			stats.cascadesRedrawn++;
+		}
+		staleCascades = 0;
+
+		// Last frame's scene may still be sampling the map, and its contents are replaced whole
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = shadowImage;
+		barrier.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, SHADOW_CASCADE_COUNT};
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		                     0, nullptr, 0, nullptr, 1, &barrier);
+
+		VkImageCopy copy = {};
+		copy.srcSubresource = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, SHADOW_CASCADE_COUNT};
+		copy.dstSubresource = copy.srcSubresource;
+		copy.extent = {fitter.resolution, fitter.resolution, 1};
+		vkCmdCopyImage(commandBuffer, cacheImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, shadowImage,
+		               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+
+		for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; i++)
+		{
+			beginLayer(commandBuffer, dynamicPass, shadowFramebuffers[i], i);
+			drawCasters(commandBuffer, draws, dynamicCasters);
+			vkCmdEndRenderPass(commandBuffer);
+			stats.dynamicDraws += static_cast<uint32_t>(dynamicCasters.size());
+		}
+	}
+	else
+	{
+		for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; i++)
+		{
+			beginLayer(commandBuffer, uncachedPass, shadowFramebuffers[i], i);
+			drawCasters(commandBuffer, draws, staticCasters);
+			drawCasters(commandBuffer, draws, dynamicCasters);
+			vkCmdEndRenderPass(commandBuffer);
+			stats.staticDraws += static_cast<uint32_t>(staticCasters.size());
+			stats.dynamicDraws += static_cast<uint32_t>(dynamicCasters.size());
+			stats.cascadesRedrawn++;
+		}
+	}
+
+	if (queryPool != VK_NULL_HANDLE)
+	{
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, firstQuery + 1);
+		timestampsWritten[imageIndex] = true;
+	}
+}
+
+void CascadedShadows::beginLayer(VkCommandBuffer commandBuffer, VkRenderPass renderPass, VkFramebuffer framebuffer,
+                                 uint32_t cascade)
+{
+	VkClearValue clearValue = {};
+	clearValue.depthStencil = {1, 0};
+
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = renderPass;
+	renderPassInfo.framebuffer = framebuffer;
+	renderPassInfo.renderArea.extent = {fitter.resolution, fitter.resolution};
+	renderPassInfo.clearValueCount = 1;
+	renderPassInfo.pClearValues = &clearValue;
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+	VkViewport viewport = {};
+	viewport.width = static_cast<float>(fitter.resolution);
+	viewport.height = static_cast<float>(fitter.resolution);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor = {};
+	scissor.extent = {fitter.resolution, fitter.resolution};
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	// The light's matrix follows the model in the push constants, pushed once per cascade
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, casterPipeline);
+	vkCmdPushConstants(commandBuffer, casterPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, sizeof(DrawPushConstants),
+	                   sizeof(glm::mat4), &fitter.getCascade(cascade).viewProj);
+}
+
+void CascadedShadows::drawCasters(VkCommandBuffer commandBuffer, const std::vector<DrawPushConstants>& draws,
+                                  const std::vector<uint32_t>& casters)
+{
+	for (uint32_t index : casters)
+	{
+		vkCmdPushConstants(commandBuffer, casterPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+		                   sizeof(DrawPushConstants), &draws[index]);
+		vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+	}
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <vk_mem_alloc.h>
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <vector>
+#include "DescriptorAllocator.h"
+#include "ShadowCascadeFitter.h"
+
+class VulkanBase;
+struct DrawPushConstants;
+
+/// Cascades of the shadowed scene shader, std140 layout
+struct ShadowUniforms
+{
+	glm::mat4 lightViewProj[SHADOW_CASCADE_COUNT];
+	/// View space depth each cascade reaches to
+	glm::vec4 splitDepths;
+	/// Direction the light travels in, world space
+	glm::vec4 lightDirection;
+};
+
+/// Set 0 of the shadowed scene pipeline
+struct ShadowedSceneDescriptors
+{
+	DescriptorInfo frameUniforms;
+	DescriptorInfo shadowUniforms;
+	DescriptorInfo shadowMap;
+};
+
+struct CascadedShadowStats
+{
+	bool caching = false;
+	/// Shadow draws of the last recorded frame, one per caster and cascade it was drawn into
+	uint32_t staticDraws = 0;
+	uint32_t dynamicDraws = 0;
+	/// Static layers rendered in the last recorded frame, every cascade without caching
+	uint32_t cascadesRedrawn = 0;
+	/// GPU time of everything the shadow pass records, zero without timestamp support
+	float gpuMilliseconds = 0.f;
+};
+
+/// Cascaded shadow maps for one directional light. Static casters are rendered into a cached layer per
+/// cascade only when ShadowCascadeFitter refits its projection, that is when the camera leaves the cached
+/// bounds or the light turns past a threshold. Every frame the cached layers are copied into the shadow map
+/// and the dynamic casters are drawn on top. Without caching both are drawn into every cascade each frame.
+/// Draws with getPipeline() in the base render pass take DrawPushConstants like the base pipeline.
+class CascadedShadows
+{
+public:
+	explicit CascadedShadows(VulkanBase& base, uint32_t resolution = 2048);
+	~CascadedShadows();
+
+	VkPipeline getPipeline() const { return scenePipeline; }
+	VkPipelineLayout getPipelineLayout() const { return scenePipelineLayout; }
+	VkDescriptorSet getDescriptorSet(uint32_t imageIndex) const { return sceneSets[imageIndex]; }
+
+	/// Reads this image's last timestamps and fits the cascades. Call once per frame after its fence has
+	/// signaled, with the unjittered camera. sceneBounds is a world space sphere around every caster.
+	void update(uint32_t imageIndex, const glm::mat4& view, const glm::mat4& proj, const glm::vec3& lightDirection,
+	            const glm::vec4& sceneBounds);
+	/// Renders the shadow map, outside a render pass and before the scene is drawn. The caster lists index
+	/// draws, static casters have to keep their transform for as long as caching is on.
+	void recordShadows(VkCommandBuffer commandBuffer, uint32_t imageIndex, const std::vector<DrawPushConstants>& draws,
+	                   const std::vector<uint32_t>& staticCasters, const std::vector<uint32_t>& dynamicCasters);
+
+	/// Matrices, sets and timestamps for the images a recreated swapchain added
+	void addSwapchainImages();
+
+	CascadedShadowStats getStats() const { return stats; }
+
+	bool caching = true;
+	/// Thresholds and split of the cascades, its resolution is fixed at construction
+	ShadowCascadeFitter fitter;
+
+private:
+	static const uint32_t TIMESTAMPS_PER_FRAME = 2;
+
+	VulkanBase& base;
+	/// Sampled with linear filtering where the device supports it for this format, which is optional
+	VkFormat depthFormat = VK_FORMAT_D16_UNORM;
+	/// Static casters of each cascade, copied from but never sampled
+	VkImage cacheImage;
+	VmaAllocation cacheAllocation;
+	VkImage shadowImage;
+	VmaAllocation shadowAllocation;
+	VkImageView shadowView;
+	VkSampler sampler;
+	std::vector<VkImageView> layerViews;
+	std::vector<VkFramebuffer> cacheFramebuffers;
+	std::vector<VkFramebuffer> shadowFramebuffers;
+
+	/// Renders static casters into the cache
+	VkRenderPass staticPass;
+	/// Loads the copied static depth and draws the dynamic casters on top
+	VkRenderPass dynamicPass;
+	/// Clears and draws every caster, without caching
+	VkRenderPass uncachedPass;
+	VkPipelineLayout casterPipelineLayout;
+	VkPipeline casterPipeline;
+	VkPipelineLayout scenePipelineLayout;
+	VkDescriptorSetLayout sceneSetLayout;
+	VkPipeline scenePipeline;
+	std::vector<VkDescriptorSet> sceneSets;
+
+	std::vector<VkBuffer> uniformBuffers;
+	std::vector<VmaAllocation> uniformAllocations;
+	std::vector<ShadowUniforms*> mappedUniforms;
+	/// Cascades whose static layer has to be rendered again, gathered until the next recordShadows
+	uint32_t staleCascades = ~0u;
+	bool wasCaching = true;
+
+	VkQueryPool queryPool = VK_NULL_HANDLE;
+	float timestampPeriod = 0.f;
+	std::vector<bool> timestampsWritten;
+	CascadedShadowStats stats;
+
+	void createImages();
+	VkRenderPass createRenderPass(VkAttachmentLoadOp loadOp, VkImageLayout initialLayout, VkImageLayout finalLayout,
+	                              VkPipelineStageFlags srcStage, VkAccessFlags srcAccess,
+	                              VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+	void createPipelines();
+	void beginLayer(VkCommandBuffer commandBuffer, VkRenderPass renderPass, VkFramebuffer framebuffer,
+	                uint32_t cascade);
+	void drawCasters(VkCommandBuffer commandBuffer, const std::vector<DrawPushConstants>& draws,
+	                 const std::vector<uint32_t>& casters);
+};
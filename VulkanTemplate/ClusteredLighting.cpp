@@ -0,0 +1,309 @@
+#include "ClusteredLighting.h"
+#include "VulkanBase.h"
+
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+ClusteredLighting::ClusteredLighting(VulkanBase& base, uint32_t maxLights, JobSystem* jobSystem)
+	: base(base), maxLights(maxLights), binner(jobSystem)
+{
+	createPipelines();
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(base.physicalDevice, &properties);
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(base.physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(base.physicalDevice, &queueFamilyCount, queueFamilies.data());
+	if (queueFamilies[base.queueFamilyIndex.graphicsFamily.value()].timestampValidBits != 0)
+	{
+		timestampPeriod = properties.limits.timestampPeriod;
+	}
+
+	addSwapchainImages();
+}
+
+void ClusteredLighting::addSwapchainImages()
+{
+	TypedUpdateTemplate<ClusteredShadingDescriptors> shadingTemplate(
+		base.device, base.layoutCache->getDescriptorUpdateTemplate(shadingSetLayout));
+	TypedUpdateTemplate<LightBinningDescriptors> binningTemplate(
+		base.device, base.layoutCache->getDescriptorUpdateTemplate(binningSetLayout));
+
+	// Each image owns its buffers, so these sets live as long as the images
+	const size_t firstImage = imageBuffers.size();
+	const size_t imageCount = base.swapchainImages.size();
+	imageBuffers.resize(imageCount);
+	shadingSets.resize(imageCount);
+	binningSets.resize(imageCount);
+	for (size_t i = firstImage; i < imageCount; i++)
+	{
+		ImageBuffers& buffers = imageBuffers[i];
+		createBuffers(buffers);
+
+		ClusteredShadingDescriptors shading = {};
+		shading.frameUniforms.buffer = {base.uniformBuffers[i], 0, VK_WHOLE_SIZE};
+		shading.clusterUniforms.buffer = {buffers.uniforms, 0, sizeof(ClusterUniforms)};
+		shading.lights.buffer = {buffers.lights, 0, VK_WHOLE_SIZE};
+		shading.clusters.buffer = {buffers.clusters, 0, VK_WHOLE_SIZE};
+		shading.lightIndices.buffer = {buffers.lightIndices, 0, VK_WHOLE_SIZE};
+		shadingSets[i] = base.descriptorAllocator->allocatePersistent(shadingSetLayout);
+		shadingTemplate.update(shadingSets[i], shading);
+
+		LightBinningDescriptors binning = {};
+		binning.clusterUniforms = shading.clusterUniforms;
+		binning.lights = shading.lights;
+		binning.clusterBounds.buffer = {buffers.bounds, 0, VK_WHOLE_SIZE};
+		binning.clusters = shading.clusters;
+		binning.lightIndices = shading.lightIndices;
+		binning.lightIndexCounter.buffer = {buffers.counter, 0, VK_WHOLE_SIZE};
+		binningSets[i] = base.descriptorAllocator->allocatePersistent(binningSetLayout);
+		binningTemplate.update(binningSets[i], binning);
+	}
+
+	if (timestampPeriod > 0.f)
+	{
+		if (queryPool != VK_NULL_HANDLE)
+		{
+			// Frames in flight may still write their timestamps
+			base.retireQueryPool(queryPool);
+		}
+		VkQueryPoolCreateInfo queryPoolCreateInfo = {};
+		queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolCreateInfo.queryCount = static_cast<uint32_t>(imageCount) * TIMESTAMPS_PER_FRAME;
+		if (vkCreateQueryPool(base.device, &queryPoolCreateInfo, nullptr, &queryPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create timestamp query pool!");
+		}
+	}
+	timestampsWritten.assign(imageCount, false);
+}
+
+ClusteredLighting::~ClusteredLighting()
+{
+	for (ImageBuffers& buffers : imageBuffers)
+	{
+		vmaUnmapMemory(base.allocator, buffers.uniformsAllocation);
+		vmaUnmapMemory(base.allocator, buffers.lightsAllocation);
+		vmaUnmapMemory(base.allocator, buffers.stagingAllocation);
+		vmaDestroyBuffer(base.allocator, buffers.uniforms, buffers.uniformsAllocation);
+		vmaDestroyBuffer(base.allocator, buffers.lights, buffers.lightsAllocation);
+		vmaDestroyBuffer(base.allocator, buffers.bounds, buffers.boundsAllocation);
+		vmaDestroyBuffer(base.allocator, buffers.clusters, buffers.clustersAllocation);
+		vmaDestroyBuffer(base.allocator, buffers.lightIndices, buffers.lightIndicesAllocation);
+		vmaDestroyBuffer(base.allocator, buffers.counter, buffers.counterAllocation);
+		vmaDestroyBuffer(base.allocator, buffers.staging, buffers.stagingAllocation);
+	}
+	if (queryPool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(base.device, queryPool, nullptr);
+	}
+	vkDestroyPipeline(base.device, binningPipeline, nullptr);
+}
+
+void ClusteredLighting::createPipelines()
+{
+	PipelineDescription description;
+	description.vertShader = base.createShaderModule("shaders/clustered_vert.spv");
+	description.fragShader = base.createShaderModule("shaders/clustered_frag.spv");
+	ReflectedPipelineLayout layout = base.layoutCache->getPipelineLayout({
+		&base.shaderReflections.at(description.vertShader), &base.shaderReflections.at(description.fragShader)
+	});
+	pipelineLayout = layout.pipelineLayout;
+	shadingSetLayout = layout.setLayouts[0];
+	description.sampleCount = base.sampleCount;
+	description.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	description.layout = pipelineLayout;
+	description.renderPass = base.renderPass;
+
+	// Owned by the pipeline cache
+	pipeline = base.pipelineCache->getPipelineBlocking(description);
+	if (pipeline == VK_NULL_HANDLE)
+	{
+		throw std::runtime_error("failed to create clustered lighting pipeline!");
+	}
+
+	binningShader = base.createShaderModule("shaders/light_cluster_comp.spv");
+	ReflectedPipelineLayout binningLayout = base.layoutCache->getPipelineLayout({
+		&base.shaderReflections.at(binningShader)
+	});
+	binningPipelineLayout = binningLayout.pipelineLayout;
+	binningSetLayout = binningLayout.setLayouts[0];
+	binningPipeline = base.createComputePipeline(binningShader, binningPipelineLayout);
+}
+
+void ClusteredLighting::createBuffers(ImageBuffers& buffers)
+{
+	// Every cluster full is the most the index list can hold, so neither path can overflow it
+	const uint32_t clusterCount = grid.getClusterCount();
+	const VkDeviceSize clustersSize = sizeof(LightCluster) * clusterCount;
+	const VkDeviceSize lightIndicesSize = sizeof(uint32_t) * clusterCount * MAX_LIGHTS_PER_CLUSTER;
+
+	void* data;
+	base.createBuffer(sizeof(ClusterUniforms), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU,
+	                  buffers.uniforms, buffers.uniformsAllocation);
+	vmaMapMemory(base.allocator, buffers.uniformsAllocation, &data);
+	buffers.mappedUniforms = static_cast<ClusterUniforms*>(data);
+
+	base.createBuffer(sizeof(PointLight) * maxLights, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+	                  VMA_MEMORY_USAGE_CPU_TO_GPU, buffers.lights, buffers.lightsAllocation);
+	vmaMapMemory(base.allocator, buffers.lightsAllocation, &data);
+	buffers.mappedLights = static_cast<PointLight*>(data);
+
+	base.createBuffer(sizeof(glm::vec4) * 2 * clusterCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+	                  VMA_MEMORY_USAGE_CPU_TO_GPU, buffers.bounds, buffers.boundsAllocation);
+	buffers.boundsVersion = gridVersion;
+
+	// Read by every fragment, so they stay in device local memory and CPU results are copied in
+	base.createBuffer(clustersSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+	                  VMA_MEMORY_USAGE_GPU_ONLY, buffers.clusters, buffers.clustersAllocation);
+	base.createBuffer(lightIndicesSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+	                  VMA_MEMORY_USAGE_GPU_ONLY, buffers.lightIndices, buffers.lightIndicesAllocation);
+	base.createBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+	                  VMA_MEMORY_USAGE_GPU_ONLY, buffers.counter, buffers.counterAllocation);
+
+	base.createBuffer(clustersSize + lightIndicesSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY,
+	                  buffers.staging, buffers.stagingAllocation);
+	vmaMapMemory(base.allocator, buffers.stagingAllocation, &data);
+	buffers.mappedStaging = static_cast<uint8_t*>(data);
+	buffers.stagedIndexCount = 0;
+	buffers.gpuBinning = false;
+}
+
+void ClusteredLighting::update(uint32_t imageIndex, const glm::mat4& view, const glm::mat4& proj)
+{
+	ImageBuffers& buffers = imageBuffers[imageIndex];
+	uint64_t timestamps[TIMESTAMPS_PER_FRAME];
+	if (timestampsWritten[imageIndex] &&
+		vkGetQueryPoolResults(base.device, queryPool, imageIndex * TIMESTAMPS_PER_FRAME, TIMESTAMPS_PER_FRAME,
+		                      sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+	{
+		const float toMilliseconds = timestampPeriod / 1000000.f;
+		stats.binningGpuMilliseconds = static_cast<float>(timestamps[1] - timestamps[0]) * toMilliseconds;
+		stats.shadingGpuMilliseconds = static_cast<float>(timestamps[2] - timestamps[1]) * toMilliseconds;
+		stats.gpuBinning = buffers.gpuBinning;
+	}
+
+	if (lights.size() > maxLights)
+	{
+		throw std::runtime_error("too many lights for clustered lighting!");
+	}
+	const uint32_t lightCount = static_cast<uint32_t>(lights.size());
+	stats.lightCount = lightCount;
+
+	// The aspect ratio follows the window, and with it the bounds of every cluster
+	if (proj != projection)
+	{
+		projection = proj;
+		binner.setGrid(grid, proj);
+		binner.getClusterBounds(clusterBounds);
+		gridVersion++;
+	}
+	if (buffers.boundsVersion != gridVersion)
+	{
+		void* data;
+		vmaMapMemory(base.allocator, buffers.boundsAllocation, &data);
+		memcpy(data, clusterBounds.data(), sizeof(glm::vec4) * clusterBounds.size());
+		vmaFlushAllocation(base.allocator, buffers.boundsAllocation, 0, VK_WHOLE_SIZE);
+		vmaUnmapMemory(base.allocator, buffers.boundsAllocation);
+		buffers.boundsVersion = gridVersion;
+	}
+
+	ClusterUniforms* uniforms = buffers.mappedUniforms;
+	uniforms->view = view;
+	uniforms->gridSize = glm::uvec4(grid.tilesX, grid.tilesY, grid.slices, lightCount);
+	uniforms->depthSlicing = glm::vec4(grid.nearPlane, grid.farPlane, grid.getSliceScale(), grid.getSliceBias());
+	uniforms->screenSize = glm::vec2(base.windowWidth, base.windowHeight);
+	vmaFlushAllocation(base.allocator, buffers.uniformsAllocation, 0, sizeof(ClusterUniforms));
+
+	memcpy(buffers.mappedLights, lights.data(), sizeof(PointLight) * lightCount);
+	vmaFlushAllocation(base.allocator, buffers.lightsAllocation, 0, sizeof(PointLight) * lightCount);
+
+	buffers.gpuBinning = gpuBinning;
+	if (gpuBinning)
+	{
+		stats.cpuBinningMilliseconds = 0.f;
+		return;
+	}
+
+	const auto start = std::chrono::high_resolution_clock::now();
+	binner.bin(lights, view);
+	stats.cpuBinningMilliseconds = std::chrono::duration<float, std::milli>(
+		std::chrono::high_resolution_clock::now() - start).count();
+	stats.droppedCount = binner.getDroppedCount();
+
+	const std::vector<LightCluster>& clusters = binner.getClusters();
+	const std::vector<uint32_t>& lightIndices = binner.getLightIndices();
+	const size_t clustersSize = sizeof(LightCluster) * clusters.size();
+	memcpy(buffers.mappedStaging, clusters.data(), clustersSize);
+	memcpy(buffers.mappedStaging + clustersSize, lightIndices.data(), sizeof(uint32_t) * lightIndices.size());
+	buffers.stagedIndexCount = static_cast<uint32_t>(lightIndices.size());
+	stats.averageLightsPerCluster = static_cast<float>(lightIndices.size()) / clusters.size();
+}
+
+void ClusteredLighting::recordBinning(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	const ImageBuffers& buffers = imageBuffers[imageIndex];
+	const uint32_t firstQuery = imageIndex * TIMESTAMPS_PER_FRAME;
+	if (queryPool != VK_NULL_HANDLE)
+	{
+		vkCmdResetQueryPool(commandBuffer, queryPool, firstQuery, TIMESTAMPS_PER_FRAME);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, firstQuery);
+	}
+
+	VkMemoryBarrier binningBarrier = {};
+	binningBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	binningBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	VkPipelineStageFlags binningStage;
+	if (buffers.gpuBinning)
+	{
+		vkCmdFillBuffer(commandBuffer, buffers.counter, 0, sizeof(uint32_t), 0);
+
+		// The cleared counter has to land before the first workgroup reserves its range
+		VkMemoryBarrier clearBarrier = {};
+		clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		                     1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, binningPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, binningPipelineLayout, 0, 1,
+		                        &binningSets[imageIndex], 0, nullptr);
+		vkCmdDispatch(commandBuffer, grid.getClusterCount(), 1, 1);
+		binningBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		binningStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	}
+	else
+	{
+		const VkDeviceSize clustersSize = sizeof(LightCluster) * grid.getClusterCount();
+		VkBufferCopy clustersCopy = {0, 0, clustersSize};
+		vkCmdCopyBuffer(commandBuffer, buffers.staging, buffers.clusters, 1, &clustersCopy);
+		if (buffers.stagedIndexCount > 0)
+		{
+			VkBufferCopy indicesCopy = {clustersSize, 0, sizeof(uint32_t) * buffers.stagedIndexCount};
+			vkCmdCopyBuffer(commandBuffer, buffers.staging, buffers.lightIndices, 1, &indicesCopy);
+		}
+		binningBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		binningStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	}
+
+	vkCmdPipelineBarrier(commandBuffer, binningStage, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &binningBarrier,
+	                     0, nullptr, 0, nullptr);
+	if (queryPool != VK_NULL_HANDLE)
+	{
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, firstQuery + 1);
+	}
+}
+
+void ClusteredLighting::recordShadingEnd(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	if (queryPool != VK_NULL_HANDLE)
+	{
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool,
+		                    imageIndex * TIMESTAMPS_PER_FRAME + 2);
+		timestampsWritten[imageIndex] = true;
+	}
+}
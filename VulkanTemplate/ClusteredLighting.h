@@ -0,0 +1,155 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <vk_mem_alloc.h>
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <vector>
+#include "DescriptorAllocator.h"
+#include "LightClusters.h"
+
+class VulkanBase;
+class JobSystem;
+
+/// Grid and camera data of the binning and shading shaders, std140 layout
+struct ClusterUniforms
+{
+	glm::mat4 view;
+	/// Tiles across, tiles down, depth slices and the light count
+	glm::uvec4 gridSize;
+	/// Near, far, then the scale and bias turning log(depth) into a slice
+	glm::vec4 depthSlicing;
+	glm::vec2 screenSize;
+	glm::vec2 padding;
+};
+
+/// Set 0 of the lit scene pipeline
+struct ClusteredShadingDescriptors
+{
+	DescriptorInfo frameUniforms;
+	DescriptorInfo clusterUniforms;
+	DescriptorInfo lights;
+	DescriptorInfo clusters;
+	DescriptorInfo lightIndices;
+};
+
+struct LightBinningDescriptors
+{
+	DescriptorInfo clusterUniforms;
+	DescriptorInfo lights;
+	DescriptorInfo clusterBounds;
+	DescriptorInfo clusters;
+	DescriptorInfo lightIndices;
+	DescriptorInfo lightIndexCounter;
+};
+
+struct ClusteredLightingStats
+{
+	uint32_t lightCount = 0;
+	bool gpuBinning = false;
+	/// Wall time of the last LightBinner::bin, zero when binning on the GPU
+	float cpuBinningMilliseconds = 0.f;
+	/// GPU time of the binning dispatch, or of the copies of the CPU result, zero without timestamp support
+	float binningGpuMilliseconds = 0.f;
+	/// GPU time of the main pass shading with the clusters
+	float shadingGpuMilliseconds = 0.f;
+	/// Only known for CPU binning, the GPU path keeps its counts on the device
+	uint32_t droppedCount = 0;
+	float averageLightsPerCluster = 0.f;
+};
+
+/// Forward shading with many point lights. The view frustum is cut into a ClusterGrid, every cluster
+/// gets the list of lights whose sphere touches it, and the fragment shader only loops over the lights
+/// of the cluster it falls in. Lights are binned either on the CPU with LightBinner and copied to device
+/// local buffers, or by a compute dispatch with a workgroup per cluster. Buffers exist once per
+/// swapchain image. Draws with getPipeline() in the base render pass take DrawPushConstants like the
+/// base pipeline.
+class ClusteredLighting
+{
+public:
+	ClusteredLighting(VulkanBase& base, uint32_t maxLights, JobSystem* jobSystem = nullptr);
+	~ClusteredLighting();
+
+	VkPipeline getPipeline() const { return pipeline; }
+	VkPipelineLayout getPipelineLayout() const { return pipelineLayout; }
+	VkDescriptorSet getDescriptorSet(uint32_t imageIndex) const { return shadingSets[imageIndex]; }
+	/// For other passes shading with the same clusters
+	VkBuffer getUniformBuffer(uint32_t imageIndex) const { return imageBuffers[imageIndex].uniforms; }
+	VkBuffer getLightBuffer(uint32_t imageIndex) const { return imageBuffers[imageIndex].lights; }
+	VkBuffer getClusterBuffer(uint32_t imageIndex) const { return imageBuffers[imageIndex].clusters; }
+	VkBuffer getLightIndexBuffer(uint32_t imageIndex) const { return imageBuffers[imageIndex].lightIndices; }
+
+	/// Reads this image's last timestamps, uploads the lights and bins them on the CPU unless gpuBinning is
+	/// set. Call once per frame after its fence has signaled, proj has to use the grid's near and far planes.
+	void update(uint32_t imageIndex, const glm::mat4& view, const glm::mat4& proj);
+	/// Fills the cluster buffers, outside a render pass and before the scene is drawn
+	void recordBinning(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	/// Closes the shading time, right after the main pass
+	void recordShadingEnd(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	/// Creates buffers and sets for the images a recreated swapchain added, the old query pool is retired
+	void addSwapchainImages();
+
+	ClusteredLightingStats getStats() const { return stats; }
+
+	/// World space, at most maxLights of them
+	std::vector<PointLight> lights;
+	bool gpuBinning = false;
+
+private:
+	static const uint32_t TIMESTAMPS_PER_FRAME = 3;
+
+	VulkanBase& base;
+	uint32_t maxLights;
+	LightBinner binner;
+	ClusterGrid grid;
+	glm::mat4 projection = glm::mat4(0.f);
+	/// Bumped whenever the projection moves the cluster bounds, every image copies them again
+	uint32_t gridVersion = 0;
+	std::vector<glm::vec4> clusterBounds;
+
+	VkPipelineLayout pipelineLayout;
+	VkDescriptorSetLayout shadingSetLayout;
+	VkPipeline pipeline;
+	VkShaderModule binningShader;
+	VkPipelineLayout binningPipelineLayout;
+	VkDescriptorSetLayout binningSetLayout;
+	VkPipeline binningPipeline;
+	std::vector<VkDescriptorSet> shadingSets;
+	std::vector<VkDescriptorSet> binningSets;
+
+	struct ImageBuffers
+	{
+		VkBuffer uniforms;
+		VmaAllocation uniformsAllocation;
+		ClusterUniforms* mappedUniforms;
+		VkBuffer lights;
+		VmaAllocation lightsAllocation;
+		PointLight* mappedLights;
+		VkBuffer bounds;
+		VmaAllocation boundsAllocation;
+		uint32_t boundsVersion;
+		VkBuffer clusters;
+		VmaAllocation clustersAllocation;
+		VkBuffer lightIndices;
+		VmaAllocation lightIndicesAllocation;
+		VkBuffer counter;
+		VmaAllocation counterAllocation;
+		/// CPU binning results, clusters followed by the light indices
+		VkBuffer staging;
+		VmaAllocation stagingAllocation;
+		uint8_t* mappedStaging;
+		uint32_t stagedIndexCount;
+		bool gpuBinning;
+	};
+	std::vector<ImageBuffers> imageBuffers;
+
+	VkQueryPool queryPool = VK_NULL_HANDLE;
+	float timestampPeriod = 0.f;
+	std::vector<bool> timestampsWritten;
+	ClusteredLightingStats stats;
+
+	void createPipelines();
+	void createBuffers(ImageBuffers& buffers);
+};
@@ -0,0 +1,349 @@
+#include "DeferredShading.h"
+#include "ClusteredLighting.h"
+#include "VulkanBase.h"
+
+#include <stdexcept>
+
+DeferredShading::DeferredShading(VulkanBase& base, ClusteredLighting& lighting)
+	: base(base), lighting(lighting)
+{
+	// The lighting subpass reads depth back to place each pixel
+	depthFormat = base.findDepthFormat(VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+		VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT);
+
+	createRenderPass();
+	createPipelines();
+	addSwapchainImages();
+	createAttachments();
+}
+
+DeferredShading::~DeferredShading()
+{
+	retireAttachments();
+	destroyRetired(true);
+	vkDestroyRenderPass(base.device, renderPass, nullptr);
+}
+
+void DeferredShading::createRenderPass()
+{
+	// Lighting covers every pixel of the swapchain image, so it is not cleared
+	VkAttachmentDescription swapchainAttachment = {};
+	swapchainAttachment.format = base.surfaceFormat.format;
+	swapchainAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	swapchainAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	swapchainAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	swapchainAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	swapchainAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	swapchainAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	swapchainAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+	// Nothing of the G-buffer is loaded or stored, it lives and dies inside the render pass
+	VkAttachmentDescription albedoAttachment = swapchainAttachment;
+	albedoAttachment.format = VK_FORMAT_R8G8B8A8_UNORM;
+	albedoAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	albedoAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	albedoAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkAttachmentDescription normalAttachment = albedoAttachment;
+	normalAttachment.format = VK_FORMAT_A2B10G10R10_UNORM_PACK32;
+
+	VkAttachmentDescription depthAttachment = albedoAttachment;
+	depthAttachment.format = depthFormat;
+	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+	const VkAttachmentDescription attachments[] = {
+		swapchainAttachment, albedoAttachment, normalAttachment, depthAttachment
+	};
+
+	const VkAttachmentReference gBufferRefs[] = {
+		{1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL},
+		{2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL},
+	};
+	const VkAttachmentReference depthRef = {3, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+	const VkAttachmentReference inputRefs[] = {
+		{1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+		{2, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+		{3, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL},
+	};
+	const VkAttachmentReference swapchainRef = {0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+
+	VkSubpassDescription subpasses[2] = {};
+	subpasses[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpasses[0].colorAttachmentCount = 2;
+	subpasses[0].pColorAttachments = gBufferRefs;
+	subpasses[0].pDepthStencilAttachment = &depthRef;
+	subpasses[1].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpasses[1].inputAttachmentCount = 3;
+	subpasses[1].pInputAttachments = inputRefs;
+	subpasses[1].colorAttachmentCount = 1;
+	subpasses[1].pColorAttachments = &swapchainRef;
+
+	VkSubpassDependency dependencies[3] = {};
+	// The last frame's lighting has to be done reading the G-buffer before this frame writes it again
+	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[0].dstSubpass = 0;
+	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+		VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	// The swapchain image is only touched by the lighting subpass, after the acquire semaphore's stage
+	dependencies[1].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[1].dstSubpass = 1;
+	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[1].srcAccessMask = 0;
+	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[1].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	// By region, every pixel only reads its own G-buffer texels, so tilers never flush the tile between
+	dependencies[2].srcSubpass = 0;
+	dependencies[2].dstSubpass = 1;
+	dependencies[2].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+		VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[2].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[2].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	dependencies[2].dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+	dependencies[2].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+	VkRenderPassCreateInfo renderPassCreateInfo = {};
+	renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassCreateInfo.attachmentCount = 4;
+	renderPassCreateInfo.pAttachments = attachments;
+	renderPassCreateInfo.subpassCount = 2;
+	renderPassCreateInfo.pSubpasses = subpasses;
+	renderPassCreateInfo.dependencyCount = 3;
+	renderPassCreateInfo.pDependencies = dependencies;
+	if (vkCreateRenderPass(base.device, &renderPassCreateInfo, nullptr, &renderPass) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create deferred render pass!");
+	}
+}
+
+void DeferredShading::createPipelines()
+{
+	// Same vertex shader as forward clustered shading, only the normal and color are written out
+	PipelineDescription description;
+	description.vertShader = base.createShaderModule("shaders/clustered_vert.spv");
+	description.fragShader = base.createShaderModule("shaders/gbuffer_frag.spv");
+	ReflectedPipelineLayout gBufferLayout = base.layoutCache->getPipelineLayout({
+		&base.shaderReflections.at(description.vertShader), &base.shaderReflections.at(description.fragShader)
+	});
+	gBufferPipelineLayout = gBufferLayout.pipelineLayout;
+	gBufferSetLayout = gBufferLayout.setLayouts[0];
+	description.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	description.colorAttachmentCount = 2;
+	description.layout = gBufferPipelineLayout;
+	description.renderPass = renderPass;
+	description.subpass = 0;
+	// Both are owned by the pipeline cache
+	gBufferPipeline = base.pipelineCache->getPipelineBlocking(description);
+
+	description.vertShader = base.createShaderModule("shaders/upscale_vert.spv");
+	description.fragShader = base.createShaderModule("shaders/deferred_lighting_frag.spv");
+	ReflectedPipelineLayout lightingLayout = base.layoutCache->getPipelineLayout({
+		&base.shaderReflections.at(description.vertShader), &base.shaderReflections.at(description.fragShader)
+	});
+	lightingPipelineLayout = lightingLayout.pipelineLayout;
+	lightingSetLayout = lightingLayout.setLayouts[0];
+	description.cullMode = VK_CULL_MODE_NONE;
+	description.depthTestEnable = VK_FALSE;
+	description.depthWriteEnable = VK_FALSE;
+	description.colorAttachmentCount = 1;
+	description.layout = lightingPipelineLayout;
+	description.subpass = 1;
+	lightingPipeline = base.pipelineCache->getPipelineBlocking(description);
+	if (gBufferPipeline == VK_NULL_HANDLE || lightingPipeline == VK_NULL_HANDLE)
+	{
+		throw std::runtime_error("failed to create deferred shading pipelines!");
+	}
+	lightingTemplate = TypedUpdateTemplate<DeferredLightingDescriptors>(
+		base.device, base.layoutCache->getDescriptorUpdateTemplate(lightingSetLayout));
+}
+
+void DeferredShading::addSwapchainImages()
+{
+	// The G-buffer sets only point at the frame uniforms, so they live as long as the swapchain images
+	TypedUpdateTemplate<GBufferDescriptors> gBufferTemplate(
+		base.device, base.layoutCache->getDescriptorUpdateTemplate(gBufferSetLayout));
+	const size_t firstImage = gBufferSets.size();
+	gBufferSets.resize(base.swapchainImages.size());
+	for (size_t i = firstImage; i < gBufferSets.size(); i++)
+	{
+		GBufferDescriptors descriptors = {};
+		descriptors.frameUniforms.buffer = {base.uniformBuffers[i], 0, VK_WHOLE_SIZE};
+		gBufferSets[i] = base.descriptorAllocator->allocatePersistent(gBufferSetLayout);
+		gBufferTemplate.update(gBufferSets[i], descriptors);
+	}
+}
+
+DeferredShading::Attachment DeferredShading::createAttachment(VkFormat format, VkImageUsageFlags usage,
+                                                              VkImageAspectFlagBits aspect)
+{
+	// Dedicated, so the commitment of the memory is the attachment's alone
+	Attachment attachment;
+	attachment.format = format;
+	usage |= VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+	if (!base.lazyAttachments ||
+		base.createImage(base.windowWidth, base.windowHeight, 1, VK_SAMPLE_COUNT_1_BIT, format,
+		                 VK_IMAGE_TILING_OPTIMAL, usage, VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED, attachment.image,
+		                 attachment.allocation, VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT) != VK_SUCCESS)
+	{
+		// Most desktop devices have no lazily allocated memory type
+		if (base.createImage(base.windowWidth, base.windowHeight, 1, VK_SAMPLE_COUNT_1_BIT, format,
+		                     VK_IMAGE_TILING_OPTIMAL, usage, VMA_MEMORY_USAGE_GPU_ONLY, attachment.image,
+		                     attachment.allocation, VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create G-buffer attachment!");
+		}
+	}
+	attachment.view = base.createImageView(attachment.image, format, aspect, 1);
+	return attachment;
+}
+
+void DeferredShading::createAttachments()
+{
+	albedo = createAttachment(VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+	                          VK_IMAGE_ASPECT_COLOR_BIT);
+	normal = createAttachment(VK_FORMAT_A2B10G10R10_UNORM_PACK32, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+	                          VK_IMAGE_ASPECT_COLOR_BIT);
+	depth = createAttachment(depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT);
+
+	framebuffers.resize(base.swapchainImageViews.size());
+	for (size_t i = 0; i < framebuffers.size(); i++)
+	{
+		const VkImageView attachments[] = {base.swapchainImageViews[i], albedo.view, normal.view, depth.view};
+
+		VkFramebufferCreateInfo framebufferCreateInfo = {};
+		framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebufferCreateInfo.renderPass = renderPass;
+		framebufferCreateInfo.attachmentCount = 4;
+		framebufferCreateInfo.pAttachments = attachments;
+		framebufferCreateInfo.width = base.windowWidth;
+		framebufferCreateInfo.height = base.windowHeight;
+		framebufferCreateInfo.layers = 1;
+		if (vkCreateFramebuffer(base.device, &framebufferCreateInfo, nullptr, &framebuffers[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create deferred framebuffer!");
+		}
+	}
+}
+
+void DeferredShading::resize()
+{
+	retireAttachments();
+	createAttachments();
+}
+
+void DeferredShading::retireAttachments()
+{
+	RetiredAttachments retired;
+	retired.retireFrame = base.frameNumber;
+	retired.attachments = {albedo, normal, depth};
+	retired.framebuffers = std::move(framebuffers);
+	retiredAttachments.push_back(std::move(retired));
+	framebuffers.clear();
+}
+
+void DeferredShading::destroyRetired(bool all)
+{
+	while (!retiredAttachments.empty() &&
+		(all || base.frameNumber >= retiredAttachments.front().retireFrame + MAX_FRAMES_IN_FLIGHT))
+	{
+		RetiredAttachments& retired = retiredAttachments.front();
+		for (VkFramebuffer framebuffer : retired.framebuffers)
+		{
+			vkDestroyFramebuffer(base.device, framebuffer, nullptr);
+		}
+		for (const Attachment& attachment : retired.attachments)
+		{
+			vkDestroyImageView(base.device, attachment.view, nullptr);
+			vmaDestroyImage(base.allocator, attachment.image, attachment.allocation);
+		}
+		retiredAttachments.pop_front();
+	}
+}
+
+void DeferredShading::setCamera(const glm::mat4& view, const glm::mat4& proj)
+{
+	camera.inverseProj = glm::inverse(proj);
+	camera.inverseView = glm::inverse(view);
+}
+
+void DeferredShading::beginGBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	destroyRetired(false);
+
+	VkClearValue clearValues[4] = {};
+	clearValues[1].color = {0, 0, 0};
+	clearValues[2].color = {0, 0, 0};
+	clearValues[3].depthStencil = {1, 0};
+
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = renderPass;
+	renderPassInfo.framebuffer = framebuffers[imageIndex];
+	renderPassInfo.renderArea.extent.width = base.windowWidth;
+	renderPassInfo.renderArea.extent.height = base.windowHeight;
+	renderPassInfo.clearValueCount = 4;
+	renderPassInfo.pClearValues = clearValues;
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+	VkViewport viewport = {};
+	viewport.width = static_cast<float>(base.windowWidth);
+	viewport.height = static_cast<float>(base.windowHeight);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor = {};
+	scissor.extent.width = base.windowWidth;
+	scissor.extent.height = base.windowHeight;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
+
+void DeferredShading::recordLighting(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+
+	// The input attachments change on resize, so the set is written anew every frame
+	DeferredLightingDescriptors descriptors = {};
+	descriptors.clusterUniforms.buffer = {lighting.getUniformBuffer(imageIndex), 0, sizeof(ClusterUniforms)};
+	descriptors.lights.buffer = {lighting.getLightBuffer(imageIndex), 0, VK_WHOLE_SIZE};
+	descriptors.clusters.buffer = {lighting.getClusterBuffer(imageIndex), 0, VK_WHOLE_SIZE};
+	descriptors.lightIndices.buffer = {lighting.getLightIndexBuffer(imageIndex), 0, VK_WHOLE_SIZE};
+	descriptors.albedo.image = {VK_NULL_HANDLE, albedo.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+	descriptors.normal.image = {VK_NULL_HANDLE, normal.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+	descriptors.depth.image = {VK_NULL_HANDLE, depth.view, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL};
+	VkDescriptorSet lightingSet = base.descriptorAllocator->allocate(lightingSetLayout);
+	lightingTemplate.update(lightingSet, descriptors);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, lightingPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, lightingPipelineLayout, 0, 1,
+	                        &lightingSet, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, lightingPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+	                   sizeof(DeferredLightingPushConstants), &camera);
+	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+	vkCmdEndRenderPass(commandBuffer);
+}
+
+DeferredShadingStats DeferredShading::getStats() const
+{
+	DeferredShadingStats stats;
+	stats.lazilyAllocated = true;
+	for (const Attachment* attachment : {&albedo, &normal, &depth})
+	{
+		const AttachmentMemory memory = base.getAttachmentMemory(attachment->allocation, attachment->format);
+		stats.gBufferAllocatedBytes += memory.allocatedBytes;
+		stats.gBufferCommittedBytes += memory.committedBytes;
+		stats.lazilyAllocated &= memory.lazilyAllocated;
+	}
+
+	// Albedo and normal are four bytes a texel, depth two or four
+	const VkDeviceSize depthBytes = depthFormat == VK_FORMAT_D16_UNORM ? 2 : 4;
+	const VkDeviceSize pixelCount = static_cast<VkDeviceSize>(base.windowWidth) * base.windowHeight;
+	stats.spilledBytesPerFrame = pixelCount * (4 + 4 + depthBytes) * 2;
+	return stats;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <vk_mem_alloc.h>
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <vector>
+#include <deque>
+#include "DescriptorAllocator.h"
+
+class VulkanBase;
+class ClusteredLighting;
+
+struct GBufferDescriptors
+{
+	DescriptorInfo frameUniforms;
+};
+
+struct DeferredLightingDescriptors
+{
+	DescriptorInfo clusterUniforms;
+	DescriptorInfo lights;
+	DescriptorInfo clusters;
+	DescriptorInfo lightIndices;
+	DescriptorInfo albedo;
+	DescriptorInfo normal;
+	DescriptorInfo depth;
+};
+
+struct DeferredLightingPushConstants
+{
+	glm::mat4 inverseProj;
+	glm::mat4 inverseView;
+};
+
+struct DeferredShadingStats
+{
+	/// Allocated for the albedo, normal and depth attachments together
+	VkDeviceSize gBufferAllocatedBytes = 0;
+	/// Backed by the driver so far, stays zero where the G-buffer never leaves tile memory
+	VkDeviceSize gBufferCommittedBytes = 0;
+	/// Only when every attachment landed in lazily allocated memory
+	bool lazilyAllocated = false;
+	/// What a frame would move through memory if the G-buffer were stored and read back: a write and a read
+	/// of every attachment texel
+	VkDeviceSize spilledBytesPerFrame = 0;
+};
+
+/// Deferred alternative to the forward passes, for scenes with many lights. One render pass with two
+/// subpasses: the scene is drawn into albedo, normal and depth, then a fullscreen triangle reads them as
+/// input attachments and shades every pixel once with the lights of its ClusteredLighting cluster.
+/// The dependency between the subpasses is by region and the G-buffer is transient, never loaded nor
+/// stored, and in lazily allocated memory where the device has it, so tilers keep it in tile memory.
+/// Single-sample, reading input attachments per sample would need sample rate shading.
+class DeferredShading
+{
+public:
+	DeferredShading(VulkanBase& base, ClusteredLighting& lighting);
+	~DeferredShading();
+
+	/// Scene draws go to the G-buffer subpass with these and take DrawPushConstants
+	VkPipeline getGBufferPipeline() const { return gBufferPipeline; }
+	VkPipelineLayout getGBufferPipelineLayout() const { return gBufferPipelineLayout; }
+	VkDescriptorSet getGBufferDescriptorSet(uint32_t imageIndex) const { return gBufferSets[imageIndex]; }
+
+	/// Unjittered camera of the frame about to be recorded, for reconstructing positions from depth
+	void setCamera(const glm::mat4& view, const glm::mat4& proj);
+	/// Begins the render pass in the G-buffer subpass, with viewport and scissor set
+	void beginGBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	/// Moves on to the lighting subpass, shades into the swapchain image and ends the render pass
+	void recordLighting(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	/// Follows the swapchain size, the old images live on until the frames using them have retired
+	void resize();
+	/// G-buffer sets for the images a recreated swapchain added, once the base made their frame uniforms
+	void addSwapchainImages();
+
+	DeferredShadingStats getStats() const;
+
+private:
+	struct Attachment
+	{
+		VkImage image = VK_NULL_HANDLE;
+		VmaAllocation allocation = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		VkFormat format = VK_FORMAT_UNDEFINED;
+	};
+
+	struct RetiredAttachments
+	{
+		uint64_t retireFrame;
+		std::vector<Attachment> attachments;
+		std::vector<VkFramebuffer> framebuffers;
+	};
+
+	VulkanBase& base;
+	ClusteredLighting& lighting;
+	VkFormat depthFormat;
+	VkRenderPass renderPass;
+	VkPipelineLayout gBufferPipelineLayout;
+	VkDescriptorSetLayout gBufferSetLayout;
+	VkPipeline gBufferPipeline;
+	VkPipelineLayout lightingPipelineLayout;
+	VkDescriptorSetLayout lightingSetLayout;
+	VkPipeline lightingPipeline;
+	TypedUpdateTemplate<DeferredLightingDescriptors> lightingTemplate;
+	std::vector<VkDescriptorSet> gBufferSets;
+
+	Attachment albedo;
+	Attachment normal;
+	Attachment depth;
+	std::vector<VkFramebuffer> framebuffers;
+	std::deque<RetiredAttachments> retiredAttachments;
+	DeferredLightingPushConstants camera = {};
+
+	void createRenderPass();
+	void createPipelines();
+	Attachment createAttachment(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlagBits aspect);
+	void createAttachments();
+	void retireAttachments();
+	void destroyRetired(bool all);
+};
@@ -0,0 +1,213 @@
+#include "DepthPyramid.h"
+#include "VulkanBase.h"
+
+#include <stdexcept>
+
+namespace
+{
+	uint32_t previousPowerOfTwo(uint32_t value)
+	{
+		uint32_t result = 1;
+		while (result * 2 <= value)
+		{
+			result *= 2;
+		}
+		return result;
+	}
+}
+
+DepthPyramid::DepthPyramid(VulkanBase& base)
+	: base(base), mipGenerator(base, MipReduction::Max)
+{
+	// Multisampled depth is read per sample, so the init pass has a variant per sampler type
+	initShader = base.createShaderModule(base.sampleCount == VK_SAMPLE_COUNT_1_BIT
+		                                     ? "shaders/hiz_init_comp.spv"
+		                                     : "shaders/hiz_init_ms_comp.spv");
+
+	ReflectedPipelineLayout initLayout = base.layoutCache->getPipelineLayout({&base.shaderReflections.at(initShader)});
+	initPipelineLayout = initLayout.pipelineLayout;
+	initSetLayout = initLayout.setLayouts[0];
+	initPipeline = base.createComputePipeline(initShader, initPipelineLayout);
+	initTemplate = TypedUpdateTemplate<PyramidInitDescriptors>(
+		base.device, base.layoutCache->getDescriptorUpdateTemplate(initSetLayout));
+
+	// Every read is a texelFetch, the sampler only has to exist
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.minLod = 0;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+	if (vkCreateSampler(base.device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create depth pyramid sampler!");
+	}
+
+	createImage();
+}
+
+DepthPyramid::~DepthPyramid()
+{
+	destroyRetired(true);
+	for (VkImageView levelView : levelViews)
+	{
+		vkDestroyImageView(base.device, levelView, nullptr);
+	}
+	vkDestroyImageView(base.device, view, nullptr);
+	vmaDestroyImage(base.allocator, image, allocation);
+	vkDestroySampler(base.device, sampler, nullptr);
+	vkDestroyPipeline(base.device, initPipeline, nullptr);
+}
+
+void DepthPyramid::createImage()
+{
+	width = previousPowerOfTwo(base.windowWidth);
+	height = previousPowerOfTwo(base.windowHeight);
+	levelCount = 1;
+	while ((width | height) >> levelCount != 0)
+	{
+		levelCount++;
+	}
+
+	base.createImage(width, height, levelCount, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R32_SFLOAT, VK_IMAGE_TILING_OPTIMAL,
+	                 VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VMA_MEMORY_USAGE_GPU_ONLY, image,
+	                 allocation);
+	view = createLevelView(0, levelCount);
+	levelViews.resize(levelCount);
+	for (uint32_t level = 0; level < levelCount; level++)
+	{
+		levelViews[level] = createLevelView(level, 1);
+	}
+	initialized = false;
+	built = false;
+}
+
+VkImageView DepthPyramid::createLevelView(uint32_t baseLevel, uint32_t count)
+{
+	VkImageViewCreateInfo viewCreateInfo = {};
+	viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewCreateInfo.image = image;
+	viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewCreateInfo.format = VK_FORMAT_R32_SFLOAT;
+	viewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewCreateInfo.subresourceRange.baseMipLevel = baseLevel;
+	viewCreateInfo.subresourceRange.levelCount = count;
+	viewCreateInfo.subresourceRange.baseArrayLayer = 0;
+	viewCreateInfo.subresourceRange.layerCount = 1;
+
+	VkImageView levelView;
+	if (vkCreateImageView(base.device, &viewCreateInfo, nullptr, &levelView) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create depth pyramid view!");
+	}
+	return levelView;
+}
+
+void DepthPyramid::resize()
+{
+	RetiredPyramid retired;
+	retired.retireFrame = base.frameNumber;
+	retired.image = image;
+	retired.allocation = allocation;
+	retired.view = view;
+	retired.levelViews = std::move(levelViews);
+	retiredPyramids.push_back(std::move(retired));
+
+	createImage();
+}
+
+void DepthPyramid::destroyRetired(bool all)
+{
+	while (!retiredPyramids.empty() &&
+		(all || base.frameNumber >= retiredPyramids.front().retireFrame + MAX_FRAMES_IN_FLIGHT))
+	{
+		RetiredPyramid& retired = retiredPyramids.front();
+		for (VkImageView levelView : retired.levelViews)
+		{
+			vkDestroyImageView(base.device, levelView, nullptr);
+		}
+		vkDestroyImageView(base.device, retired.view, nullptr);
+		vmaDestroyImage(base.allocator, retired.image, retired.allocation);
+		retiredPyramids.pop_front();
+	}
+}
+
+void DepthPyramid::record(VkCommandBuffer commandBuffer)
+{
+	destroyRetired(false);
+
+	// Depth writes have to land before the init pass reads them, and culling reads of the previous
+	// contents have to finish before they are overwritten
+	VkImageMemoryBarrier depthBarrier = {};
+	depthBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	depthBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	depthBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	depthBarrier.image = base.depthImage;
+	depthBarrier.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1};
+
+	VkImageMemoryBarrier pyramidBarrier = {};
+	pyramidBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	pyramidBarrier.srcAccessMask = 0;
+	pyramidBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	pyramidBarrier.oldLayout = initialized ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_UNDEFINED;
+	pyramidBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	pyramidBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	pyramidBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	pyramidBarrier.image = image;
+	pyramidBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1};
+
+	const VkImageMemoryBarrier startBarriers[] = {depthBarrier, pyramidBarrier};
+	vkCmdPipelineBarrier(commandBuffer,
+	                     VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+	                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 2, startBarriers);
+	initialized = true;
+
+	PyramidPushConstants pushConstants = {};
+	pushConstants.sourceSize = glm::ivec2(base.windowWidth, base.windowHeight);
+	pushConstants.targetSize = glm::ivec2(width, height);
+	pushConstants.sampleCount = static_cast<int32_t>(base.sampleCount);
+
+	PyramidInitDescriptors initDescriptors = {};
+	initDescriptors.depthImage.image = {sampler, base.depthImageView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL};
+	initDescriptors.pyramidLevel.image = {VK_NULL_HANDLE, levelViews[0], VK_IMAGE_LAYOUT_GENERAL};
+	VkDescriptorSet initSet = base.descriptorAllocator->allocate(initSetLayout);
+	initTemplate.update(initSet, initDescriptors);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, initPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, initPipelineLayout, 0, 1, &initSet, 0,
+	                        nullptr);
+	vkCmdPushConstants(commandBuffer, initPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+	                   sizeof(PyramidPushConstants), &pushConstants);
+	vkCmdDispatch(commandBuffer, (width + 7) / 8, (height + 7) / 8, 1);
+
+	// Hand depth back to the render pass as soon as it has been read
+	depthBarrier.srcAccessMask = 0;
+	depthBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkMemoryBarrier levelBarrier = {};
+	levelBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+	                     VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, 0, 1, &levelBarrier, 0, nullptr, 1,
+	                     &depthBarrier);
+
+	// Every level below the first in one dispatch, then visible to the culling reads
+	mipGenerator.record(commandBuffer, width, height, levelViews);
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+	                     1, &levelBarrier, 0, nullptr, 0, nullptr);
+	built = true;
+}
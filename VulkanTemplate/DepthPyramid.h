@@ -0,0 +1,85 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <vk_mem_alloc.h>
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <vector>
+#include <deque>
+#include "DescriptorAllocator.h"
+#include "MipGenerator.h"
+
+class VulkanBase;
+
+struct PyramidPushConstants
+{
+	glm::ivec2 sourceSize;
+	glm::ivec2 targetSize;
+	int32_t sampleCount;
+};
+
+struct PyramidInitDescriptors
+{
+	DescriptorInfo depthImage;
+	DescriptorInfo pyramidLevel;
+};
+
+/// Hierarchical depth buffer. Level 0 is the depth buffer reduced to the previous power of two size,
+/// every further level keeps the farthest depth of 2x2 texels below it, so one texel bounds all the
+/// depth it covers. Those levels come from MipGenerator, in one dispatch where the device allows. The
+/// image stays in GENERAL layout, written by the reduction passes and sampled by occlusion culling.
+class DepthPyramid
+{
+public:
+	explicit DepthPyramid(VulkanBase& base);
+	~DepthPyramid();
+
+	/// Follows the swapchain size, the old image lives on until the frames using it have retired
+	void resize();
+	/// Reduces base.depthImage, which has to be in DEPTH_STENCIL_ATTACHMENT_OPTIMAL and is left there
+	void record(VkCommandBuffer commandBuffer);
+
+	VkImageView getView() const { return view; }
+	VkSampler getSampler() const { return sampler; }
+	uint32_t getWidth() const { return width; }
+	uint32_t getHeight() const { return height; }
+	uint32_t getLevelCount() const { return levelCount; }
+	/// False until a build has been recorded since the last resize
+	bool hasContents() const { return built; }
+
+private:
+	struct RetiredPyramid
+	{
+		uint64_t retireFrame;
+		VkImage image;
+		VmaAllocation allocation;
+		VkImageView view;
+		std::vector<VkImageView> levelViews;
+	};
+
+	VulkanBase& base;
+	VkShaderModule initShader;
+	VkPipelineLayout initPipelineLayout;
+	VkDescriptorSetLayout initSetLayout;
+	VkPipeline initPipeline;
+	TypedUpdateTemplate<PyramidInitDescriptors> initTemplate;
+	MipGenerator mipGenerator;
+	VkSampler sampler;
+
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t levelCount = 0;
+	VkImage image = VK_NULL_HANDLE;
+	VmaAllocation allocation = VK_NULL_HANDLE;
+	VkImageView view = VK_NULL_HANDLE;
+	std::vector<VkImageView> levelViews;
+	bool initialized = false;
+	bool built = false;
+	std::deque<RetiredPyramid> retiredPyramids;
+
+	void createImage();
+	void destroyRetired(bool all);
+	VkImageView createLevelView(uint32_t baseLevel, uint32_t count);
+};
@@ -0,0 +1,215 @@
+#include "DescriptorAllocator.h"
+
+#include <stdexcept>
+
+namespace
+{
+	template <typename T>
+	void hashCombine(size_t& seed, const T& value)
+	{
+		seed ^= std::hash<T>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+	}
+
+	/// Descriptors of each type per set, a pool holds setsPerPool times this
+	const std::vector<std::pair<VkDescriptorType, float>> poolSizeRatios = {
+		{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.f},
+		{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.f},
+		{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.f},
+		{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.f},
+		{VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1.f},
+		{VK_DESCRIPTOR_TYPE_SAMPLER, 0.5f},
+		{VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.f},
+		{VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 0.5f}
+	};
+
+	bool isImageDescriptor(VkDescriptorType type)
+	{
+		return type == VK_DESCRIPTOR_TYPE_SAMPLER || type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER ||
+			type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE || type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE ||
+			type == VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+	}
+}
+
+bool DescriptorBinding::operator==(const DescriptorBinding& other) const
+{
+	return binding == other.binding && descriptorType == other.descriptorType &&
+		bufferInfo.buffer == other.bufferInfo.buffer && bufferInfo.offset == other.bufferInfo.offset &&
+		bufferInfo.range == other.bufferInfo.range &&
+		imageInfo.sampler == other.imageInfo.sampler && imageInfo.imageView == other.imageInfo.imageView &&
+		imageInfo.imageLayout == other.imageInfo.imageLayout;
+}
+
+size_t std::hash<DescriptorSetKey>::operator()(DescriptorSetKey const& key) const
+{
+	size_t seed = 0;
+	hashCombine(seed, (uint64_t)key.layout);
+	for (const auto& binding : key.bindings)
+	{
+		hashCombine(seed, binding.binding);
+		hashCombine(seed, static_cast<uint32_t>(binding.descriptorType));
+		hashCombine(seed, (uint64_t)binding.bufferInfo.buffer);
+		hashCombine(seed, binding.bufferInfo.offset);
+		hashCombine(seed, binding.bufferInfo.range);
+		hashCombine(seed, (uint64_t)binding.imageInfo.sampler);
+		hashCombine(seed, (uint64_t)binding.imageInfo.imageView);
+		hashCombine(seed, static_cast<uint32_t>(binding.imageInfo.imageLayout));
+	}
+	return seed;
+}
+
+DescriptorAllocator::DescriptorAllocator(VkDevice device, uint32_t framesInFlight, uint32_t setsPerPool)
+	: device(device), setsPerPool(setsPerPool), frames(framesInFlight)
+{
+}
+
+DescriptorAllocator::~DescriptorAllocator()
+{
+	for (auto& frame : frames)
+	{
+		freePools.insert(freePools.end(), frame.pools.begin(), frame.pools.end());
+	}
+	freePools.insert(freePools.end(), persistent.pools.begin(), persistent.pools.end());
+	for (VkDescriptorPool pool : freePools)
+	{
+		vkDestroyDescriptorPool(device, pool, nullptr);
+	}
+}
+
+void DescriptorAllocator::beginFrame(uint32_t frameIndex)
+{
+	stats.allocationsLastFrame = allocations;
+	stats.cacheHitsLastFrame = cacheHits;
+	allocations = 0;
+	cacheHits = 0;
+
+	// The caller waited for this frame's fence, nothing can still reference its sets
+	currentFrame = frameIndex;
+	PoolList& frame = frames[currentFrame];
+	for (VkDescriptorPool pool : frame.pools)
+	{
+		vkResetDescriptorPool(device, pool, 0);
+		freePools.push_back(pool);
+	}
+	frame.pools.clear();
+	frame.cache.clear();
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout)
+{
+	return allocateFrom(frames[currentFrame], layout);
+}
+
+VkDescriptorSet DescriptorAllocator::allocatePersistent(VkDescriptorSetLayout layout)
+{
+	return allocateFrom(persistent, layout);
+}
+
+VkDescriptorSet DescriptorAllocator::getDescriptorSet(VkDescriptorSetLayout layout,
+                                                      const std::vector<DescriptorBinding>& bindings)
+{
+	PoolList& frame = frames[currentFrame];
+	DescriptorSetKey key = {layout, bindings};
+	auto it = frame.cache.find(key);
+	if (it != frame.cache.end())
+	{
+		cacheHits++;
+		return it->second;
+	}
+
+	VkDescriptorSet descriptorSet = allocateFrom(frame, layout);
+	writeDescriptorSet(descriptorSet, bindings);
+	frame.cache.emplace(std::move(key), descriptorSet);
+	return descriptorSet;
+}
+
+void DescriptorAllocator::writeDescriptorSet(VkDescriptorSet descriptorSet,
+                                             const std::vector<DescriptorBinding>& bindings)
+{
+	std::vector<VkWriteDescriptorSet> descriptorWrites(bindings.size());
+	for (size_t i = 0; i < bindings.size(); i++)
+	{
+		VkWriteDescriptorSet& descriptorWrite = descriptorWrites[i];
+		descriptorWrite = {};
+		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite.dstSet = descriptorSet;
+		descriptorWrite.dstBinding = bindings[i].binding;
+		descriptorWrite.descriptorCount = 1;
+		descriptorWrite.descriptorType = bindings[i].descriptorType;
+		if (isImageDescriptor(bindings[i].descriptorType))
+		{
+			descriptorWrite.pImageInfo = &bindings[i].imageInfo;
+		}
+		else
+		{
+			descriptorWrite.pBufferInfo = &bindings[i].bufferInfo;
+		}
+	}
+	vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0,
+	                       nullptr);
+}
+
+VkDescriptorSet DescriptorAllocator::allocateFrom(PoolList& poolList, VkDescriptorSetLayout layout)
+{
+	if (poolList.pools.empty())
+	{
+		poolList.pools.push_back(acquirePool());
+	}
+
+	VkDescriptorSetAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocateInfo.descriptorPool = poolList.pools.back();
+	allocateInfo.descriptorSetCount = 1;
+	allocateInfo.pSetLayouts = &layout;
+
+	VkDescriptorSet descriptorSet;
+	VkResult result = vkAllocateDescriptorSets(device, &allocateInfo, &descriptorSet);
+	if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL)
+	{
+		// Current pool is exhausted, continue in a fresh one
+		poolList.pools.push_back(acquirePool());
+		allocateInfo.descriptorPool = poolList.pools.back();
+		result = vkAllocateDescriptorSets(device, &allocateInfo, &descriptorSet);
+	}
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate descriptor set!");
+	}
+
+	allocations++;
+	stats.totalAllocations++;
+	return descriptorSet;
+}
+
+VkDescriptorPool DescriptorAllocator::acquirePool()
+{
+	if (!freePools.empty())
+	{
+		VkDescriptorPool pool = freePools.back();
+		freePools.pop_back();
+		return pool;
+	}
+
+	std::vector<VkDescriptorPoolSize> poolSizes;
+	for (const auto& ratio : poolSizeRatios)
+	{
+		VkDescriptorPoolSize poolSize;
+		poolSize.type = ratio.first;
+		poolSize.descriptorCount = static_cast<uint32_t>(ratio.second * setsPerPool);
+		poolSizes.push_back(poolSize);
+	}
+
+	VkDescriptorPoolCreateInfo poolCreateInfo = {};
+	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolCreateInfo.maxSets = setsPerPool;
+	poolCreateInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolCreateInfo.pPoolSizes = poolSizes.data();
+
+	VkDescriptorPool pool;
+	if (vkCreateDescriptorPool(device, &poolCreateInfo, nullptr, &pool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create descriptor pool!");
+	}
+
+	stats.poolCount++;
+	return pool;
+}
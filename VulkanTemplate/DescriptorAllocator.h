@@ -0,0 +1,125 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <type_traits>
+#include <stdexcept>
+#include "ShaderReflection.h"
+
+/// One descriptor in a packed struct written through a descriptor update template.
+union DescriptorInfo
+{
+	VkDescriptorBufferInfo buffer;
+	VkDescriptorImageInfo image;
+	VkBufferView texelBufferView;
+};
+
+/// What one binding of a descriptor set points at. Buffer types use bufferInfo, image and
+/// sampler types use imageInfo, the other one stays zeroed.
+struct DescriptorBinding
+{
+	uint32_t binding = 0;
+	VkDescriptorType descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	VkDescriptorBufferInfo bufferInfo = {};
+	VkDescriptorImageInfo imageInfo = {};
+
+	bool operator==(const DescriptorBinding& other) const;
+};
+
+struct DescriptorSetKey
+{
+	VkDescriptorSetLayout layout;
+	std::vector<DescriptorBinding> bindings;
+
+	bool operator==(const DescriptorSetKey& other) const
+	{
+		return layout == other.layout && bindings == other.bindings;
+	}
+};
+
+namespace std
+{
+	template <>
+	struct hash<DescriptorSetKey>
+	{
+		size_t operator()(DescriptorSetKey const& key) const;
+	};
+}
+
+struct DescriptorAllocatorStats
+{
+	uint32_t allocationsLastFrame = 0;
+	uint32_t cacheHitsLastFrame = 0;
+	uint32_t poolCount = 0;
+	uint64_t totalAllocations = 0;
+};
+
+/// Hands out descriptor sets from lists of pools. Each frame in flight owns its pools, which are
+/// reset wholesale once that frame retires, and a new pool is grabbed whenever the current one runs
+/// out. Persistent sets come from a separate list that is never reset.
+class DescriptorAllocator
+{
+public:
+	DescriptorAllocator(VkDevice device, uint32_t framesInFlight, uint32_t setsPerPool = 64);
+	~DescriptorAllocator();
+
+	void beginFrame(uint32_t frameIndex);
+	VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+	VkDescriptorSet allocatePersistent(VkDescriptorSetLayout layout);
+	VkDescriptorSet getDescriptorSet(VkDescriptorSetLayout layout, const std::vector<DescriptorBinding>& bindings);
+	void writeDescriptorSet(VkDescriptorSet descriptorSet, const std::vector<DescriptorBinding>& bindings);
+	DescriptorAllocatorStats getStats() const { return stats; }
+
+private:
+	struct PoolList
+	{
+		std::vector<VkDescriptorPool> pools;
+		std::unordered_map<DescriptorSetKey, VkDescriptorSet> cache;
+	};
+
+	VkDevice device;
+	uint32_t setsPerPool;
+	uint32_t currentFrame = 0;
+	std::vector<PoolList> frames;
+	PoolList persistent;
+	std::vector<VkDescriptorPool> freePools;
+	uint32_t allocations = 0;
+	uint32_t cacheHits = 0;
+	DescriptorAllocatorStats stats;
+
+	VkDescriptorSet allocateFrom(PoolList& poolList, VkDescriptorSetLayout layout);
+	VkDescriptorPool acquirePool();
+};
+
+/// Writes whole descriptor sets from a struct of DescriptorInfo members declared in binding order,
+/// one vkUpdateDescriptorSetWithTemplate per set instead of a VkWriteDescriptorSet per binding.
+template <typename T>
+class TypedUpdateTemplate
+{
+public:
+	static_assert(std::is_standard_layout<T>::value && sizeof(T) % sizeof(DescriptorInfo) == 0,
+		"descriptor structs must only hold DescriptorInfo members");
+
+	TypedUpdateTemplate() = default;
+
+	TypedUpdateTemplate(VkDevice device, const DescriptorUpdateTemplate& updateTemplate)
+		: device(device), handle(updateTemplate.handle)
+	{
+		if (updateTemplate.descriptorCount * sizeof(DescriptorInfo) != sizeof(T))
+		{
+			throw std::runtime_error("descriptor struct does not match the set layout!");
+		}
+	}
+
+	void update(VkDescriptorSet descriptorSet, const T& descriptors) const
+	{
+		vkUpdateDescriptorSetWithTemplate(device, descriptorSet, handle, &descriptors);
+	}
+
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	VkDescriptorUpdateTemplate handle = VK_NULL_HANDLE;
+};
@@ -0,0 +1,463 @@
+#include "DynamicResolution.h"
+#include "VulkanBase.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+DynamicResolution::DynamicResolution(VulkanBase& base)
+	: base(base)
+{
+	createSceneRenderPass();
+	createUpscaleRenderPass();
+	createPipeline();
+
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.minLod = 0;
+	samplerInfo.maxLod = 0;
+	if (vkCreateSampler(base.device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create upscale sampler!");
+	}
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(base.physicalDevice, &properties);
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(base.physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(base.physicalDevice, &queueFamilyCount, queueFamilies.data());
+	if (queueFamilies[base.queueFamilyIndex.graphicsFamily.value()].timestampValidBits != 0)
+	{
+		timestampPeriod = properties.limits.timestampPeriod;
+	}
+
+	addSwapchainImages();
+	createTarget();
+}
+
+void DynamicResolution::addSwapchainImages()
+{
+	const size_t imageCount = base.swapchainImages.size();
+	if (timestampPeriod > 0.f)
+	{
+		if (queryPool != VK_NULL_HANDLE)
+		{
+			// Frames in flight may still write their timestamps
+			base.retireQueryPool(queryPool);
+		}
+		VkQueryPoolCreateInfo queryPoolCreateInfo = {};
+		queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolCreateInfo.queryCount = static_cast<uint32_t>(imageCount) * TIMESTAMPS_PER_FRAME;
+		if (vkCreateQueryPool(base.device, &queryPoolCreateInfo, nullptr, &queryPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create timestamp query pool!");
+		}
+	}
+	timestampsWritten.assign(imageCount, false);
+	recordedScales.resize(imageCount, 1.f);
+}
+
+DynamicResolution::~DynamicResolution()
+{
+	destroyRetired(true);
+	for (VkFramebuffer framebuffer : upscaleFramebuffers)
+	{
+		vkDestroyFramebuffer(base.device, framebuffer, nullptr);
+	}
+	vkDestroyFramebuffer(base.device, sceneFramebuffer, nullptr);
+	vkDestroyImageView(base.device, view, nullptr);
+	vmaDestroyImage(base.allocator, image, allocation);
+	if (queryPool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(base.device, queryPool, nullptr);
+	}
+	vkDestroySampler(base.device, sampler, nullptr);
+	vkDestroyRenderPass(base.device, sceneRenderPass, nullptr);
+	vkDestroyRenderPass(base.device, upscaleRenderPass, nullptr);
+}
+
+void DynamicResolution::createSceneRenderPass()
+{
+	// Same attachments as the base render pass, the resolve goes to the internal target instead of
+	// the swapchain and is left ready for sampling
+	VkAttachmentDescription colorAttachmentResolve = {};
+	colorAttachmentResolve.format = base.surfaceFormat.format;
+	colorAttachmentResolve.samples = VK_SAMPLE_COUNT_1_BIT;
+	colorAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkAttachmentDescription colorAttachment = {};
+	colorAttachment.format = base.surfaceFormat.format;
+	colorAttachment.samples = base.sampleCount;
+	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentDescription depthAttachment = {};
+	depthAttachment.format = base.depthImageFormat;
+	depthAttachment.samples = base.sampleCount;
+	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	const VkAttachmentDescription attachments[] = {colorAttachmentResolve, colorAttachment, depthAttachment};
+
+	VkAttachmentReference colorAttachmentResolveRef = {0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+	VkAttachmentReference colorAttachmentRef = {1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+	VkAttachmentReference depthAttachmentRef = {2, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+
+	VkSubpassDescription subpassDescription = {};
+	subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpassDescription.colorAttachmentCount = 1;
+	subpassDescription.pColorAttachments = &colorAttachmentRef;
+	subpassDescription.pResolveAttachments = &colorAttachmentResolveRef;
+	subpassDescription.pDepthStencilAttachment = &depthAttachmentRef;
+
+	// The previous frame's upscale has to be done sampling the target before the resolve overwrites
+	// it, and the resolve has to land before this frame's upscale samples it
+	VkSubpassDependency dependencies[2] = {};
+	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[0].dstSubpass = 0;
+	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	dependencies[0].srcAccessMask = 0;
+	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[1].srcSubpass = 0;
+	dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	VkRenderPassCreateInfo renderPassCreateInfo = {};
+	renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassCreateInfo.attachmentCount = 3;
+	renderPassCreateInfo.pAttachments = attachments;
+	renderPassCreateInfo.subpassCount = 1;
+	renderPassCreateInfo.pSubpasses = &subpassDescription;
+	renderPassCreateInfo.dependencyCount = 2;
+	renderPassCreateInfo.pDependencies = dependencies;
+
+	if (vkCreateRenderPass(base.device, &renderPassCreateInfo, nullptr, &sceneRenderPass) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create dynamic resolution scene render pass!");
+	}
+}
+
+void DynamicResolution::createUpscaleRenderPass()
+{
+	// The pass covers every pixel, so nothing of the swapchain image is loaded
+	VkAttachmentDescription swapchainAttachment = {};
+	swapchainAttachment.format = base.surfaceFormat.format;
+	swapchainAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	swapchainAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	swapchainAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	swapchainAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	swapchainAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	swapchainAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	swapchainAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+	VkAttachmentReference swapchainAttachmentRef = {0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+
+	VkSubpassDescription subpassDescription = {};
+	subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpassDescription.colorAttachmentCount = 1;
+	subpassDescription.pColorAttachments = &swapchainAttachmentRef;
+
+	// The layout transition waits for the stage the acquire semaphore is waited on in
+	VkSubpassDependency dependency = {};
+	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependency.dstSubpass = 0;
+	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependency.srcAccessMask = 0;
+	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+	VkRenderPassCreateInfo renderPassCreateInfo = {};
+	renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassCreateInfo.attachmentCount = 1;
+	renderPassCreateInfo.pAttachments = &swapchainAttachment;
+	renderPassCreateInfo.subpassCount = 1;
+	renderPassCreateInfo.pSubpasses = &subpassDescription;
+	renderPassCreateInfo.dependencyCount = 1;
+	renderPassCreateInfo.pDependencies = &dependency;
+
+	if (vkCreateRenderPass(base.device, &renderPassCreateInfo, nullptr, &upscaleRenderPass) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create upscale render pass!");
+	}
+}
+
+void DynamicResolution::createPipeline()
+{
+	vertShader = base.createShaderModule("shaders/upscale_vert.spv");
+	fragShader = base.createShaderModule("shaders/upscale_frag.spv");
+	ReflectedPipelineLayout layout = base.layoutCache->getPipelineLayout({
+		&base.shaderReflections.at(vertShader), &base.shaderReflections.at(fragShader)
+	});
+	pipelineLayout = layout.pipelineLayout;
+	setLayout = layout.setLayouts[0];
+	updateTemplate = TypedUpdateTemplate<UpscaleDescriptors>(
+		base.device, base.layoutCache->getDescriptorUpdateTemplate(setLayout));
+
+	PipelineDescription description;
+	description.vertShader = vertShader;
+	description.fragShader = fragShader;
+	description.cullMode = VK_CULL_MODE_NONE;
+	description.depthTestEnable = VK_FALSE;
+	description.depthWriteEnable = VK_FALSE;
+	description.layout = pipelineLayout;
+	description.renderPass = upscaleRenderPass;
+
+	// Owned by the pipeline cache
+	pipeline = base.pipelineCache->getPipelineBlocking(description);
+	if (pipeline == VK_NULL_HANDLE)
+	{
+		throw std::runtime_error("failed to create upscale pipeline!");
+	}
+}
+
+void DynamicResolution::createTarget()
+{
+	// Full window size, so any scale up to 1 fits without recreating it
+	base.createImage(base.windowWidth, base.windowHeight, 1, VK_SAMPLE_COUNT_1_BIT, base.surfaceFormat.format,
+	                 VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+	                 VMA_MEMORY_USAGE_GPU_ONLY, image, allocation);
+	view = base.createImageView(image, base.surfaceFormat.format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+
+	// The multisampled color and depth of the base are full window size too and reused as they are
+	const VkImageView sceneAttachments[] = {view, base.colorImageView, base.depthImageView};
+	VkFramebufferCreateInfo framebufferCreateInfo = {};
+	framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	framebufferCreateInfo.renderPass = sceneRenderPass;
+	framebufferCreateInfo.attachmentCount = 3;
+	framebufferCreateInfo.pAttachments = sceneAttachments;
+	framebufferCreateInfo.width = base.windowWidth;
+	framebufferCreateInfo.height = base.windowHeight;
+	framebufferCreateInfo.layers = 1;
+	if (vkCreateFramebuffer(base.device, &framebufferCreateInfo, nullptr, &sceneFramebuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create dynamic resolution framebuffer!");
+	}
+
+	upscaleFramebuffers.resize(base.swapchainImageViews.size());
+	for (size_t i = 0; i < upscaleFramebuffers.size(); i++)
+	{
+		framebufferCreateInfo.renderPass = upscaleRenderPass;
+		framebufferCreateInfo.attachmentCount = 1;
+		framebufferCreateInfo.pAttachments = &base.swapchainImageViews[i];
+		if (vkCreateFramebuffer(base.device, &framebufferCreateInfo, nullptr, &upscaleFramebuffers[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create upscale framebuffer!");
+		}
+	}
+}
+
+void DynamicResolution::resize()
+{
+	RetiredTarget retired;
+	retired.retireFrame = base.frameNumber;
+	retired.image = image;
+	retired.allocation = allocation;
+	retired.view = view;
+	retired.sceneFramebuffer = sceneFramebuffer;
+	retired.upscaleFramebuffers = std::move(upscaleFramebuffers);
+	retiredTargets.push_back(std::move(retired));
+
+	createTarget();
+	// The cost per pixel stays about the same, but the average is in terms of the old window size
+	fullResolutionMilliseconds = 0.f;
+}
+
+void DynamicResolution::destroyRetired(bool all)
+{
+	while (!retiredTargets.empty() &&
+		(all || base.frameNumber >= retiredTargets.front().retireFrame + MAX_FRAMES_IN_FLIGHT))
+	{
+		RetiredTarget& retired = retiredTargets.front();
+		for (VkFramebuffer framebuffer : retired.upscaleFramebuffers)
+		{
+			vkDestroyFramebuffer(base.device, framebuffer, nullptr);
+		}
+		vkDestroyFramebuffer(base.device, retired.sceneFramebuffer, nullptr);
+		vkDestroyImageView(base.device, retired.view, nullptr);
+		vmaDestroyImage(base.allocator, retired.image, retired.allocation);
+		retiredTargets.pop_front();
+	}
+}
+
+VkExtent2D DynamicResolution::getRenderExtent() const
+{
+	VkExtent2D extent;
+	extent.width = std::max(1u, static_cast<uint32_t>(base.windowWidth * scale + 0.5f));
+	extent.height = std::max(1u, static_cast<uint32_t>(base.windowHeight * scale + 0.5f));
+	return extent;
+}
+
+void DynamicResolution::beginScene(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	if (queryPool != VK_NULL_HANDLE)
+	{
+		vkCmdResetQueryPool(commandBuffer, queryPool, imageIndex * TIMESTAMPS_PER_FRAME, TIMESTAMPS_PER_FRAME);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool,
+		                    imageIndex * TIMESTAMPS_PER_FRAME);
+		timestampsWritten[imageIndex] = true;
+	}
+	recordedScales[imageIndex] = scale;
+
+	const VkExtent2D extent = getRenderExtent();
+	VkClearValue clearValues[3] = {};
+	clearValues[1].color = {0, 0, 0};
+	clearValues[2].depthStencil = {1, 0};
+
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = sceneRenderPass;
+	renderPassInfo.framebuffer = sceneFramebuffer;
+	renderPassInfo.renderArea.offset = {0, 0};
+	renderPassInfo.renderArea.extent = extent;
+	renderPassInfo.clearValueCount = 3;
+	renderPassInfo.pClearValues = clearValues;
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+	// The aspect ratio is the window's, so the projection needs no change
+	VkViewport viewport = {};
+	viewport.width = static_cast<float>(extent.width);
+	viewport.height = static_cast<float>(extent.height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor = {};
+	scissor.extent = extent;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
+
+void DynamicResolution::endScene(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	vkCmdEndRenderPass(commandBuffer);
+	destroyRetired(false);
+
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = upscaleRenderPass;
+	renderPassInfo.framebuffer = upscaleFramebuffers[imageIndex];
+	renderPassInfo.renderArea.offset = {0, 0};
+	renderPassInfo.renderArea.extent.width = base.windowWidth;
+	renderPassInfo.renderArea.extent.height = base.windowHeight;
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+	VkViewport viewport = {};
+	viewport.width = static_cast<float>(base.windowWidth);
+	viewport.height = static_cast<float>(base.windowHeight);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor = {};
+	scissor.extent = renderPassInfo.renderArea.extent;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	// The target view changes with the swapchain size, so the set is written every frame
+	UpscaleDescriptors descriptors = {};
+	descriptors.sceneColor.image = {sampler, view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+	VkDescriptorSet descriptorSet = base.descriptorAllocator->allocate(setLayout);
+	updateTemplate.update(descriptorSet, descriptors);
+
+	const VkExtent2D extent = getRenderExtent();
+	UpscalePushConstants pushConstants;
+	pushConstants.uvScale = glm::vec2(static_cast<float>(extent.width) / base.windowWidth,
+	                                  static_cast<float>(extent.height) / base.windowHeight);
+	// Half a texel in from the edge of what was rendered
+	pushConstants.uvMax = (glm::vec2(extent.width, extent.height) - 0.5f) /
+		glm::vec2(base.windowWidth, base.windowHeight);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0,
+	                        nullptr);
+	vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(UpscalePushConstants),
+	                   &pushConstants);
+	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+	vkCmdEndRenderPass(commandBuffer);
+
+	if (queryPool != VK_NULL_HANDLE)
+	{
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool,
+		                    imageIndex * TIMESTAMPS_PER_FRAME + 1);
+	}
+}
+
+void DynamicResolution::update(uint32_t imageIndex)
+{
+	uint64_t timestamps[TIMESTAMPS_PER_FRAME];
+	if (timestampsWritten[imageIndex] &&
+		vkGetQueryPoolResults(base.device, queryPool, imageIndex * TIMESTAMPS_PER_FRAME, TIMESTAMPS_PER_FRAME,
+		                      sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+	{
+		const float toMilliseconds = timestampPeriod / 1000000.f;
+		updateScale(static_cast<float>(timestamps[1] - timestamps[0]) * toMilliseconds, recordedScales[imageIndex]);
+	}
+	if (!scalingEnabled)
+	{
+		scale = maxScale;
+	}
+
+	const VkExtent2D extent = getRenderExtent();
+	stats.targetMilliseconds = targetMilliseconds;
+	stats.scale = scale;
+	stats.renderWidth = extent.width;
+	stats.renderHeight = extent.height;
+}
+
+void DynamicResolution::updateScale(float gpuMilliseconds, float recordedScale)
+{
+	stats.gpuMilliseconds = gpuMilliseconds;
+
+	// Cost is taken to follow the pixel count, so a frame at any scale tells what full resolution costs
+	const float fullResolution = gpuMilliseconds / (recordedScale * recordedScale);
+	fullResolutionMilliseconds = fullResolutionMilliseconds == 0.f
+		                             ? fullResolution
+		                             : fullResolutionMilliseconds + smoothing * (fullResolution -
+			                             fullResolutionMilliseconds);
+	stats.predictedMilliseconds = fullResolutionMilliseconds * scale * scale;
+
+	if (!scalingEnabled || fullResolutionMilliseconds <= 0.f)
+	{
+		return;
+	}
+	if (std::abs(stats.predictedMilliseconds - targetMilliseconds) <= deadband * targetMilliseconds)
+	{
+		return;
+	}
+
+	float desired = std::sqrt(targetMilliseconds / fullResolutionMilliseconds);
+	desired = std::min(std::max(desired, scale - maxStep), scale + maxStep);
+	desired = std::min(std::max(desired, minScale), maxScale);
+	if (desired != scale)
+	{
+		scale = desired;
+		stats.adjustments++;
+	}
+	else
+	{
+		stats.saturatedFrames++;
+	}
+}
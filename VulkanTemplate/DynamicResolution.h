@@ -0,0 +1,127 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <vk_mem_alloc.h>
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <vector>
+#include <deque>
+#include "DescriptorAllocator.h"
+
+class VulkanBase;
+
+struct UpscalePushConstants
+{
+	glm::vec2 uvScale;
+	glm::vec2 uvMax;
+};
+
+struct UpscaleDescriptors
+{
+	DescriptorInfo sceneColor;
+};
+
+struct DynamicResolutionStats
+{
+	float targetMilliseconds = 0.f;
+	/// GPU time of the scene and upscale passes of the last frame read back, zero without timestamp support
+	float gpuMilliseconds = 0.f;
+	/// What the running average of the full resolution cost predicts for the current scale
+	float predictedMilliseconds = 0.f;
+	float scale = 1.f;
+	uint32_t renderWidth = 0;
+	uint32_t renderHeight = 0;
+	/// Frames the scale was changed in, and frames it was held at minScale or maxScale while off target
+	uint32_t adjustments = 0;
+	uint32_t saturatedFrames = 0;
+};
+
+/// Renders the scene into the top left of an internal target at a fraction of the window size and
+/// upscales that into the swapchain with a bilinear pass. The fraction follows the GPU time measured
+/// with timestamps: every frame read back updates a running average of what the frame would cost at
+/// full resolution, taking cost to grow with the pixel count, and the scale moves toward the one that
+/// average says meets targetMilliseconds, at most maxStep per frame and not while within the deadband.
+class DynamicResolution
+{
+public:
+	explicit DynamicResolution(VulkanBase& base);
+	~DynamicResolution();
+
+	/// Compatible with the base render pass, so pipelines made for it draw into the internal target
+	VkRenderPass getSceneRenderPass() const { return sceneRenderPass; }
+
+	/// Begins the scene pass and sets the viewport and scissor to the scaled extent
+	void beginScene(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	/// Ends the scene pass and upscales into the swapchain image
+	void endScene(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	/// Feeds the GPU time of this image's last frame to the controller, call once its fence has signaled
+	void update(uint32_t imageIndex);
+	/// Follows the swapchain size, the old target lives on until the frames using it have retired
+	void resize();
+	/// Makes room for the timestamps of images a recreated swapchain added
+	void addSwapchainImages();
+
+	VkExtent2D getRenderExtent() const;
+	DynamicResolutionStats getStats() const { return stats; }
+
+	float targetMilliseconds = 16.f;
+	float minScale = 0.5f;
+	float maxScale = 1.f;
+	float maxStep = 0.05f;
+	/// Relative error of the prediction the scale is left alone within, so it does not hunt around the target
+	float deadband = 0.05f;
+	/// Weight of the newest frame in the running average
+	float smoothing = 0.2f;
+	/// When off the scene is rendered at maxScale and only the upscale pass is added, for comparison
+	bool scalingEnabled = true;
+
+private:
+	static const uint32_t TIMESTAMPS_PER_FRAME = 2;
+
+	struct RetiredTarget
+	{
+		uint64_t retireFrame;
+		VkImage image;
+		VmaAllocation allocation;
+		VkImageView view;
+		VkFramebuffer sceneFramebuffer;
+		std::vector<VkFramebuffer> upscaleFramebuffers;
+	};
+
+	VulkanBase& base;
+	VkRenderPass sceneRenderPass;
+	VkRenderPass upscaleRenderPass;
+	VkShaderModule vertShader;
+	VkShaderModule fragShader;
+	VkPipelineLayout pipelineLayout;
+	VkDescriptorSetLayout setLayout;
+	VkPipeline pipeline;
+	TypedUpdateTemplate<UpscaleDescriptors> updateTemplate;
+	VkSampler sampler;
+
+	VkImage image = VK_NULL_HANDLE;
+	VmaAllocation allocation = VK_NULL_HANDLE;
+	VkImageView view = VK_NULL_HANDLE;
+	VkFramebuffer sceneFramebuffer = VK_NULL_HANDLE;
+	std::vector<VkFramebuffer> upscaleFramebuffers;
+	std::deque<RetiredTarget> retiredTargets;
+
+	float scale = 1.f;
+	/// Running average of the measured time divided by the pixel fraction it was measured at, 0 until the first
+	float fullResolutionMilliseconds = 0.f;
+	DynamicResolutionStats stats;
+
+	VkQueryPool queryPool = VK_NULL_HANDLE;
+	float timestampPeriod = 0.f;
+	std::vector<bool> timestampsWritten;
+	std::vector<float> recordedScales;
+
+	void createSceneRenderPass();
+	void createUpscaleRenderPass();
+	void createPipeline();
+	void createTarget();
+	void destroyRetired(bool all);
+	void updateScale(float gpuMilliseconds, float recordedScale);
+};
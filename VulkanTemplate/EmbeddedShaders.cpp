@@ -0,0 +1,131 @@
+#include "EmbeddedShaders.h"
+
+#include <unordered_map>
+
+namespace
+{
+	/// Generated from shaders/*.vert|frag|comp by glslc -mfmt=num during the build
+	alignas(4) constexpr uint32_t vertSpv[] = {
+#include "shaders/vert.spv.inc"
+	};
+
+	alignas(4) constexpr uint32_t fragSpv[] = {
+#include "shaders/frag.spv.inc"
+	};
+
+	alignas(4) constexpr uint32_t indirectVertSpv[] = {
+#include "shaders/indirect_vert.spv.inc"
+	};
+
+	alignas(4) constexpr uint32_t cullCompSpv[] = {
+#include "shaders/cull_comp.spv.inc"
+	};
+
+	alignas(4) constexpr uint32_t instancedVertSpv[] = {
+#include "shaders/instanced_vert.spv.inc"
+	};
+
+	alignas(4) constexpr uint32_t hizInitCompSpv[] = {
+#include "shaders/hiz_init_comp.spv.inc"
+	};
+
+	alignas(4) constexpr uint32_t hizInitMsCompSpv[] = {
+#include "shaders/hiz_init_ms_comp.spv.inc"
+	};
+
+	alignas(4) constexpr uint32_t occlusionCullCompSpv[] = {
+#include "shaders/occlusion_cull_comp.spv.inc"
+	};
+
+	alignas(4) constexpr uint32_t upscaleVertSpv[] = {
+#include "shaders/upscale_vert.spv.inc"
+	};
+
+	alignas(4) constexpr uint32_t upscaleFragSpv[] = {
+#include "shaders/upscale_frag.spv.inc"
+	};
+
+	alignas(4) constexpr uint32_t fxaaFragSpv[] = {
+#include "shaders/fxaa_frag.spv.inc"
+	};
+
+	alignas(4) constexpr uint32_t taaFragSpv[] = {
+#include "shaders/taa_frag.spv.inc"
+	};
+
+	alignas(4) constexpr uint32_t downsampleCompSpv[] = {
+#include "shaders/downsample_comp.spv.inc"
+	};
+
+	alignas(4) constexpr uint32_t downsampleMaxCompSpv[] = {
+#include "shaders/downsample_max_comp.spv.inc"
+	};
+
+	alignas(4) constexpr uint32_t downsampleSplitCompSpv[] = {
+#include "shaders/downsample_split_comp.spv.inc"
+	};
+
+	alignas(4) constexpr uint32_t downsampleMaxSplitCompSpv[] = {
+#include "shaders/downsample_max_split_comp.spv.inc"
+	};
+
+	alignas(4) constexpr uint32_t clusteredVertSpv[] = {
+#include "shaders/clustered_vert.spv.inc"
+	};
+
+	alignas(4) constexpr uint32_t clusteredFragSpv[] = {
+#include "shaders/clustered_frag.spv.inc"
+	};
+
+	alignas(4) constexpr uint32_t lightClusterCompSpv[] = {
+#include "shaders/light_cluster_comp.spv.inc"
+	};
+
+	alignas(4) constexpr uint32_t gbufferFragSpv[] = {
+#include "shaders/gbuffer_frag.spv.inc"
+	};
+
+	alignas(4) constexpr uint32_t deferredLightingFragSpv[] = {
+#include "shaders/deferred_lighting_frag.spv.inc"
+	};
+
+	alignas(4) constexpr uint32_t shadowVertSpv[] = {
+#include "shaders/shadow_vert.spv.inc"
+	};
+
+	alignas(4) constexpr uint32_t shadowedFragSpv[] = {
+#include "shaders/shadowed_frag.spv.inc"
+	};
+
+	const std::unordered_map<std::string, EmbeddedShader> embeddedShaders = {
+		{"shaders/vert.spv", {vertSpv, sizeof(vertSpv)}},
+		{"shaders/frag.spv", {fragSpv, sizeof(fragSpv)}},
+		{"shaders/indirect_vert.spv", {indirectVertSpv, sizeof(indirectVertSpv)}},
+		{"shaders/cull_comp.spv", {cullCompSpv, sizeof(cullCompSpv)}},
+		{"shaders/instanced_vert.spv", {instancedVertSpv, sizeof(instancedVertSpv)}},
+		{"shaders/hiz_init_comp.spv", {hizInitCompSpv, sizeof(hizInitCompSpv)}},
+		{"shaders/hiz_init_ms_comp.spv", {hizInitMsCompSpv, sizeof(hizInitMsCompSpv)}},
+		{"shaders/occlusion_cull_comp.spv", {occlusionCullCompSpv, sizeof(occlusionCullCompSpv)}},
+		{"shaders/upscale_vert.spv", {upscaleVertSpv, sizeof(upscaleVertSpv)}},
+		{"shaders/upscale_frag.spv", {upscaleFragSpv, sizeof(upscaleFragSpv)}},
+		{"shaders/fxaa_frag.spv", {fxaaFragSpv, sizeof(fxaaFragSpv)}},
+		{"shaders/taa_frag.spv", {taaFragSpv, sizeof(taaFragSpv)}},
+		{"shaders/downsample_comp.spv", {downsampleCompSpv, sizeof(downsampleCompSpv)}},
+		{"shaders/downsample_max_comp.spv", {downsampleMaxCompSpv, sizeof(downsampleMaxCompSpv)}},
+		{"shaders/downsample_split_comp.spv", {downsampleSplitCompSpv, sizeof(downsampleSplitCompSpv)}},
+		{"shaders/downsample_max_split_comp.spv", {downsampleMaxSplitCompSpv, sizeof(downsampleMaxSplitCompSpv)}},
+		{"shaders/clustered_vert.spv", {clusteredVertSpv, sizeof(clusteredVertSpv)}},
+		{"shaders/clustered_frag.spv", {clusteredFragSpv, sizeof(clusteredFragSpv)}},
+		{"shaders/light_cluster_comp.spv", {lightClusterCompSpv, sizeof(lightClusterCompSpv)}},
+		{"shaders/gbuffer_frag.spv", {gbufferFragSpv, sizeof(gbufferFragSpv)}},
+		{"shaders/deferred_lighting_frag.spv", {deferredLightingFragSpv, sizeof(deferredLightingFragSpv)}},
+		{"shaders/shadow_vert.spv", {shadowVertSpv, sizeof(shadowVertSpv)}},
+		{"shaders/shadowed_frag.spv", {shadowedFragSpv, sizeof(shadowedFragSpv)}},
+	};
+}
+
+const EmbeddedShader* findEmbeddedShader(const std::string& name)
+{
+	auto it = embeddedShaders.find(name);
+	return it != embeddedShaders.end() ? &it->second : nullptr;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+struct EmbeddedShader
+{
+	const uint32_t* code;
+	size_t codeSize;
+};
+
+/// SPIR-V compiled into the executable at build time, looked up by the path it would have on disk
+/// (e.g. "shaders/vert.spv"). Returns nullptr if no shader with that name was embedded.
+const EmbeddedShader* findEmbeddedShader(const std::string& name);
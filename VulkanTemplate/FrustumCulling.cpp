@@ -0,0 +1,259 @@
+#include "FrustumCulling.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+#include <immintrin.h>
+const uint32_t CULL_SIMD_WIDTH = 8;
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+#include <emmintrin.h>
+const uint32_t CULL_SIMD_WIDTH = 4;
+#else
+const uint32_t CULL_SIMD_WIDTH = 1;
+#endif
+
+namespace
+{
+	/// Storage is always padded to the widest SIMD path so the arrays do not depend on the build
+	const uint32_t BOUNDS_PADDING = 8;
+
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+	using Lanes = __m256;
+	const int ALL_LANES = 0xff;
+
+	inline Lanes load(const float* data) { return _mm256_loadu_ps(data); }
+	inline Lanes splat(float value) { return _mm256_set1_ps(value); }
+	inline Lanes add(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+	inline Lanes mul(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+	inline Lanes negate(Lanes a) { return _mm256_sub_ps(_mm256_setzero_ps(), a); }
+	inline int greaterMask(Lanes a, Lanes b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_GT_OQ)); }
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+	using Lanes = __m128;
+	const int ALL_LANES = 0xf;
+
+	inline Lanes load(const float* data) { return _mm_loadu_ps(data); }
+	inline Lanes splat(float value) { return _mm_set1_ps(value); }
+	inline Lanes add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+	inline Lanes mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+	inline Lanes negate(Lanes a) { return _mm_sub_ps(_mm_setzero_ps(), a); }
+	inline int greaterMask(Lanes a, Lanes b) { return _mm_movemask_ps(_mm_cmpgt_ps(a, b)); }
+#endif
+
+#if GLM_ARCH & (GLM_ARCH_AVX_BIT | GLM_ARCH_SSE2_BIT)
+	inline void appendLanes(int mask, uint32_t first, uint32_t end, std::vector<uint32_t>& visible)
+	{
+		for (uint32_t lane = 0; mask != 0; lane++, mask >>= 1)
+		{
+			if ((mask & 1) && first + lane < end)
+			{
+				visible.push_back(first + lane);
+			}
+		}
+	}
+
+	void cullSpheres(const BoundsSoA& bounds, const glm::vec4 planes[6], uint32_t begin, uint32_t end,
+	                 std::vector<uint32_t>& visible)
+	{
+		Lanes planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (int p = 0; p < 6; p++)
+		{
+			planeX[p] = splat(planes[p].x);
+			planeY[p] = splat(planes[p].y);
+			planeZ[p] = splat(planes[p].z);
+			planeW[p] = splat(planes[p].w);
+		}
+
+		for (uint32_t i = begin; i < end; i += CULL_SIMD_WIDTH)
+		{
+			const Lanes x = load(&bounds.centerX[i]);
+			const Lanes y = load(&bounds.centerY[i]);
+			const Lanes z = load(&bounds.centerZ[i]);
+			const Lanes negativeRadius = negate(load(&bounds.radius[i]));
+
+			int mask = ALL_LANES;
+			for (int p = 0; p < 6 && mask != 0; p++)
+			{
+				const Lanes distance = add(add(mul(x, planeX[p]), mul(y, planeY[p])),
+				                           add(mul(z, planeZ[p]), planeW[p]));
+				mask &= greaterMask(distance, negativeRadius);
+			}
+			appendLanes(mask, i, end, visible);
+		}
+	}
+
+	void cullAabbs(const BoundsSoA& bounds, const glm::vec4 planes[6], uint32_t begin, uint32_t end,
+	               std::vector<uint32_t>& visible)
+	{
+		// The corner farthest along a plane normal is the same for every box, so pick its arrays once
+		const float* cornerX[6];
+		const float* cornerY[6];
+		const float* cornerZ[6];
+		Lanes planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (int p = 0; p < 6; p++)
+		{
+			cornerX[p] = planes[p].x > 0.f ? bounds.maxX.data() : bounds.minX.data();
+			cornerY[p] = planes[p].y > 0.f ? bounds.maxY.data() : bounds.minY.data();
+			cornerZ[p] = planes[p].z > 0.f ? bounds.maxZ.data() : bounds.minZ.data();
+			planeX[p] = splat(planes[p].x);
+			planeY[p] = splat(planes[p].y);
+			planeZ[p] = splat(planes[p].z);
+			planeW[p] = splat(-planes[p].w);
+		}
+
+		for (uint32_t i = begin; i < end; i += CULL_SIMD_WIDTH)
+		{
+			int mask = ALL_LANES;
+			for (int p = 0; p < 6 && mask != 0; p++)
+			{
+				const Lanes distance = add(add(mul(load(cornerX[p] + i), planeX[p]),
+				                               mul(load(cornerY[p] + i), planeY[p])),
+				                           mul(load(cornerZ[p] + i), planeZ[p]));
+				mask &= greaterMask(distance, planeW[p]);
+			}
+			appendLanes(mask, i, end, visible);
+		}
+	}
+#endif
+}
+
+void extractFrustumPlanes(const glm::mat4& viewProj, glm::vec4 planes[6])
+{
+	const glm::vec4 row0(viewProj[0][0], viewProj[1][0], viewProj[2][0], viewProj[3][0]);
+	const glm::vec4 row1(viewProj[0][1], viewProj[1][1], viewProj[2][1], viewProj[3][1]);
+	const glm::vec4 row2(viewProj[0][2], viewProj[1][2], viewProj[2][2], viewProj[3][2]);
+	const glm::vec4 row3(viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]);
+
+	planes[0] = row3 + row0;
+	planes[1] = row3 - row0;
+	planes[2] = row3 + row1;
+	planes[3] = row3 - row1;
+	planes[4] = row2;
+	planes[5] = row3 - row2;
+	for (int i = 0; i < 6; i++)
+	{
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+}
+
+bool isSphereVisible(const glm::vec4 planes[6], const glm::vec4& sphere)
+{
+	for (int i = 0; i < 6; i++)
+	{
+		if (glm::dot(glm::vec3(planes[i]), glm::vec3(sphere)) + planes[i].w <= -sphere.w)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool isAabbVisible(const glm::vec4 planes[6], const glm::vec3& min, const glm::vec3& max)
+{
+	for (int i = 0; i < 6; i++)
+	{
+		const glm::vec3 corner(planes[i].x > 0.f ? max.x : min.x, planes[i].y > 0.f ? max.y : min.y,
+		                       planes[i].z > 0.f ? max.z : min.z);
+		if (glm::dot(glm::vec3(planes[i]), corner) <= -planes[i].w)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void BoundsSoA::resize(uint32_t count)
+{
+	this->count = count;
+	const size_t paddedCount = (count + BOUNDS_PADDING - 1) / BOUNDS_PADDING * BOUNDS_PADDING;
+	for (auto* component : {
+		     &centerX, &centerY, &centerZ, &radius, &minX, &minY, &minZ, &maxX, &maxY, &maxZ
+	     })
+	{
+		component->resize(paddedCount, 0.f);
+	}
+}
+
+void BoundsSoA::setSphere(uint32_t index, const glm::vec3& center, float sphereRadius)
+{
+	centerX[index] = center.x;
+	centerY[index] = center.y;
+	centerZ[index] = center.z;
+	radius[index] = sphereRadius;
+}
+
+void BoundsSoA::setAabb(uint32_t index, const glm::vec3& min, const glm::vec3& max)
+{
+	minX[index] = min.x;
+	minY[index] = min.y;
+	minZ[index] = min.z;
+	maxX[index] = max.x;
+	maxY[index] = max.y;
+	maxZ[index] = max.z;
+}
+
+void cullRange(const BoundsSoA& bounds, BoundingVolume volume, const glm::vec4 planes[6], uint32_t begin,
+               uint32_t end, std::vector<uint32_t>& visible)
+{
+#if GLM_ARCH & (GLM_ARCH_AVX_BIT | GLM_ARCH_SSE2_BIT)
+	if (volume == BoundingVolume::Sphere)
+	{
+		cullSpheres(bounds, planes, begin, end, visible);
+	}
+	else
+	{
+		cullAabbs(bounds, planes, begin, end, visible);
+	}
+#else
+	for (uint32_t i = begin; i < end; i++)
+	{
+		const bool isVisible = volume == BoundingVolume::Sphere
+			                       ? isSphereVisible(planes, glm::vec4(bounds.centerX[i], bounds.centerY[i],
+			                                                           bounds.centerZ[i], bounds.radius[i]))
+			                       : isAabbVisible(planes, glm::vec3(bounds.minX[i], bounds.minY[i], bounds.minZ[i]),
+			                                       glm::vec3(bounds.maxX[i], bounds.maxY[i], bounds.maxZ[i]));
+		if (isVisible)
+		{
+			visible.push_back(i);
+		}
+	}
+#endif
+}
+
+FrustumCuller::FrustumCuller(JobSystem* jobSystem, uint32_t batchSize)
+	: jobSystem(jobSystem),
+	  batchSize((std::max(batchSize, CULL_SIMD_WIDTH) + CULL_SIMD_WIDTH - 1) / CULL_SIMD_WIDTH * CULL_SIMD_WIDTH)
+{
+}
+
+void FrustumCuller::cull(const BoundsSoA& bounds, BoundingVolume volume, const glm::mat4& viewProj,
+                         std::vector<uint32_t>& visible)
+{
+	glm::vec4 planes[6];
+	extractFrustumPlanes(viewProj, planes);
+	visible.clear();
+
+	const uint32_t count = bounds.size();
+	if (jobSystem == nullptr || count <= batchSize)
+	{
+		cullRange(bounds, volume, planes, 0, count, visible);
+		return;
+	}
+
+	// Each batch fills its own list, concatenating them in order keeps the result sorted
+	const uint32_t batchCount = (count + batchSize - 1) / batchSize;
+	if (batchResults.size() < batchCount)
+	{
+		batchResults.resize(batchCount);
+	}
+	jobSystem->parallelFor(count, batchSize, [&](uint32_t begin, uint32_t end)
+	{
+		std::vector<uint32_t>& result = batchResults[begin / batchSize];
+		result.clear();
+		cullRange(bounds, volume, planes, begin, end, result);
+	});
+	for (uint32_t i = 0; i < batchCount; i++)
+	{
+		visible.insert(visible.end(), batchResults[i].begin(), batchResults[i].end());
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <vector>
+
+class JobSystem;
+
+/// Normalized left, right, bottom, top, near, far planes of a view projection with 0..1 depth.
+void extractFrustumPlanes(const glm::mat4& viewProj, glm::vec4 planes[6]);
+bool isSphereVisible(const glm::vec4 planes[6], const glm::vec4& sphere);
+bool isAabbVisible(const glm::vec4 planes[6], const glm::vec3& min, const glm::vec3& max);
+
+enum class BoundingVolume
+{
+	Sphere,
+	Aabb
+};
+
+/// Object bounds as structure of arrays, so one SIMD register holds the same component of several
+/// objects. Arrays are padded to a multiple of 8, the widest SIMD path, whatever CULL_SIMD_WIDTH the
+/// build uses. Padding lanes are never reported.
+struct BoundsSoA
+{
+	std::vector<float> centerX, centerY, centerZ, radius;
+	std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+
+	void resize(uint32_t count);
+	uint32_t size() const { return count; }
+	void setSphere(uint32_t index, const glm::vec3& center, float sphereRadius);
+	void setAabb(uint32_t index, const glm::vec3& min, const glm::vec3& max);
+
+private:
+	uint32_t count = 0;
+};
+
+/// Lanes tested per SIMD instruction, 8 with AVX, 4 with SSE2 and 1 without either.
+extern const uint32_t CULL_SIMD_WIDTH;
+
+/// Appends the indices of objects in [begin, end) that intersect the frustum, in ascending order.
+/// begin has to be a multiple of CULL_SIMD_WIDTH.
+void cullRange(const BoundsSoA& bounds, BoundingVolume volume, const glm::vec4 planes[6], uint32_t begin,
+               uint32_t end, std::vector<uint32_t>& visible);
+
+/// Tests every object against the frustum and returns the visible ones in ascending order. With a
+/// job system the objects are split into batches culled in parallel, then concatenated.
+class FrustumCuller
+{
+public:
+	explicit FrustumCuller(JobSystem* jobSystem = nullptr, uint32_t batchSize = 4096);
+
+	void cull(const BoundsSoA& bounds, BoundingVolume volume, const glm::mat4& viewProj,
+	          std::vector<uint32_t>& visible);
+
+private:
+	JobSystem* jobSystem;
+	uint32_t batchSize;
+	std::vector<std::vector<uint32_t>> batchResults;
+};
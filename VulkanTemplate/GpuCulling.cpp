@@ -0,0 +1,141 @@
+#include "GpuCulling.h"
+#include "VulkanBase.h"
+
+#include <stdexcept>
+
+GpuCulling::GpuCulling(VulkanBase& base, uint32_t maxObjects)
+	: base(base), maxObjects(maxObjects)
+{
+	if (!base.enabledFeatures.multiDrawIndirect || !base.enabledFeatures.drawIndirectFirstInstance)
+	{
+		throw std::runtime_error("gpu culling needs multiDrawIndirect and drawIndirectFirstInstance!");
+	}
+	compact = base.drawIndirectCountSupported;
+
+	cullShader = base.createShaderModule("shaders/cull_comp.spv");
+	ReflectedPipelineLayout layout = base.layoutCache->getPipelineLayout({&base.shaderReflections.at(cullShader)});
+	pipelineLayout = layout.pipelineLayout;
+
+	pipeline = base.createComputePipeline(cullShader, pipelineLayout);
+	setLayout = layout.setLayouts[0];
+
+	addSwapchainImages();
+}
+
+void GpuCulling::addSwapchainImages()
+{
+	TypedUpdateTemplate<CullDescriptors> updateTemplate(
+		base.device, base.layoutCache->getDescriptorUpdateTemplate(setLayout));
+
+	const size_t firstImage = descriptorSets.size();
+	const size_t imageCount = base.swapchainImages.size();
+	descriptorSets.resize(imageCount);
+	objectBuffers.resize(imageCount);
+	objectBufferAllocations.resize(imageCount);
+	mappedObjects.resize(imageCount);
+	drawCommandBuffers.resize(imageCount);
+	drawCommandBufferAllocations.resize(imageCount);
+	drawCountBuffers.resize(imageCount);
+	drawCountBufferAllocations.resize(imageCount);
+	for (size_t i = firstImage; i < imageCount; i++)
+	{
+		base.createBuffer(sizeof(GpuObject) * maxObjects, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		                  VMA_MEMORY_USAGE_CPU_TO_GPU, objectBuffers[i], objectBufferAllocations[i]);
+		void* data;
+		vmaMapMemory(base.allocator, objectBufferAllocations[i], &data);
+		mappedObjects[i] = static_cast<GpuObject*>(data);
+
+		base.createBuffer(sizeof(VkDrawIndexedIndirectCommand) * maxObjects,
+		                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		                  VMA_MEMORY_USAGE_GPU_ONLY, drawCommandBuffers[i], drawCommandBufferAllocations[i]);
+		// Read back for stats, so it lives in host visible memory
+		base.createBuffer(sizeof(uint32_t),
+		                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+		                  VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		                  VMA_MEMORY_USAGE_GPU_TO_CPU, drawCountBuffers[i], drawCountBufferAllocations[i]);
+
+		CullDescriptors descriptors = {};
+		descriptors.objects.buffer = {objectBuffers[i], 0, VK_WHOLE_SIZE};
+		descriptors.drawCommands.buffer = {drawCommandBuffers[i], 0, VK_WHOLE_SIZE};
+		descriptors.drawCount.buffer = {drawCountBuffers[i], 0, VK_WHOLE_SIZE};
+		descriptorSets[i] = base.descriptorAllocator->allocatePersistent(setLayout);
+		updateTemplate.update(descriptorSets[i], descriptors);
+	}
+}
+
+GpuCulling::~GpuCulling()
+{
+	for (size_t i = 0; i < objectBuffers.size(); i++)
+	{
+		vmaUnmapMemory(base.allocator, objectBufferAllocations[i]);
+		vmaDestroyBuffer(base.allocator, objectBuffers[i], objectBufferAllocations[i]);
+		vmaDestroyBuffer(base.allocator, drawCommandBuffers[i], drawCommandBufferAllocations[i]);
+		vmaDestroyBuffer(base.allocator, drawCountBuffers[i], drawCountBufferAllocations[i]);
+	}
+	vkDestroyPipeline(base.device, pipeline, nullptr);
+}
+
+void GpuCulling::recordCulling(VkCommandBuffer commandBuffer, uint32_t imageIndex, const glm::mat4& viewProj,
+                               uint32_t objectCount)
+{
+	if (objectCount > maxObjects)
+	{
+		throw std::runtime_error("too many objects for gpu culling!");
+	}
+
+	vmaFlushAllocation(base.allocator, objectBufferAllocations[imageIndex], 0, sizeof(GpuObject) * objectCount);
+	vkCmdFillBuffer(commandBuffer, drawCountBuffers[imageIndex], 0, sizeof(uint32_t), 0);
+
+	// The cleared count has to land before the shader starts incrementing it
+	VkMemoryBarrier clearBarrier = {};
+	clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+	                     &clearBarrier, 0, nullptr, 0, nullptr);
+
+	CullPushConstants pushConstants = {};
+	extractFrustumPlanes(viewProj, pushConstants.frustumPlanes);
+	pushConstants.objectCount = objectCount;
+	pushConstants.compact = compact ? 1 : 0;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1,
+	                        &descriptorSets[imageIndex], 0, nullptr);
+	vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants),
+	                   &pushConstants);
+	vkCmdDispatch(commandBuffer, (objectCount + 63) / 64, 1, 1);
+
+	VkMemoryBarrier cullBarrier = {};
+	cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	                     VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &cullBarrier, 0,
+	                     nullptr, 0, nullptr);
+}
+
+void GpuCulling::recordDraws(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t objectCount)
+{
+	if (compact)
+	{
+		base.cmdDrawIndexedIndirectCount(commandBuffer, drawCommandBuffers[imageIndex], 0,
+		                                 drawCountBuffers[imageIndex], 0, objectCount,
+		                                 sizeof(VkDrawIndexedIndirectCommand));
+	}
+	else
+	{
+		vkCmdDrawIndexedIndirect(commandBuffer, drawCommandBuffers[imageIndex], 0, objectCount,
+		                         sizeof(VkDrawIndexedIndirectCommand));
+	}
+}
+
+uint32_t GpuCulling::readVisibleCount(uint32_t imageIndex)
+{
+	void* data;
+	vmaMapMemory(base.allocator, drawCountBufferAllocations[imageIndex], &data);
+	vmaInvalidateAllocation(base.allocator, drawCountBufferAllocations[imageIndex], 0, sizeof(uint32_t));
+	uint32_t visibleCount = *static_cast<uint32_t*>(data);
+	vmaUnmapMemory(base.allocator, drawCountBufferAllocations[imageIndex]);
+	return visibleCount;
+}
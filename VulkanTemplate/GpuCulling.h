@@ -0,0 +1,77 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <vk_mem_alloc.h>
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <vector>
+#include "DescriptorAllocator.h"
+#include "FrustumCulling.h"
+
+class VulkanBase;
+
+/// Per-object data read by the culling shader and the indirect vertex shader, std430 layout.
+struct GpuObject
+{
+	glm::mat4 model;
+	glm::vec4 boundingSphere;
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	uint32_t padding;
+};
+
+struct CullPushConstants
+{
+	glm::vec4 frustumPlanes[6];
+	uint32_t objectCount;
+	uint32_t compact;
+};
+
+struct CullDescriptors
+{
+	DescriptorInfo objects;
+	DescriptorInfo drawCommands;
+	DescriptorInfo drawCount;
+};
+
+/// Frustum culls objects on the GPU and turns the survivors into indirect draw commands. Uses
+/// vkCmdDrawIndexedIndirectCount when available, otherwise every object keeps a command slot and
+/// culled ones draw zero instances. Buffers exist once per swapchain image.
+class GpuCulling
+{
+public:
+	GpuCulling(VulkanBase& base, uint32_t maxObjects);
+	~GpuCulling();
+
+	GpuObject* getObjects(uint32_t imageIndex) { return mappedObjects[imageIndex]; }
+	VkBuffer getObjectBuffer(uint32_t imageIndex) const { return objectBuffers[imageIndex]; }
+	VmaAllocation getObjectAllocation(uint32_t imageIndex) const { return objectBufferAllocations[imageIndex]; }
+	uint32_t getMaxObjects() const { return maxObjects; }
+
+	void recordCulling(VkCommandBuffer commandBuffer, uint32_t imageIndex, const glm::mat4& viewProj,
+	                   uint32_t objectCount);
+	void recordDraws(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t objectCount);
+	uint32_t readVisibleCount(uint32_t imageIndex);
+	/// Creates the buffers of swapchain images that have none yet
+	void addSwapchainImages();
+
+private:
+	VulkanBase& base;
+	uint32_t maxObjects;
+	bool compact;
+	VkShaderModule cullShader;
+	VkPipelineLayout pipelineLayout;
+	VkPipeline pipeline;
+	VkDescriptorSetLayout setLayout;
+	std::vector<VkDescriptorSet> descriptorSets;
+	std::vector<VkBuffer> objectBuffers;
+	std::vector<VmaAllocation> objectBufferAllocations;
+	std::vector<GpuObject*> mappedObjects;
+	std::vector<VkBuffer> drawCommandBuffers;
+	std::vector<VmaAllocation> drawCommandBufferAllocations;
+	std::vector<VkBuffer> drawCountBuffers;
+	std::vector<VmaAllocation> drawCountBufferAllocations;
+};
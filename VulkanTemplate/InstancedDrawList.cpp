@@ -0,0 +1,46 @@
+#include "InstancedDrawList.h"
+
+void InstancedDrawList::clear()
+{
+	drawIndices.clear();
+	submitted.clear();
+	submittedDraws.clear();
+	draws.clear();
+}
+
+void InstancedDrawList::add(uint32_t mesh, uint32_t material, const glm::mat4& model)
+{
+	const uint64_t key = static_cast<uint64_t>(mesh) << 32 | material;
+	auto it = drawIndices.find(key);
+	if (it == drawIndices.end())
+	{
+		it = drawIndices.emplace(key, static_cast<uint32_t>(draws.size())).first;
+		draws.push_back({mesh, material, 0, 0});
+	}
+
+	draws[it->second].instanceCount++;
+	submitted.push_back({model, material});
+	submittedDraws.push_back(it->second);
+}
+
+void InstancedDrawList::build()
+{
+	// Counting sort: every draw knows its size, so each instance goes straight to its final slot
+	uint32_t firstInstance = 0;
+	for (auto& draw : draws)
+	{
+		draw.firstInstance = firstInstance;
+		firstInstance += draw.instanceCount;
+	}
+
+	instances.resize(submitted.size());
+	nextSlots.resize(draws.size());
+	for (size_t i = 0; i < draws.size(); i++)
+	{
+		nextSlots[i] = draws[i].firstInstance;
+	}
+	for (size_t i = 0; i < submitted.size(); i++)
+	{
+		instances[nextSlots[submittedDraws[i]]++] = submitted[i];
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <vector>
+#include <unordered_map>
+
+/// Per-instance vertex data, read through a VK_VERTEX_INPUT_RATE_INSTANCE binding. Tightly packed
+/// to match the attribute offsets reflected from the shader.
+struct InstanceData
+{
+	glm::mat4 model;
+	uint32_t materialIndex;
+};
+
+static_assert(sizeof(InstanceData) == sizeof(glm::mat4) + sizeof(uint32_t), "instance data must be tightly packed");
+
+/// One vkCmdDraw covering every instance of a mesh and material pair.
+struct InstancedDraw
+{
+	uint32_t mesh;
+	uint32_t material;
+	uint32_t firstInstance;
+	uint32_t instanceCount;
+};
+
+/// Collects per-object draws for a frame and merges the ones sharing a mesh and material into
+/// instanced draws. build() lays the instances of each draw out contiguously in one array that can
+/// be copied straight into the instance buffer.
+class InstancedDrawList
+{
+public:
+	void clear();
+	void add(uint32_t mesh, uint32_t material, const glm::mat4& model);
+	void build();
+
+	const std::vector<InstanceData>& getInstances() const { return instances; }
+	const std::vector<InstancedDraw>& getDraws() const { return draws; }
+	uint32_t getSubmittedCount() const { return static_cast<uint32_t>(submitted.size()); }
+
+private:
+	std::unordered_map<uint64_t, uint32_t> drawIndices;
+	std::vector<InstanceData> submitted;
+	std::vector<uint32_t> submittedDraws;
+	std::vector<InstancedDraw> draws;
+	std::vector<InstanceData> instances;
+	std::vector<uint32_t> nextSlots;
+};
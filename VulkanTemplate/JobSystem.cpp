@@ -0,0 +1,103 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+
+JobSystem::JobSystem(uint32_t workerCount)
+{
+	for (uint32_t i = 0; i < workerCount; i++)
+	{
+		workers.emplace_back(&JobSystem::workerLoop, this);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	workCondition.notify_all();
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+void JobSystem::parallelFor(uint32_t count, uint32_t batchSize, const RangeJob& job)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	batchSize = std::max(1u, batchSize);
+	const uint32_t batchCount = (count + batchSize - 1) / batchSize;
+	if (batchCount == 1 || workers.empty())
+	{
+		for (uint32_t begin = 0; begin < count; begin += batchSize)
+		{
+			job(begin, std::min(begin + batchSize, count));
+		}
+		return;
+	}
+
+	{
+		// A worker that woke up late for the previous loop may still hold its job
+		std::unique_lock<std::mutex> lock(mutex);
+		doneCondition.wait(lock, [&] { return activeWorkers == 0; });
+		this->job = &job;
+		this->count = count;
+		this->batchSize = batchSize;
+		this->batchCount = batchCount;
+		nextBatch = 0;
+		generation++;
+	}
+	workCondition.notify_all();
+
+	runBatches(job, count, batchSize, batchCount);
+
+	// Every batch was claimed, wait for the workers still running theirs
+	std::unique_lock<std::mutex> lock(mutex);
+	doneCondition.wait(lock, [&] { return activeWorkers == 0; });
+}
+
+void JobSystem::workerLoop()
+{
+	uint64_t lastGeneration = 0;
+	while (true)
+	{
+		const RangeJob* currentJob;
+		uint32_t currentCount, currentBatchSize, currentBatchCount;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			workCondition.wait(lock, [&] { return stopping || generation != lastGeneration; });
+			if (stopping)
+			{
+				return;
+			}
+			lastGeneration = generation;
+			currentJob = job;
+			currentCount = count;
+			currentBatchSize = batchSize;
+			currentBatchCount = batchCount;
+			activeWorkers++;
+		}
+
+		runBatches(*currentJob, currentCount, currentBatchSize, currentBatchCount);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			activeWorkers--;
+		}
+		doneCondition.notify_all();
+	}
+}
+
+void JobSystem::runBatches(const RangeJob& job, uint32_t count, uint32_t batchSize, uint32_t batchCount)
+{
+	uint32_t batch;
+	while ((batch = nextBatch.fetch_add(1)) < batchCount)
+	{
+		const uint32_t begin = batch * batchSize;
+		job(begin, std::min(begin + batchSize, count));
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+/// Fixed pool of worker threads for data parallel loops. parallelFor cuts a range into batches that
+/// workers and the calling thread pull until none are left, and returns once all of them ran.
+/// Jobs must not call parallelFor themselves.
+class JobSystem
+{
+public:
+	using RangeJob = std::function<void(uint32_t begin, uint32_t end)>;
+
+	explicit JobSystem(uint32_t workerCount);
+	~JobSystem();
+
+	void parallelFor(uint32_t count, uint32_t batchSize, const RangeJob& job);
+	/// Workers plus the calling thread
+	uint32_t getThreadCount() const { return static_cast<uint32_t>(workers.size()) + 1; }
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable workCondition;
+	std::condition_variable doneCondition;
+	const RangeJob* job = nullptr;
+	uint32_t count = 0;
+	uint32_t batchSize = 1;
+	uint32_t batchCount = 0;
+	std::atomic<uint32_t> nextBatch{0};
+	uint64_t generation = 0;
+	uint32_t activeWorkers = 0;
+	bool stopping = false;
+
+	void workerLoop();
+	void runBatches(const RangeJob& job, uint32_t count, uint32_t batchSize, uint32_t batchCount);
+};
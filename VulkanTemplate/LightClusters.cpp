@@ -0,0 +1,286 @@
+#include "LightClusters.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+#include <immintrin.h>
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	/// Storage is always padded to the widest SIMD path so the arrays do not depend on the build
+	const uint32_t BOUNDS_PADDING = 8;
+
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+	const uint32_t SIMD_WIDTH = 8;
+	using Lanes = __m256;
+
+	inline Lanes load(const float* data) { return _mm256_loadu_ps(data); }
+	inline Lanes splat(float value) { return _mm256_set1_ps(value); }
+	inline Lanes add(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+	inline Lanes sub(Lanes a, Lanes b) { return _mm256_sub_ps(a, b); }
+	inline Lanes mul(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+	inline Lanes max(Lanes a, Lanes b) { return _mm256_max_ps(a, b); }
+	inline Lanes zero() { return _mm256_setzero_ps(); }
+	inline int lessEqualMask(Lanes a, Lanes b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LE_OQ)); }
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+	const uint32_t SIMD_WIDTH = 4;
+	using Lanes = __m128;
+
+	inline Lanes load(const float* data) { return _mm_loadu_ps(data); }
+	inline Lanes splat(float value) { return _mm_set1_ps(value); }
+	inline Lanes add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+	inline Lanes sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+	inline Lanes mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+	inline Lanes max(Lanes a, Lanes b) { return _mm_max_ps(a, b); }
+	inline Lanes zero() { return _mm_setzero_ps(); }
+	inline int lessEqualMask(Lanes a, Lanes b) { return _mm_movemask_ps(_mm_cmple_ps(a, b)); }
+#else
+	const uint32_t SIMD_WIDTH = 1;
+	using Lanes = float;
+
+	inline Lanes load(const float* data) { return *data; }
+	inline Lanes splat(float value) { return value; }
+	inline Lanes add(Lanes a, Lanes b) { return a + b; }
+	inline Lanes sub(Lanes a, Lanes b) { return a - b; }
+	inline Lanes mul(Lanes a, Lanes b) { return a * b; }
+	inline Lanes max(Lanes a, Lanes b) { return a > b ? a : b; }
+	inline Lanes zero() { return 0.f; }
+	inline int lessEqualMask(Lanes a, Lanes b) { return a <= b ? 1 : 0; }
+#endif
+
+	/// Distance along one axis from the center to the box, zero inside it
+	inline Lanes axisDistance(Lanes center, const float* boxMin, const float* boxMax)
+	{
+		return max(max(sub(load(boxMin), center), sub(center, load(boxMax))), zero());
+	}
+}
+
+float ClusterGrid::getSliceScale() const
+{
+	return slices / std::log(farPlane / nearPlane);
+}
+
+float ClusterGrid::getSliceBias() const
+{
+	return -(slices * std::log(nearPlane)) / std::log(farPlane / nearPlane);
+}
+
+uint32_t ClusterGrid::getSlice(float depth) const
+{
+	const float slice = std::log(std::max(depth, nearPlane)) * getSliceScale() + getSliceBias();
+	return std::min(static_cast<uint32_t>(std::max(slice, 0.f)), slices - 1);
+}
+
+LightBinner::LightBinner(JobSystem* jobSystem, uint32_t batchSize)
+	: jobSystem(jobSystem), batchSize(batchSize)
+{
+}
+
+void LightBinner::setGrid(const ClusterGrid& clusterGrid, const glm::mat4& proj)
+{
+	grid = clusterGrid;
+	projection = proj;
+	const uint32_t clusterCount = grid.getClusterCount();
+	const uint32_t paddedCount = (clusterCount + BOUNDS_PADDING - 1) / BOUNDS_PADDING * BOUNDS_PADDING;
+	for (std::vector<float>* component : {&minX, &minY, &minZ, &maxX, &maxY, &maxZ})
+	{
+		component->assign(paddedCount, 0.f);
+	}
+
+	// Direction through every tile corner, scaled to a view space depth of 1
+	const glm::mat4 inverseProj = glm::inverse(proj);
+	std::vector<glm::vec3> cornerDirections((grid.tilesX + 1) * (grid.tilesY + 1));
+	for (uint32_t y = 0; y <= grid.tilesY; y++)
+	{
+		for (uint32_t x = 0; x <= grid.tilesX; x++)
+		{
+			const glm::vec4 corner = inverseProj * glm::vec4(-1.f + 2.f * x / grid.tilesX,
+			                                                 -1.f + 2.f * y / grid.tilesY, 1.f, 1.f);
+			const glm::vec3 position = glm::vec3(corner) / corner.w;
+			cornerDirections[y * (grid.tilesX + 1) + x] = position / -position.z;
+		}
+	}
+
+	for (uint32_t slice = 0; slice < grid.slices; slice++)
+	{
+		const float ratio = grid.farPlane / grid.nearPlane;
+		const float nearDepth = grid.nearPlane * std::pow(ratio, static_cast<float>(slice) / grid.slices);
+		const float farDepth = grid.nearPlane * std::pow(ratio, static_cast<float>(slice + 1) / grid.slices);
+		for (uint32_t y = 0; y < grid.tilesY; y++)
+		{
+			for (uint32_t x = 0; x < grid.tilesX; x++)
+			{
+				glm::vec3 min(FLT_MAX);
+				glm::vec3 max(-FLT_MAX);
+				for (uint32_t corner = 0; corner < 4; corner++)
+				{
+					const uint32_t cornerIndex = (y + corner / 2) * (grid.tilesX + 1) + x + corner % 2;
+					const glm::vec3& direction = cornerDirections[cornerIndex];
+					for (float depth : {nearDepth, farDepth})
+					{
+						min = glm::min(min, direction * depth);
+						max = glm::max(max, direction * depth);
+					}
+				}
+
+				const uint32_t cluster = (slice * grid.tilesY + y) * grid.tilesX + x;
+				minX[cluster] = min.x;
+				minY[cluster] = min.y;
+				minZ[cluster] = min.z;
+				maxX[cluster] = max.x;
+				maxY[cluster] = max.y;
+				maxZ[cluster] = max.z;
+			}
+		}
+	}
+}
+
+void LightBinner::getClusterBounds(std::vector<glm::vec4>& bounds) const
+{
+	const uint32_t clusterCount = grid.getClusterCount();
+	bounds.resize(clusterCount * 2);
+	for (uint32_t cluster = 0; cluster < clusterCount; cluster++)
+	{
+		bounds[cluster * 2] = glm::vec4(minX[cluster], minY[cluster], minZ[cluster], 0.f);
+		bounds[cluster * 2 + 1] = glm::vec4(maxX[cluster], maxY[cluster], maxZ[cluster], 0.f);
+	}
+}
+
+void LightBinner::binRange(const std::vector<PointLight>& lights, const glm::mat4& view, uint32_t begin, uint32_t end,
+                           std::vector<LightPair>& pairs) const
+{
+	for (uint32_t light = begin; light < end; light++)
+	{
+		const glm::vec3 center = glm::vec3(view * glm::vec4(lights[light].position, 1.f));
+		const float radius = lights[light].radius;
+		const float nearDepth = -center.z - radius;
+		const float farDepth = -center.z + radius;
+		if (farDepth < grid.nearPlane || nearDepth > grid.farPlane)
+		{
+			continue;
+		}
+
+		// Tiles the projected bounding box of the sphere covers, all of them when it reaches the near plane
+		glm::ivec2 firstTile(0);
+		glm::ivec2 lastTile(grid.tilesX - 1, grid.tilesY - 1);
+		if (nearDepth > grid.nearPlane)
+		{
+			glm::vec2 ndcMin(FLT_MAX);
+			glm::vec2 ndcMax(-FLT_MAX);
+			for (uint32_t corner = 0; corner < 8; corner++)
+			{
+				const glm::vec3 offset(corner & 1 ? radius : -radius, corner & 2 ? radius : -radius,
+				                       corner & 4 ? radius : -radius);
+				const glm::vec4 clip = projection * glm::vec4(center + offset, 1.f);
+				ndcMin = glm::min(ndcMin, glm::vec2(clip) / clip.w);
+				ndcMax = glm::max(ndcMax, glm::vec2(clip) / clip.w);
+			}
+			const glm::vec2 tiles(grid.tilesX, grid.tilesY);
+			const glm::vec2 tileMin = glm::floor((ndcMin * 0.5f + 0.5f) * tiles);
+			const glm::vec2 tileMax = glm::floor((ndcMax * 0.5f + 0.5f) * tiles);
+			if (tileMax.x < 0.f || tileMax.y < 0.f || tileMin.x >= tiles.x || tileMin.y >= tiles.y)
+			{
+				continue;
+			}
+			firstTile = glm::max(glm::ivec2(tileMin), firstTile);
+			lastTile = glm::min(glm::ivec2(tileMax), lastTile);
+		}
+
+		const Lanes x = splat(center.x);
+		const Lanes y = splat(center.y);
+		const Lanes z = splat(center.z);
+		const Lanes radiusSquared = splat(radius * radius);
+		const uint32_t lastSlice = grid.getSlice(farDepth);
+		for (uint32_t slice = grid.getSlice(nearDepth); slice <= lastSlice; slice++)
+		{
+			for (uint32_t row = firstTile.y; row <= static_cast<uint32_t>(lastTile.y); row++)
+			{
+				// A row of tiles at a time, from a SIMD aligned cluster on
+				const uint32_t rowStart = (slice * grid.tilesY + row) * grid.tilesX;
+				const uint32_t first = rowStart + firstTile.x;
+				const uint32_t last = rowStart + lastTile.x + 1;
+				for (uint32_t cluster = first - first % SIMD_WIDTH; cluster < last; cluster += SIMD_WIDTH)
+				{
+					const Lanes dx = axisDistance(x, &minX[cluster], &maxX[cluster]);
+					const Lanes dy = axisDistance(y, &minY[cluster], &maxY[cluster]);
+					const Lanes dz = axisDistance(z, &minZ[cluster], &maxZ[cluster]);
+					int mask = lessEqualMask(add(add(mul(dx, dx), mul(dy, dy)), mul(dz, dz)), radiusSquared);
+					for (uint32_t lane = 0; mask != 0; lane++, mask >>= 1)
+					{
+						if ((mask & 1) && cluster + lane >= first && cluster + lane < last)
+						{
+							pairs.push_back({cluster + lane, light});
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+void LightBinner::bin(const std::vector<PointLight>& lights, const glm::mat4& view)
+{
+	const uint32_t lightCount = static_cast<uint32_t>(lights.size());
+	const uint32_t batchCount = std::max((lightCount + batchSize - 1) / batchSize, 1u);
+	batchPairs.resize(batchCount);
+	auto binBatches = [&](uint32_t beginBatch, uint32_t endBatch)
+	{
+		for (uint32_t batch = beginBatch; batch < endBatch; batch++)
+		{
+			batchPairs[batch].clear();
+			binRange(lights, view, batch * batchSize, std::min((batch + 1) * batchSize, lightCount),
+			         batchPairs[batch]);
+		}
+	};
+	if (jobSystem)
+	{
+		jobSystem->parallelFor(batchCount, 1, binBatches);
+	}
+	else
+	{
+		binBatches(0, batchCount);
+	}
+
+	// Count, reserve a range per cluster, then fill the ranges in light order
+	const uint32_t clusterCount = grid.getClusterCount();
+	clusterCounts.assign(clusterCount, 0);
+	for (const std::vector<LightPair>& pairs : batchPairs)
+	{
+		for (const LightPair& pair : pairs)
+		{
+			clusterCounts[pair.cluster]++;
+		}
+	}
+
+	clusters.resize(clusterCount);
+	uint32_t offset = 0;
+	for (uint32_t cluster = 0; cluster < clusterCount; cluster++)
+	{
+		clusters[cluster] = {offset, 0};
+		offset += std::min(clusterCounts[cluster], MAX_LIGHTS_PER_CLUSTER);
+	}
+	lightIndices.resize(offset);
+
+	droppedCount = 0;
+	for (const std::vector<LightPair>& pairs : batchPairs)
+	{
+		for (const LightPair& pair : pairs)
+		{
+			LightCluster& cluster = clusters[pair.cluster];
+			if (cluster.count < MAX_LIGHTS_PER_CLUSTER)
+			{
+				lightIndices[cluster.offset + cluster.count++] = pair.light;
+			}
+			else
+			{
+				droppedCount++;
+			}
+		}
+	}
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <vector>
+
+class JobSystem;
+
+/// Lights a cluster keeps, the rest of the lights touching it are dropped
+const uint32_t MAX_LIGHTS_PER_CLUSTER = 256;
+
+/// World space point light, laid out as the shaders read it from a std430 buffer
+struct PointLight
+{
+	glm::vec3 position;
+	float radius;
+	glm::vec3 color;
+	float padding;
+};
+
+/// Range of the light index list holding the lights of one cluster
+struct LightCluster
+{
+	uint32_t offset;
+	uint32_t count;
+};
+
+/// Screen tiles cut into depth slices, spaced logarithmically between near and far so clusters stay
+/// roughly as deep as they are wide. Clusters are numbered slice by slice, row by row within a slice.
+struct ClusterGrid
+{
+	uint32_t tilesX = 16;
+	uint32_t tilesY = 9;
+	uint32_t slices = 24;
+	float nearPlane = 0.1f;
+	float farPlane = 10.f;
+
+	uint32_t getClusterCount() const { return tilesX * tilesY * slices; }
+	/// slice = log(depth) * sliceScale + sliceBias, for a positive view space depth
+	float getSliceScale() const;
+	float getSliceBias() const;
+	uint32_t getSlice(float depth) const;
+};
+
+/// Assigns lights to the clusters their sphere touches, on the CPU. Cluster bounds are view space
+/// AABBs stored as structure of arrays, so each light is tested against several clusters of its slice
+/// range per SIMD instruction. The result is a compact light index list with a range per cluster.
+/// With a job system the lights are split into batches tested in parallel.
+class LightBinner
+{
+public:
+	explicit LightBinner(JobSystem* jobSystem = nullptr, uint32_t batchSize = 256);
+
+	/// Recomputes the cluster bounds, proj has to be a perspective projection with the grid's near and far
+	void setGrid(const ClusterGrid& grid, const glm::mat4& proj);
+	void bin(const std::vector<PointLight>& lights, const glm::mat4& view);
+
+	const ClusterGrid& getGrid() const { return grid; }
+	const std::vector<LightCluster>& getClusters() const { return clusters; }
+	const std::vector<uint32_t>& getLightIndices() const { return lightIndices; }
+	/// Light and cluster pairs left out of the last bin() because the cluster was full
+	uint32_t getDroppedCount() const { return droppedCount; }
+	/// Minimum and maximum corner of every cluster, for the GPU binning path
+	void getClusterBounds(std::vector<glm::vec4>& bounds) const;
+
+private:
+	struct LightPair
+	{
+		uint32_t cluster;
+		uint32_t light;
+	};
+
+	JobSystem* jobSystem;
+	uint32_t batchSize;
+	ClusterGrid grid;
+	glm::mat4 projection = glm::mat4(1.f);
+	std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+	std::vector<std::vector<LightPair>> batchPairs;
+	std::vector<uint32_t> clusterCounts;
+	std::vector<LightCluster> clusters;
+	std::vector<uint32_t> lightIndices;
+	uint32_t droppedCount = 0;
+
+	void binRange(const std::vector<PointLight>& lights, const glm::mat4& view, uint32_t begin, uint32_t end,
+	              std::vector<LightPair>& pairs) const;
+};
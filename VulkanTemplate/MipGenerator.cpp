@@ -0,0 +1,540 @@
+#include "MipGenerator.h"
+#include "VulkanBase.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string>
+
+MipGenerator::MipGenerator(VulkanBase& base, MipReduction reduction)
+	: base(base), reduction(reduction)
+{
+	// The single pass binds a view of every level, a stage is only guaranteed four storage images
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(base.physicalDevice, &properties);
+	splitDispatch = properties.limits.maxPerStageDescriptorStorageImages < MAX_DOWNSAMPLE_LEVELS;
+	timestampPeriod = properties.limits.timestampPeriod;
+
+	const std::string shaderName = reduction == MipReduction::Max ? "shaders/downsample_max" : "shaders/downsample";
+	shader = base.createShaderModule(shaderName + (splitDispatch ? "_split_comp.spv" : "_comp.spv"));
+	ReflectedPipelineLayout layout = base.layoutCache->getPipelineLayout({&base.shaderReflections.at(shader)});
+	pipelineLayout = layout.pipelineLayout;
+	setLayout = layout.setLayouts[0];
+	pipeline = base.createComputePipeline(shader, pipelineLayout);
+	if (splitDispatch)
+	{
+		splitUpdateTemplate = TypedUpdateTemplate<SplitDownsampleDescriptors>(
+			base.device, base.layoutCache->getDescriptorUpdateTemplate(setLayout));
+	}
+	else
+	{
+		updateTemplate = TypedUpdateTemplate<DownsampleDescriptors>(
+			base.device, base.layoutCache->getDescriptorUpdateTemplate(setLayout));
+	}
+
+	// Level 0 is read with texelFetch, the sampler only has to exist
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.minLod = 0;
+	samplerInfo.maxLod = 0;
+	if (vkCreateSampler(base.device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create mip generation sampler!");
+	}
+
+	// Uploads dispatch on the compute queue as well as on graphics, concurrent sharing spares transferring
+	// the ownership of a buffer nothing outside the dispatch touches
+	const uint32_t queueFamilies[] = {
+		base.queueFamilyIndex.graphicsFamily.value(), base.queueFamilyIndex.computeFamily.value()
+	};
+	VkBufferCreateInfo bufferCreateInfo = {};
+	bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCreateInfo.size = sizeof(uint32_t);
+	bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	if (queueFamilies[0] != queueFamilies[1])
+	{
+		bufferCreateInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		bufferCreateInfo.queueFamilyIndexCount = 2;
+		bufferCreateInfo.pQueueFamilyIndices = queueFamilies;
+	}
+	else
+	{
+		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	}
+	VmaAllocationCreateInfo allocationCreateInfo = {};
+	allocationCreateInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+	if (vmaCreateBuffer(base.allocator, &bufferCreateInfo, &allocationCreateInfo, &counterBuffer, &counterAllocation,
+	                    nullptr) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create mip generation counter!");
+	}
+
+	// The last workgroup of every dispatch sets the counter back to zero, so it is only cleared once
+	void* data;
+	vmaMapMemory(base.allocator, counterAllocation, &data);
+	memset(data, 0, sizeof(uint32_t));
+	vmaUnmapMemory(base.allocator, counterAllocation);
+}
+
+MipGenerator::~MipGenerator()
+{
+	waitForUploads();
+	vmaDestroyBuffer(base.allocator, counterBuffer, counterAllocation);
+	vkDestroySampler(base.device, sampler, nullptr);
+	vkDestroyPipeline(base.device, pipeline, nullptr);
+}
+
+void MipGenerator::record(VkCommandBuffer commandBuffer, uint32_t width, uint32_t height,
+                          const std::vector<VkImageView>& levelViews, VkDescriptorPool descriptorPool)
+{
+	const uint32_t levelCount = static_cast<uint32_t>(levelViews.size()) - 1;
+	if (levelCount == 0)
+	{
+		return;
+	}
+	if (splitDispatch)
+	{
+		recordSplit(commandBuffer, width, height, levelViews, descriptorPool);
+		return;
+	}
+	// Level 6 has to fit the one tile the last workgroup reduces
+	if (levelCount > MAX_DOWNSAMPLE_LEVELS || (width >> 6) > 64 || (height >> 6) > 64)
+	{
+		throw std::runtime_error("image too large for single pass mip generation!");
+	}
+
+	// The previous dispatch reset the counter, that write has to land before this one counts on it
+	VkBufferMemoryBarrier counterBarrier = {};
+	counterBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	counterBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	counterBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	counterBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	counterBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	counterBarrier.buffer = counterBuffer;
+	counterBarrier.offset = 0;
+	counterBarrier.size = VK_WHOLE_SIZE;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	                     0, 0, nullptr, 1, &counterBarrier, 0, nullptr);
+
+	DownsampleDescriptors descriptors = {};
+	descriptors.sourceLevel.image = {sampler, levelViews[0], VK_IMAGE_LAYOUT_GENERAL};
+	for (uint32_t i = 0; i < MAX_DOWNSAMPLE_LEVELS; i++)
+	{
+		// Slots past the last level are never written, but every one needs a valid view
+		const VkImageView levelView = levelViews[std::min(i + 1, levelCount)];
+		descriptors.levels[i].image = {VK_NULL_HANDLE, levelView, VK_IMAGE_LAYOUT_GENERAL};
+	}
+	descriptors.counter.buffer = {counterBuffer, 0, sizeof(uint32_t)};
+	VkDescriptorSet descriptorSet = allocateSet(descriptorPool);
+	updateTemplate.update(descriptorSet, descriptors);
+
+	const uint32_t groupsX = (width + 63) / 64;
+	const uint32_t groupsY = (height + 63) / 64;
+	DownsamplePushConstants pushConstants = {};
+	pushConstants.sourceSize = glm::ivec2(width, height);
+	pushConstants.levelCount = static_cast<int32_t>(levelCount);
+	pushConstants.workgroupCount = groupsX * groupsY;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0,
+	                        nullptr);
+	vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DownsamplePushConstants),
+	                   &pushConstants);
+	vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
+}
+
+void MipGenerator::recordSplit(VkCommandBuffer commandBuffer, uint32_t width, uint32_t height,
+                               const std::vector<VkImageView>& levelViews, VkDescriptorPool descriptorPool)
+{
+	const uint32_t levelCount = static_cast<uint32_t>(levelViews.size()) - 1;
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	for (uint32_t baseLevel = 0; baseLevel < levelCount; baseLevel += SPLIT_DOWNSAMPLE_LEVELS)
+	{
+		if (baseLevel > 0)
+		{
+			// The last level the previous dispatch wrote is the source of this one
+			VkMemoryBarrier barrier = {};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		}
+
+		const uint32_t dispatchLevels = std::min(levelCount - baseLevel, SPLIT_DOWNSAMPLE_LEVELS);
+		SplitDownsampleDescriptors descriptors = {};
+		descriptors.sourceLevel.image = {sampler, levelViews[baseLevel], VK_IMAGE_LAYOUT_GENERAL};
+		for (uint32_t i = 0; i < SPLIT_DOWNSAMPLE_LEVELS; i++)
+		{
+			const VkImageView levelView = levelViews[baseLevel + std::min(i + 1, dispatchLevels)];
+			descriptors.levels[i].image = {VK_NULL_HANDLE, levelView, VK_IMAGE_LAYOUT_GENERAL};
+		}
+		VkDescriptorSet descriptorSet = allocateSet(descriptorPool);
+		splitUpdateTemplate.update(descriptorSet, descriptors);
+
+		const uint32_t sourceWidth = std::max(width >> baseLevel, 1u);
+		const uint32_t sourceHeight = std::max(height >> baseLevel, 1u);
+		const uint32_t groupsX = (sourceWidth + 63) / 64;
+		const uint32_t groupsY = (sourceHeight + 63) / 64;
+		DownsamplePushConstants pushConstants = {};
+		pushConstants.sourceSize = glm::ivec2(sourceWidth, sourceHeight);
+		pushConstants.levelCount = static_cast<int32_t>(dispatchLevels);
+		pushConstants.workgroupCount = groupsX * groupsY;
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet,
+		                        0, nullptr);
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+		                   sizeof(DownsamplePushConstants), &pushConstants);
+		vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
+	}
+}
+
+VkDescriptorSet MipGenerator::allocateSet(VkDescriptorPool descriptorPool)
+{
+	if (descriptorPool == VK_NULL_HANDLE)
+	{
+		return base.descriptorAllocator->allocate(setLayout);
+	}
+	VkDescriptorSetAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocateInfo.descriptorPool = descriptorPool;
+	allocateInfo.descriptorSetCount = 1;
+	allocateInfo.pSetLayouts = &setLayout;
+	VkDescriptorSet descriptorSet;
+	if (vkAllocateDescriptorSets(base.device, &allocateInfo, &descriptorSet) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate mip upload descriptor set!");
+	}
+	return descriptorSet;
+}
+
+VkDescriptorPool MipGenerator::createUploadDescriptorPool(uint32_t levelCount)
+{
+	// The per-frame sets would be reset by the next frame while the upload may still be running
+	const uint32_t dispatchCount = (levelCount + SPLIT_DOWNSAMPLE_LEVELS - 2) / SPLIT_DOWNSAMPLE_LEVELS;
+	const uint32_t setCount = splitDispatch ? std::max(dispatchCount, 1u) : 1;
+	const VkDescriptorPoolSize poolSizes[] = {
+		{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, setCount},
+		{VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, setCount * MAX_DOWNSAMPLE_LEVELS},
+		{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, setCount},
+	};
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = setCount;
+	poolInfo.poolSizeCount = 3;
+	poolInfo.pPoolSizes = poolSizes;
+	VkDescriptorPool descriptorPool;
+	if (vkCreateDescriptorPool(base.device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create mip upload descriptor pool!");
+	}
+	return descriptorPool;
+}
+
+VkImageView MipGenerator::createLevelView(VkImage image, uint32_t level)
+{
+	VkImageViewCreateInfo viewCreateInfo = {};
+	viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewCreateInfo.image = image;
+	viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewCreateInfo.format = reduction == MipReduction::Max ? VK_FORMAT_R32_SFLOAT : VK_FORMAT_R8G8B8A8_UNORM;
+	viewCreateInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+
+	VkImageView levelView;
+	if (vkCreateImageView(base.device, &viewCreateInfo, nullptr, &levelView) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create mip level view!");
+	}
+	return levelView;
+}
+
+void MipGenerator::recordBlits(VkCommandBuffer commandBuffer, VkImage image, uint32_t width, uint32_t height,
+                               uint32_t levelCount)
+{
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.image = image;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+	int32_t levelWidth = static_cast<int32_t>(width);
+	int32_t levelHeight = static_cast<int32_t>(height);
+	for (uint32_t level = 1; level < levelCount; level++)
+	{
+		barrier.subresourceRange.baseMipLevel = level - 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
+		                     nullptr, 0, nullptr, 1, &barrier);
+
+		VkImageBlit blit = {};
+		blit.srcOffsets[1] = {levelWidth, levelHeight, 1};
+		blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1};
+		levelWidth = std::max(levelWidth / 2, 1);
+		levelHeight = std::max(levelHeight / 2, 1);
+		blit.dstOffsets[1] = {levelWidth, levelHeight, 1};
+		blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+		vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image,
+		               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
+		                     nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	barrier.subresourceRange.baseMipLevel = levelCount - 1;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
+	                     nullptr, 0, nullptr, 1, &barrier);
+}
+
+void MipGenerator::upload(VkImage image, VkBuffer stagingBuffer, uint32_t width, uint32_t height,
+                          uint32_t levelCount)
+{
+	if (reduction != MipReduction::Average)
+	{
+		throw std::runtime_error("mip uploads need the average reduction!");
+	}
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	// Blits need a graphics queue
+	const uint32_t graphicsFamily = base.queueFamilyIndex.graphicsFamily.value();
+	const uint32_t computeFamily = base.queueFamilyIndex.computeFamily.value();
+	const bool async = useAsyncCompute && !useBlits && computeFamily != graphicsFamily;
+	const uint32_t workFamily = async ? computeFamily : graphicsFamily;
+
+	// Uploads share the counter buffer and only finish in order on one queue, so switching queues waits
+	retireUploads();
+	if (!pendingUploads.empty() && pendingUploads.back().asyncCompute != async)
+	{
+		waitForUploads();
+	}
+	PendingMipUpload pending = {};
+	pending.asyncCompute = async;
+
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(base.physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(base.physicalDevice, &queueFamilyCount, queueFamilies.data());
+	if (queueFamilies[workFamily].timestampValidBits != 0)
+	{
+		VkQueryPoolCreateInfo queryPoolCreateInfo = {};
+		queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolCreateInfo.queryCount = 2;
+		if (vkCreateQueryPool(base.device, &queryPoolCreateInfo, nullptr, &pending.queryPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create timestamp query pool!");
+		}
+	}
+	const VkQueryPool queryPool = pending.queryPool;
+
+	auto beginCommands = [this](uint32_t family, VkCommandPool& pool)
+	{
+		VkCommandPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		poolInfo.queueFamilyIndex = family;
+		if (vkCreateCommandPool(base.device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create mip upload command pool!");
+		}
+
+		VkCommandBufferAllocateInfo allocateInfo = {};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocateInfo.commandPool = pool;
+		allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocateInfo.commandBufferCount = 1;
+		VkCommandBuffer commandBuffer;
+		vkAllocateCommandBuffers(base.device, &allocateInfo, &commandBuffer);
+
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+		return commandBuffer;
+	};
+
+	VkCommandBuffer commandBuffer = beginCommands(workFamily, pending.workPool);
+	if (queryPool != VK_NULL_HANDLE)
+	{
+		vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+	}
+
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1};
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
+	                     nullptr, 0, nullptr, 1, &barrier);
+
+	VkBufferImageCopy region = {};
+	region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+	region.imageExtent = {width, height, 1};
+	vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+	if (queryPool != VK_NULL_HANDLE)
+	{
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, queryPool, 0);
+	}
+
+	if (useBlits)
+	{
+		recordBlits(commandBuffer, image, width, height, levelCount);
+	}
+	else
+	{
+		for (uint32_t level = 0; level < levelCount; level++)
+		{
+			pending.levelViews.push_back(createLevelView(image, level));
+		}
+		pending.descriptorPool = createUploadDescriptorPool(levelCount);
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0,
+		                     nullptr, 0, nullptr, 1, &barrier);
+
+		record(commandBuffer, width, height, pending.levelViews, pending.descriptorPool);
+
+		// On the compute queue this is the release half of the hand over to graphics
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = async ? 0 : VK_ACCESS_SHADER_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcQueueFamilyIndex = async ? computeFamily : VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = async ? graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		                     async ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
+		                     nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	if (queryPool != VK_NULL_HANDLE)
+	{
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+	}
+	vkEndCommandBuffer(commandBuffer);
+
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	vkCreateFence(base.device, &fenceInfo, nullptr, &pending.fence);
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+
+	if (async)
+	{
+		VkSemaphoreCreateInfo semaphoreInfo = {};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		vkCreateSemaphore(base.device, &semaphoreInfo, nullptr, &pending.handedOver);
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &pending.handedOver;
+		if (vkQueueSubmit(base.computeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to submit mip generation!");
+		}
+
+		// The acquire half, a matching barrier on the graphics queue once compute is done
+		VkCommandBuffer acquireCommandBuffer = beginCommands(graphicsFamily, pending.acquirePool);
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(acquireCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		                     VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		vkEndCommandBuffer(acquireCommandBuffer);
+
+		const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		VkSubmitInfo acquireSubmitInfo = {};
+		acquireSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		acquireSubmitInfo.waitSemaphoreCount = 1;
+		acquireSubmitInfo.pWaitSemaphores = &pending.handedOver;
+		acquireSubmitInfo.pWaitDstStageMask = &waitStage;
+		acquireSubmitInfo.commandBufferCount = 1;
+		acquireSubmitInfo.pCommandBuffers = &acquireCommandBuffer;
+		if (vkQueueSubmit(base.graphicsQueue, 1, &acquireSubmitInfo, pending.fence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to submit mip ownership transfer!");
+		}
+	}
+	else if (vkQueueSubmit(base.graphicsQueue, 1, &submitInfo, pending.fence) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to submit mip generation!");
+	}
+	pendingUploads.push_back(std::move(pending));
+
+	stats.asyncCompute = async;
+	stats.cpuMilliseconds = std::chrono::duration<float, std::milli>(
+		std::chrono::high_resolution_clock::now() - start).count();
+}
+
+size_t MipGenerator::retireUploads()
+{
+	// All pending uploads went to the same queue, the first unfinished one ends the search
+	while (!pendingUploads.empty() && vkGetFenceStatus(base.device, pendingUploads.front().fence) == VK_SUCCESS)
+	{
+		PendingMipUpload& pending = pendingUploads.front();
+		stats.gpuMilliseconds = 0.f;
+		if (pending.queryPool != VK_NULL_HANDLE)
+		{
+			uint64_t timestamps[2];
+			if (vkGetQueryPoolResults(base.device, pending.queryPool, 0, 2, sizeof(timestamps), timestamps,
+			                          sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+			{
+				stats.gpuMilliseconds = (timestamps[1] - timestamps[0]) * timestampPeriod / 1000000.f;
+			}
+			vkDestroyQueryPool(base.device, pending.queryPool, nullptr);
+		}
+
+		for (VkImageView levelView : pending.levelViews)
+		{
+			vkDestroyImageView(base.device, levelView, nullptr);
+		}
+		if (pending.descriptorPool != VK_NULL_HANDLE)
+		{
+			vkDestroyDescriptorPool(base.device, pending.descriptorPool, nullptr);
+		}
+		if (pending.handedOver != VK_NULL_HANDLE)
+		{
+			vkDestroySemaphore(base.device, pending.handedOver, nullptr);
+			vkDestroyCommandPool(base.device, pending.acquirePool, nullptr);
+		}
+		vkDestroyFence(base.device, pending.fence, nullptr);
+		vkDestroyCommandPool(base.device, pending.workPool, nullptr);
+		pendingUploads.pop_front();
+	}
+	return pendingUploads.size();
+}
+
+void MipGenerator::waitForUploads()
+{
+	for (const PendingMipUpload& pending : pendingUploads)
+	{
+		vkWaitForFences(base.device, 1, &pending.fence, VK_TRUE, UINT64_MAX);
+	}
+	retireUploads();
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <vk_mem_alloc.h>
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <vector>
+#include <deque>
+#include "DescriptorAllocator.h"
+
+class VulkanBase;
+
+/// Levels one dispatch writes below the source, enough for 4096x4096
+const uint32_t MAX_DOWNSAMPLE_LEVELS = 12;
+/// Levels per dispatch where a stage cannot bind MAX_DOWNSAMPLE_LEVELS storage images, four are guaranteed
+const uint32_t SPLIT_DOWNSAMPLE_LEVELS = 4;
+
+enum class MipReduction
+{
+	/// Box filter, for R8G8B8A8_UNORM textures
+	Average,
+	/// Farthest depth, for R32_SFLOAT depth pyramids
+	Max,
+};
+
+struct DownsamplePushConstants
+{
+	glm::ivec2 sourceSize;
+	int32_t levelCount;
+	uint32_t workgroupCount;
+};
+
+struct DownsampleDescriptors
+{
+	DescriptorInfo sourceLevel;
+	DescriptorInfo levels[MAX_DOWNSAMPLE_LEVELS];
+	DescriptorInfo counter;
+};
+
+/// Set of the split variant, which has no counter as it never reduces past the tile
+struct SplitDownsampleDescriptors
+{
+	DescriptorInfo sourceLevel;
+	DescriptorInfo levels[SPLIT_DOWNSAMPLE_LEVELS];
+};
+
+struct MipUploadStats
+{
+	/// GPU time of the mip generation alone in the last upload retired, zero without timestamp support on its queue
+	float gpuMilliseconds = 0.f;
+	/// CPU time upload spent recording and submitting, it does not wait for the GPU
+	float cpuMilliseconds = 0.f;
+	bool asyncCompute = false;
+};
+
+/// What a submitted upload keeps alive until its fence signals
+struct PendingMipUpload
+{
+	VkFence fence;
+	VkCommandPool workPool;
+	VkCommandPool acquirePool;
+	VkSemaphore handedOver;
+	VkQueryPool queryPool;
+	VkDescriptorPool descriptorPool;
+	std::vector<VkImageView> levelViews;
+	bool asyncCompute;
+};
+
+/// Builds a whole mip chain in a single compute dispatch instead of a barrier and blit per level.
+/// Each workgroup reduces a 64x64 tile of level 0 through shared memory to the six levels below it,
+/// and the last workgroup to finish, counted with a global atomic, reduces level 6 to the rest.
+/// Devices with fewer storage images per stage get a dispatch per SPLIT_DOWNSAMPLE_LEVELS levels instead.
+class MipGenerator
+{
+public:
+	MipGenerator(VulkanBase& base, MipReduction reduction);
+	~MipGenerator();
+
+	/// Fills levels 1 and up from level 0. levelViews holds a single-level view of every level, all in
+	/// GENERAL layout with level 0 visible to compute reads. They are left in GENERAL and the caller
+	/// makes the new levels visible to whatever reads them. Sets come from descriptorPool when given,
+	/// for work that outlives the frame it was recorded in.
+	void record(VkCommandBuffer commandBuffer, uint32_t width, uint32_t height,
+	            const std::vector<VkImageView>& levelViews, VkDescriptorPool descriptorPool = VK_NULL_HANDLE);
+
+	/// Copies level 0 of an R8G8B8A8_UNORM image from a staging buffer, generates the other levels and
+	/// leaves the image in SHADER_READ_ONLY_OPTIMAL for the graphics queue. It returns once submitted, graphics
+	/// work submitted after it sees the levels. With useAsyncCompute and a separate compute family it runs there
+	/// and hands the image over to graphics. The image and staging buffer stay in use until retireUploads.
+	void upload(VkImage image, VkBuffer stagingBuffer, uint32_t width, uint32_t height, uint32_t levelCount);
+	/// Destroys what finished uploads used and takes the GPU time of the last one, without waiting.
+	/// Returns how many are still pending.
+	size_t retireUploads();
+	void waitForUploads();
+
+	MipUploadStats getStats() const { return stats; }
+
+	bool useAsyncCompute = false;
+	/// Uploads generate levels with the vkCmdBlitImage chain on the graphics queue instead, for comparison
+	bool useBlits = false;
+
+private:
+	VulkanBase& base;
+	MipReduction reduction;
+	VkShaderModule shader;
+	VkPipelineLayout pipelineLayout;
+	VkDescriptorSetLayout setLayout;
+	VkPipeline pipeline;
+	/// Chains dispatches of the split variant, only one of the templates is valid
+	bool splitDispatch = false;
+	TypedUpdateTemplate<DownsampleDescriptors> updateTemplate;
+	TypedUpdateTemplate<SplitDownsampleDescriptors> splitUpdateTemplate;
+	VkSampler sampler;
+	VkBuffer counterBuffer;
+	VmaAllocation counterAllocation;
+	float timestampPeriod;
+	std::deque<PendingMipUpload> pendingUploads;
+	MipUploadStats stats;
+
+	void recordSplit(VkCommandBuffer commandBuffer, uint32_t width, uint32_t height,
+	                 const std::vector<VkImageView>& levelViews, VkDescriptorPool descriptorPool);
+	VkDescriptorSet allocateSet(VkDescriptorPool descriptorPool);
+	VkDescriptorPool createUploadDescriptorPool(uint32_t levelCount);
+	VkImageView createLevelView(VkImage image, uint32_t level);
+	void recordBlits(VkCommandBuffer commandBuffer, VkImage image, uint32_t width, uint32_t height,
+	                 uint32_t levelCount);
+};
@@ -0,0 +1,324 @@
+#include "OcclusionCulling.h"
+#include "GpuCulling.h"
+#include "VulkanBase.h"
+
+#include <stdexcept>
+
+OcclusionCulling::OcclusionCulling(VulkanBase& base, GpuCulling& gpuCulling, uint32_t maxObjects)
+	: base(base), gpuCulling(gpuCulling), pyramid(base), maxObjects(maxObjects)
+{
+	if (maxObjects > gpuCulling.getMaxObjects())
+	{
+		throw std::runtime_error("occlusion culling needs an object buffer for every object!");
+	}
+	compact = base.drawIndirectCountSupported;
+
+	cullShader = base.createShaderModule("shaders/occlusion_cull_comp.spv");
+	ReflectedPipelineLayout layout = base.layoutCache->getPipelineLayout({&base.shaderReflections.at(cullShader)});
+	pipelineLayout = layout.pipelineLayout;
+	setLayout = layout.setLayouts[0];
+	pipeline = base.createComputePipeline(cullShader, pipelineLayout);
+	updateTemplate = TypedUpdateTemplate<OcclusionCullDescriptors>(
+		base.device, base.layoutCache->getDescriptorUpdateTemplate(setLayout));
+
+	renderPasses[0] = createRenderPass(0);
+	renderPasses[1] = createRenderPass(1);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(base.physicalDevice, &properties);
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(base.physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(base.physicalDevice, &queueFamilyCount, queueFamilies.data());
+	if (queueFamilies[base.queueFamilyIndex.graphicsFamily.value()].timestampValidBits != 0)
+	{
+		timestampPeriod = properties.limits.timestampPeriod;
+	}
+
+	addSwapchainImages();
+}
+
+void OcclusionCulling::addSwapchainImages()
+{
+	const size_t firstImage = drawCommandBuffers.size();
+	const size_t imageCount = base.swapchainImages.size();
+	if (timestampPeriod > 0.f)
+	{
+		if (queryPool != VK_NULL_HANDLE)
+		{
+			// Frames in flight may still write their timestamps
+			base.retireQueryPool(queryPool);
+		}
+		VkQueryPoolCreateInfo queryPoolCreateInfo = {};
+		queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolCreateInfo.queryCount = static_cast<uint32_t>(imageCount) * TIMESTAMPS_PER_FRAME;
+		if (vkCreateQueryPool(base.device, &queryPoolCreateInfo, nullptr, &queryPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create timestamp query pool!");
+		}
+	}
+
+	timestampsWritten.assign(imageCount, false);
+	recordedObjectCounts.resize(imageCount, 0);
+	drawCommandBuffers.resize(imageCount);
+	drawCommandBufferAllocations.resize(imageCount);
+	counterBuffers.resize(imageCount);
+	counterBufferAllocations.resize(imageCount);
+	occludedFlagBuffers.resize(imageCount);
+	occludedFlagBufferAllocations.resize(imageCount);
+	for (size_t i = firstImage; i < imageCount; i++)
+	{
+		// One region of commands per phase
+		base.createBuffer(sizeof(VkDrawIndexedIndirectCommand) * maxObjects * 2,
+		                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		                  VMA_MEMORY_USAGE_GPU_ONLY, drawCommandBuffers[i], drawCommandBufferAllocations[i]);
+		base.createBuffer(sizeof(OcclusionCounters),
+		                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+		                  VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		                  VMA_MEMORY_USAGE_GPU_TO_CPU, counterBuffers[i], counterBufferAllocations[i]);
+		base.createBuffer(sizeof(uint32_t) * maxObjects, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		                  VMA_MEMORY_USAGE_GPU_ONLY, occludedFlagBuffers[i], occludedFlagBufferAllocations[i]);
+	}
+}
+
+OcclusionCulling::~OcclusionCulling()
+{
+	for (size_t i = 0; i < drawCommandBuffers.size(); i++)
+	{
+		vmaDestroyBuffer(base.allocator, drawCommandBuffers[i], drawCommandBufferAllocations[i]);
+		vmaDestroyBuffer(base.allocator, counterBuffers[i], counterBufferAllocations[i]);
+		vmaDestroyBuffer(base.allocator, occludedFlagBuffers[i], occludedFlagBufferAllocations[i]);
+	}
+	if (queryPool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(base.device, queryPool, nullptr);
+	}
+	vkDestroyRenderPass(base.device, renderPasses[0], nullptr);
+	vkDestroyRenderPass(base.device, renderPasses[1], nullptr);
+	vkDestroyPipeline(base.device, pipeline, nullptr);
+}
+
+VkRenderPass OcclusionCulling::createRenderPass(uint32_t phase)
+{
+	// Same attachments as the base render pass, only the first pass stores what the second loads
+	const bool firstPhase = phase == 0;
+
+	VkAttachmentDescription colorAttachmentResolve = {};
+	colorAttachmentResolve.format = base.surfaceFormat.format;
+	colorAttachmentResolve.samples = VK_SAMPLE_COUNT_1_BIT;
+	colorAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachmentResolve.storeOp = firstPhase ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+	colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+	VkAttachmentDescription colorAttachment = {};
+	colorAttachment.format = base.surfaceFormat.format;
+	colorAttachment.samples = base.sampleCount;
+	colorAttachment.loadOp = firstPhase ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+	colorAttachment.storeOp = firstPhase ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	colorAttachment.initialLayout = firstPhase
+		                                ? VK_IMAGE_LAYOUT_UNDEFINED
+		                                : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentDescription depthAttachment = {};
+	depthAttachment.format = base.depthImageFormat;
+	depthAttachment.samples = base.sampleCount;
+	depthAttachment.loadOp = firstPhase ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+	depthAttachment.storeOp = firstPhase ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.initialLayout = firstPhase
+		                                ? VK_IMAGE_LAYOUT_UNDEFINED
+		                                : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	std::vector<VkAttachmentDescription> attachments = {colorAttachmentResolve, colorAttachment, depthAttachment};
+
+	VkAttachmentReference colorAttachmentRef = {1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+	VkAttachmentReference colorAttachmentResolveRef = {0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+	VkAttachmentReference depthAttachmentRef = {2, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+
+	VkSubpassDescription subpassDescription = {};
+	subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpassDescription.colorAttachmentCount = 1;
+	subpassDescription.pColorAttachments = &colorAttachmentRef;
+	subpassDescription.pResolveAttachments = &colorAttachmentResolveRef;
+	subpassDescription.pDepthStencilAttachment = &depthAttachmentRef;
+
+	// The second pass continues the first one's color and depth
+	VkSubpassDependency dependency = {};
+	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependency.dstSubpass = 0;
+	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+		VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+		VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+	VkRenderPassCreateInfo renderPassCreateInfo = {};
+	renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	renderPassCreateInfo.pAttachments = attachments.data();
+	renderPassCreateInfo.subpassCount = 1;
+	renderPassCreateInfo.pSubpasses = &subpassDescription;
+	renderPassCreateInfo.dependencyCount = firstPhase ? 0 : 1;
+	renderPassCreateInfo.pDependencies = firstPhase ? nullptr : &dependency;
+
+	VkRenderPass renderPass;
+	if (vkCreateRenderPass(base.device, &renderPassCreateInfo, nullptr, &renderPass) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create occlusion render pass!");
+	}
+	return renderPass;
+}
+
+void OcclusionCulling::writeTimestamp(VkCommandBuffer commandBuffer, uint32_t imageIndex,
+                                      VkPipelineStageFlagBits stage, uint32_t index)
+{
+	if (queryPool != VK_NULL_HANDLE)
+	{
+		vkCmdWriteTimestamp(commandBuffer, stage, queryPool, imageIndex * TIMESTAMPS_PER_FRAME + index);
+	}
+}
+
+void OcclusionCulling::recordFirstPhase(VkCommandBuffer commandBuffer, uint32_t imageIndex,
+                                        const glm::mat4& viewProj, uint32_t objectCount)
+{
+	if (objectCount > maxObjects)
+	{
+		throw std::runtime_error("too many objects for occlusion culling!");
+	}
+	recordedObjectCounts[imageIndex] = objectCount;
+
+	if (queryPool != VK_NULL_HANDLE)
+	{
+		vkCmdResetQueryPool(commandBuffer, queryPool, imageIndex * TIMESTAMPS_PER_FRAME, TIMESTAMPS_PER_FRAME);
+		timestampsWritten[imageIndex] = true;
+	}
+	writeTimestamp(commandBuffer, imageIndex, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0);
+
+	extractFrustumPlanes(viewProj, frustumPlanes);
+	vmaFlushAllocation(base.allocator, gpuCulling.getObjectAllocation(imageIndex), 0, sizeof(GpuObject) * objectCount);
+	vkCmdFillBuffer(commandBuffer, counterBuffers[imageIndex], 0, sizeof(OcclusionCounters), 0);
+
+	VkMemoryBarrier clearBarrier = {};
+	clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+	                     &clearBarrier, 0, nullptr, 0, nullptr);
+
+	recordCulling(commandBuffer, imageIndex, 0, objectCount);
+}
+
+void OcclusionCulling::recordSecondPhase(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t objectCount)
+{
+	writeTimestamp(commandBuffer, imageIndex, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 1);
+	pyramid.record(commandBuffer);
+	recordCulling(commandBuffer, imageIndex, 1, objectCount);
+	writeTimestamp(commandBuffer, imageIndex, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 2);
+}
+
+void OcclusionCulling::recordCulling(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t phase,
+                                     uint32_t objectCount)
+{
+	OcclusionCullDescriptors descriptors = {};
+	descriptors.frameUniforms.buffer = {base.uniformBuffers[imageIndex], 0, VK_WHOLE_SIZE};
+	descriptors.objects.buffer = {gpuCulling.getObjectBuffer(imageIndex), 0, VK_WHOLE_SIZE};
+	descriptors.drawCommands.buffer = {drawCommandBuffers[imageIndex], 0, VK_WHOLE_SIZE};
+	descriptors.counters.buffer = {counterBuffers[imageIndex], 0, VK_WHOLE_SIZE};
+	descriptors.occludedFlags.buffer = {occludedFlagBuffers[imageIndex], 0, VK_WHOLE_SIZE};
+	// The pyramid view changes with the swapchain size, so the set is rewritten every frame
+	descriptors.depthPyramid.image = {pyramid.getSampler(), pyramid.getView(), VK_IMAGE_LAYOUT_GENERAL};
+	VkDescriptorSet descriptorSet = base.descriptorAllocator->allocate(setLayout);
+	updateTemplate.update(descriptorSet, descriptors);
+
+	OcclusionPushConstants pushConstants = {};
+	for (int i = 0; i < 6; i++)
+	{
+		pushConstants.frustumPlanes[i] = frustumPlanes[i];
+	}
+	pushConstants.pyramidSize = glm::vec2(pyramid.getWidth(), pyramid.getHeight());
+	pushConstants.objectCount = objectCount;
+	pushConstants.phase = phase;
+	pushConstants.compact = compact ? 1 : 0;
+	// Right after a resize the pyramid holds nothing yet and everything in view is drawn first
+	pushConstants.occlusionEnabled = occlusionEnabled && pyramid.hasContents() ? 1 : 0;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0,
+	                        nullptr);
+	vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(OcclusionPushConstants),
+	                   &pushConstants);
+	vkCmdDispatch(commandBuffer, (objectCount + 63) / 64, 1, 1);
+
+	// The second phase reads the flags the first one wrote
+	VkMemoryBarrier cullBarrier = {};
+	cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT |
+		VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	                     VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+	                     VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &cullBarrier, 0, nullptr, 0, nullptr);
+}
+
+void OcclusionCulling::recordDraws(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t phase,
+                                   uint32_t objectCount)
+{
+	const VkDeviceSize regionOffset = sizeof(VkDrawIndexedIndirectCommand) * objectCount * phase;
+	if (compact)
+	{
+		base.cmdDrawIndexedIndirectCount(commandBuffer, drawCommandBuffers[imageIndex], regionOffset,
+		                                 counterBuffers[imageIndex], sizeof(uint32_t) * phase, objectCount,
+		                                 sizeof(VkDrawIndexedIndirectCommand));
+	}
+	else
+	{
+		vkCmdDrawIndexedIndirect(commandBuffer, drawCommandBuffers[imageIndex], regionOffset, objectCount,
+		                         sizeof(VkDrawIndexedIndirectCommand));
+	}
+}
+
+void OcclusionCulling::recordEnd(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	writeTimestamp(commandBuffer, imageIndex, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 3);
+}
+
+OcclusionStats OcclusionCulling::readStats(uint32_t imageIndex)
+{
+	OcclusionStats stats;
+	stats.objectCount = recordedObjectCounts[imageIndex];
+
+	void* data;
+	vmaMapMemory(base.allocator, counterBufferAllocations[imageIndex], &data);
+	vmaInvalidateAllocation(base.allocator, counterBufferAllocations[imageIndex], 0, sizeof(OcclusionCounters));
+	const OcclusionCounters counters = *static_cast<OcclusionCounters*>(data);
+	vmaUnmapMemory(base.allocator, counterBufferAllocations[imageIndex]);
+	stats.frustumCulled = counters.frustumCulled;
+	stats.occluded = counters.occluded;
+	stats.recovered = counters.recovered;
+	stats.drawn = counters.drawCount[0] + counters.drawCount[1];
+
+	uint64_t timestamps[TIMESTAMPS_PER_FRAME];
+	if (timestampsWritten[imageIndex] &&
+		vkGetQueryPoolResults(base.device, queryPool, imageIndex * TIMESTAMPS_PER_FRAME, TIMESTAMPS_PER_FRAME,
+		                      sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+	{
+		const float toMilliseconds = timestampPeriod / 1000000.f;
+		stats.frameMilliseconds = static_cast<float>(timestamps[3] - timestamps[0]) * toMilliseconds;
+		stats.firstPassMilliseconds = static_cast<float>(timestamps[1] - timestamps[0]) * toMilliseconds;
+		stats.pyramidMilliseconds = static_cast<float>(timestamps[2] - timestamps[1]) * toMilliseconds;
+		stats.secondPassMilliseconds = static_cast<float>(timestamps[3] - timestamps[2]) * toMilliseconds;
+	}
+	return stats;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <vk_mem_alloc.h>
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <vector>
+#include "DescriptorAllocator.h"
+#include "DepthPyramid.h"
+
+class VulkanBase;
+class GpuCulling;
+
+struct OcclusionPushConstants
+{
+	glm::vec4 frustumPlanes[6];
+	glm::vec2 pyramidSize;
+	uint32_t objectCount;
+	uint32_t phase;
+	uint32_t compact;
+	uint32_t occlusionEnabled;
+};
+
+struct OcclusionCullDescriptors
+{
+	DescriptorInfo frameUniforms;
+	DescriptorInfo objects;
+	DescriptorInfo drawCommands;
+	DescriptorInfo counters;
+	DescriptorInfo occludedFlags;
+	DescriptorInfo depthPyramid;
+};
+
+/// Written by the culling shader, std430 layout
+struct OcclusionCounters
+{
+	uint32_t drawCount[2];
+	uint32_t frustumCulled;
+	uint32_t occluded;
+	uint32_t recovered;
+};
+
+struct OcclusionStats
+{
+	uint32_t objectCount = 0;
+	uint32_t frustumCulled = 0;
+	/// Rejected by the first phase against last frame's depth
+	uint32_t occluded = 0;
+	/// Occluded objects the second phase found visible after all and drew late
+	uint32_t recovered = 0;
+	uint32_t drawn = 0;
+	/// GPU times from timestamps, all zero when the queue has no timestamp support
+	float frameMilliseconds = 0.f;
+	float firstPassMilliseconds = 0.f;
+	float pyramidMilliseconds = 0.f;
+	float secondPassMilliseconds = 0.f;
+};
+
+/// Two-phase Hi-Z occlusion culling on top of GpuCulling's object buffers. The first phase frustum
+/// culls and tests against the depth pyramid of the previous frame, its survivors are drawn with
+/// getRenderPass(0), which keeps depth. The pyramid is then rebuilt from that depth and the second
+/// phase retests only what the first phase rejected, drawing whatever turned out visible with
+/// getRenderPass(1) on top, so objects coming out from behind an occluder never pop in late.
+class OcclusionCulling
+{
+public:
+	OcclusionCulling(VulkanBase& base, GpuCulling& gpuCulling, uint32_t maxObjects);
+	~OcclusionCulling();
+
+	/// Both passes are compatible with the base render pass and framebuffers
+	VkRenderPass getRenderPass(uint32_t phase) const { return renderPasses[phase]; }
+
+	void recordFirstPhase(VkCommandBuffer commandBuffer, uint32_t imageIndex, const glm::mat4& viewProj,
+	                      uint32_t objectCount);
+	/// Between the two render passes, builds the pyramid and culls the second phase
+	void recordSecondPhase(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t objectCount);
+	void recordDraws(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t phase, uint32_t objectCount);
+	void recordEnd(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	/// Stats of the last frame recorded for this image, call once its fence has signaled
+	OcclusionStats readStats(uint32_t imageIndex);
+	void resize() { pyramid.resize(); }
+	/// Gives swapchain images without buffers their own, the timestamps start over in a new query pool
+	void addSwapchainImages();
+
+	/// When off the pyramid is still built but nothing is rejected by it, for comparing GPU times
+	bool occlusionEnabled = true;
+
+private:
+	static const uint32_t TIMESTAMPS_PER_FRAME = 4;
+
+	VulkanBase& base;
+	GpuCulling& gpuCulling;
+	DepthPyramid pyramid;
+	uint32_t maxObjects;
+	bool compact;
+	VkShaderModule cullShader;
+	VkPipelineLayout pipelineLayout;
+	VkDescriptorSetLayout setLayout;
+	VkPipeline pipeline;
+	TypedUpdateTemplate<OcclusionCullDescriptors> updateTemplate;
+	VkRenderPass renderPasses[2];
+	glm::vec4 frustumPlanes[6];
+
+	VkQueryPool queryPool = VK_NULL_HANDLE;
+	float timestampPeriod = 0.f;
+	std::vector<bool> timestampsWritten;
+	std::vector<uint32_t> recordedObjectCounts;
+	std::vector<VkBuffer> drawCommandBuffers;
+	std::vector<VmaAllocation> drawCommandBufferAllocations;
+	std::vector<VkBuffer> counterBuffers;
+	std::vector<VmaAllocation> counterBufferAllocations;
+	std::vector<VkBuffer> occludedFlagBuffers;
+	std::vector<VmaAllocation> occludedFlagBufferAllocations;
+
+	VkRenderPass createRenderPass(uint32_t phase);
+	void recordCulling(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t phase, uint32_t objectCount);
+	void writeTimestamp(VkCommandBuffer commandBuffer, uint32_t imageIndex, VkPipelineStageFlagBits stage,
+	                    uint32_t index);
+};
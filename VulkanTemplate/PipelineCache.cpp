@@ -0,0 +1,455 @@
+#include "PipelineCache.h"
+
+#include <stdexcept>
+
+namespace
+{
+	template <typename T>
+	void hashCombine(size_t& seed, const T& value)
+	{
+		seed ^= std::hash<T>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+	}
+}
+
+bool PipelineDescription::operator==(const PipelineDescription& other) const
+{
+	if (vertexBindings.size() != other.vertexBindings.size() ||
+		vertexAttributes.size() != other.vertexAttributes.size())
+	{
+		return false;
+	}
+	for (size_t i = 0; i < vertexBindings.size(); i++)
+	{
+		const auto& a = vertexBindings[i];
+		const auto& b = other.vertexBindings[i];
+		if (a.binding != b.binding || a.stride != b.stride || a.inputRate != b.inputRate)
+		{
+			return false;
+		}
+	}
+	for (size_t i = 0; i < vertexAttributes.size(); i++)
+	{
+		const auto& a = vertexAttributes[i];
+		const auto& b = other.vertexAttributes[i];
+		if (a.location != b.location || a.binding != b.binding || a.format != b.format || a.offset != b.offset)
+		{
+			return false;
+		}
+	}
+
+	return vertShader == other.vertShader && fragShader == other.fragShader &&
+		specializationConstants == other.specializationConstants &&
+		topology == other.topology && polygonMode == other.polygonMode &&
+		cullMode == other.cullMode && frontFace == other.frontFace && sampleCount == other.sampleCount &&
+		depthBiasEnable == other.depthBiasEnable && depthBiasConstantFactor == other.depthBiasConstantFactor &&
+		depthBiasSlopeFactor == other.depthBiasSlopeFactor &&
+		depthTestEnable == other.depthTestEnable && depthWriteEnable == other.depthWriteEnable &&
+		depthCompareOp == other.depthCompareOp && colorAttachmentCount == other.colorAttachmentCount &&
+		blendEnable == other.blendEnable &&
+		srcColorBlendFactor == other.srcColorBlendFactor && dstColorBlendFactor == other.dstColorBlendFactor &&
+		colorBlendOp == other.colorBlendOp &&
+		layout == other.layout && renderPass == other.renderPass && subpass == other.subpass;
+}
+
+size_t std::hash<PipelineDescription>::operator()(PipelineDescription const& description) const
+{
+	size_t seed = 0;
+	hashCombine(seed, (uint64_t)description.vertShader);
+	hashCombine(seed, (uint64_t)description.fragShader);
+	for (const auto& constant : description.specializationConstants)
+	{
+		hashCombine(seed, constant.constantID);
+		hashCombine(seed, constant.value);
+	}
+	for (const auto& binding : description.vertexBindings)
+	{
+		hashCombine(seed, binding.binding);
+		hashCombine(seed, binding.stride);
+		hashCombine(seed, static_cast<uint32_t>(binding.inputRate));
+	}
+	for (const auto& attribute : description.vertexAttributes)
+	{
+		hashCombine(seed, attribute.location);
+		hashCombine(seed, attribute.binding);
+		hashCombine(seed, static_cast<uint32_t>(attribute.format));
+		hashCombine(seed, attribute.offset);
+	}
+	hashCombine(seed, static_cast<uint32_t>(description.topology));
+	hashCombine(seed, static_cast<uint32_t>(description.polygonMode));
+	hashCombine(seed, static_cast<uint32_t>(description.cullMode));
+	hashCombine(seed, static_cast<uint32_t>(description.frontFace));
+	hashCombine(seed, static_cast<uint32_t>(description.sampleCount));
+	hashCombine(seed, description.depthBiasEnable);
+	hashCombine(seed, description.depthBiasConstantFactor);
+	hashCombine(seed, description.depthBiasSlopeFactor);
+	hashCombine(seed, description.depthTestEnable);
+	hashCombine(seed, description.depthWriteEnable);
+	hashCombine(seed, static_cast<uint32_t>(description.depthCompareOp));
+	hashCombine(seed, description.colorAttachmentCount);
+	hashCombine(seed, description.blendEnable);
+	hashCombine(seed, static_cast<uint32_t>(description.srcColorBlendFactor));
+	hashCombine(seed, static_cast<uint32_t>(description.dstColorBlendFactor));
+	hashCombine(seed, static_cast<uint32_t>(description.colorBlendOp));
+	hashCombine(seed, (uint64_t)description.layout);
+	hashCombine(seed, (uint64_t)description.renderPass);
+	hashCombine(seed, description.subpass);
+	return seed;
+}
+
+PipelineCache::PipelineCache(VkDevice device, uint32_t workerCount)
+	: device(device)
+{
+	if (workerCount == 0)
+	{
+		throw std::runtime_error("pipeline cache needs at least one worker thread");
+	}
+
+	VkPipelineCacheCreateInfo cacheCreateInfo = {};
+	cacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+	if (vkCreatePipelineCache(device, &cacheCreateInfo, nullptr, &vkPipelineCache) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create pipeline cache!");
+	}
+
+	for (uint32_t i = 0; i < workerCount; i++)
+	{
+		workers.emplace_back(&PipelineCache::workerLoop, this);
+	}
+}
+
+PipelineCache::~PipelineCache()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	queueCondition.notify_all();
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+
+	for (auto& entry : entries)
+	{
+		if (entry.second.pipeline != VK_NULL_HANDLE)
+		{
+			vkDestroyPipeline(device, entry.second.pipeline, nullptr);
+		}
+	}
+	vkDestroyPipelineCache(device, vkPipelineCache, nullptr);
+}
+
+VkPipeline PipelineCache::getPipeline(const PipelineDescription& description, VkPipeline fallback)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto it = entries.find(description);
+	if (it != entries.end())
+	{
+		if (it->second.pending)
+		{
+			return fallback;
+		}
+		stats.hits++;
+		return it->second.pipeline;
+	}
+
+	failures.erase(description);
+	stats.misses++;
+	entries[description].pending = true;
+	trackModules(description, true);
+	compileQueue.push_back(description);
+	queueCondition.notify_one();
+	return fallback;
+}
+
+VkPipeline PipelineCache::getPipelineBlocking(const PipelineDescription& description)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	auto it = entries.find(description);
+	if (it != entries.end())
+	{
+		idleCondition.wait(lock, [&]
+		{
+			it = entries.find(description);
+			return it == entries.end() || !it->second.pending;
+		});
+		// Gone when its compile failed or it was evicted meanwhile
+		if (it == entries.end())
+		{
+			return VK_NULL_HANDLE;
+		}
+		stats.hits++;
+		return it->second.pipeline;
+	}
+
+	failures.erase(description);
+	stats.misses++;
+	entries[description].pending = true;
+	trackModules(description, true);
+	lock.unlock();
+
+	VkPipeline pipeline = compile(description);
+
+	lock.lock();
+	pipeline = finishCompile(description, pipeline);
+	idleCondition.notify_all();
+	return pipeline;
+}
+
+bool PipelineCache::hasFailed(const PipelineDescription& description)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return failures.count(description) != 0;
+}
+
+VkPipeline PipelineCache::evict(const PipelineDescription& description)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	failures.erase(description);
+	auto it = entries.find(description);
+	if (it == entries.end())
+	{
+		return VK_NULL_HANDLE;
+	}
+	if (it->second.pending)
+	{
+		it->second.evicted = true;
+		return VK_NULL_HANDLE;
+	}
+	VkPipeline pipeline = it->second.pipeline;
+	entries.erase(it);
+	return pipeline;
+}
+
+bool PipelineCache::isModuleInUse(VkShaderModule shaderModule)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return moduleJobs.count(shaderModule) != 0;
+}
+
+void PipelineCache::waitIdle()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	idleCondition.wait(lock, [&] { return compileQueue.empty() && activeJobs == 0; });
+}
+
+size_t PipelineCache::size()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return entries.size();
+}
+
+PipelineCacheStats PipelineCache::getStats()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+void PipelineCache::workerLoop()
+{
+	while (true)
+	{
+		PipelineDescription description;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			queueCondition.wait(lock, [&] { return stopping || !compileQueue.empty(); });
+			if (stopping)
+			{
+				return;
+			}
+			description = std::move(compileQueue.front());
+			compileQueue.pop_front();
+			activeJobs++;
+		}
+
+		VkPipeline pipeline = compile(description);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			finishCompile(description, pipeline);
+			activeJobs--;
+		}
+		idleCondition.notify_all();
+	}
+}
+
+VkPipeline PipelineCache::finishCompile(const PipelineDescription& description, VkPipeline pipeline)
+{
+	pipeline != VK_NULL_HANDLE ? stats.compiled++ : stats.failed++;
+	trackModules(description, false);
+	auto it = entries.find(description);
+	if (it->second.evicted)
+	{
+		// Nothing has seen it yet, so it can go right away
+		if (pipeline != VK_NULL_HANDLE)
+		{
+			vkDestroyPipeline(device, pipeline, nullptr);
+		}
+		entries.erase(it);
+		return VK_NULL_HANDLE;
+	}
+	if (pipeline == VK_NULL_HANDLE)
+	{
+		// Not cached, so a fixed shader or layout is picked up the next time it is asked for
+		entries.erase(it);
+		failures.insert(description);
+		return VK_NULL_HANDLE;
+	}
+
+	it->second.pipeline = pipeline;
+	it->second.pending = false;
+	return pipeline;
+}
+
+VkPipeline PipelineCache::compile(const PipelineDescription& description)
+{
+	std::vector<VkSpecializationMapEntry> mapEntries;
+	std::vector<uint32_t> specializationData;
+	for (const auto& constant : description.specializationConstants)
+	{
+		VkSpecializationMapEntry mapEntry;
+		mapEntry.constantID = constant.constantID;
+		mapEntry.offset = static_cast<uint32_t>(specializationData.size() * sizeof(uint32_t));
+		mapEntry.size = sizeof(uint32_t);
+		mapEntries.push_back(mapEntry);
+		specializationData.push_back(constant.value);
+	}
+
+	VkSpecializationInfo specializationInfo = {};
+	specializationInfo.mapEntryCount = static_cast<uint32_t>(mapEntries.size());
+	specializationInfo.pMapEntries = mapEntries.data();
+	specializationInfo.dataSize = specializationData.size() * sizeof(uint32_t);
+	specializationInfo.pData = specializationData.data();
+
+	VkPipelineShaderStageCreateInfo shaderStages[2] = {};
+	shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	shaderStages[0].module = description.vertShader;
+	shaderStages[0].pName = "main";
+	shaderStages[0].pSpecializationInfo = mapEntries.empty() ? nullptr : &specializationInfo;
+	shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	shaderStages[1].module = description.fragShader;
+	shaderStages[1].pName = "main";
+	shaderStages[1].pSpecializationInfo = mapEntries.empty() ? nullptr : &specializationInfo;
+
+	VkPipelineVertexInputStateCreateInfo inputState = {};
+	inputState.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	inputState.vertexBindingDescriptionCount = static_cast<uint32_t>(description.vertexBindings.size());
+	inputState.pVertexBindingDescriptions = description.vertexBindings.data();
+	inputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(description.vertexAttributes.size());
+	inputState.pVertexAttributeDescriptions = description.vertexAttributes.data();
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = description.topology;
+	inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+	// Viewport and scissor are dynamic so swapchain resizes never force a pipeline rebuild
+	VkPipelineViewportStateCreateInfo viewportState = {};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1;
+	viewportState.pViewports = nullptr;
+	viewportState.scissorCount = 1;
+	viewportState.pScissors = nullptr;
+
+	VkDynamicState dynamicStates[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+	VkPipelineDynamicStateCreateInfo dynamicState = {};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = 2;
+	dynamicState.pDynamicStates = dynamicStates;
+
+	VkPipelineRasterizationStateCreateInfo rasterizer = {};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.depthClampEnable = VK_FALSE;
+	rasterizer.rasterizerDiscardEnable = VK_FALSE;
+	rasterizer.polygonMode = description.polygonMode;
+	rasterizer.lineWidth = 1.0f;
+	rasterizer.cullMode = description.cullMode;
+	rasterizer.frontFace = description.frontFace;
+	rasterizer.depthBiasEnable = description.depthBiasEnable;
+	rasterizer.depthBiasConstantFactor = description.depthBiasConstantFactor;
+	rasterizer.depthBiasSlopeFactor = description.depthBiasSlopeFactor;
+
+	VkPipelineMultisampleStateCreateInfo multiSampleInfo = {};
+	multiSampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multiSampleInfo.sampleShadingEnable = VK_FALSE;
+	multiSampleInfo.rasterizationSamples = description.sampleCount;
+
+	VkPipelineDepthStencilStateCreateInfo depthInfo = {};
+	depthInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthInfo.depthTestEnable = description.depthTestEnable;
+	depthInfo.depthWriteEnable = description.depthWriteEnable;
+	depthInfo.depthCompareOp = description.depthCompareOp;
+	depthInfo.depthBoundsTestEnable = VK_FALSE;
+	depthInfo.stencilTestEnable = VK_FALSE;
+
+	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+	colorBlendAttachment.colorWriteMask =
+		VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	colorBlendAttachment.blendEnable = description.blendEnable;
+	colorBlendAttachment.srcColorBlendFactor = description.srcColorBlendFactor;
+	colorBlendAttachment.dstColorBlendFactor = description.dstColorBlendFactor;
+	colorBlendAttachment.colorBlendOp = description.colorBlendOp;
+	colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+	VkPipelineColorBlendStateCreateInfo colorBlending = {};
+	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlending.logicOpEnable = VK_FALSE;
+	colorBlending.logicOp = VK_LOGIC_OP_COPY;
+	const std::vector<VkPipelineColorBlendAttachmentState> colorBlendAttachments(description.colorAttachmentCount,
+	                                                                             colorBlendAttachment);
+	colorBlending.attachmentCount = description.colorAttachmentCount;
+	colorBlending.pAttachments = colorBlendAttachments.data();
+
+	VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
+	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineCreateInfo.stageCount = description.fragShader != VK_NULL_HANDLE ? 2 : 1;
+	pipelineCreateInfo.pStages = shaderStages;
+	pipelineCreateInfo.pVertexInputState = &inputState;
+	pipelineCreateInfo.pInputAssemblyState = &inputAssembly;
+	pipelineCreateInfo.pViewportState = &viewportState;
+	pipelineCreateInfo.pRasterizationState = &rasterizer;
+	pipelineCreateInfo.pMultisampleState = &multiSampleInfo;
+	pipelineCreateInfo.pDepthStencilState = &depthInfo;
+	pipelineCreateInfo.pColorBlendState = &colorBlending;
+	pipelineCreateInfo.pDynamicState = &dynamicState;
+	pipelineCreateInfo.layout = description.layout;
+	pipelineCreateInfo.renderPass = description.renderPass;
+	pipelineCreateInfo.subpass = description.subpass;
+	pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelineCreateInfo.basePipelineIndex = -1;
+
+	// VkPipelineCache is internally synchronized, so workers can share it
+	VkPipeline pipeline;
+	if (vkCreateGraphicsPipelines(device, vkPipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline) != VK_SUCCESS)
+	{
+		return VK_NULL_HANDLE;
+	}
+	return pipeline;
+}
+
+void PipelineCache::trackModules(const PipelineDescription& description, bool started)
+{
+	for (VkShaderModule shaderModule : {description.vertShader, description.fragShader})
+	{
+		if (shaderModule == VK_NULL_HANDLE)
+		{
+			continue;
+		}
+		if (started)
+		{
+			moduleJobs[shaderModule]++;
+		}
+		else if (--moduleJobs[shaderModule] == 0)
+		{
+			moduleJobs.erase(shaderModule);
+		}
+	}
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+
+struct SpecializationConstant
+{
+	uint32_t constantID;
+	uint32_t value;
+
+	bool operator==(const SpecializationConstant& other) const
+	{
+		return constantID == other.constantID && value == other.value;
+	}
+};
+
+struct PipelineDescription
+{
+	VkShaderModule vertShader = VK_NULL_HANDLE;
+	/// Left null for depth-only pipelines
+	VkShaderModule fragShader = VK_NULL_HANDLE;
+	std::vector<SpecializationConstant> specializationConstants;
+
+	std::vector<VkVertexInputBindingDescription> vertexBindings;
+	std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+	VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+	VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+	VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+	VkSampleCountFlagBits sampleCount = VK_SAMPLE_COUNT_1_BIT;
+	/// Constant and slope scaled, as shadow map passes use to keep surfaces from shadowing themselves
+	VkBool32 depthBiasEnable = VK_FALSE;
+	float depthBiasConstantFactor = 0.f;
+	float depthBiasSlopeFactor = 0.f;
+
+	VkBool32 depthTestEnable = VK_TRUE;
+	VkBool32 depthWriteEnable = VK_TRUE;
+	VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+	/// Every color attachment of the subpass gets the same blend state
+	uint32_t colorAttachmentCount = 1;
+	VkBool32 blendEnable = VK_FALSE;
+	VkBlendFactor srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+	VkBlendFactor dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+	VkBlendOp colorBlendOp = VK_BLEND_OP_ADD;
+
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	uint32_t subpass = 0;
+
+	bool operator==(const PipelineDescription& other) const;
+};
+
+namespace std
+{
+	template <>
+	struct hash<PipelineDescription>
+	{
+		size_t operator()(PipelineDescription const& description) const;
+	};
+}
+
+struct PipelineCacheStats
+{
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	uint64_t compiled = 0;
+	uint64_t failed = 0;
+};
+
+/// Hands out VkPipelines keyed by their full description. Missing pipelines are
+/// compiled on worker threads, so a frame can fall back or skip the draw instead of hitching.
+class PipelineCache
+{
+public:
+	PipelineCache(VkDevice device, uint32_t workerCount);
+	~PipelineCache();
+
+	VkPipeline getPipeline(const PipelineDescription& description, VkPipeline fallback = VK_NULL_HANDLE);
+	VkPipeline getPipelineBlocking(const PipelineDescription& description);
+	/// Failed compiles are not cached, asking for the pipeline again compiles it again and clears this
+	bool hasFailed(const PipelineDescription& description);
+	/// Forgets a pipeline nothing will bind again and hands it back, for the caller to destroy once the frames
+	/// using it have retired. One still compiling is destroyed by the worker as soon as it is done.
+	VkPipeline evict(const PipelineDescription& description);
+	/// Whether a queued or running compile still reads the module, which has to outlive that job
+	bool isModuleInUse(VkShaderModule shaderModule);
+	void waitIdle();
+	size_t size();
+	PipelineCacheStats getStats();
+
+private:
+	struct Entry
+	{
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		bool pending = false;
+		bool evicted = false;
+	};
+
+	VkDevice device;
+	VkPipelineCache vkPipelineCache;
+	std::unordered_map<PipelineDescription, Entry> entries;
+	std::unordered_set<PipelineDescription> failures;
+	/// Compile jobs not finished yet per shader module they read
+	std::unordered_map<VkShaderModule, uint32_t> moduleJobs;
+	std::deque<PipelineDescription> compileQueue;
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable queueCondition;
+	std::condition_variable idleCondition;
+	uint32_t activeJobs = 0;
+	bool stopping = false;
+	PipelineCacheStats stats;
+
+	void workerLoop();
+	VkPipeline compile(const PipelineDescription& description);
+	/// Stores the result of a compile with the mutex held, returns what the requester may use
+	VkPipeline finishCompile(const PipelineDescription& description, VkPipeline pipeline);
+	void trackModules(const PipelineDescription& description, bool started);
+};
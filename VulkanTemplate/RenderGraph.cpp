@@ -0,0 +1,841 @@
+#include "RenderGraph.h"
+#include "VulkanBase.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+namespace
+{
+	const VkAccessFlags WRITE_ACCESS = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	bool isDepthFormat(VkFormat format)
+	{
+		return format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_X8_D24_UNORM_PACK32 ||
+			format == VK_FORMAT_D32_SFLOAT || format == VK_FORMAT_D16_UNORM_S8_UINT ||
+			format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+	}
+
+	VkImageAspectFlagBits aspectOf(VkFormat format)
+	{
+		return isDepthFormat(format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+	}
+
+	bool overlaps(uint32_t firstA, uint32_t lastA, uint32_t firstB, uint32_t lastB)
+	{
+		return firstA <= lastB && firstB <= lastA;
+	}
+}
+
+RenderGraph::RenderGraph(VulkanBase& base)
+	: base(base)
+{
+}
+
+RenderGraph::~RenderGraph()
+{
+	for (Pass& pass : passes)
+	{
+		for (VkFramebuffer framebuffer : pass.framebuffers)
+		{
+			vkDestroyFramebuffer(base.device, framebuffer, nullptr);
+		}
+		if (pass.renderPass != VK_NULL_HANDLE)
+		{
+			vkDestroyRenderPass(base.device, pass.renderPass, nullptr);
+		}
+	}
+	for (Resource& resource : resources)
+	{
+		if (resource.imported)
+		{
+			continue;
+		}
+		for (VkImageView view : resource.views)
+		{
+			vkDestroyImageView(base.device, view, nullptr);
+		}
+		for (VkImage image : resource.images)
+		{
+			vkDestroyImage(base.device, image, nullptr);
+		}
+	}
+	for (MemoryBlock& block : memoryBlocks)
+	{
+		vmaFreeMemory(base.allocator, block.allocation);
+	}
+}
+
+RenderGraphResource RenderGraph::createImage(const std::string& name, const RenderGraphImageDesc& desc)
+{
+	Resource resource;
+	resource.name = name;
+	resource.desc = desc;
+	resources.push_back(resource);
+	return static_cast<RenderGraphResource>(resources.size() - 1);
+}
+
+RenderGraphResource RenderGraph::importImage(const std::string& name, const std::vector<VkImage>& images,
+                                             const std::vector<VkImageView>& views, VkFormat format,
+                                             VkSampleCountFlagBits samples, VkImageLayout finalLayout)
+{
+	if (images.empty() || images.size() != views.size())
+	{
+		throw std::runtime_error("render graph import needs a view for every image!");
+	}
+
+	Resource resource;
+	resource.name = name;
+	resource.desc.format = format;
+	resource.desc.samples = samples;
+	resource.imported = true;
+	resource.finalLayout = finalLayout;
+	resource.images = images;
+	resource.views = views;
+	resources.push_back(resource);
+	imageCount = std::max(imageCount, static_cast<uint32_t>(images.size()));
+	return static_cast<RenderGraphResource>(resources.size() - 1);
+}
+
+void RenderGraph::markOutput(RenderGraphResource resource)
+{
+	resources[resource].output = true;
+}
+
+uint32_t RenderGraph::addGraphicsPass(const std::string& name, const RecordCallback& record)
+{
+	return addPass(name, false, record);
+}
+
+uint32_t RenderGraph::addComputePass(const std::string& name, const RecordCallback& record)
+{
+	return addPass(name, true, record);
+}
+
+uint32_t RenderGraph::addPass(const std::string& name, bool compute, const RecordCallback& record)
+{
+	if (compiled)
+	{
+		throw std::runtime_error("render graph is already compiled!");
+	}
+	Pass pass;
+	pass.name = name;
+	pass.compute = compute;
+	pass.record = record;
+	passes.push_back(pass);
+	return static_cast<uint32_t>(passes.size() - 1);
+}
+
+void RenderGraph::markSideEffects(uint32_t pass)
+{
+	passes[pass].sideEffects = true;
+}
+
+void RenderGraph::writeColor(uint32_t pass, RenderGraphResource resource, VkAttachmentLoadOp loadOp,
+                             VkClearColorValue clearColor)
+{
+	VkClearValue clearValue = {};
+	clearValue.color = clearColor;
+	addUse(pass, resource, Access::ColorWrite, loadOp, clearValue);
+}
+
+void RenderGraph::writeDepth(uint32_t pass, RenderGraphResource resource, VkAttachmentLoadOp loadOp,
+                             VkClearDepthStencilValue clearDepth)
+{
+	VkClearValue clearValue = {};
+	clearValue.depthStencil = clearDepth;
+	addUse(pass, resource, Access::DepthWrite, loadOp, clearValue);
+}
+
+void RenderGraph::resolveColor(uint32_t pass, RenderGraphResource source, RenderGraphResource target)
+{
+	const std::vector<Use>& uses = passes[pass].uses;
+	const bool sourceIsColor = std::any_of(uses.begin(), uses.end(), [source](const Use& use)
+	{
+		return use.resource == source && use.access == Access::ColorWrite;
+	});
+	if (!sourceIsColor)
+	{
+		throw std::runtime_error("render graph resolve source is not a color attachment of the pass!");
+	}
+	addUse(pass, target, Access::ResolveWrite, VK_ATTACHMENT_LOAD_OP_DONT_CARE, {}, source);
+}
+
+void RenderGraph::readSampled(uint32_t pass, RenderGraphResource resource)
+{
+	addUse(pass, resource, Access::SampledRead, VK_ATTACHMENT_LOAD_OP_LOAD, {});
+}
+
+void RenderGraph::readStorage(uint32_t pass, RenderGraphResource resource)
+{
+	addUse(pass, resource, Access::StorageRead, VK_ATTACHMENT_LOAD_OP_LOAD, {});
+}
+
+void RenderGraph::writeStorage(uint32_t pass, RenderGraphResource resource)
+{
+	addUse(pass, resource, Access::StorageWrite, VK_ATTACHMENT_LOAD_OP_LOAD, {});
+}
+
+void RenderGraph::addUse(uint32_t pass, RenderGraphResource resource, Access access, VkAttachmentLoadOp loadOp,
+                         VkClearValue clearValue, RenderGraphResource source)
+{
+	if (compiled)
+	{
+		throw std::runtime_error("render graph is already compiled!");
+	}
+	Pass& target = passes[pass];
+	for (const Use& use : target.uses)
+	{
+		if (use.resource == resource)
+		{
+			throw std::runtime_error("render graph pass uses the same image twice!");
+		}
+	}
+	const bool attachment = access == Access::ColorWrite || access == Access::DepthWrite ||
+		access == Access::ResolveWrite;
+	if (attachment && target.compute)
+	{
+		throw std::runtime_error("compute render graph pass cannot have attachments!");
+	}
+
+	target.uses.push_back({resource, access, loadOp, clearValue, source});
+	Resource& image = resources[resource];
+	switch (access)
+	{
+	case Access::ColorWrite:
+	case Access::ResolveWrite:
+		image.usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		break;
+	case Access::DepthWrite:
+		image.usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		break;
+	case Access::SampledRead:
+		image.usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+		break;
+	case Access::StorageRead:
+	case Access::StorageWrite:
+		image.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+		break;
+	}
+}
+
+void RenderGraph::compile(uint32_t width, uint32_t height)
+{
+	if (compiled)
+	{
+		throw std::runtime_error("render graph is already compiled!");
+	}
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	cullPasses();
+	computeLifetimes();
+	extent = {width, height};
+	createTransientImages(width, height);
+	aliasMemory();
+	for (uint32_t position = 0; position < executionOrder.size(); position++)
+	{
+		Pass& pass = passes[executionOrder[position]];
+		if (!pass.compute)
+		{
+			createRenderPass(pass, position);
+		}
+	}
+	planBarriers();
+	compiled = true;
+
+	stats.declaredPasses = static_cast<uint32_t>(passes.size());
+	stats.culledPasses = static_cast<uint32_t>(passes.size() - executionOrder.size());
+	stats.compileMilliseconds = std::chrono::duration<double, std::milli>(
+		std::chrono::high_resolution_clock::now() - startTime).count();
+}
+
+RenderGraph::AccessInfo RenderGraph::describeAccess(const Use& use, bool compute)
+{
+	const VkPipelineStageFlags shaderStage = compute
+		                                         ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+		                                         : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	const bool load = use.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD;
+	switch (use.access)
+	{
+	case Access::ColorWrite:
+		return {
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | (load ? VK_ACCESS_COLOR_ATTACHMENT_READ_BIT : 0u), true, load
+		};
+	case Access::DepthWrite:
+		// Depth testing reads the attachment whatever the load op
+		return {
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, true, load
+		};
+	case Access::ResolveWrite:
+		return {
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, true, false
+		};
+	case Access::SampledRead:
+		return {VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, shaderStage, VK_ACCESS_SHADER_READ_BIT, false, true};
+	case Access::StorageRead:
+		return {VK_IMAGE_LAYOUT_GENERAL, shaderStage, VK_ACCESS_SHADER_READ_BIT, false, true};
+	default:
+		// Storage writes may leave parts of the image as they were
+		return {
+			VK_IMAGE_LAYOUT_GENERAL, shaderStage, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, true, true
+		};
+	}
+}
+
+void RenderGraph::cullPasses()
+{
+	// Walking back from the outputs, a pass is needed when a later needed pass reads what it writes
+	std::vector<bool> needed(resources.size());
+	for (size_t i = 0; i < resources.size(); i++)
+	{
+		needed[i] = resources[i].output;
+	}
+	for (size_t i = passes.size(); i-- > 0;)
+	{
+		Pass& pass = passes[i];
+		bool keep = pass.sideEffects;
+		for (const Use& use : pass.uses)
+		{
+			keep = keep || (describeAccess(use, pass.compute).writes && needed[use.resource]);
+		}
+		pass.culled = !keep;
+		if (!keep)
+		{
+			continue;
+		}
+
+		// Whatever earlier passes wrote is overwritten here, unless this pass builds on it
+		for (const Use& use : pass.uses)
+		{
+			const AccessInfo info = describeAccess(use, pass.compute);
+			if (info.writes && !info.readsContents)
+			{
+				needed[use.resource] = false;
+			}
+		}
+		for (const Use& use : pass.uses)
+		{
+			if (describeAccess(use, pass.compute).readsContents)
+			{
+				needed[use.resource] = true;
+			}
+		}
+	}
+
+	executionOrder.clear();
+	for (uint32_t i = 0; i < passes.size(); i++)
+	{
+		if (!passes[i].culled)
+		{
+			executionOrder.push_back(i);
+		}
+	}
+}
+
+void RenderGraph::computeLifetimes()
+{
+	for (uint32_t position = 0; position < executionOrder.size(); position++)
+	{
+		for (const Use& use : passes[executionOrder[position]].uses)
+		{
+			Resource& resource = resources[use.resource];
+			resource.firstUse = std::min(resource.firstUse, position);
+			resource.lastUse = std::max(resource.lastUse, position);
+		}
+	}
+	// Outputs are read after the graph, nothing later in the frame may take their memory
+	for (Resource& resource : resources)
+	{
+		if (resource.output && resource.firstUse != UINT32_MAX)
+		{
+			resource.lastUse = static_cast<uint32_t>(executionOrder.size());
+		}
+	}
+}
+
+void RenderGraph::createTransientImages(uint32_t width, uint32_t height)
+{
+	for (Resource& resource : resources)
+	{
+		if (resource.imported)
+		{
+			resource.extent = {width, height};
+			continue;
+		}
+		// Images only culled passes used are never created
+		if (resource.firstUse == UINT32_MAX)
+		{
+			continue;
+		}
+
+		resource.extent.width = std::max(1u, static_cast<uint32_t>(width * resource.desc.scale));
+		resource.extent.height = std::max(1u, static_cast<uint32_t>(height * resource.desc.scale));
+
+		VkImageCreateInfo imageCreateInfo = {};
+		imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageCreateInfo.extent.width = resource.extent.width;
+		imageCreateInfo.extent.height = resource.extent.height;
+		imageCreateInfo.extent.depth = 1;
+		imageCreateInfo.mipLevels = 1;
+		imageCreateInfo.arrayLayers = 1;
+		imageCreateInfo.format = resource.desc.format;
+		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageCreateInfo.usage = resource.usage;
+		imageCreateInfo.samples = resource.desc.samples;
+		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		// Memory is bound once every image is known, so images can share it
+		VkImage image;
+		if (vkCreateImage(base.device, &imageCreateInfo, nullptr, &image) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create render graph image!");
+		}
+		resource.images.push_back(image);
+		vkGetImageMemoryRequirements(base.device, image, &resource.memoryRequirements);
+		stats.transientImages++;
+		stats.transientBytes += resource.memoryRequirements.size;
+	}
+}
+
+void RenderGraph::aliasMemory()
+{
+	// Largest first, each image goes to the first block it fits in without overlapping lifetimes
+	std::vector<RenderGraphResource> order;
+	for (uint32_t i = 0; i < resources.size(); i++)
+	{
+		if (!resources[i].imported && !resources[i].images.empty())
+		{
+			order.push_back(i);
+		}
+	}
+	std::stable_sort(order.begin(), order.end(), [this](RenderGraphResource a, RenderGraphResource b)
+	{
+		return resources[a].memoryRequirements.size > resources[b].memoryRequirements.size;
+	});
+
+	for (RenderGraphResource index : order)
+	{
+		Resource& resource = resources[index];
+		const VkMemoryRequirements& requirements = resource.memoryRequirements;
+		uint32_t blockIndex = UINT32_MAX;
+		for (uint32_t i = 0; i < memoryBlocks.size() && aliasingEnabled; i++)
+		{
+			const MemoryBlock& block = memoryBlocks[i];
+			if ((block.requirements.memoryTypeBits & requirements.memoryTypeBits) == 0)
+			{
+				continue;
+			}
+			const bool free = std::none_of(block.resources.begin(), block.resources.end(),
+			                               [&](RenderGraphResource other)
+			                               {
+				                               return overlaps(resource.firstUse, resource.lastUse,
+				                                               resources[other].firstUse, resources[other].lastUse);
+			                               });
+			if (free)
+			{
+				blockIndex = i;
+				break;
+			}
+		}
+
+		if (blockIndex == UINT32_MAX)
+		{
+			blockIndex = static_cast<uint32_t>(memoryBlocks.size());
+			memoryBlocks.emplace_back();
+			memoryBlocks.back().requirements = requirements;
+		}
+		else
+		{
+			VkMemoryRequirements& shared = memoryBlocks[blockIndex].requirements;
+			shared.size = std::max(shared.size, requirements.size);
+			shared.alignment = std::max(shared.alignment, requirements.alignment);
+			shared.memoryTypeBits &= requirements.memoryTypeBits;
+		}
+		memoryBlocks[blockIndex].resources.push_back(index);
+		resource.memoryBlock = blockIndex;
+	}
+
+	for (MemoryBlock& block : memoryBlocks)
+	{
+		std::sort(block.resources.begin(), block.resources.end(), [this](RenderGraphResource a, RenderGraphResource b)
+		{
+			return resources[a].firstUse < resources[b].firstUse;
+		});
+
+		VmaAllocationCreateInfo allocationCreateInfo = {};
+		allocationCreateInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+		if (vmaAllocateMemory(base.allocator, &block.requirements, &allocationCreateInfo, &block.allocation,
+		                      nullptr) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate render graph memory!");
+		}
+		for (RenderGraphResource index : block.resources)
+		{
+			Resource& resource = resources[index];
+			if (vmaBindImageMemory(base.allocator, block.allocation, resource.images[0]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to bind render graph memory!");
+			}
+			resource.views.push_back(base.createImageView(resource.images[0], resource.desc.format,
+			                                              aspectOf(resource.desc.format), 1));
+		}
+		stats.allocatedBytes += block.requirements.size;
+	}
+	stats.memoryBlocks = static_cast<uint32_t>(memoryBlocks.size());
+}
+
+bool RenderGraph::isReadAfter(RenderGraphResource resource, uint32_t position) const
+{
+	for (uint32_t later = position + 1; later < executionOrder.size(); later++)
+	{
+		const Pass& pass = passes[executionOrder[later]];
+		for (const Use& use : pass.uses)
+		{
+			if (use.resource == resource)
+			{
+				return describeAccess(use, pass.compute).readsContents;
+			}
+		}
+	}
+	return resources[resource].output || resources[resource].imported;
+}
+
+void RenderGraph::createRenderPass(Pass& pass, uint32_t position)
+{
+	std::vector<VkAttachmentDescription> attachments;
+	std::vector<RenderGraphResource> attachmentResources;
+	std::vector<VkAttachmentReference> colorRefs;
+	std::vector<VkAttachmentReference> resolveRefs;
+	VkAttachmentReference depthRef = {VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED};
+	bool resolves = false;
+	bool perImage = false;
+
+	auto addAttachment = [&](const Use& use)
+	{
+		const Resource& resource = resources[use.resource];
+		if (!attachmentResources.empty() && (resource.extent.width != pass.extent.width ||
+			resource.extent.height != pass.extent.height))
+		{
+			throw std::runtime_error("render graph pass attachments differ in size!");
+		}
+		pass.extent = resource.extent;
+
+		// Barriers before the pass do the transitions, the render pass keeps the layout
+		const VkImageLayout layout = describeAccess(use, false).layout;
+		VkAttachmentDescription attachment = {};
+		attachment.format = resource.desc.format;
+		attachment.samples = resource.desc.samples;
+		attachment.loadOp = use.loadOp;
+		attachment.storeOp = isReadAfter(use.resource, position)
+			                     ? VK_ATTACHMENT_STORE_OP_STORE
+			                     : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachment.initialLayout = layout;
+		attachment.finalLayout = layout;
+		attachments.push_back(attachment);
+		attachmentResources.push_back(use.resource);
+		pass.clearValues.push_back(use.clearValue);
+		perImage = perImage || resource.images.size() > 1;
+		return VkAttachmentReference{static_cast<uint32_t>(attachments.size() - 1), layout};
+	};
+
+	// Colors first, so resolves can be matched to them by index
+	for (const Use& use : pass.uses)
+	{
+		if (use.access == Access::ColorWrite)
+		{
+			colorRefs.push_back(addAttachment(use));
+		}
+	}
+	resolveRefs.assign(colorRefs.size(), {VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED});
+	for (const Use& use : pass.uses)
+	{
+		if (use.access == Access::DepthWrite)
+		{
+			depthRef = addAttachment(use);
+		}
+		else if (use.access == Access::ResolveWrite)
+		{
+			const VkAttachmentReference resolveRef = addAttachment(use);
+			for (size_t i = 0; i < colorRefs.size(); i++)
+			{
+				if (attachmentResources[colorRefs[i].attachment] == use.source)
+				{
+					resolveRefs[i] = resolveRef;
+				}
+			}
+			resolves = true;
+		}
+	}
+	if (attachments.empty())
+	{
+		pass.extent = extent;
+	}
+
+	VkSubpassDescription subpassDescription = {};
+	subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpassDescription.colorAttachmentCount = static_cast<uint32_t>(colorRefs.size());
+	subpassDescription.pColorAttachments = colorRefs.data();
+	subpassDescription.pResolveAttachments = resolves ? resolveRefs.data() : nullptr;
+	subpassDescription.pDepthStencilAttachment = depthRef.attachment != VK_ATTACHMENT_UNUSED ? &depthRef : nullptr;
+
+	VkRenderPassCreateInfo renderPassCreateInfo = {};
+	renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	renderPassCreateInfo.pAttachments = attachments.data();
+	renderPassCreateInfo.subpassCount = 1;
+	renderPassCreateInfo.pSubpasses = &subpassDescription;
+
+	if (vkCreateRenderPass(base.device, &renderPassCreateInfo, nullptr, &pass.renderPass) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create render graph render pass!");
+	}
+
+	// Passes drawing to an imported image need a framebuffer for every swapchain image
+	pass.framebuffers.resize(perImage ? imageCount : 1);
+	for (uint32_t i = 0; i < pass.framebuffers.size(); i++)
+	{
+		std::vector<VkImageView> views;
+		for (RenderGraphResource resource : attachmentResources)
+		{
+			views.push_back(getImageView(resource, i));
+		}
+
+		VkFramebufferCreateInfo framebufferCreateInfo = {};
+		framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebufferCreateInfo.renderPass = pass.renderPass;
+		framebufferCreateInfo.attachmentCount = static_cast<uint32_t>(views.size());
+		framebufferCreateInfo.pAttachments = views.data();
+		framebufferCreateInfo.width = pass.extent.width;
+		framebufferCreateInfo.height = pass.extent.height;
+		framebufferCreateInfo.layers = 1;
+
+		if (vkCreateFramebuffer(base.device, &framebufferCreateInfo, nullptr, &pass.framebuffers[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create render graph framebuffer!");
+		}
+	}
+}
+
+void RenderGraph::planBarriers()
+{
+	// The first pass over the frame finds where it leaves every image, the second plans the barriers
+	// of a frame that follows such a frame
+	std::vector<ImageState> states(resources.size());
+	simulateFrame(states, false);
+	simulateFrame(states, true);
+
+	stats.imageBarriers = static_cast<uint32_t>(finalBarriers.barriers.size());
+	stats.pipelineBarriers = finalBarriers.dstStages != 0 ? 1 : 0;
+	for (uint32_t index : executionOrder)
+	{
+		const BarrierBatch& batch = passes[index].barriers;
+		stats.imageBarriers += static_cast<uint32_t>(batch.barriers.size());
+		stats.pipelineBarriers += batch.dstStages != 0 ? 1 : 0;
+	}
+}
+
+void RenderGraph::simulateFrame(std::vector<ImageState>& states, bool plan)
+{
+	const std::vector<ImageState> previousFrame = states;
+	for (size_t i = 0; i < resources.size(); i++)
+	{
+		states[i] = ImageState();
+		// The submit waits for the acquire semaphore at color attachment output, so waiting for that
+		// stage orders the first use after the presentation engine is done with the image
+		if (resources[i].imported)
+		{
+			states[i].stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			states[i].writeStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		}
+	}
+
+	for (uint32_t position = 0; position < executionOrder.size(); position++)
+	{
+		Pass& pass = passes[executionOrder[position]];
+		BarrierBatch batch;
+		for (const Use& use : pass.uses)
+		{
+			const Resource& resource = resources[use.resource];
+			ImageState& state = states[use.resource];
+			if (!resource.imported && resource.firstUse == position)
+			{
+				// The memory was last used by the image before this one in its block, or for the first one by
+				// the block's last image in the previous frame, which may still be in flight
+				const std::vector<RenderGraphResource>& sharing = memoryBlocks[resource.memoryBlock].resources;
+				const size_t slot = std::find(sharing.begin(), sharing.end(), use.resource) - sharing.begin();
+				const ImageState& previous = slot == 0 ? previousFrame[sharing.back()] : states[sharing[slot - 1]];
+				ImageState aliased;
+				aliased.stages = previous.stages | previous.writeStages;
+				aliased.writeStages = aliased.stages;
+				aliased.writeAccess = previous.writeAccess;
+				state = aliased;
+			}
+			addTransition(batch, use.resource, state, describeAccess(use, pass.compute));
+		}
+		if (plan)
+		{
+			pass.barriers = batch;
+		}
+	}
+
+	BarrierBatch batch;
+	for (uint32_t i = 0; i < resources.size(); i++)
+	{
+		const Resource& resource = resources[i];
+		if (resource.imported && resource.firstUse != UINT32_MAX &&
+			resource.finalLayout != VK_IMAGE_LAYOUT_UNDEFINED && states[i].layout != resource.finalLayout)
+		{
+			const AccessInfo handOff = {resource.finalLayout, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, false, true};
+			addTransition(batch, i, states[i], handOff);
+		}
+	}
+	if (plan)
+	{
+		finalBarriers = batch;
+	}
+}
+
+void RenderGraph::addTransition(BarrierBatch& batch, RenderGraphResource resource, ImageState& state,
+                                const AccessInfo& info) const
+{
+	const bool layoutChange = state.layout != info.layout;
+	auto addBarrier = [&](VkPipelineStageFlags srcStages, VkImageLayout oldLayout)
+	{
+		batch.srcStages |= srcStages != 0 ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		batch.dstStages |= info.stages;
+		batch.barriers.push_back({resource, oldLayout, info.layout, state.writeAccess, info.access});
+	};
+
+	if (info.writes)
+	{
+		// Layout transitions and writes after writes need the earlier writes made available, writes after
+		// reads only have to wait for the reads to finish
+		if (layoutChange || (state.writeAccess != 0 && state.visibleStages == 0))
+		{
+			addBarrier(state.stages, info.readsContents ? state.layout : VK_IMAGE_LAYOUT_UNDEFINED);
+		}
+		else if (state.stages != 0)
+		{
+			batch.srcStages |= state.stages;
+			batch.dstStages |= info.stages;
+		}
+		state.layout = info.layout;
+		state.stages = info.stages;
+		state.writeStages = info.stages;
+		state.writeAccess = info.access & WRITE_ACCESS;
+		state.visibleStages = 0;
+	}
+	else if (layoutChange)
+	{
+		addBarrier(state.stages, state.layout);
+		// The transition counts as a write, ordered before the stages it was made for
+		state.layout = info.layout;
+		state.stages = info.stages;
+		state.writeStages = info.stages;
+		state.visibleStages = info.stages;
+	}
+	else if (state.writeStages != 0 && (info.stages & ~state.visibleStages) != 0)
+	{
+		addBarrier(state.writeStages, state.layout);
+		state.stages |= info.stages;
+		state.visibleStages |= info.stages;
+	}
+	else
+	{
+		// Reads after reads in the same layout need nothing, later writes wait for all of them
+		state.stages |= info.stages;
+	}
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	if (!compiled)
+	{
+		throw std::runtime_error("render graph is not compiled!");
+	}
+
+	for (uint32_t index : executionOrder)
+	{
+		const Pass& pass = passes[index];
+		recordBarriers(commandBuffer, imageIndex, pass.barriers);
+		if (pass.compute)
+		{
+			if (pass.record)
+			{
+				pass.record(commandBuffer, imageIndex);
+			}
+			continue;
+		}
+
+		VkRenderPassBeginInfo renderPassInfo = {};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = pass.renderPass;
+		renderPassInfo.framebuffer = pass.framebuffers[pass.framebuffers.size() == 1 ? 0 : imageIndex];
+		renderPassInfo.renderArea.offset = {0, 0};
+		renderPassInfo.renderArea.extent = pass.extent;
+		renderPassInfo.clearValueCount = static_cast<uint32_t>(pass.clearValues.size());
+		renderPassInfo.pClearValues = pass.clearValues.data();
+
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		if (pass.record)
+		{
+			pass.record(commandBuffer, imageIndex);
+		}
+		vkCmdEndRenderPass(commandBuffer);
+	}
+	recordBarriers(commandBuffer, imageIndex, finalBarriers);
+}
+
+void RenderGraph::recordBarriers(VkCommandBuffer commandBuffer, uint32_t imageIndex, const BarrierBatch& batch) const
+{
+	if (batch.dstStages == 0)
+	{
+		return;
+	}
+
+	std::vector<VkImageMemoryBarrier> imageBarriers;
+	imageBarriers.reserve(batch.barriers.size());
+	for (const Barrier& barrier : batch.barriers)
+	{
+		VkImageMemoryBarrier imageBarrier = {};
+		imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		imageBarrier.srcAccessMask = barrier.srcAccess;
+		imageBarrier.dstAccessMask = barrier.dstAccess;
+		imageBarrier.oldLayout = barrier.oldLayout;
+		imageBarrier.newLayout = barrier.newLayout;
+		imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.image = getImage(barrier.resource, imageIndex);
+		imageBarrier.subresourceRange.aspectMask = aspectOf(resources[barrier.resource].desc.format);
+		imageBarrier.subresourceRange.levelCount = 1;
+		imageBarrier.subresourceRange.layerCount = 1;
+		imageBarriers.push_back(imageBarrier);
+	}
+	vkCmdPipelineBarrier(commandBuffer, batch.srcStages, batch.dstStages, 0, 0, nullptr, 0, nullptr,
+	                     static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+}
+
+VkImage RenderGraph::getImage(RenderGraphResource resource, uint32_t imageIndex) const
+{
+	const std::vector<VkImage>& images = resources[resource].images;
+	return images[images.size() == 1 ? 0 : imageIndex];
+}
+
+VkImageView RenderGraph::getImageView(RenderGraphResource resource, uint32_t imageIndex) const
+{
+	const std::vector<VkImageView>& views = resources[resource].views;
+	if (views.empty())
+	{
+		throw std::runtime_error("render graph image has no view, it is culled or not compiled!");
+	}
+	return views[views.size() == 1 ? 0 : imageIndex];
+}
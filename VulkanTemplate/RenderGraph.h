@@ -0,0 +1,229 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <vk_mem_alloc.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+class VulkanBase;
+
+/// Handle of an image declared on a render graph
+using RenderGraphResource = uint32_t;
+
+struct RenderGraphImageDesc
+{
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+	/// Size relative to the extent the graph is compiled for
+	float scale = 1.f;
+};
+
+struct RenderGraphStats
+{
+	uint32_t declaredPasses = 0;
+	uint32_t culledPasses = 0;
+	uint32_t transientImages = 0;
+	/// Allocations the transient images were packed into
+	uint32_t memoryBlocks = 0;
+	/// Recorded every frame, including the transitions of imported images to their final layout
+	uint32_t imageBarriers = 0;
+	uint32_t pipelineBarriers = 0;
+	/// What the transient images would take with an allocation each, and what they take aliased
+	VkDeviceSize transientBytes = 0;
+	VkDeviceSize allocatedBytes = 0;
+	double compileMilliseconds = 0.0;
+};
+
+/// Frame described as passes that declare which images they read and write. compile() culls passes
+/// that contribute nothing to an output, plans the layout transitions and the barriers between
+/// passes, so only real hazards get one, and places transient images whose lifetimes do not overlap
+/// in the same memory. Passes run in declaration order, reads see the last earlier write. Every
+/// graphics pass is a render pass of its own, begun and ended by the graph around its callback.
+class RenderGraph
+{
+public:
+	/// Recorded inside the pass' render pass for graphics passes
+	using RecordCallback = std::function<void(VkCommandBuffer commandBuffer, uint32_t imageIndex)>;
+
+	explicit RenderGraph(VulkanBase& base);
+	~RenderGraph();
+
+	/// Created by the graph at compile time, contents do not survive the frame
+	RenderGraphResource createImage(const std::string& name, const RenderGraphImageDesc& desc);
+	/// One image per swapchain image, picked by the image index. Contents are undefined at the start of
+	/// every frame and left in finalLayout at its end.
+	RenderGraphResource importImage(const std::string& name, const std::vector<VkImage>& images,
+	                                const std::vector<VkImageView>& views, VkFormat format,
+	                                VkSampleCountFlagBits samples, VkImageLayout finalLayout);
+	/// Passes are kept only when they lead to an output or are marked as having side effects
+	void markOutput(RenderGraphResource resource);
+
+	uint32_t addGraphicsPass(const std::string& name, const RecordCallback& record);
+	uint32_t addComputePass(const std::string& name, const RecordCallback& record);
+	/// For passes that write buffers or anything else the graph does not see
+	void markSideEffects(uint32_t pass);
+
+	/// loadOp LOAD reads what earlier passes wrote, CLEAR and DONT_CARE overwrite it
+	void writeColor(uint32_t pass, RenderGraphResource resource, VkAttachmentLoadOp loadOp,
+	                VkClearColorValue clearColor = {});
+	void writeDepth(uint32_t pass, RenderGraphResource resource, VkAttachmentLoadOp loadOp,
+	                VkClearDepthStencilValue clearDepth = {1.f, 0});
+	/// source has to be a color attachment of the same pass
+	void resolveColor(uint32_t pass, RenderGraphResource source, RenderGraphResource target);
+	/// Sampled in the fragment shader of graphics passes and in compute passes
+	void readSampled(uint32_t pass, RenderGraphResource resource);
+	void readStorage(uint32_t pass, RenderGraphResource resource);
+	void writeStorage(uint32_t pass, RenderGraphResource resource);
+
+	/// Creates the images, render passes and framebuffers and plans the barriers, after the last
+	/// declaration. A graph is compiled once, a new size needs a new graph.
+	void compile(uint32_t width, uint32_t height);
+	void execute(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+
+	VkImageView getImageView(RenderGraphResource resource, uint32_t imageIndex = 0) const;
+	/// Null for culled and compute passes
+	VkRenderPass getRenderPass(uint32_t pass) const { return passes[pass].renderPass; }
+	VkExtent2D getExtent(uint32_t pass) const { return passes[pass].extent; }
+	bool isCulled(uint32_t pass) const { return passes[pass].culled; }
+	RenderGraphStats getStats() const { return stats; }
+
+	/// When off every transient image gets an allocation of its own, for comparison
+	bool aliasingEnabled = true;
+
+private:
+	enum class Access
+	{
+		ColorWrite,
+		DepthWrite,
+		ResolveWrite,
+		SampledRead,
+		StorageRead,
+		StorageWrite,
+	};
+
+	struct Use
+	{
+		RenderGraphResource resource;
+		Access access;
+		VkAttachmentLoadOp loadOp;
+		VkClearValue clearValue;
+		/// Color attachment a resolve writes from
+		RenderGraphResource source;
+	};
+
+	/// What one use of an image needs from it
+	struct AccessInfo
+	{
+		VkImageLayout layout;
+		VkPipelineStageFlags stages;
+		VkAccessFlags access;
+		bool writes;
+		/// Whether the use needs what the image held before, otherwise its contents are discarded
+		bool readsContents;
+	};
+
+	/// Where an image stands at one point of the frame
+	struct ImageState
+	{
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		/// Every stage that used the image since its last write, the next write waits for all of them
+		VkPipelineStageFlags stages = 0;
+		/// Stages and access of the last write or layout transition
+		VkPipelineStageFlags writeStages = 0;
+		VkAccessFlags writeAccess = 0;
+		/// Stages the last write has been made visible to, reads elsewhere need a barrier first
+		VkPipelineStageFlags visibleStages = 0;
+	};
+
+	struct Barrier
+	{
+		RenderGraphResource resource;
+		VkImageLayout oldLayout;
+		VkImageLayout newLayout;
+		VkAccessFlags srcAccess;
+		VkAccessFlags dstAccess;
+	};
+
+	struct BarrierBatch
+	{
+		VkPipelineStageFlags srcStages = 0;
+		VkPipelineStageFlags dstStages = 0;
+		std::vector<Barrier> barriers;
+	};
+
+	struct Resource
+	{
+		std::string name;
+		RenderGraphImageDesc desc;
+		bool imported = false;
+		bool output = false;
+		VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkImageUsageFlags usage = 0;
+		VkExtent2D extent = {};
+		/// One per swapchain image for imported images, one otherwise
+		std::vector<VkImage> images;
+		std::vector<VkImageView> views;
+		VkMemoryRequirements memoryRequirements = {};
+		uint32_t memoryBlock = UINT32_MAX;
+		/// Executed passes of the first and last use, UINT32_MAX when unused
+		uint32_t firstUse = UINT32_MAX;
+		uint32_t lastUse = 0;
+	};
+
+	struct Pass
+	{
+		std::string name;
+		bool compute;
+		bool sideEffects = false;
+		bool culled = false;
+		RecordCallback record;
+		std::vector<Use> uses;
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		std::vector<VkFramebuffer> framebuffers;
+		VkExtent2D extent = {};
+		std::vector<VkClearValue> clearValues;
+		BarrierBatch barriers;
+	};
+
+	struct MemoryBlock
+	{
+		VmaAllocation allocation = VK_NULL_HANDLE;
+		VkMemoryRequirements requirements = {};
+		/// Resources placed in the block, by first use
+		std::vector<RenderGraphResource> resources;
+	};
+
+	VulkanBase& base;
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	/// Passes left after culling, in execution order
+	std::vector<uint32_t> executionOrder;
+	std::vector<MemoryBlock> memoryBlocks;
+	/// Transitions of imported images to their final layout after the last pass
+	BarrierBatch finalBarriers;
+	VkExtent2D extent = {};
+	uint32_t imageCount = 1;
+	bool compiled = false;
+	RenderGraphStats stats;
+
+	uint32_t addPass(const std::string& name, bool compute, const RecordCallback& record);
+	void addUse(uint32_t pass, RenderGraphResource resource, Access access, VkAttachmentLoadOp loadOp,
+	            VkClearValue clearValue, RenderGraphResource source = UINT32_MAX);
+	void cullPasses();
+	void computeLifetimes();
+	void createTransientImages(uint32_t width, uint32_t height);
+	void aliasMemory();
+	void planBarriers();
+	void addTransition(BarrierBatch& batch, RenderGraphResource resource, ImageState& state,
+	                   const AccessInfo& info) const;
+	/// Walks the frame from states holding the end of the previous one and leaves them at its end
+	void simulateFrame(std::vector<ImageState>& states, bool plan);
+	void createRenderPass(Pass& pass, uint32_t position);
+	static AccessInfo describeAccess(const Use& use, bool compute);
+	void recordBarriers(VkCommandBuffer commandBuffer, uint32_t imageIndex, const BarrierBatch& batch) const;
+	VkImage getImage(RenderGraphResource resource, uint32_t imageIndex) const;
+	/// Whether anything after the executed pass at position reads what the resource holds
+	bool isReadAfter(RenderGraphResource resource, uint32_t position) const;
+};
@@ -0,0 +1,181 @@
+#include "ShaderHotReload.h"
+#include "VulkanBase.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <cstdlib>
+#include <chrono>
+#include <algorithm>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+ShaderHotReload::ShaderHotReload(const std::string& compilerPath)
+	: compilerPath(compilerPath)
+{
+#ifdef __linux__
+	inotifyFd = inotify_init1(IN_NONBLOCK);
+	if (inotifyFd < 0)
+	{
+		throw std::runtime_error("failed to initialize inotify");
+	}
+#endif
+	watcherThread = std::thread(&ShaderHotReload::watcherLoop, this);
+}
+
+ShaderHotReload::~ShaderHotReload()
+{
+	stopping = true;
+	watcherThread.join();
+#ifdef __linux__
+	close(inotifyFd);
+#endif
+}
+
+void ShaderHotReload::watch(const std::string& sourceFile, const std::string& spvFile)
+{
+	std::filesystem::path sourcePath(sourceFile);
+
+	WatchedShader shader;
+	shader.sourceFile = sourceFile;
+	shader.spvFile = spvFile;
+	shader.directory = sourcePath.has_parent_path() ? sourcePath.parent_path().string() : ".";
+	shader.fileName = sourcePath.filename().string();
+	shader.lastWriteTime = std::filesystem::last_write_time(sourcePath);
+
+	std::lock_guard<std::mutex> lock(mutex);
+#ifdef __linux__
+	auto it = std::find_if(watchedDirectories.begin(), watchedDirectories.end(),
+	                       [&](const auto& directory) { return directory.second == shader.directory; });
+	if (it == watchedDirectories.end())
+	{
+		int wd = inotify_add_watch(inotifyFd, shader.directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if (wd < 0)
+		{
+			throw std::runtime_error("failed to watch shader directory " + shader.directory);
+		}
+		watchedDirectories[wd] = shader.directory;
+	}
+#endif
+	watchedShaders.push_back(shader);
+}
+
+std::vector<CompiledShader> ShaderHotReload::takeCompiledShaders()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<CompiledShader> shaders;
+	shaders.swap(compiledShaders);
+	return shaders;
+}
+
+void ShaderHotReload::watcherLoop()
+{
+	while (!stopping)
+	{
+		for (const WatchedShader& shader : waitForChanges())
+		{
+			recompile(shader);
+		}
+	}
+}
+
+std::vector<ShaderHotReload::WatchedShader> ShaderHotReload::waitForChanges()
+{
+	std::vector<WatchedShader> changed;
+
+#ifdef __linux__
+	pollfd pollFd = {};
+	pollFd.fd = inotifyFd;
+	pollFd.events = POLLIN;
+	if (poll(&pollFd, 1, 200) <= 0)
+	{
+		return changed;
+	}
+
+	alignas(inotify_event) char buffer[4096];
+	ssize_t length;
+	std::lock_guard<std::mutex> lock(mutex);
+	while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+	{
+		for (char* ptr = buffer; ptr < buffer + length;)
+		{
+			const inotify_event* event = reinterpret_cast<const inotify_event*>(ptr);
+			ptr += sizeof(inotify_event) + event->len;
+			if (event->len == 0)
+			{
+				continue;
+			}
+
+			const std::string& directory = watchedDirectories[event->wd];
+			for (const WatchedShader& shader : watchedShaders)
+			{
+				// Editors often save several times in a row, only compile once
+				bool alreadyChanged = std::any_of(changed.begin(), changed.end(), [&](const WatchedShader& other)
+				{
+					return other.sourceFile == shader.sourceFile;
+				});
+				if (!alreadyChanged && shader.directory == directory && shader.fileName == event->name)
+				{
+					changed.push_back(shader);
+				}
+			}
+		}
+	}
+#else
+	std::this_thread::sleep_for(std::chrono::milliseconds(250));
+
+	std::lock_guard<std::mutex> lock(mutex);
+	for (WatchedShader& shader : watchedShaders)
+	{
+		std::error_code error;
+		auto lastWriteTime = std::filesystem::last_write_time(shader.sourceFile, error);
+		if (!error && lastWriteTime != shader.lastWriteTime)
+		{
+			shader.lastWriteTime = lastWriteTime;
+			changed.push_back(shader);
+		}
+	}
+#endif
+
+	return changed;
+}
+
+void ShaderHotReload::recompile(const WatchedShader& shader)
+{
+	const std::string outputFile = shader.spvFile + ".tmp";
+	std::string command = "\"" + compilerPath + "\" \"" + shader.sourceFile + "\" -o \"" + outputFile + "\"";
+#ifdef _WIN32
+	// cmd.exe strips the first and last quote of the whole line
+	command = "\"" + command + "\"";
+#endif
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+	if (std::system(command.c_str()) != 0)
+	{
+		std::cerr << "Shader hot reload: failed to compile " << shader.sourceFile <<
+			", keeping previous pipeline" << std::endl;
+		return;
+	}
+
+	CompiledShader compiled;
+	compiled.spvFile = shader.spvFile;
+	try
+	{
+		compiled.code = VulkanBase::readShaderFile(outputFile);
+		std::filesystem::rename(outputFile, shader.spvFile);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Shader hot reload: " << e.what() << std::endl;
+		return;
+	}
+
+	auto endTime = std::chrono::high_resolution_clock::now();
+	compiled.compileMilliseconds = std::chrono::duration<float, std::chrono::milliseconds::period>(
+		endTime - startTime).count();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	compiledShaders.push_back(std::move(compiled));
+}
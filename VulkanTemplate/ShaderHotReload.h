@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <filesystem>
+#ifdef __linux__
+#include <unordered_map>
+#endif
+
+struct CompiledShader
+{
+	std::string spvFile;
+	std::vector<uint32_t> code;
+	/// Compiler run and reading the result back
+	float compileMilliseconds = 0.f;
+};
+
+/// Watches GLSL sources and recompiles them to SPIR-V on a background thread. Uses inotify on Linux
+/// and falls back to polling modification times elsewhere. Failed compiles are reported and dropped,
+/// so whatever was built from the previous binary stays in use.
+class ShaderHotReload
+{
+public:
+	explicit ShaderHotReload(const std::string& compilerPath);
+	~ShaderHotReload();
+
+	void watch(const std::string& sourceFile, const std::string& spvFile);
+	std::vector<CompiledShader> takeCompiledShaders();
+
+private:
+	struct WatchedShader
+	{
+		std::string sourceFile;
+		std::string spvFile;
+		std::string directory;
+		std::string fileName;
+		std::filesystem::file_time_type lastWriteTime;
+	};
+
+	std::string compilerPath;
+	std::vector<WatchedShader> watchedShaders;
+	std::vector<CompiledShader> compiledShaders;
+	std::mutex mutex;
+	std::atomic<bool> stopping{false};
+	std::thread watcherThread;
+#ifdef __linux__
+	int inotifyFd = -1;
+	std::unordered_map<int, std::string> watchedDirectories;
+#endif
+
+	void watcherLoop();
+	std::vector<WatchedShader> waitForChanges();
+	void recompile(const WatchedShader& shader);
+};
@@ -0,0 +1,636 @@
+#include "ShaderReflection.h"
+#include "DescriptorAllocator.h"
+
+#include <stdexcept>
+#include <algorithm>
+
+namespace
+{
+	const uint32_t SpvMagicNumber = 0x07230203;
+
+	enum SpvOp : uint32_t
+	{
+		OpEntryPoint = 15,
+		OpTypeInt = 21,
+		OpTypeFloat = 22,
+		OpTypeVector = 23,
+		OpTypeMatrix = 24,
+		OpTypeImage = 25,
+		OpTypeSampler = 26,
+		OpTypeSampledImage = 27,
+		OpTypeArray = 28,
+		OpTypeRuntimeArray = 29,
+		OpTypeStruct = 30,
+		OpTypePointer = 32,
+		OpConstant = 43,
+		OpVariable = 59,
+		OpDecorate = 71,
+		OpMemberDecorate = 72,
+	};
+
+	enum SpvDecoration : uint32_t
+	{
+		DecorationBlock = 2,
+		DecorationBufferBlock = 3,
+		DecorationArrayStride = 6,
+		DecorationMatrixStride = 7,
+		DecorationBuiltIn = 11,
+		DecorationLocation = 30,
+		DecorationBinding = 33,
+		DecorationDescriptorSet = 34,
+		DecorationOffset = 35,
+	};
+
+	enum SpvStorageClass : uint32_t
+	{
+		StorageClassUniformConstant = 0,
+		StorageClassInput = 1,
+		StorageClassUniform = 2,
+		StorageClassPushConstant = 9,
+		StorageClassStorageBuffer = 12,
+	};
+
+	struct SpvId
+	{
+		uint32_t opcode = 0;
+		std::vector<uint32_t> operands;
+		uint32_t storageClass = 0;
+		uint32_t typeId = 0;
+		uint32_t constant = 0;
+
+		uint32_t set = 0;
+		uint32_t binding = 0;
+		uint32_t location = 0;
+		uint32_t arrayStride = 0;
+		bool hasBinding = false;
+		bool hasLocation = false;
+		bool builtIn = false;
+		bool block = false;
+		bool bufferBlock = false;
+		std::vector<uint32_t> memberOffsets;
+		std::vector<uint32_t> memberMatrixStrides;
+	};
+
+	VkShaderStageFlagBits toShaderStage(uint32_t executionModel)
+	{
+		switch (executionModel)
+		{
+		case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+		case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+		case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+		case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+		case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+		case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+		default: throw std::runtime_error("unsupported shader execution model");
+		}
+	}
+
+	class SpvParser
+	{
+	public:
+		std::vector<SpvId> ids;
+
+		uint32_t typeSize(uint32_t typeId, uint32_t matrixStride = 0) const
+		{
+			const SpvId& type = ids[typeId];
+			switch (type.opcode)
+			{
+			case OpTypeInt:
+			case OpTypeFloat:
+				return type.operands[0] / 8;
+			case OpTypeVector:
+				return typeSize(type.operands[0]) * type.operands[1];
+			case OpTypeMatrix:
+				return (matrixStride ? matrixStride : typeSize(type.operands[0])) * type.operands[1];
+			case OpTypeArray:
+			{
+				uint32_t stride = type.arrayStride ? type.arrayStride : typeSize(type.operands[0]);
+				return stride * ids[type.operands[1]].constant;
+			}
+			case OpTypeStruct:
+			{
+				uint32_t size = 0;
+				for (size_t i = 0; i < type.operands.size(); i++)
+				{
+					uint32_t offset = i < type.memberOffsets.size() ? type.memberOffsets[i] : 0;
+					uint32_t stride = i < type.memberMatrixStrides.size() ? type.memberMatrixStrides[i] : 0;
+					size = std::max(size, offset + typeSize(type.operands[i], stride));
+				}
+				return size;
+			}
+			default:
+				return 0;
+			}
+		}
+
+		VkFormat inputFormat(uint32_t typeId) const
+		{
+			const SpvId& type = ids[typeId];
+			uint32_t componentCount = 1;
+			const SpvId* component = &type;
+			if (type.opcode == OpTypeVector)
+			{
+				componentCount = type.operands[1];
+				component = &ids[type.operands[0]];
+			}
+
+			if (component->opcode == OpTypeFloat)
+			{
+				const VkFormat formats[] = {
+					VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT,
+					VK_FORMAT_R32G32B32A32_SFLOAT
+				};
+				return formats[componentCount - 1];
+			}
+			if (component->opcode == OpTypeInt && component->operands[1] == 1)
+			{
+				const VkFormat formats[] = {
+					VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT
+				};
+				return formats[componentCount - 1];
+			}
+			if (component->opcode == OpTypeInt)
+			{
+				const VkFormat formats[] = {
+					VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT
+				};
+				return formats[componentCount - 1];
+			}
+			return VK_FORMAT_UNDEFINED;
+		}
+
+		VkDescriptorType descriptorType(uint32_t storageClass, const SpvId& type) const
+		{
+			switch (type.opcode)
+			{
+			case OpTypeSampledImage:
+				return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			case OpTypeSampler:
+				return VK_DESCRIPTOR_TYPE_SAMPLER;
+			case OpTypeImage:
+			{
+				const uint32_t dim = type.operands[1];
+				const bool storage = type.operands[5] == 2;
+				if (dim == 6)
+				{
+					return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+				}
+				if (dim == 5)
+				{
+					return storage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+				}
+				return storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+			}
+			case OpTypeStruct:
+				if (storageClass == StorageClassStorageBuffer || type.bufferBlock)
+				{
+					return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				}
+				return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			default:
+				throw std::runtime_error("unsupported descriptor type in shader");
+			}
+		}
+	};
+}
+
+ShaderReflection reflectShader(const uint32_t* code, size_t wordCount)
+{
+	if (wordCount < 5 || code[0] != SpvMagicNumber)
+	{
+		throw std::runtime_error("invalid SPIR-V binary");
+	}
+
+	SpvParser parser;
+	parser.ids.resize(code[3]);
+	ShaderReflection reflection;
+
+	/// Collect types, variables and decorations
+	size_t offset = 5;
+	while (offset < wordCount)
+	{
+		const uint32_t opcode = code[offset] & 0xFFFF;
+		const uint32_t instructionWordCount = code[offset] >> 16;
+		const uint32_t* operands = code + offset + 1;
+		if (instructionWordCount == 0 || offset + instructionWordCount > wordCount)
+		{
+			throw std::runtime_error("malformed SPIR-V instruction");
+		}
+
+		switch (opcode)
+		{
+		case OpEntryPoint:
+			reflection.stage = toShaderStage(operands[0]);
+			break;
+		case OpTypeInt:
+		case OpTypeFloat:
+		case OpTypeVector:
+		case OpTypeMatrix:
+		case OpTypeImage:
+		case OpTypeSampler:
+		case OpTypeSampledImage:
+		case OpTypeArray:
+		case OpTypeRuntimeArray:
+		case OpTypeStruct:
+		{
+			SpvId& id = parser.ids[operands[0]];
+			id.opcode = opcode;
+			id.operands.assign(operands + 1, operands + instructionWordCount - 1);
+			break;
+		}
+		case OpTypePointer:
+		{
+			SpvId& id = parser.ids[operands[0]];
+			id.opcode = opcode;
+			id.storageClass = operands[1];
+			id.typeId = operands[2];
+			break;
+		}
+		case OpConstant:
+		{
+			SpvId& id = parser.ids[operands[1]];
+			id.opcode = opcode;
+			id.constant = operands[2];
+			break;
+		}
+		case OpVariable:
+		{
+			SpvId& id = parser.ids[operands[1]];
+			id.opcode = opcode;
+			id.typeId = operands[0];
+			id.storageClass = operands[2];
+			break;
+		}
+		case OpDecorate:
+		{
+			SpvId& id = parser.ids[operands[0]];
+			switch (operands[1])
+			{
+			case DecorationBlock:
+				id.block = true;
+				break;
+			case DecorationBufferBlock:
+				id.bufferBlock = true;
+				break;
+			case DecorationArrayStride:
+				id.arrayStride = operands[2];
+				break;
+			case DecorationBuiltIn:
+				id.builtIn = true;
+				break;
+			case DecorationLocation:
+				id.location = operands[2];
+				id.hasLocation = true;
+				break;
+			case DecorationBinding:
+				id.binding = operands[2];
+				id.hasBinding = true;
+				break;
+			case DecorationDescriptorSet:
+				id.set = operands[2];
+				break;
+			default:
+				break;
+			}
+			break;
+		}
+		case OpMemberDecorate:
+		{
+			SpvId& id = parser.ids[operands[0]];
+			const uint32_t member = operands[1];
+			if (operands[2] == DecorationOffset)
+			{
+				id.memberOffsets.resize(std::max<size_t>(id.memberOffsets.size(), member + 1));
+				id.memberOffsets[member] = operands[3];
+			}
+			else if (operands[2] == DecorationMatrixStride)
+			{
+				id.memberMatrixStrides.resize(std::max<size_t>(id.memberMatrixStrides.size(), member + 1));
+				id.memberMatrixStrides[member] = operands[3];
+			}
+			break;
+		}
+		default:
+			break;
+		}
+
+		offset += instructionWordCount;
+	}
+
+	/// Turn interface variables into bindings, push constant ranges and inputs
+	for (const SpvId& variable : parser.ids)
+	{
+		if (variable.opcode != OpVariable)
+		{
+			continue;
+		}
+
+		const SpvId& pointer = parser.ids[variable.typeId];
+		uint32_t typeId = pointer.typeId;
+
+		if (variable.storageClass == StorageClassPushConstant)
+		{
+			// A stage may only declare the members past the ones another stage reads
+			const std::vector<uint32_t>& memberOffsets = parser.ids[typeId].memberOffsets;
+			VkPushConstantRange range;
+			range.stageFlags = reflection.stage;
+			range.offset = memberOffsets.empty() ? 0 : *std::min_element(memberOffsets.begin(), memberOffsets.end());
+			range.size = parser.typeSize(typeId) - range.offset;
+			reflection.pushConstantRanges.push_back(range);
+		}
+		else if (variable.storageClass == StorageClassInput)
+		{
+			if (variable.builtIn || !variable.hasLocation || parser.ids[typeId].block)
+			{
+				continue;
+			}
+			ReflectedInput input;
+			input.location = variable.location;
+			if (parser.ids[typeId].opcode == OpTypeMatrix)
+			{
+				input.locationCount = parser.ids[typeId].operands[1];
+				typeId = parser.ids[typeId].operands[0];
+			}
+			input.format = parser.inputFormat(typeId);
+			input.size = parser.typeSize(typeId);
+			reflection.inputs.push_back(input);
+		}
+		else if (variable.hasBinding &&
+			(variable.storageClass == StorageClassUniformConstant ||
+				variable.storageClass == StorageClassUniform ||
+				variable.storageClass == StorageClassStorageBuffer))
+		{
+			uint32_t descriptorCount = 1;
+			if (parser.ids[typeId].opcode == OpTypeArray)
+			{
+				descriptorCount = parser.ids[parser.ids[typeId].operands[1]].constant;
+				typeId = parser.ids[typeId].operands[0];
+			}
+			else if (parser.ids[typeId].opcode == OpTypeRuntimeArray)
+			{
+				// Would need descriptor indexing for a variable count, which the layouts here do not enable
+				throw std::runtime_error("runtime sized descriptor arrays are not supported");
+			}
+
+			ReflectedBinding binding;
+			binding.set = variable.set;
+			binding.binding = variable.binding;
+			binding.descriptorType = parser.descriptorType(variable.storageClass, parser.ids[typeId]);
+			binding.descriptorCount = descriptorCount;
+			binding.stageFlags = reflection.stage;
+			reflection.bindings.push_back(binding);
+		}
+	}
+
+	std::sort(reflection.inputs.begin(), reflection.inputs.end(),
+	          [](const ReflectedInput& a, const ReflectedInput& b) { return a.location < b.location; });
+	return reflection;
+}
+
+void ShaderReflection::getVertexInput(uint32_t binding,
+                                      std::vector<VkVertexInputBindingDescription>& bindingDescriptions,
+                                      std::vector<VkVertexInputAttributeDescription>& attributeDescriptions) const
+{
+	getVertexInput(binding, binding, UINT32_MAX, bindingDescriptions, attributeDescriptions);
+}
+
+void ShaderReflection::getVertexInput(uint32_t vertexBinding, uint32_t instanceBinding,
+                                      uint32_t firstInstanceLocation,
+                                      std::vector<VkVertexInputBindingDescription>& bindingDescriptions,
+                                      std::vector<VkVertexInputAttributeDescription>& attributeDescriptions) const
+{
+	/// Attributes are assumed tightly packed in location order within each binding
+	uint32_t strides[2] = {};
+	for (const auto& input : inputs)
+	{
+		const bool perInstance = input.location >= firstInstanceLocation;
+		for (uint32_t i = 0; i < input.locationCount; i++)
+		{
+			VkVertexInputAttributeDescription attributeDescription;
+			attributeDescription.binding = perInstance ? instanceBinding : vertexBinding;
+			attributeDescription.location = input.location + i;
+			attributeDescription.format = input.format;
+			attributeDescription.offset = strides[perInstance];
+			attributeDescriptions.push_back(attributeDescription);
+			strides[perInstance] += input.size;
+		}
+	}
+
+	const uint32_t bindings[2] = {vertexBinding, instanceBinding};
+	const VkVertexInputRate inputRates[2] = {VK_VERTEX_INPUT_RATE_VERTEX, VK_VERTEX_INPUT_RATE_INSTANCE};
+	for (int i = 0; i < 2; i++)
+	{
+		if (strides[i] == 0)
+		{
+			continue;
+		}
+		VkVertexInputBindingDescription bindingDescription;
+		bindingDescription.binding = bindings[i];
+		bindingDescription.stride = strides[i];
+		bindingDescription.inputRate = inputRates[i];
+		bindingDescriptions.push_back(bindingDescription);
+	}
+}
+
+LayoutCache::~LayoutCache()
+{
+	for (auto& pipelineLayout : pipelineLayouts)
+	{
+		vkDestroyPipelineLayout(device, pipelineLayout.second, nullptr);
+	}
+	for (auto& updateTemplate : updateTemplates)
+	{
+		vkDestroyDescriptorUpdateTemplate(device, updateTemplate.second.handle, nullptr);
+	}
+	for (auto& setLayout : setLayouts)
+	{
+		vkDestroyDescriptorSetLayout(device, setLayout.second, nullptr);
+	}
+}
+
+VkDescriptorSetLayout LayoutCache::getDescriptorSetLayout(const std::vector<ReflectedBinding>& bindings)
+{
+	std::vector<uint32_t> key;
+	for (const auto& binding : bindings)
+	{
+		key.insert(key.end(), {
+			           binding.binding, static_cast<uint32_t>(binding.descriptorType), binding.descriptorCount,
+			           binding.stageFlags
+		           });
+	}
+
+	auto it = setLayouts.find(key);
+	if (it != setLayouts.end())
+	{
+		return it->second;
+	}
+
+	std::vector<VkDescriptorSetLayoutBinding> layoutBindings;
+	for (const auto& binding : bindings)
+	{
+		VkDescriptorSetLayoutBinding layoutBinding;
+		layoutBinding.binding = binding.binding;
+		layoutBinding.descriptorType = binding.descriptorType;
+		layoutBinding.descriptorCount = binding.descriptorCount;
+		layoutBinding.stageFlags = binding.stageFlags;
+		layoutBinding.pImmutableSamplers = nullptr;
+		layoutBindings.push_back(layoutBinding);
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutCreateInfo;
+	layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutCreateInfo.pNext = nullptr;
+	layoutCreateInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
+	layoutCreateInfo.pBindings = layoutBindings.data();
+	layoutCreateInfo.flags = VK_NULL_HANDLE;
+
+	VkDescriptorSetLayout setLayout;
+	if (vkCreateDescriptorSetLayout(device, &layoutCreateInfo, nullptr, &setLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create descriptor set layout!");
+	}
+	setLayouts[key] = setLayout;
+
+	std::vector<VkDescriptorUpdateTemplateEntry> entries;
+	uint32_t descriptorCount = 0;
+	for (const auto& binding : bindings)
+	{
+		VkDescriptorUpdateTemplateEntry entry;
+		entry.dstBinding = binding.binding;
+		entry.dstArrayElement = 0;
+		entry.descriptorCount = binding.descriptorCount;
+		entry.descriptorType = binding.descriptorType;
+		entry.offset = descriptorCount * sizeof(DescriptorInfo);
+		entry.stride = sizeof(DescriptorInfo);
+		entries.push_back(entry);
+		descriptorCount += binding.descriptorCount;
+	}
+	if (!entries.empty())
+	{
+		VkDescriptorUpdateTemplateCreateInfo templateCreateInfo = {};
+		templateCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+		templateCreateInfo.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+		templateCreateInfo.pDescriptorUpdateEntries = entries.data();
+		templateCreateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+		templateCreateInfo.descriptorSetLayout = setLayout;
+
+		DescriptorUpdateTemplate updateTemplate;
+		updateTemplate.descriptorCount = descriptorCount;
+		if (vkCreateDescriptorUpdateTemplate(device, &templateCreateInfo, nullptr, &updateTemplate.handle) !=
+			VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create descriptor update template!");
+		}
+		updateTemplates[setLayout] = updateTemplate;
+	}
+
+	return setLayout;
+}
+
+DescriptorUpdateTemplate LayoutCache::getDescriptorUpdateTemplate(VkDescriptorSetLayout setLayout) const
+{
+	auto it = updateTemplates.find(setLayout);
+	if (it == updateTemplates.end())
+	{
+		throw std::runtime_error("descriptor set layout has no update template!");
+	}
+	return it->second;
+}
+
+VkPipelineLayout LayoutCache::getPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts,
+                                                const std::vector<VkPushConstantRange>& pushConstantRanges)
+{
+	std::vector<uint64_t> key;
+	for (VkDescriptorSetLayout setLayout : setLayouts)
+	{
+		key.push_back((uint64_t)setLayout);
+	}
+	key.push_back(~0ull);
+	for (const auto& range : pushConstantRanges)
+	{
+		key.insert(key.end(), {range.stageFlags, range.offset, range.size});
+	}
+
+	auto it = pipelineLayouts.find(key);
+	if (it != pipelineLayouts.end())
+	{
+		return it->second;
+	}
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+	pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+	pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+	pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges.data();
+
+	VkPipelineLayout pipelineLayout;
+	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create pipeline layout!");
+	}
+	pipelineLayouts[key] = pipelineLayout;
+	return pipelineLayout;
+}
+
+ReflectedPipelineLayout LayoutCache::getPipelineLayout(const std::vector<const ShaderReflection*>& stages)
+{
+	/// Merge bindings of all stages, OR-ing stage flags of shared bindings
+	std::map<std::pair<uint32_t, uint32_t>, ReflectedBinding> mergedBindings;
+	std::vector<VkPushConstantRange> pushConstantRanges;
+	for (const ShaderReflection* stage : stages)
+	{
+		for (const auto& binding : stage->bindings)
+		{
+			auto key = std::make_pair(binding.set, binding.binding);
+			auto it = mergedBindings.find(key);
+			if (it == mergedBindings.end())
+			{
+				mergedBindings[key] = binding;
+			}
+			else if (it->second.descriptorType != binding.descriptorType)
+			{
+				throw std::runtime_error("shader stages disagree on descriptor type");
+			}
+			else
+			{
+				it->second.stageFlags |= binding.stageFlags;
+			}
+		}
+		/// Stages reading the same bytes share a range, the others keep their own offset and size
+		for (const auto& range : stage->pushConstantRanges)
+		{
+			bool merged = false;
+			for (auto& pushConstantRange : pushConstantRanges)
+			{
+				if (pushConstantRange.offset == range.offset && pushConstantRange.size == range.size)
+				{
+					pushConstantRange.stageFlags |= range.stageFlags;
+					merged = true;
+				}
+			}
+			if (!merged)
+			{
+				pushConstantRanges.push_back(range);
+			}
+		}
+	}
+
+	ReflectedPipelineLayout layout;
+	for (const auto& binding : mergedBindings)
+	{
+		const uint32_t set = binding.first.first;
+		if (layout.setBindings.size() <= set)
+		{
+			layout.setBindings.resize(set + 1);
+		}
+		layout.setBindings[set].push_back(binding.second);
+	}
+	for (const auto& bindings : layout.setBindings)
+	{
+		layout.setLayouts.push_back(getDescriptorSetLayout(bindings));
+	}
+
+	layout.pipelineLayout = getPipelineLayout(layout.setLayouts, pushConstantRanges);
+	return layout;
+}
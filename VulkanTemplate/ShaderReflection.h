@@ -0,0 +1,82 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <vector>
+#include <map>
+
+struct ReflectedBinding
+{
+	uint32_t set;
+	uint32_t binding;
+	VkDescriptorType descriptorType;
+	uint32_t descriptorCount;
+	VkShaderStageFlags stageFlags;
+};
+
+struct ReflectedInput
+{
+	uint32_t location;
+	VkFormat format;
+	/// Size of one location, matrices take one location per column
+	uint32_t size;
+	uint32_t locationCount = 1;
+};
+
+struct ShaderReflection
+{
+	VkShaderStageFlagBits stage = VK_SHADER_STAGE_ALL;
+	std::vector<ReflectedBinding> bindings;
+	std::vector<VkPushConstantRange> pushConstantRanges;
+	std::vector<ReflectedInput> inputs;
+
+	void getVertexInput(uint32_t binding, std::vector<VkVertexInputBindingDescription>& bindingDescriptions,
+	                    std::vector<VkVertexInputAttributeDescription>& attributeDescriptions) const;
+	/// Inputs from firstInstanceLocation on are read per instance from instanceBinding.
+	void getVertexInput(uint32_t vertexBinding, uint32_t instanceBinding, uint32_t firstInstanceLocation,
+	                    std::vector<VkVertexInputBindingDescription>& bindingDescriptions,
+	                    std::vector<VkVertexInputAttributeDescription>& attributeDescriptions) const;
+};
+
+/// Parses a SPIR-V binary for the descriptor bindings, push constants and stage inputs it declares.
+ShaderReflection reflectShader(const uint32_t* code, size_t wordCount);
+
+/// Update template created together with a set layout. It reads descriptorCount consecutive
+/// DescriptorInfo slots, one per descriptor in binding order.
+struct DescriptorUpdateTemplate
+{
+	VkDescriptorUpdateTemplate handle = VK_NULL_HANDLE;
+	uint32_t descriptorCount = 0;
+};
+
+struct ReflectedPipelineLayout
+{
+	std::vector<VkDescriptorSetLayout> setLayouts;
+	std::vector<std::vector<ReflectedBinding>> setBindings;
+	VkPipelineLayout pipelineLayout;
+};
+
+/// Creates descriptor set and pipeline layouts from reflected shaders, sharing identical
+/// layouts between every pipeline that asks for them.
+class LayoutCache
+{
+public:
+	explicit LayoutCache(VkDevice device)
+		: device(device)
+	{
+	}
+
+	~LayoutCache();
+
+	VkDescriptorSetLayout getDescriptorSetLayout(const std::vector<ReflectedBinding>& bindings);
+	DescriptorUpdateTemplate getDescriptorUpdateTemplate(VkDescriptorSetLayout setLayout) const;
+	VkPipelineLayout getPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts,
+	                                   const std::vector<VkPushConstantRange>& pushConstantRanges);
+	ReflectedPipelineLayout getPipelineLayout(const std::vector<const ShaderReflection*>& stages);
+
+private:
+	VkDevice device;
+	std::map<std::vector<uint32_t>, VkDescriptorSetLayout> setLayouts;
+	std::map<VkDescriptorSetLayout, DescriptorUpdateTemplate> updateTemplates;
+	std::map<std::vector<uint64_t>, VkPipelineLayout> pipelineLayouts;
+};
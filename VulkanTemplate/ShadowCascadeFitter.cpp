@@ -0,0 +1,93 @@
+#include "ShadowCascadeFitter.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+
+uint32_t ShadowCascadeFitter::update(const glm::mat4& view, const glm::mat4& proj, const glm::vec3& lightDirection,
+                                     const glm::vec4& sceneBounds, bool caching)
+{
+	const float nearPlane = proj[3][2] / proj[2][2];
+	const float farPlane = proj[3][2] / (proj[2][2] + 1.f);
+	// Squared half diagonal of the frustum at a depth of one
+	const float tanX = 1.f / std::abs(proj[0][0]);
+	const float tanY = 1.f / std::abs(proj[1][1]);
+	const float diagonal = tanX * tanX + tanY * tanY;
+	const glm::mat4 inverseView = glm::inverse(view);
+	const glm::vec3 direction = glm::normalize(lightDirection);
+
+	uint32_t changed = 0;
+	float splitNear = nearPlane;
+	for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; i++)
+	{
+		const float t = static_cast<float>(i + 1) / SHADOW_CASCADE_COUNT;
+		const float splitFar = splitLambda * nearPlane * std::pow(farPlane / nearPlane, t) +
+			(1.f - splitLambda) * (nearPlane + (farPlane - nearPlane) * t);
+
+		// The smallest sphere through the near and far corners of the slice, centered on the view axis
+		const float nearCorner = splitNear * splitNear * diagonal;
+		const float farCorner = splitFar * splitFar * diagonal;
+		float center = (splitFar * splitFar + farCorner - splitNear * splitNear - nearCorner) /
+			(2.f * (splitFar - splitNear));
+		center = glm::clamp(center, splitNear, splitFar);
+		float radius = std::sqrt(std::max((splitFar - center) * (splitFar - center) + farCorner,
+		                                  (center - splitNear) * (center - splitNear) + nearCorner));
+		// Rounded up, so float noise in the matrices never changes the size
+		radius = std::ceil(radius * 16.f) / 16.f;
+		const glm::vec3 worldCenter = glm::vec3(inverseView * glm::vec4(0.f, 0.f, -center, 1.f));
+
+		ShadowCascade& cascade = cascades[i];
+		cascade.splitDepth = splitFar;
+		bool refit = !caching || !cascade.valid;
+		if (!refit)
+		{
+			const float angle = glm::degrees(std::acos(glm::clamp(glm::dot(direction, cascade.lightDirection), -1.f,
+			                                                      1.f)));
+			refit = angle > maxLightAngle ||
+				glm::distance(worldCenter, glm::vec3(cascade.bounds)) + radius > cascade.bounds.w;
+		}
+		if (refit)
+		{
+			const float coveredRadius = caching ? radius * (1.f + cacheMargin) : radius;
+			fit(cascade, glm::vec4(worldCenter, coveredRadius), direction, sceneBounds);
+			changed |= 1u << i;
+		}
+		splitNear = splitFar;
+	}
+	return changed;
+}
+
+void ShadowCascadeFitter::invalidate()
+{
+	for (ShadowCascade& cascade : cascades)
+	{
+		cascade.valid = false;
+	}
+}
+
+void ShadowCascadeFitter::fit(ShadowCascade& cascade, const glm::vec4& bounds, const glm::vec3& lightDirection,
+                              const glm::vec4& sceneBounds) const
+{
+	// Any up vector will do as long as it is not along the light
+	const glm::vec3 up = std::abs(lightDirection.z) > 0.99f ? glm::vec3(0.f, 1.f, 0.f) : glm::vec3(0.f, 0.f, 1.f);
+	const glm::mat4 lightView = glm::lookAt(glm::vec3(0.f), lightDirection, up);
+	const float radius = bounds.w;
+
+	// Whole texel steps, so refitting does not make the edges of static shadows crawl. Snapping moves the
+	// center by up to a texel, the map reaches one texel past the sphere on each side so it still covers it.
+	const float texelSize = 2.f * radius / (resolution - 2);
+	const float extent = radius + texelSize;
+	glm::vec3 center = glm::vec3(lightView * glm::vec4(glm::vec3(bounds), 1.f));
+	center.x = std::floor(center.x / texelSize) * texelSize;
+	center.y = std::floor(center.y / texelSize) * texelSize;
+
+	// The light looks down -z, the depth range spans the cascade and every caster in the scene
+	const float sceneDepth = (lightView * glm::vec4(glm::vec3(sceneBounds), 1.f)).z;
+	const float nearest = std::max(center.z + radius, sceneDepth + sceneBounds.w);
+	const float farthest = std::min(center.z - radius, sceneDepth - sceneBounds.w);
+	cascade.viewProj = glm::ortho(center.x - extent, center.x + extent, center.y - extent, center.y + extent,
+	                              -nearest, -farthest) * lightView;
+	cascade.bounds = bounds;
+	cascade.lightDirection = lightDirection;
+	cascade.valid = true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+/// Cascades the view range is split into, the shadow shader selects between this many
+const uint32_t SHADOW_CASCADE_COUNT = 4;
+
+/// Light projection one cascade's shadow map layer is rendered with
+struct ShadowCascade
+{
+	glm::mat4 viewProj = glm::mat4(1.f);
+	/// World space sphere the projection covers, w is the radius
+	glm::vec4 bounds = glm::vec4(0.f);
+	glm::vec3 lightDirection = glm::vec3(0.f);
+	/// View space depth the cascade reaches to
+	float splitDepth = 0.f;
+	bool valid = false;
+};
+
+/// Fits an orthographic light projection around each cascade's slice of the view frustum. Projections are
+/// fitted to a bounding sphere, so they do not change size as the camera turns, and are snapped to whole
+/// shadow map texels. With caching, a cascade keeps its projection, and with it the static casters already
+/// rendered, until the slice leaves the enlarged sphere it was fitted with or the light turns too far.
+class ShadowCascadeFitter
+{
+public:
+	/// Share of the view range split logarithmically, the rest is split evenly
+	float splitLambda = 0.75f;
+	/// Cached projections cover this much more than the slice, so the camera can move before a refit
+	float cacheMargin = 0.25f;
+	/// Degrees the light may turn before cached projections are refitted
+	float maxLightAngle = 2.f;
+	uint32_t resolution = 2048;
+
+	/// proj has to be a zero to one depth perspective projection. sceneBounds is a world space sphere around
+	/// every caster, the depth range reaches over it so casters outside a cascade still shadow into it.
+	/// Returns a bit per cascade whose projection changed, every cascade is refitted tightly without caching.
+	uint32_t update(const glm::mat4& view, const glm::mat4& proj, const glm::vec3& lightDirection,
+	                const glm::vec4& sceneBounds, bool caching);
+
+	const ShadowCascade& getCascade(uint32_t index) const { return cascades[index]; }
+	/// Refits every cascade on the next update
+	void invalidate();
+
+private:
+	ShadowCascade cascades[SHADOW_CASCADE_COUNT];
+
+	void fit(ShadowCascade& cascade, const glm::vec4& bounds, const glm::vec3& lightDirection,
+	         const glm::vec4& sceneBounds) const;
+};
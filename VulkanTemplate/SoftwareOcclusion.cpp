@@ -0,0 +1,570 @@
+#include "SoftwareOcclusion.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <fstream>
+#include <utility>
+#include <stdexcept>
+
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+#include <immintrin.h>
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	const uint32_t TILE_PIXELS = SoftwareOcclusion::TILE_WIDTH * SoftwareOcclusion::TILE_HEIGHT;
+	const uint32_t PROJECT_BATCH_SIZE = 8192;
+	const uint32_t SETUP_BATCH_SIZE = 4096;
+	const uint32_t CULL_BATCH_SIZE = 1024;
+	/// Vertices closer than this to the camera plane are treated as crossing it
+	const float MIN_W = 1e-5f;
+
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+	const uint32_t SIMD_WIDTH = 8;
+	using Lanes = __m256;
+	using Mask = __m256;
+
+	inline Lanes load(const float* data) { return _mm256_loadu_ps(data); }
+	inline void store(float* data, Lanes a) { _mm256_storeu_ps(data, a); }
+	inline Lanes splat(float value) { return _mm256_set1_ps(value); }
+	inline Lanes add(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+	inline Lanes mul(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+	inline Lanes min(Lanes a, Lanes b) { return _mm256_min_ps(a, b); }
+	inline Lanes max(Lanes a, Lanes b) { return _mm256_max_ps(a, b); }
+	inline Lanes laneIndices() { return _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f); }
+	inline Mask greater(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+	inline Mask greaterEqual(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+	inline Mask both(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+	inline Lanes select(Mask mask, Lanes a, Lanes b) { return _mm256_blendv_ps(b, a, mask); }
+	inline bool any(Mask mask) { return _mm256_movemask_ps(mask) != 0; }
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+	const uint32_t SIMD_WIDTH = 4;
+	using Lanes = __m128;
+	using Mask = __m128;
+
+	inline Lanes load(const float* data) { return _mm_loadu_ps(data); }
+	inline void store(float* data, Lanes a) { _mm_storeu_ps(data, a); }
+	inline Lanes splat(float value) { return _mm_set1_ps(value); }
+	inline Lanes add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+	inline Lanes mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+	inline Lanes min(Lanes a, Lanes b) { return _mm_min_ps(a, b); }
+	inline Lanes max(Lanes a, Lanes b) { return _mm_max_ps(a, b); }
+	inline Lanes laneIndices() { return _mm_setr_ps(0.f, 1.f, 2.f, 3.f); }
+	inline Mask greater(Lanes a, Lanes b) { return _mm_cmpgt_ps(a, b); }
+	inline Mask greaterEqual(Lanes a, Lanes b) { return _mm_cmpge_ps(a, b); }
+	inline Mask both(Mask a, Mask b) { return _mm_and_ps(a, b); }
+	inline Lanes select(Mask mask, Lanes a, Lanes b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+	inline bool any(Mask mask) { return _mm_movemask_ps(mask) != 0; }
+#else
+	const uint32_t SIMD_WIDTH = 1;
+	using Lanes = float;
+	using Mask = bool;
+
+	inline Lanes load(const float* data) { return *data; }
+	inline void store(float* data, Lanes a) { *data = a; }
+	inline Lanes splat(float value) { return value; }
+	inline Lanes add(Lanes a, Lanes b) { return a + b; }
+	inline Lanes mul(Lanes a, Lanes b) { return a * b; }
+	inline Lanes min(Lanes a, Lanes b) { return a < b ? a : b; }
+	inline Lanes max(Lanes a, Lanes b) { return a > b ? a : b; }
+	inline Lanes laneIndices() { return 0.f; }
+	inline Mask greater(Lanes a, Lanes b) { return a > b; }
+	inline Mask greaterEqual(Lanes a, Lanes b) { return a >= b; }
+	inline Mask both(Mask a, Mask b) { return a && b; }
+	inline Lanes select(Mask mask, Lanes a, Lanes b) { return mask ? a : b; }
+	inline bool any(Mask mask) { return mask; }
+#endif
+
+	inline int32_t clampToPixel(float value, uint32_t size)
+	{
+		// Clamp before converting, projected coordinates can be far outside int range
+		return static_cast<int32_t>(std::floor(std::min(std::max(value, -1.f), static_cast<float>(size))));
+	}
+}
+
+SoftwareOcclusion::SoftwareOcclusion(uint32_t width, uint32_t height, JobSystem* jobSystem)
+	: width(width), height(height), jobSystem(jobSystem)
+{
+	if (width == 0 || height == 0 || width % TILE_WIDTH != 0 || height % TILE_HEIGHT != 0)
+	{
+		throw std::runtime_error("software occlusion size must be a multiple of the tile size!");
+	}
+	tilesX = width / TILE_WIDTH;
+	tilesY = height / TILE_HEIGHT;
+	depth.resize(width * height, 1.f);
+	tileMaxDepth.resize(tilesX * tilesY, 1.f);
+}
+
+void SoftwareOcclusion::beginFrame(const glm::mat4& viewProj)
+{
+	this->viewProj = viewProj;
+	std::fill(depth.begin(), depth.end(), 1.f);
+	std::fill(tileMaxDepth.begin(), tileMaxDepth.end(), 1.f);
+	occluders.clear();
+	vertexCount = 0;
+	triangleCount = 0;
+}
+
+void SoftwareOcclusion::addOccluder(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices,
+                                    const glm::mat4& model)
+{
+	Occluder occluder;
+	occluder.positions = positions.data();
+	occluder.indices = indices.data();
+	occluder.firstVertex = vertexCount;
+	occluder.vertexCount = static_cast<uint32_t>(positions.size());
+	occluder.firstTriangle = triangleCount;
+	occluder.triangleCount = static_cast<uint32_t>(indices.size() / 3);
+	occluder.modelViewProj = viewProj * model;
+	if (occluder.triangleCount != 0)
+	{
+		occluders.push_back(occluder);
+		vertexCount += occluder.vertexCount;
+		triangleCount += occluder.triangleCount;
+	}
+}
+
+void SoftwareOcclusion::rasterize()
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	// Vertices are projected once, triangles are set up and binned to rows of tiles in batches, then
+	// every row rasterizes the triangles binned to it in submission order
+	if (screenVertices.size() < vertexCount)
+	{
+		screenVertices.resize(vertexCount);
+	}
+	setupBatchCount = (triangleCount + SETUP_BATCH_SIZE - 1) / SETUP_BATCH_SIZE;
+	if (setupBatches.size() < setupBatchCount)
+	{
+		setupBatches.resize(setupBatchCount);
+	}
+	auto projectJob = [&](uint32_t begin, uint32_t end)
+	{
+		projectVertices(begin, end);
+	};
+	auto setupJob = [&](uint32_t begin, uint32_t end)
+	{
+		setupTriangles(begin / SETUP_BATCH_SIZE, begin, end);
+	};
+	auto rasterJob = [&](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t tileY = begin; tileY < end; tileY++)
+		{
+			rasterizeTileRow(tileY);
+		}
+	};
+
+	if (jobSystem != nullptr)
+	{
+		jobSystem->parallelFor(vertexCount, PROJECT_BATCH_SIZE, projectJob);
+		jobSystem->parallelFor(triangleCount, SETUP_BATCH_SIZE, setupJob);
+	}
+	else
+	{
+		projectJob(0, vertexCount);
+		for (uint32_t begin = 0; begin < triangleCount; begin += SETUP_BATCH_SIZE)
+		{
+			setupJob(begin, std::min(begin + SETUP_BATCH_SIZE, triangleCount));
+		}
+	}
+	auto setupTime = std::chrono::high_resolution_clock::now();
+
+	if (jobSystem != nullptr)
+	{
+		jobSystem->parallelFor(tilesY, 1, rasterJob);
+	}
+	else
+	{
+		rasterJob(0, tilesY);
+	}
+	auto endTime = std::chrono::high_resolution_clock::now();
+
+	stats.occluderTriangles = triangleCount;
+	stats.rasterizedTriangles = 0;
+	for (uint32_t i = 0; i < setupBatchCount; i++)
+	{
+		stats.rasterizedTriangles += static_cast<uint32_t>(setupBatches[i].triangles.size());
+	}
+	stats.setupMilliseconds = std::chrono::duration<double, std::milli>(setupTime - startTime).count();
+	stats.rasterMilliseconds = std::chrono::duration<double, std::milli>(endTime - setupTime).count();
+}
+
+void SoftwareOcclusion::projectVertices(uint32_t begin, uint32_t end)
+{
+	auto occluder = std::upper_bound(occluders.begin(), occluders.end(), begin,
+	                                 [](uint32_t vertex, const Occluder& other)
+	                                 {
+		                                 return vertex < other.firstVertex;
+	                                 }) - 1;
+	const float halfWidth = 0.5f * width;
+	const float halfHeight = 0.5f * height;
+	for (uint32_t vertex = begin; vertex < end; vertex++)
+	{
+		while (vertex >= occluder->firstVertex + occluder->vertexCount)
+		{
+			++occluder;
+		}
+		const glm::vec3& position = occluder->positions[vertex - occluder->firstVertex];
+		const glm::mat4& modelViewProj = occluder->modelViewProj;
+		const glm::vec4 clip = modelViewProj[0] * position.x + modelViewProj[1] * position.y +
+			modelViewProj[2] * position.z + modelViewProj[3];
+		if (clip.w < MIN_W || clip.z < 0.f)
+		{
+			screenVertices[vertex] = glm::vec4(0.f, 0.f, 0.f, -1.f);
+			continue;
+		}
+		const float inverseW = 1.f / clip.w;
+		screenVertices[vertex] = glm::vec4((clip.x * inverseW + 1.f) * halfWidth,
+		                                   (clip.y * inverseW + 1.f) * halfHeight, clip.z * inverseW, clip.w);
+	}
+}
+
+void SoftwareOcclusion::setupTriangles(uint32_t batch, uint32_t begin, uint32_t end)
+{
+	SetupBatch& setupBatch = setupBatches[batch];
+	setupBatch.triangles.clear();
+	setupBatch.tileRows.resize(tilesY);
+	for (auto& tileRow : setupBatch.tileRows)
+	{
+		tileRow.clear();
+	}
+
+	auto occluder = std::upper_bound(occluders.begin(), occluders.end(), begin,
+	                                 [](uint32_t triangle, const Occluder& other)
+	                                 {
+		                                 return triangle < other.firstTriangle;
+	                                 }) - 1;
+	for (uint32_t triangle = begin; triangle < end; triangle++)
+	{
+		while (triangle >= occluder->firstTriangle + occluder->triangleCount)
+		{
+			++occluder;
+		}
+		const uint32_t* indices = occluder->indices + (triangle - occluder->firstTriangle) * 3;
+
+		glm::vec3 screen[3];
+		bool clipped = false;
+		for (int i = 0; i < 3; i++)
+		{
+			const glm::vec4& vertex = screenVertices[occluder->firstVertex + indices[i]];
+			// Crossing the near plane would need clipping, dropping the triangle only loses occlusion
+			clipped = clipped || vertex.w < 0.f;
+			screen[i] = glm::vec3(vertex);
+		}
+		if (clipped)
+		{
+			continue;
+		}
+
+		TriangleSetup setup;
+		setup.minDepth = std::min(std::min(screen[0].z, screen[1].z), screen[2].z);
+		setup.minX = std::max(0, clampToPixel(std::min(std::min(screen[0].x, screen[1].x), screen[2].x), width));
+		setup.maxX = std::min(static_cast<int32_t>(width) - 1,
+		                      clampToPixel(std::max(std::max(screen[0].x, screen[1].x), screen[2].x), width));
+		setup.minY = std::max(0, clampToPixel(std::min(std::min(screen[0].y, screen[1].y), screen[2].y), height));
+		setup.maxY = std::min(static_cast<int32_t>(height) - 1,
+		                      clampToPixel(std::max(std::max(screen[0].y, screen[1].y), screen[2].y), height));
+		if (setup.minX > setup.maxX || setup.minY > setup.maxY || setup.minDepth >= 1.f)
+		{
+			continue;
+		}
+
+		const float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) -
+			(screen[1].y - screen[0].y) * (screen[2].x - screen[0].x);
+		if (std::abs(area) < 1e-8f)
+		{
+			continue;
+		}
+
+		// Edge i is opposite vertex i and equals area at it, so edge / area is its barycentric weight.
+		// Flipping clockwise triangles keeps both windings positive inside.
+		const float sign = area > 0.f ? 1.f : -1.f;
+		const float inverseArea = 1.f / std::abs(area);
+		setup.depthA = setup.depthB = setup.depthC = 0.f;
+		for (int i = 0; i < 3; i++)
+		{
+			const glm::vec3* from = &screen[(i + 1) % 3];
+			const glm::vec3* to = &screen[(i + 2) % 3];
+			float edgeSign = sign;
+			// Both triangles sharing an edge evaluate it from the same end, so their values are exact
+			// negations of each other and pixel centers on the edge are never missed by both
+			if (to->x < from->x || (to->x == from->x && to->y < from->y))
+			{
+				std::swap(from, to);
+				edgeSign = -edgeSign;
+			}
+			const float a = from->y - to->y;
+			const float b = to->x - from->x;
+			setup.edgeA[i] = edgeSign * a;
+			setup.edgeB[i] = edgeSign * b;
+			setup.edgeC[i] = -edgeSign * (a * from->x + b * from->y);
+			setup.depthA += setup.edgeA[i] * inverseArea * screen[i].z;
+			setup.depthB += setup.edgeB[i] * inverseArea * screen[i].z;
+			setup.depthC += setup.edgeC[i] * inverseArea * screen[i].z;
+		}
+
+		const uint32_t index = static_cast<uint32_t>(setupBatch.triangles.size());
+		setupBatch.triangles.push_back(setup);
+		for (int32_t tileY = setup.minY / static_cast<int32_t>(TILE_HEIGHT);
+		     tileY <= setup.maxY / static_cast<int32_t>(TILE_HEIGHT); tileY++)
+		{
+			setupBatch.tileRows[tileY].push_back(index);
+		}
+	}
+}
+
+void SoftwareOcclusion::rasterizeTileRow(uint32_t tileY)
+{
+	for (uint32_t batch = 0; batch < setupBatchCount; batch++)
+	{
+		const SetupBatch& setupBatch = setupBatches[batch];
+		for (uint32_t index : setupBatch.tileRows[tileY])
+		{
+			rasterizeTriangle(setupBatch.triangles[index], tileY);
+		}
+	}
+	for (uint32_t tileX = 0; tileX < tilesX; tileX++)
+	{
+		updateTileMaxDepth(tileY * tilesX + tileX);
+	}
+}
+
+void SoftwareOcclusion::rasterizeTriangle(const TriangleSetup& triangle, uint32_t tileY)
+{
+	const int32_t tileTop = static_cast<int32_t>(tileY * TILE_HEIGHT);
+	const int32_t rowBegin = std::max(triangle.minY, tileTop);
+	const int32_t rowEnd = std::min(triangle.maxY, tileTop + static_cast<int32_t>(TILE_HEIGHT) - 1);
+	const bool coversRows = triangle.minY <= tileTop && triangle.maxY >= tileTop + static_cast<int32_t>(TILE_HEIGHT) - 1;
+
+	const Lanes zero = splat(0.f);
+	const Lanes far = splat(FLT_MAX);
+	const Lanes centerOffsets = add(laneIndices(), splat(0.5f));
+	const Lanes edgeA0 = splat(triangle.edgeA[0]);
+	const Lanes edgeA1 = splat(triangle.edgeA[1]);
+	const Lanes edgeA2 = splat(triangle.edgeA[2]);
+	const Lanes depthA = splat(triangle.depthA);
+
+	const uint32_t firstTileX = static_cast<uint32_t>(triangle.minX) / TILE_WIDTH;
+	const uint32_t lastTileX = static_cast<uint32_t>(triangle.maxX) / TILE_WIDTH;
+	for (uint32_t tileX = firstTileX; tileX <= lastTileX; tileX++)
+	{
+		const uint32_t tile = tileY * tilesX + tileX;
+		if (triangle.minDepth >= tileMaxDepth[tile])
+		{
+			// Behind everything already in the tile
+			continue;
+		}
+
+		float* tileDepth = &depth[tile * TILE_PIXELS];
+		const int32_t tileLeft = static_cast<int32_t>(tileX * TILE_WIDTH);
+		const int32_t columnBegin = (std::max(triangle.minX, tileLeft) - tileLeft) / SIMD_WIDTH * SIMD_WIDTH;
+		const int32_t columnEnd = std::min(triangle.maxX, tileLeft + static_cast<int32_t>(TILE_WIDTH) - 1) - tileLeft;
+		for (int32_t y = rowBegin; y <= rowEnd; y++)
+		{
+			const float centerY = y + 0.5f;
+			const Lanes rowEdge0 = splat(triangle.edgeB[0] * centerY + triangle.edgeC[0]);
+			const Lanes rowEdge1 = splat(triangle.edgeB[1] * centerY + triangle.edgeC[1]);
+			const Lanes rowEdge2 = splat(triangle.edgeB[2] * centerY + triangle.edgeC[2]);
+			const Lanes rowDepth = splat(triangle.depthB * centerY + triangle.depthC);
+			float* rowPixels = tileDepth + (y - tileTop) * TILE_WIDTH;
+
+			for (int32_t column = columnBegin; column <= columnEnd; column += SIMD_WIDTH)
+			{
+				const Lanes x = add(splat(static_cast<float>(tileLeft + column)), centerOffsets);
+				// Pixel centers exactly on an edge count as inside, which closes cracks between triangles
+				const Mask inside = both(both(greaterEqual(add(mul(edgeA0, x), rowEdge0), zero),
+				                              greaterEqual(add(mul(edgeA1, x), rowEdge1), zero)),
+				                         greaterEqual(add(mul(edgeA2, x), rowEdge2), zero));
+				if (!any(inside))
+				{
+					continue;
+				}
+				const Lanes pixelDepth = add(mul(depthA, x), rowDepth);
+				store(rowPixels + column, min(load(rowPixels + column), select(inside, pixelDepth, far)));
+			}
+		}
+
+		// Large occluders can pull the whole tile forward, which lets later triangles skip it
+		if (coversRows && triangle.minX <= tileLeft && triangle.maxX >= tileLeft + static_cast<int32_t>(TILE_WIDTH) - 1)
+		{
+			updateTileMaxDepth(tile);
+		}
+	}
+}
+
+void SoftwareOcclusion::updateTileMaxDepth(uint32_t tile)
+{
+	const float* tileDepth = &depth[tile * TILE_PIXELS];
+	Lanes farthest = load(tileDepth);
+	for (uint32_t i = SIMD_WIDTH; i < TILE_PIXELS; i += SIMD_WIDTH)
+	{
+		farthest = max(farthest, load(tileDepth + i));
+	}
+
+	float lanes[8];
+	store(lanes, farthest);
+	float maxDepth = lanes[0];
+	for (uint32_t i = 1; i < SIMD_WIDTH; i++)
+	{
+		maxDepth = std::max(maxDepth, lanes[i]);
+	}
+	tileMaxDepth[tile] = maxDepth;
+}
+
+bool SoftwareOcclusion::isVisible(const Aabb& bounds) const
+{
+	glm::vec2 minScreen(FLT_MAX);
+	glm::vec2 maxScreen(-FLT_MAX);
+	float nearestDepth = FLT_MAX;
+	for (int i = 0; i < 8; i++)
+	{
+		const glm::vec3 corner((i & 1) ? bounds.max.x : bounds.min.x, (i & 2) ? bounds.max.y : bounds.min.y,
+		                       (i & 4) ? bounds.max.z : bounds.min.z);
+		const glm::vec4 clip = viewProj * glm::vec4(corner, 1.f);
+		if (clip.w < MIN_W || clip.z < 0.f)
+		{
+			// Reaches past the near plane, the projected rectangle is meaningless
+			return true;
+		}
+		const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		minScreen = glm::min(minScreen, glm::vec2(ndc));
+		maxScreen = glm::max(maxScreen, glm::vec2(ndc));
+		nearestDepth = std::min(nearestDepth, ndc.z);
+	}
+
+	const int32_t minX = std::max(0, clampToPixel((minScreen.x + 1.f) * 0.5f * width, width));
+	const int32_t maxX = std::min(static_cast<int32_t>(width) - 1, clampToPixel((maxScreen.x + 1.f) * 0.5f * width, width));
+	const int32_t minY = std::max(0, clampToPixel((minScreen.y + 1.f) * 0.5f * height, height));
+	const int32_t maxY = std::min(static_cast<int32_t>(height) - 1,
+	                              clampToPixel((maxScreen.y + 1.f) * 0.5f * height, height));
+	if (minX > maxX || minY > maxY)
+	{
+		return false;
+	}
+
+	const Lanes nearest = splat(nearestDepth);
+	const Lanes columnMin = splat(minX - 0.5f);
+	const Lanes columnMax = splat(maxX + 0.5f);
+	for (uint32_t tileY = minY / TILE_HEIGHT; tileY <= maxY / TILE_HEIGHT; tileY++)
+	{
+		for (uint32_t tileX = minX / TILE_WIDTH; tileX <= maxX / TILE_WIDTH; tileX++)
+		{
+			const uint32_t tile = tileY * tilesX + tileX;
+			if (nearestDepth >= tileMaxDepth[tile])
+			{
+				// Every pixel of the tile is in front of the box
+				continue;
+			}
+
+			const float* tileDepth = &depth[tile * TILE_PIXELS];
+			const int32_t tileLeft = static_cast<int32_t>(tileX * TILE_WIDTH);
+			const int32_t tileTop = static_cast<int32_t>(tileY * TILE_HEIGHT);
+			const int32_t columnBegin = (std::max(minX, tileLeft) - tileLeft) / SIMD_WIDTH * SIMD_WIDTH;
+			const int32_t columnEnd = std::min(maxX, tileLeft + static_cast<int32_t>(TILE_WIDTH) - 1) - tileLeft;
+			const int32_t rowBegin = std::max(minY, tileTop);
+			const int32_t rowEnd = std::min(maxY, tileTop + static_cast<int32_t>(TILE_HEIGHT) - 1);
+			for (int32_t y = rowBegin; y <= rowEnd; y++)
+			{
+				const float* rowPixels = tileDepth + (y - tileTop) * TILE_WIDTH;
+				for (int32_t column = columnBegin; column <= columnEnd; column += SIMD_WIDTH)
+				{
+					const Lanes x = add(splat(static_cast<float>(tileLeft + column)), laneIndices());
+					const Mask inRect = both(greater(x, columnMin), greater(columnMax, x));
+					if (any(both(inRect, greater(load(rowPixels + column), nearest))))
+					{
+						return true;
+					}
+				}
+			}
+		}
+	}
+	return false;
+}
+
+void SoftwareOcclusion::cullOccluded(const std::vector<Aabb>& bounds, std::vector<uint32_t>& candidates)
+{
+	const uint32_t count = static_cast<uint32_t>(candidates.size());
+	const uint32_t batchCount = (count + CULL_BATCH_SIZE - 1) / CULL_BATCH_SIZE;
+	if (cullResults.size() < batchCount)
+	{
+		cullResults.resize(batchCount);
+	}
+	auto cullJob = [&](uint32_t begin, uint32_t end)
+	{
+		std::vector<uint32_t>& result = cullResults[begin / CULL_BATCH_SIZE];
+		result.clear();
+		for (uint32_t i = begin; i < end; i++)
+		{
+			if (isVisible(bounds[candidates[i]]))
+			{
+				result.push_back(candidates[i]);
+			}
+		}
+	};
+
+	if (jobSystem != nullptr)
+	{
+		jobSystem->parallelFor(count, CULL_BATCH_SIZE, cullJob);
+	}
+	else
+	{
+		for (uint32_t begin = 0; begin < count; begin += CULL_BATCH_SIZE)
+		{
+			cullJob(begin, std::min(begin + CULL_BATCH_SIZE, count));
+		}
+	}
+
+	candidates.clear();
+	for (uint32_t i = 0; i < batchCount; i++)
+	{
+		candidates.insert(candidates.end(), cullResults[i].begin(), cullResults[i].end());
+	}
+}
+
+float SoftwareOcclusion::getDepth(uint32_t x, uint32_t y) const
+{
+	const uint32_t tile = y / TILE_HEIGHT * tilesX + x / TILE_WIDTH;
+	return depth[tile * TILE_PIXELS + y % TILE_HEIGHT * TILE_WIDTH + x % TILE_WIDTH];
+}
+
+bool SoftwareOcclusion::writeDepthImage(const std::string& filename) const
+{
+	std::ofstream file(filename, std::ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+
+	float minDepth = 1.f;
+	float maxDepth = 0.f;
+	for (float value : depth)
+	{
+		if (value < 1.f)
+		{
+			minDepth = std::min(minDepth, value);
+			maxDepth = std::max(maxDepth, value);
+		}
+	}
+	const float scale = maxDepth > minDepth ? 1.f / (maxDepth - minDepth) : 0.f;
+
+	// Empty pixels are black, occluders fade from white when near to dark gray when far
+	std::vector<uint8_t> pixels(width * height);
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			const float value = getDepth(x, y);
+			pixels[y * width + x] = value < 1.f ? static_cast<uint8_t>(255.f - 223.f * (value - minDepth) * scale) : 0;
+		}
+	}
+
+	file << "P5\n" << width << " " << height << "\n255\n";
+	file.write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+	return static_cast<bool>(file);
+}
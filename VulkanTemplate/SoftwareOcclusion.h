@@ -0,0 +1,106 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+#include "Bvh.h"
+
+class JobSystem;
+
+struct SoftwareOcclusionStats
+{
+	uint32_t occluderTriangles = 0;
+	/// Triangles left after dropping degenerate ones, ones crossing the near plane and ones off screen
+	uint32_t rasterizedTriangles = 0;
+	double setupMilliseconds = 0.0;
+	double rasterMilliseconds = 0.0;
+};
+
+/// Low resolution depth buffer rasterized on the CPU from a few occluder meshes, so occludees can be
+/// rejected before any commands are recorded, without waiting for GPU depth. Pixels are stored in
+/// TILE_WIDTH x TILE_HEIGHT tiles that each keep the farthest depth inside them, which rejects most
+/// triangles and tests a tile at a time before looking at pixels. Rows of tiles are rasterized in
+/// parallel, each by one thread, so no two threads write the same pixel.
+class SoftwareOcclusion
+{
+public:
+	static const uint32_t TILE_WIDTH = 32;
+	static const uint32_t TILE_HEIGHT = 8;
+
+	/// Width and height have to be multiples of the tile size
+	explicit SoftwareOcclusion(uint32_t width = 512, uint32_t height = 256, JobSystem* jobSystem = nullptr);
+
+	/// Clears depth and the occluder list
+	void beginFrame(const glm::mat4& viewProj);
+	/// Indexed triangle list, only referenced until rasterize() returns
+	void addOccluder(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices,
+	                 const glm::mat4& model);
+	void rasterize();
+
+	/// False when the box is behind the rasterized occluders or off screen
+	bool isVisible(const Aabb& bounds) const;
+	/// Keeps the candidates whose bounds are visible, in order
+	void cullOccluded(const std::vector<Aabb>& bounds, std::vector<uint32_t>& candidates);
+
+	/// Binary PGM with near depth bright, scaled to the written depth range
+	bool writeDepthImage(const std::string& filename) const;
+
+	uint32_t getWidth() const { return width; }
+	uint32_t getHeight() const { return height; }
+	float getDepth(uint32_t x, uint32_t y) const;
+	SoftwareOcclusionStats getStats() const { return stats; }
+
+private:
+	struct Occluder
+	{
+		const glm::vec3* positions;
+		const uint32_t* indices;
+		uint32_t firstVertex;
+		uint32_t vertexCount;
+		uint32_t firstTriangle;
+		uint32_t triangleCount;
+		glm::mat4 modelViewProj;
+	};
+
+	/// Edge functions are positive inside, depth is a plane in screen space
+	struct TriangleSetup
+	{
+		float edgeA[3], edgeB[3], edgeC[3];
+		float depthA, depthB, depthC;
+		float minDepth;
+		int32_t minX, minY, maxX, maxY;
+	};
+
+	struct SetupBatch
+	{
+		std::vector<TriangleSetup> triangles;
+		/// Indices into triangles per row of tiles the triangle overlaps
+		std::vector<std::vector<uint32_t>> tileRows;
+	};
+
+	uint32_t width;
+	uint32_t height;
+	uint32_t tilesX;
+	uint32_t tilesY;
+	JobSystem* jobSystem;
+	glm::mat4 viewProj = glm::mat4(1.f);
+	std::vector<float> depth;
+	std::vector<float> tileMaxDepth;
+	std::vector<Occluder> occluders;
+	uint32_t vertexCount = 0;
+	uint32_t triangleCount = 0;
+	/// Screen x, y, depth and clip w of every occluder vertex, w below zero when behind the near plane
+	std::vector<glm::vec4> screenVertices;
+	std::vector<SetupBatch> setupBatches;
+	uint32_t setupBatchCount = 0;
+	std::vector<std::vector<uint32_t>> cullResults;
+	SoftwareOcclusionStats stats;
+
+	void projectVertices(uint32_t begin, uint32_t end);
+	void setupTriangles(uint32_t batch, uint32_t begin, uint32_t end);
+	void rasterizeTileRow(uint32_t tileY);
+	void rasterizeTriangle(const TriangleSetup& triangle, uint32_t tileY);
+	void updateTileMaxDepth(uint32_t tile);
+};
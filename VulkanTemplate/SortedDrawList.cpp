@@ -0,0 +1,269 @@
+#include "SortedDrawList.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+namespace
+{
+	const uint32_t SORT_BATCH_SIZE = 16384;
+	const uint32_t RADIX_BITS = 8;
+	const uint32_t RADIX_BUCKETS = 1 << RADIX_BITS;
+	const uint32_t PASS_COUNT = 1 << DRAW_KEY_PASS_BITS;
+
+	const uint32_t BIND_PIPELINE = 1;
+	const uint32_t BIND_DESCRIPTOR_SET = 2;
+	const uint32_t BIND_VERTEX_BUFFER = 4;
+
+	inline uint64_t packField(uint64_t key, uint32_t value, uint32_t bits)
+	{
+		return key << bits | (value & ((1u << bits) - 1));
+	}
+
+	inline uint32_t keyPass(uint64_t key)
+	{
+		return static_cast<uint32_t>(key >> (64 - DRAW_KEY_PASS_BITS));
+	}
+}
+
+uint64_t makeDrawKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth)
+{
+	const uint32_t maxDepth = (1u << DRAW_KEY_DEPTH_BITS) - 1;
+	const uint32_t quantizedDepth = static_cast<uint32_t>(std::min(std::max(depth, 0.f), 1.f) * maxDepth + 0.5f);
+
+	uint64_t key = pass;
+	key = packField(key, pipeline, DRAW_KEY_PIPELINE_BITS);
+	key = packField(key, material, DRAW_KEY_MATERIAL_BITS);
+	key = packField(key, mesh, DRAW_KEY_MESH_BITS);
+	return packField(key, quantizedDepth, DRAW_KEY_DEPTH_BITS);
+}
+
+SortedDrawList::SortedDrawList(JobSystem* jobSystem)
+	: jobSystem(jobSystem)
+{
+}
+
+uint32_t SortedDrawList::addPipeline(VkPipeline pipeline, VkPipelineLayout layout)
+{
+	if (pipelines.size() >= 1u << DRAW_KEY_PIPELINE_BITS)
+	{
+		throw std::runtime_error("too many pipelines for the draw sort key!");
+	}
+	pipelines.push_back({pipeline, layout});
+	return static_cast<uint32_t>(pipelines.size() - 1);
+}
+
+uint32_t SortedDrawList::addMaterial(VkDescriptorSet descriptorSet)
+{
+	if (materials.size() >= 1u << DRAW_KEY_MATERIAL_BITS)
+	{
+		throw std::runtime_error("too many materials for the draw sort key!");
+	}
+	materials.push_back(descriptorSet);
+	return static_cast<uint32_t>(materials.size() - 1);
+}
+
+uint32_t SortedDrawList::addMesh(VkBuffer vertexBuffer, uint32_t vertexCount)
+{
+	if (meshes.size() >= 1u << DRAW_KEY_MESH_BITS)
+	{
+		throw std::runtime_error("too many meshes for the draw sort key!");
+	}
+	meshes.push_back({vertexBuffer, vertexCount});
+	return static_cast<uint32_t>(meshes.size() - 1);
+}
+
+void SortedDrawList::clear()
+{
+	pipelines.clear();
+	materials.clear();
+	meshes.clear();
+	keys.clear();
+	draws.clear();
+	models.clear();
+	sortedKeys.clear();
+	order.clear();
+}
+
+void SortedDrawList::add(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth,
+                         const glm::mat4& model)
+{
+	if (pass >= PASS_COUNT)
+	{
+		throw std::runtime_error("draw pass does not fit the sort key!");
+	}
+	keys.push_back(makeDrawKey(pass, pipeline, material, mesh, depth));
+	draws.push_back({pipeline, material, mesh});
+	models.push_back(model);
+}
+
+void SortedDrawList::sort()
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+	sortedKeys.assign(keys.begin(), keys.end());
+	order.resize(keys.size());
+	for (uint32_t i = 0; i < size(); i++)
+	{
+		order[i] = i;
+	}
+	if (sortingEnabled)
+	{
+		radixSort();
+	}
+	stats.sortMilliseconds = std::chrono::duration<double, std::milli>(
+		std::chrono::high_resolution_clock::now() - startTime).count();
+	countBinds();
+}
+
+void SortedDrawList::radixSort()
+{
+	const uint32_t count = size();
+	const uint32_t batchCount = (count + SORT_BATCH_SIZE - 1) / SORT_BATCH_SIZE;
+	batchHistograms.resize(batchCount);
+	scratchKeys.resize(count);
+	scratchOrder.resize(count);
+
+	auto runBatches = [&](const JobSystem::RangeJob& job)
+	{
+		if (jobSystem != nullptr)
+		{
+			jobSystem->parallelFor(count, SORT_BATCH_SIZE, job);
+		}
+		else
+		{
+			for (uint32_t begin = 0; begin < count; begin += SORT_BATCH_SIZE)
+			{
+				job(begin, std::min(begin + SORT_BATCH_SIZE, count));
+			}
+		}
+	};
+
+	for (uint32_t shift = 0; shift < 64; shift += RADIX_BITS)
+	{
+		runBatches([&](uint32_t begin, uint32_t end)
+		{
+			std::array<uint32_t, 256>& histogram = batchHistograms[begin / SORT_BATCH_SIZE];
+			histogram.fill(0);
+			for (uint32_t i = begin; i < end; i++)
+			{
+				histogram[(sortedKeys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+			}
+		});
+
+		// Turn the counts into where every batch writes each digit, keeping equal digits in order
+		uint32_t offset = 0;
+		bool singleDigit = false;
+		for (uint32_t digit = 0; digit < RADIX_BUCKETS && !singleDigit; digit++)
+		{
+			const uint32_t digitStart = offset;
+			for (uint32_t batch = 0; batch < batchCount; batch++)
+			{
+				const uint32_t digitCount = batchHistograms[batch][digit];
+				batchHistograms[batch][digit] = offset;
+				offset += digitCount;
+			}
+			// Fields that are the same for every draw, like unused passes, leave the order as it is
+			singleDigit = offset - digitStart == count;
+		}
+		if (singleDigit)
+		{
+			continue;
+		}
+
+		runBatches([&](uint32_t begin, uint32_t end)
+		{
+			std::array<uint32_t, 256>& offsets = batchHistograms[begin / SORT_BATCH_SIZE];
+			for (uint32_t i = begin; i < end; i++)
+			{
+				const uint32_t target = offsets[(sortedKeys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+				scratchKeys[target] = sortedKeys[i];
+				scratchOrder[target] = order[i];
+			}
+		});
+		sortedKeys.swap(scratchKeys);
+		order.swap(scratchOrder);
+	}
+}
+
+uint32_t SortedDrawList::updateBindState(BindState& state, const Draw& draw) const
+{
+	uint32_t binds = 0;
+	const Pipeline& pipeline = pipelines[draw.pipeline];
+	if (draw.pipeline != state.pipeline)
+	{
+		binds |= BIND_PIPELINE;
+		state.pipeline = draw.pipeline;
+	}
+	// Sets stay bound across pipelines only while the layout is the same
+	if (draw.material != state.material || pipeline.layout != state.layout)
+	{
+		binds |= BIND_DESCRIPTOR_SET;
+		state.material = draw.material;
+		state.layout = pipeline.layout;
+	}
+	const VkBuffer vertexBuffer = meshes[draw.mesh].vertexBuffer;
+	if (vertexBuffer != VK_NULL_HANDLE && vertexBuffer != state.vertexBuffer)
+	{
+		binds |= BIND_VERTEX_BUFFER;
+		state.vertexBuffer = vertexBuffer;
+	}
+	return binds;
+}
+
+void SortedDrawList::countBinds()
+{
+	stats.drawCount = size();
+	stats.pipelineBinds = 0;
+	stats.descriptorSetBinds = 0;
+	stats.vertexBufferBinds = 0;
+	uint32_t drawByDrawBinds = 0;
+
+	// Every pass starts recording from nothing bound
+	BindState passStates[PASS_COUNT];
+	for (uint32_t i = 0; i < size(); i++)
+	{
+		const Draw& draw = draws[order[i]];
+		const uint32_t binds = updateBindState(passStates[keyPass(sortedKeys[i])], draw);
+		stats.pipelineBinds += (binds & BIND_PIPELINE) ? 1 : 0;
+		stats.descriptorSetBinds += (binds & BIND_DESCRIPTOR_SET) ? 1 : 0;
+		stats.vertexBufferBinds += (binds & BIND_VERTEX_BUFFER) ? 1 : 0;
+		drawByDrawBinds += meshes[draw.mesh].vertexBuffer != VK_NULL_HANDLE ? 3 : 2;
+	}
+	stats.bindsSaved = drawByDrawBinds - stats.pipelineBinds - stats.descriptorSetBinds - stats.vertexBufferBinds;
+}
+
+void SortedDrawList::record(VkCommandBuffer commandBuffer, uint32_t pass) const
+{
+	BindState state;
+	for (uint32_t i = 0; i < sortedKeys.size(); i++)
+	{
+		if (keyPass(sortedKeys[i]) != pass)
+		{
+			continue;
+		}
+
+		const uint32_t index = order[i];
+		const Draw& draw = draws[index];
+		const Pipeline& pipeline = pipelines[draw.pipeline];
+		const Mesh& mesh = meshes[draw.mesh];
+		const uint32_t binds = updateBindState(state, draw);
+		if (binds & BIND_PIPELINE)
+		{
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.pipeline);
+		}
+		if (binds & BIND_DESCRIPTOR_SET)
+		{
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.layout, 0, 1,
+			                        &materials[draw.material], 0, nullptr);
+		}
+		if (binds & BIND_VERTEX_BUFFER)
+		{
+			const VkDeviceSize offset = 0;
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &mesh.vertexBuffer, &offset);
+		}
+		vkCmdPushConstants(commandBuffer, pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4),
+		                   &models[index]);
+		vkCmdDraw(commandBuffer, mesh.vertexCount, 1, 0, 0);
+	}
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <array>
+#include <vector>
+
+class JobSystem;
+
+/// Bit widths of the sort key fields, from the most significant down
+const uint32_t DRAW_KEY_PASS_BITS = 4;
+const uint32_t DRAW_KEY_PIPELINE_BITS = 10;
+const uint32_t DRAW_KEY_MATERIAL_BITS = 16;
+const uint32_t DRAW_KEY_MESH_BITS = 14;
+const uint32_t DRAW_KEY_DEPTH_BITS = 20;
+
+/// Packs a draw so that sorting the keys groups it by pass, then pipeline, material and mesh, and
+/// orders it front to back within those. depth is clamped to 0..1, pass 1 - depth to get back to front.
+uint64_t makeDrawKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth);
+
+struct DrawSortStats
+{
+	uint32_t drawCount = 0;
+	uint32_t pipelineBinds = 0;
+	uint32_t descriptorSetBinds = 0;
+	uint32_t vertexBufferBinds = 0;
+	/// Binds a draw-by-draw recording would have made on top of the ones recorded
+	uint32_t bindsSaved = 0;
+	double sortMilliseconds = 0.0;
+};
+
+/// Draws of a frame sorted by packed 64-bit keys, recorded without rebinding state that is already
+/// bound. Pipelines, materials and meshes are registered for the frame and referred to by index,
+/// every material is a descriptor set bound as set 0 and every draw pushes its model matrix. Keys
+/// are sorted with an LSD radix sort whose passes are split into batches run on the job system.
+class SortedDrawList
+{
+public:
+	explicit SortedDrawList(JobSystem* jobSystem = nullptr);
+
+	uint32_t addPipeline(VkPipeline pipeline, VkPipelineLayout layout);
+	uint32_t addMaterial(VkDescriptorSet descriptorSet);
+	/// A null vertex buffer is never bound, for meshes the vertex shader generates
+	uint32_t addMesh(VkBuffer vertexBuffer, uint32_t vertexCount);
+
+	/// Forgets the draws and everything registered, handles may change between frames
+	void clear();
+	void add(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth, const glm::mat4& model);
+	/// Sorts the draws and counts the binds recording them takes, after the last add
+	void sort();
+	/// Records the draws of one pass, inside a render pass
+	void record(VkCommandBuffer commandBuffer, uint32_t pass) const;
+
+	uint32_t size() const { return static_cast<uint32_t>(keys.size()); }
+	DrawSortStats getStats() const { return stats; }
+
+	/// When off the draws stay in submission order and only the elision applies, for comparison
+	bool sortingEnabled = true;
+
+private:
+	struct Pipeline
+	{
+		VkPipeline pipeline;
+		VkPipelineLayout layout;
+	};
+
+	struct Mesh
+	{
+		VkBuffer vertexBuffer;
+		uint32_t vertexCount;
+	};
+
+	struct Draw
+	{
+		uint32_t pipeline;
+		uint32_t material;
+		uint32_t mesh;
+	};
+
+	/// What is bound while recording one pass
+	struct BindState
+	{
+		uint32_t pipeline = UINT32_MAX;
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		uint32_t material = UINT32_MAX;
+		VkBuffer vertexBuffer = VK_NULL_HANDLE;
+	};
+
+	JobSystem* jobSystem;
+	std::vector<Pipeline> pipelines;
+	std::vector<VkDescriptorSet> materials;
+	std::vector<Mesh> meshes;
+
+	/// In submission order
+	std::vector<uint64_t> keys;
+	std::vector<Draw> draws;
+	std::vector<glm::mat4> models;
+	/// Keys in recording order and the submitted draw each one came from
+	std::vector<uint64_t> sortedKeys;
+	std::vector<uint32_t> order;
+
+	std::vector<uint64_t> scratchKeys;
+	std::vector<uint32_t> scratchOrder;
+	std::vector<std::array<uint32_t, 256>> batchHistograms;
+	DrawSortStats stats;
+
+	void radixSort();
+	void countBinds();
+	/// Returns the BIND_ flags of what the draw needs bound and updates the state to match
+	uint32_t updateBindState(BindState& state, const Draw& draw) const;
+};
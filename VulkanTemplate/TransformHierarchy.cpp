@@ -0,0 +1,185 @@
+#include "TransformHierarchy.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+#include <glm/simd/matrix.h>
+#endif
+
+namespace
+{
+	inline void multiply(const glm::mat4& parent, const glm::mat4& local, glm::mat4& world)
+	{
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+		glm_vec4 parentColumns[4];
+		glm_vec4 localColumns[4];
+		glm_vec4 worldColumns[4];
+		for (int i = 0; i < 4; i++)
+		{
+			parentColumns[i] = _mm_loadu_ps(&parent[i][0]);
+			localColumns[i] = _mm_loadu_ps(&local[i][0]);
+		}
+		glm_mat4_mul(parentColumns, localColumns, worldColumns);
+		for (int i = 0; i < 4; i++)
+		{
+			_mm_storeu_ps(&world[i][0], worldColumns[i]);
+		}
+#else
+		world = parent * local;
+#endif
+	}
+}
+
+TransformHierarchy::TransformHierarchy(JobSystem* jobSystem, uint32_t batchSize)
+	: jobSystem(jobSystem), batchSize(batchSize)
+{
+}
+
+uint32_t TransformHierarchy::addNode(uint32_t parent, const glm::mat4& local)
+{
+	if (parent != NO_PARENT && parent >= nodeSlots.size())
+	{
+		throw std::runtime_error("transform parent does not exist!");
+	}
+
+	// Appending keeps parents first, sorting by depth is left to the next update
+	const uint32_t node = static_cast<uint32_t>(nodeSlots.size());
+	const uint32_t slot = static_cast<uint32_t>(locals.size());
+	nodeSlots.push_back(slot);
+	nodeDepths.push_back(parent == NO_PARENT ? 0 : nodeDepths[parent] + 1);
+	locals.push_back(local);
+	worlds.push_back(local);
+	parents.push_back(parent == NO_PARENT ? parent : nodeSlots[parent]);
+	slotNodes.push_back(node);
+	dirty.push_back(1);
+	orderChanged = true;
+	return node;
+}
+
+void TransformHierarchy::setLocal(uint32_t node, const glm::mat4& local)
+{
+	const uint32_t slot = nodeSlots[node];
+	locals[slot] = local;
+	dirty[slot] = 1;
+}
+
+void TransformHierarchy::update()
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+	if (orderChanged)
+	{
+		sortByDepth();
+		orderChanged = false;
+	}
+
+	// A depth only reads the one above it, which is finished, so its batches never overlap
+	std::atomic<uint32_t> updatedNodes{0};
+	auto updateJob = [&](uint32_t begin, uint32_t end)
+	{
+		updatedNodes += updateRange(begin, end);
+	};
+	for (size_t level = 0; level + 1 < levelOffsets.size(); level++)
+	{
+		const uint32_t begin = levelOffsets[level];
+		const uint32_t count = levelOffsets[level + 1] - begin;
+		if (jobSystem != nullptr && count > batchSize)
+		{
+			jobSystem->parallelFor(count, batchSize, [&](uint32_t first, uint32_t last)
+			{
+				updateJob(begin + first, begin + last);
+			});
+		}
+		else
+		{
+			updateJob(begin, begin + count);
+		}
+	}
+	std::fill(dirty.begin(), dirty.end(), 0);
+
+	stats.nodeCount = size();
+	stats.levelCount = levelOffsets.empty() ? 0 : static_cast<uint32_t>(levelOffsets.size() - 1);
+	stats.updatedNodes = updatedNodes;
+	stats.milliseconds = std::chrono::duration<double, std::milli>(
+		std::chrono::high_resolution_clock::now() - startTime).count();
+}
+
+uint32_t TransformHierarchy::updateRange(uint32_t begin, uint32_t end)
+{
+	uint32_t updated = 0;
+	for (uint32_t slot = begin; slot < end; slot++)
+	{
+		const uint32_t parent = parents[slot];
+		if (parent == NO_PARENT)
+		{
+			if (dirty[slot])
+			{
+				worlds[slot] = locals[slot];
+				updated++;
+			}
+		}
+		else if (dirty[slot] || dirty[parent])
+		{
+			// Marking the node passes the change on to its own children
+			multiply(worlds[parent], locals[slot], worlds[slot]);
+			dirty[slot] = 1;
+			updated++;
+		}
+	}
+	return updated;
+}
+
+void TransformHierarchy::sortByDepth()
+{
+	const uint32_t count = size();
+	uint32_t levelCount = 0;
+	for (uint32_t depth : nodeDepths)
+	{
+		levelCount = std::max(levelCount, depth + 1);
+	}
+
+	// Counting sort by depth, stable so siblings keep their creation order
+	levelOffsets.assign(levelCount + 1, 0);
+	for (uint32_t depth : nodeDepths)
+	{
+		levelOffsets[depth + 1]++;
+	}
+	for (uint32_t level = 0; level < levelCount; level++)
+	{
+		levelOffsets[level + 1] += levelOffsets[level];
+	}
+
+	std::vector<uint32_t> nextSlots(levelOffsets.begin(), levelOffsets.end() - 1);
+	std::vector<uint32_t> newSlots(count);
+	for (uint32_t node = 0; node < count; node++)
+	{
+		newSlots[node] = nextSlots[nodeDepths[node]]++;
+	}
+
+	std::vector<glm::mat4> sortedLocals(count);
+	std::vector<glm::mat4> sortedWorlds(count);
+	std::vector<uint32_t> sortedParents(count);
+	std::vector<uint8_t> sortedDirty(count);
+	for (uint32_t node = 0; node < count; node++)
+	{
+		const uint32_t oldSlot = nodeSlots[node];
+		const uint32_t newSlot = newSlots[node];
+		const uint32_t parent = parents[oldSlot];
+		sortedLocals[newSlot] = locals[oldSlot];
+		sortedWorlds[newSlot] = worlds[oldSlot];
+		sortedParents[newSlot] = parent == NO_PARENT ? parent : newSlots[slotNodes[parent]];
+		sortedDirty[newSlot] = dirty[oldSlot];
+	}
+	for (uint32_t node = 0; node < count; node++)
+	{
+		nodeSlots[node] = newSlots[node];
+		slotNodes[newSlots[node]] = node;
+	}
+	locals.swap(sortedLocals);
+	worlds.swap(sortedWorlds);
+	parents.swap(sortedParents);
+	dirty.swap(sortedDirty);
+}
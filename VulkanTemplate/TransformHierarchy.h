@@ -0,0 +1,65 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <vector>
+
+class JobSystem;
+
+struct TransformStats
+{
+	uint32_t nodeCount = 0;
+	uint32_t levelCount = 0;
+	/// World matrices recomputed by the last update, dirty nodes and everything below them
+	uint32_t updatedNodes = 0;
+	double milliseconds = 0.0;
+};
+
+/// Scene graph of local and world matrices kept as separate arrays sorted by depth in the tree, so
+/// every parent is updated before its children and all nodes of one depth are independent of each
+/// other. setLocal marks a node dirty, update() recomputes only dirty nodes and their subtrees, a
+/// depth at a time, splitting each depth into batches that run in parallel with a job system.
+class TransformHierarchy
+{
+public:
+	static const uint32_t NO_PARENT = UINT32_MAX;
+
+	explicit TransformHierarchy(JobSystem* jobSystem = nullptr, uint32_t batchSize = 2048);
+
+	/// Returns the node handle, which stays valid while the arrays are resorted
+	uint32_t addNode(uint32_t parent, const glm::mat4& local = glm::mat4(1.f));
+	void setLocal(uint32_t node, const glm::mat4& local);
+	const glm::mat4& getLocal(uint32_t node) const { return locals[nodeSlots[node]]; }
+	/// As of the last update
+	const glm::mat4& getWorld(uint32_t node) const { return worlds[nodeSlots[node]]; }
+
+	void update();
+
+	uint32_t size() const { return static_cast<uint32_t>(nodeSlots.size()); }
+	TransformStats getStats() const { return stats; }
+
+private:
+	JobSystem* jobSystem;
+	uint32_t batchSize;
+
+	/// Indexed by handle
+	std::vector<uint32_t> nodeSlots;
+	std::vector<uint32_t> nodeDepths;
+
+	/// Indexed by slot, parents always come first
+	std::vector<glm::mat4> locals;
+	std::vector<glm::mat4> worlds;
+	std::vector<uint32_t> parents;
+	std::vector<uint32_t> slotNodes;
+	/// Set by setLocal, then by update for every recomputed node until the update finishes
+	std::vector<uint8_t> dirty;
+
+	/// First slot of every depth plus the end
+	std::vector<uint32_t> levelOffsets;
+	bool orderChanged = false;
+	TransformStats stats;
+
+	void sortByDepth();
+	uint32_t updateRange(uint32_t begin, uint32_t end);
+};
@@ -2,11 +2,16 @@
 
 #define VMA_IMPLEMENTATION
 #include "vk_mem_alloc.h"
+#include "EmbeddedShaders.h"
 
 #include <iostream>
 #include <set>
 #include <array>
 #include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <chrono>
 
 void VulkanBase::init()
 {
@@ -18,8 +23,16 @@ void VulkanBase::initWindow()
 {
 	glfwInit();
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	glfwWindowHint(GLFW_RESIZABLE,GLFW_FALSE);
+	glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 	window = glfwCreateWindow(windowWidth, windowHeight, windowTitle.c_str(), nullptr, nullptr);
+	glfwSetWindowUserPointer(window, this);
+	glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+}
+
+void VulkanBase::framebufferResizeCallback(GLFWwindow* window, int width, int height)
+{
+	auto app = reinterpret_cast<VulkanBase*>(glfwGetWindowUserPointer(window));
+	app->framebufferResized = true;
 }
 
 void VulkanBase::initVulkan()
@@ -35,14 +48,17 @@ void VulkanBase::initVulkan()
 	createMemoryAllocator();
 	createSwapchain();
 	createSwapchainImageViews();
+	sampleCount = findSampleCount(sampleCount);
+	depthImageFormat = findDepthFormat(depthImageUsage);
 	createRenderPass();
 	createColorResources();
 	createDepthResources();
 	createFramebuffers();
 	createCommandPool();
 	createSyncObjects();
-	createDescriptorSetLayout();
-	createDescriptorPool();
+	createDescriptorAllocator();
+	createPipelineCache();
+	createShaderHotReload();
 }
 
 void VulkanBase::createInstance()
@@ -112,8 +128,15 @@ void VulkanBase::pickPhysicalDevice()
 {
 	uint32_t deviceCount = 0;
 	vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+	if (deviceCount == 0)
+	{
+		throw std::runtime_error("failed to find gpu with vulkan support");
+	}
 	std::vector<VkPhysicalDevice> devices(deviceCount);
 	vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+
+	// Prefer a discrete gpu, but fall back to whatever is there so software drivers like lavapipe work
+	physicalDevice = devices[0];
 	for (const auto& device : devices)
 	{
 		VkPhysicalDeviceProperties properties;
@@ -123,10 +146,6 @@ void VulkanBase::pickPhysicalDevice()
 			physicalDevice = device;
 			break;
 		}
-		else
-		{
-			throw std::runtime_error("failed to find discrete gpu");
-		}
 	}
 }
 
@@ -136,7 +155,8 @@ void VulkanBase::createLogicalDevice()
 	std::set<uint32_t> uniqueQueueFamily = {
 		queueFamilyIndex.graphicsFamily.value(),
 		queueFamilyIndex.presentFamily.value(),
-		queueFamilyIndex.transferFamily.value()
+		queueFamilyIndex.transferFamily.value(),
+		queueFamilyIndex.computeFamily.value()
 	};
 
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
@@ -154,23 +174,53 @@ void VulkanBase::createLogicalDevice()
 	}
 
 
+	uint32_t extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+	std::vector<const char*> enabledExtensions = deviceExtensions;
+	drawIndirectCountSupported = std::any_of(availableExtensions.begin(), availableExtensions.end(),
+	                                         [](const VkExtensionProperties& extension)
+	                                         {
+		                                         return strcmp(extension.extensionName,
+		                                                       VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0;
+	                                         });
+	if (drawIndirectCountSupported)
+	{
+		enabledExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+	}
+
+	/// Only turn on optional features the device actually has
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+	enabledFeatures = {};
+	enabledFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+	enabledFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+
 	VkDeviceCreateInfo deviceCreateInfo;
 	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-	deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+	deviceCreateInfo.ppEnabledExtensionNames = enabledExtensions.data();
 	deviceCreateInfo.enabledLayerCount = 0;
 	deviceCreateInfo.ppEnabledLayerNames = nullptr;
 	deviceCreateInfo.flags = VK_NULL_HANDLE;
 	deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 	deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
-	deviceCreateInfo.pEnabledFeatures = nullptr;
+	deviceCreateInfo.pEnabledFeatures = &enabledFeatures;
 	deviceCreateInfo.pNext = nullptr;
 
 	vkCreateDevice(physicalDevice, &deviceCreateInfo, nullptr, &device);
+	if (drawIndirectCountSupported)
+	{
+		cmdDrawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(
+			device, "vkCmdDrawIndexedIndirectCountKHR");
+	}
 
 	vkGetDeviceQueue(device, queueFamilyIndex.graphicsFamily.value(), 0, &graphicsQueue);
 	vkGetDeviceQueue(device, queueFamilyIndex.presentFamily.value(), 0, &presentQueue);
 	vkGetDeviceQueue(device, queueFamilyIndex.transferFamily.value(), 0, &transferQueue);
+	vkGetDeviceQueue(device, queueFamilyIndex.computeFamily.value(), 0, &computeQueue);
 }
 
 void VulkanBase::createMemoryAllocator()
@@ -187,15 +237,35 @@ void VulkanBase::createSwapchain()
 	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &surfaceCapabilities);
 	surfaceFormat = chooseSurfaceFormat();
 
+	VkExtent2D extent = surfaceCapabilities.currentExtent;
+	if (extent.width == UINT32_MAX)
+	{
+		int width, height;
+		glfwGetFramebufferSize(window, &width, &height);
+		extent.width = std::clamp(static_cast<uint32_t>(width), surfaceCapabilities.minImageExtent.width,
+		                          surfaceCapabilities.maxImageExtent.width);
+		extent.height = std::clamp(static_cast<uint32_t>(height), surfaceCapabilities.minImageExtent.height,
+		                           surfaceCapabilities.maxImageExtent.height);
+	}
+	windowWidth = extent.width;
+	windowHeight = extent.height;
+
+	// A maximum of 0 means there is no limit
+	uint32_t minImageCount = std::max(3u, surfaceCapabilities.minImageCount);
+	if (surfaceCapabilities.maxImageCount > 0)
+	{
+		minImageCount = std::min(minImageCount, surfaceCapabilities.maxImageCount);
+	}
+
 	VkSwapchainCreateInfoKHR swapchainCreateInfo;
 	swapchainCreateInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
 	swapchainCreateInfo.pNext = nullptr;
 	swapchainCreateInfo.flags = VK_NULL_HANDLE;
 	swapchainCreateInfo.surface = surface;
-	swapchainCreateInfo.minImageCount = 3;
+	swapchainCreateInfo.minImageCount = minImageCount;
 	swapchainCreateInfo.imageFormat = surfaceFormat.format;
 	swapchainCreateInfo.imageColorSpace = surfaceFormat.colorSpace;
-	swapchainCreateInfo.imageExtent = surfaceCapabilities.currentExtent;
+	swapchainCreateInfo.imageExtent = extent;
 	swapchainCreateInfo.imageArrayLayers = 1;
 	swapchainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 	swapchainCreateInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
@@ -203,11 +273,16 @@ void VulkanBase::createSwapchain()
 	swapchainCreateInfo.pQueueFamilyIndices = nullptr;
 	swapchainCreateInfo.preTransform = surfaceCapabilities.currentTransform;
 	swapchainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-	swapchainCreateInfo.presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+	swapchainCreateInfo.presentMode = choosePresentMode();
 	swapchainCreateInfo.clipped = VK_TRUE;
-	swapchainCreateInfo.oldSwapchain = nullptr;
+	swapchainCreateInfo.oldSwapchain = swapchain;
 
-	vkCreateSwapchainKHR(device, &swapchainCreateInfo, nullptr, &swapchain);
+	VkSwapchainKHR newSwapchain;
+	if (vkCreateSwapchainKHR(device, &swapchainCreateInfo, nullptr, &newSwapchain) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create swapchain!");
+	}
+	swapchain = newSwapchain;
 
 	uint32_t imageCount;
 	vkGetSwapchainImagesKHR(device, swapchain, &imageCount, nullptr);
@@ -215,6 +290,96 @@ void VulkanBase::createSwapchain()
 	vkGetSwapchainImagesKHR(device, swapchain, &imageCount, swapchainImages.data());
 }
 
+void VulkanBase::recreateSwapchain()
+{
+	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &surfaceCapabilities);
+	while (surfaceCapabilities.currentExtent.width == 0 || surfaceCapabilities.currentExtent.height == 0)
+	{
+		// Minimized, nothing can be presented until the window has a size again
+		if (glfwWindowShouldClose(window))
+		{
+			return;
+		}
+		glfwWaitEvents();
+		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &surfaceCapabilities);
+	}
+	framebufferResized = false;
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	/// Everything sized to the old swapchain is kept alive until the frames using it have retired
+	RetiredSwapchain retired;
+	retired.retireFrame = frameNumber;
+	retired.swapchain = swapchain;
+	retired.imageViews = std::move(swapchainImageViews);
+	retired.framebuffers = std::move(swapchainFramebuffers);
+	retired.colorImage = colorImage;
+	retired.colorImageAllocation = colorImageAllocation;
+	retired.colorImageView = colorImageView;
+	retired.depthImage = depthImage;
+	retired.depthImageAllocation = depthImageAllocation;
+	retired.depthImageView = depthImageView;
+	retiredSwapchains.push_back(std::move(retired));
+
+	createSwapchain();
+	createSwapchainImageViews();
+	createColorResources();
+	createDepthResources();
+	createFramebuffers();
+	if (swapchainImages.size() > imagesInFlight.size())
+	{
+		addSwapchainImages();
+	}
+	std::fill(commandBufferDirty.begin(), commandBufferDirty.end(), true);
+
+	auto endTime = std::chrono::high_resolution_clock::now();
+	lastSwapchainRecreateTime = std::chrono::duration<float, std::chrono::milliseconds::period>(
+		endTime - startTime).count();
+	swapchainRecreateCount++;
+
+	onSwapchainRecreated();
+}
+
+void VulkanBase::addSwapchainImages()
+{
+	/// Per-image resources only ever grow, images a smaller swapchain no longer has simply leave theirs unused.
+	/// Frames in flight keep what they use, so the device does not have to be idle.
+	imagesInFlight.resize(swapchainImages.size(), VK_NULL_HANDLE);
+	if (!uniformBuffers.empty())
+	{
+		createUniformBuffer(uniformBufferSize);
+	}
+	onSwapchainImagesAdded();
+	allocateCommandBuffers();
+}
+
+void VulkanBase::destroyRetiredSwapchains()
+{
+	while (!retiredSwapchains.empty() &&
+		frameNumber >= retiredSwapchains.front().retireFrame + MAX_FRAMES_IN_FLIGHT)
+	{
+		RetiredSwapchain& retired = retiredSwapchains.front();
+		for (VkFramebuffer framebuffer : retired.framebuffers)
+		{
+			vkDestroyFramebuffer(device, framebuffer, nullptr);
+		}
+		for (VkImageView imageView : retired.imageViews)
+		{
+			vkDestroyImageView(device, imageView, nullptr);
+		}
+		vkDestroyImageView(device, retired.colorImageView, nullptr);
+		vmaDestroyImage(allocator, retired.colorImage, retired.colorImageAllocation);
+		vkDestroyImageView(device, retired.depthImageView, nullptr);
+		vmaDestroyImage(allocator, retired.depthImage, retired.depthImageAllocation);
+		for (VkQueryPool queryPool : retired.queryPools)
+		{
+			vkDestroyQueryPool(device, queryPool, nullptr);
+		}
+		vkDestroySwapchainKHR(device, retired.swapchain, nullptr);
+		retiredSwapchains.pop_front();
+	}
+}
+
 void VulkanBase::createSwapchainImageViews()
 {
 	swapchainImageViews.resize(swapchainImages.size());
@@ -302,22 +467,98 @@ void VulkanBase::createRenderPass()
 
 void VulkanBase::createColorResources()
 {
-	createImage(windowWidth, windowHeight, 1, sampleCount, surfaceFormat.format,
-	            VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
-	            VMA_MEMORY_USAGE_GPU_ONLY,
-	            colorImage, colorImageAllocation);
+	createAttachmentImage(surfaceFormat.format,
+	                      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+	                      colorImage, colorImageAllocation);
 	colorImageView = createImageView(colorImage, surfaceFormat.format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
 }
 
 void VulkanBase::createDepthResources()
 {
-	createImage(windowWidth, windowHeight, 1, sampleCount, depthImageFormat, VK_IMAGE_TILING_OPTIMAL,
-	            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
-	            VMA_MEMORY_USAGE_GPU_ONLY,
-	            depthImage, depthImageAllocation);
+	createAttachmentImage(depthImageFormat, depthImageUsage, depthImage, depthImageAllocation);
 	depthImageView = createImageView(depthImage, depthImageFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
 }
 
+void VulkanBase::createAttachmentImage(VkFormat format, VkImageUsageFlags usage, VkImage& image,
+                                       VmaAllocation& allocation)
+{
+	// Dedicated allocations, so the commitment of their memory is the attachment's alone
+	if (lazyAttachments && (usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) &&
+		createImage(windowWidth, windowHeight, 1, sampleCount, format, VK_IMAGE_TILING_OPTIMAL, usage,
+		            VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED, image, allocation,
+		            VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT) == VK_SUCCESS)
+	{
+		return;
+	}
+	// Most desktop devices have no lazily allocated memory type
+	if (createImage(windowWidth, windowHeight, 1, sampleCount, format, VK_IMAGE_TILING_OPTIMAL, usage,
+	                VMA_MEMORY_USAGE_GPU_ONLY, image, allocation, VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT) !=
+		VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create attachment image!");
+	}
+}
+
+VkFormat VulkanBase::findDepthFormat(VkImageUsageFlags usage) const
+{
+	// Smallest first, none with stencil since nothing uses it
+	const std::pair<VkFormat, uint32_t> candidates[] = {
+		{VK_FORMAT_D16_UNORM, 16},
+		{VK_FORMAT_X8_D24_UNORM_PACK32, 24},
+		{VK_FORMAT_D32_SFLOAT, 32},
+	};
+	for (const auto& candidate : candidates)
+	{
+		if (candidate.second < minDepthBits)
+		{
+			continue;
+		}
+		VkImageFormatProperties properties;
+		if (vkGetPhysicalDeviceImageFormatProperties(physicalDevice, candidate.first, VK_IMAGE_TYPE_2D,
+		                                             VK_IMAGE_TILING_OPTIMAL, usage, 0, &properties) == VK_SUCCESS &&
+			(properties.sampleCounts & sampleCount))
+		{
+			return candidate.first;
+		}
+	}
+	throw std::runtime_error("failed to find a supported depth format!");
+}
+
+VkSampleCountFlagBits VulkanBase::findSampleCount(VkSampleCountFlagBits requested) const
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	const VkSampleCountFlags supported = properties.limits.framebufferColorSampleCounts &
+		properties.limits.framebufferDepthSampleCounts;
+
+	// Devices have to support 1 and 4 samples, so asking for more never ends below 4
+	VkSampleCountFlagBits samples = requested;
+	while (samples > VK_SAMPLE_COUNT_1_BIT && !(supported & samples))
+	{
+		samples = static_cast<VkSampleCountFlagBits>(samples >> 1);
+	}
+	return samples;
+}
+
+AttachmentMemory VulkanBase::getAttachmentMemory(VmaAllocation allocation, VkFormat format) const
+{
+	VmaAllocationInfo allocationInfo;
+	vmaGetAllocationInfo(allocator, allocation, &allocationInfo);
+	VkMemoryPropertyFlags memoryFlags;
+	vmaGetMemoryTypeProperties(allocator, allocationInfo.memoryType, &memoryFlags);
+
+	AttachmentMemory memory = {};
+	memory.format = format;
+	memory.allocatedBytes = allocationInfo.size;
+	memory.committedBytes = allocationInfo.size;
+	memory.lazilyAllocated = (memoryFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0;
+	if (memory.lazilyAllocated)
+	{
+		vkGetDeviceMemoryCommitment(device, allocationInfo.deviceMemory, &memory.committedBytes);
+	}
+	return memory;
+}
+
 void VulkanBase::createFramebuffers()
 {
 	swapchainFramebuffers.resize(swapchainImageViews.size());
@@ -351,6 +592,7 @@ void VulkanBase::createCommandPool()
 	VkCommandPoolCreateInfo poolInfo = {};
 	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	poolInfo.queueFamilyIndex = queueFamilyIndex.graphicsFamily.value();
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
 	if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS)
 	{
@@ -363,6 +605,7 @@ void VulkanBase::createSyncObjects()
 	imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
 	renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
 	inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+	imagesInFlight.resize(swapchainImages.size(), VK_NULL_HANDLE);
 
 	VkSemaphoreCreateInfo semaphoreInfo = {};
 	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -382,46 +625,317 @@ void VulkanBase::createSyncObjects()
 	}
 }
 
-void VulkanBase::createDescriptorSetLayout()
+void VulkanBase::createPipelineLayout(const std::vector<VkShaderModule>& shaderModules)
+{
+	std::vector<const ShaderReflection*> stages;
+	for (VkShaderModule shaderModule : shaderModules)
+	{
+		stages.push_back(&shaderReflections.at(shaderModule));
+	}
+
+	ReflectedPipelineLayout layout = layoutCache->getPipelineLayout(stages);
+	pipelineLayout = layout.pipelineLayout;
+	if (!layout.setLayouts.empty())
+	{
+		descriptorSetLayout = layout.setLayouts[0];
+	}
+}
+
+void VulkanBase::createDescriptorAllocator()
+{
+	descriptorAllocator = std::make_unique<DescriptorAllocator>(device, MAX_FRAMES_IN_FLIGHT);
+}
+
+void VulkanBase::createPipelineCache()
+{
+	uint32_t workerCount = std::max(1u, std::thread::hardware_concurrency() / 2);
+	pipelineCache = std::make_unique<PipelineCache>(device, workerCount);
+	layoutCache = std::make_unique<LayoutCache>(device);
+}
+
+void VulkanBase::createShaderHotReload()
+{
+	if (enableShaderHotReload)
+	{
+		// Shaders start out from the embedded SPIR-V, a source is compiled once it changes
+		shaderHotReload = std::make_unique<ShaderHotReload>(shaderCompilerPath);
+	}
+}
+
+void VulkanBase::resolveCompilingPipelines()
+{
+	for (auto& reloadable : reloadablePipelines)
+	{
+		if (*reloadable.pipeline != VK_NULL_HANDLE)
+		{
+			continue;
+		}
+		if (pipelineCache->hasFailed(reloadable.description))
+		{
+			throw std::runtime_error("failed to create graphics pipeline!");
+		}
+		/// Draws that need it were skipped so far, the command buffers are recorded again with it
+		*reloadable.pipeline = pipelineCache->getPipeline(reloadable.description);
+		if (*reloadable.pipeline != VK_NULL_HANDLE)
+		{
+			std::fill(commandBufferDirty.begin(), commandBufferDirty.end(), true);
+		}
+	}
+}
+
+void VulkanBase::registerReloadablePipeline(VkPipeline& pipeline, VkPipelineLayout& layout,
+                                            const PipelineDescription& description)
+{
+	ReloadablePipeline reloadable;
+	reloadable.pipeline = &pipeline;
+	reloadable.layout = &layout;
+	for (const auto& named : shaderModulesByName)
+	{
+		if (named.second == description.vertShader)
+		{
+			reloadable.vertFile = named.first;
+		}
+		if (named.second == description.fragShader)
+		{
+			reloadable.fragFile = named.first;
+		}
+	}
+	reloadable.description = description;
+	reloadable.setLayouts = reflectPipelineLayout(description).setLayouts;
+	reloadablePipelines.push_back(reloadable);
+}
+
+ReflectedPipelineLayout VulkanBase::reflectPipelineLayout(const PipelineDescription& description)
+{
+	std::vector<const ShaderReflection*> stages = {&shaderReflections.at(description.vertShader)};
+	if (description.fragShader != VK_NULL_HANDLE)
+	{
+		stages.push_back(&shaderReflections.at(description.fragShader));
+	}
+	return layoutCache->getPipelineLayout(stages);
+}
+
+VkPipeline VulkanBase::createComputePipeline(VkShaderModule shaderModule, VkPipelineLayout layout)
 {
-	VkDescriptorSetLayoutBinding uboLayoutBinding;
-	uboLayoutBinding.binding = 0;
-	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	uboLayoutBinding.descriptorCount = 1;
-	uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-	uboLayoutBinding.pImmutableSamplers = nullptr;
+	VkComputePipelineCreateInfo pipelineCreateInfo = {};
+	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineCreateInfo.stage.module = shaderModule;
+	pipelineCreateInfo.stage.pName = "main";
+	pipelineCreateInfo.layout = layout;
+
+	VkPipeline computePipeline;
+	if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &computePipeline) !=
+		VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create compute pipeline!");
+	}
+	return computePipeline;
+}
+
+void VulkanBase::updateShaderHotReload()
+{
+	/// Queue rebuilds of the pipelines created from a freshly compiled file
+	for (const CompiledShader& compiled : shaderHotReload->takeCompiledShaders())
+	{
+		auto it = shaderModulesByName.find(compiled.spvFile);
+		if (it == shaderModulesByName.end())
+		{
+			continue;
+		}
+
+		VkShaderModule newModule;
+		try
+		{
+			newModule = createShaderModule(compiled.code.data(), compiled.code.size() * sizeof(uint32_t));
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Shader hot reload: " << e.what() << std::endl;
+			continue;
+		}
+		supersededModules.push_back(it->second);
+		it->second = newModule;
+
+		for (auto& reloadable : reloadablePipelines)
+		{
+			if (reloadable.vertFile != compiled.spvFile && reloadable.fragFile != compiled.spvFile)
+			{
+				continue;
+			}
+			PipelineDescription description = reloadable.pending
+				                                  ? reloadable.pendingDescription
+				                                  : reloadable.description;
+			if (reloadable.vertFile == compiled.spvFile)
+			{
+				description.vertShader = newModule;
+			}
+			if (reloadable.fragFile == compiled.spvFile)
+			{
+				description.fragShader = newModule;
+			}
+
+			// The new code may declare other bindings or push constants
+			const ReflectedPipelineLayout layout = reflectPipelineLayout(description);
+			if (layout.setLayouts.size() != reloadable.setLayouts.size())
+			{
+				std::cerr << "Shader hot reload: " << compiled.spvFile <<
+					" changes the number of descriptor sets, keeping previous pipeline" << std::endl;
+				continue;
+			}
+			description.layout = layout.pipelineLayout;
+
+			if (reloadable.pending)
+			{
+				// Replaced before it was ever swapped in
+				retireShaderObjects(VK_NULL_HANDLE, pipelineCache->evict(reloadable.pendingDescription));
+			}
+			reloadable.pendingDescription = description;
+			reloadable.pendingSetLayouts = layout.setLayouts;
+			reloadable.pending = true;
+			pipelineCache->getPipeline(description);
+		}
+	}
+
+	/// Swap in once every rebuild is done, so pipelines sharing layouts and descriptor sets change together.
+	/// Command buffers are re-recorded once their image is free.
+	for (auto& reloadable : reloadablePipelines)
+	{
+		if (reloadable.pending && !pipelineCache->hasFailed(reloadable.pendingDescription) &&
+			pipelineCache->getPipeline(reloadable.pendingDescription) == VK_NULL_HANDLE)
+		{
+			return;
+		}
+	}
+	for (auto& reloadable : reloadablePipelines)
+	{
+		if (!reloadable.pending)
+		{
+			continue;
+		}
+		reloadable.pending = false;
+		if (pipelineCache->hasFailed(reloadable.pendingDescription))
+		{
+			std::cerr << "Shader hot reload: pipeline creation failed, keeping previous pipeline" << std::endl;
+			pipelineCache->evict(reloadable.pendingDescription);
+			continue;
+		}
+
+		try
+		{
+			for (size_t i = 0; i < reloadable.setLayouts.size(); i++)
+			{
+				if (reloadable.pendingSetLayouts[i] != reloadable.setLayouts[i])
+				{
+					onDescriptorSetLayoutChanged(reloadable.setLayouts[i], reloadable.pendingSetLayouts[i]);
+				}
+			}
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Shader hot reload: " << e.what() << ", keeping previous pipeline" << std::endl;
+			retireShaderObjects(VK_NULL_HANDLE, pipelineCache->evict(reloadable.pendingDescription));
+			continue;
+		}
+
+		retireShaderObjects(VK_NULL_HANDLE, pipelineCache->evict(reloadable.description));
+		*reloadable.pipeline = pipelineCache->getPipeline(reloadable.pendingDescription);
+		*reloadable.layout = reloadable.pendingDescription.layout;
+		reloadable.description = reloadable.pendingDescription;
+		reloadable.setLayouts = reloadable.pendingSetLayouts;
+		std::fill(commandBufferDirty.begin(), commandBufferDirty.end(), true);
+	}
+
+	/// Old modules are kept while a pipeline may still be created from them
+	for (auto it = supersededModules.begin(); it != supersededModules.end();)
+	{
+		const VkShaderModule shaderModule = *it;
+		bool referenced = false;
+		for (const auto& reloadable : reloadablePipelines)
+		{
+			referenced |= reloadable.description.vertShader == shaderModule ||
+				reloadable.description.fragShader == shaderModule;
+		}
+		if (referenced)
+		{
+			++it;
+			continue;
+		}
+		retireShaderObjects(shaderModule, VK_NULL_HANDLE);
+		it = supersededModules.erase(it);
+	}
+}
 
-	VkDescriptorSetLayoutCreateInfo layoutCreateInfo;
-	layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	layoutCreateInfo.pNext = nullptr;
-	layoutCreateInfo.bindingCount = 1;
-	layoutCreateInfo.pBindings = &uboLayoutBinding;
-	layoutCreateInfo.flags = VK_NULL_HANDLE;
-	vkCreateDescriptorSetLayout(device, &layoutCreateInfo, nullptr, &descriptorSetLayout);
+void VulkanBase::retireShaderObjects(VkShaderModule shaderModule, VkPipeline pipeline)
+{
+	if (shaderModule != VK_NULL_HANDLE || pipeline != VK_NULL_HANDLE)
+	{
+		retiredShaderObjects.push_back({frameNumber, shaderModule, pipeline});
+	}
 }
 
-void VulkanBase::createDescriptorPool()
+void VulkanBase::destroyRetiredShaderObjects()
 {
-	VkDescriptorPoolSize uboPoolSize;
-	uboPoolSize.descriptorCount = 1;
-	uboPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	for (auto it = retiredShaderObjects.begin();
+		it != retiredShaderObjects.end() && frameNumber >= it->retireFrame + MAX_FRAMES_IN_FLIGHT;)
+	{
+		// A worker may still be compiling an evicted pipeline from the module, it waits for that job to finish
+		if (it->shaderModule != VK_NULL_HANDLE && pipelineCache->isModuleInUse(it->shaderModule))
+		{
+			++it;
+			continue;
+		}
+		if (it->pipeline != VK_NULL_HANDLE)
+		{
+			vkDestroyPipeline(device, it->pipeline, nullptr);
+		}
+		if (it->shaderModule != VK_NULL_HANDLE)
+		{
+			vkDestroyShaderModule(device, it->shaderModule, nullptr);
+			shaderReflections.erase(it->shaderModule);
+		}
+		it = retiredShaderObjects.erase(it);
+	}
+}
 
-	VkDescriptorPoolCreateInfo poolCreateInfo;
-	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	poolCreateInfo.pNext = nullptr;
-	poolCreateInfo.flags = VK_NULL_HANDLE;
-	poolCreateInfo.maxSets = static_cast<uint32_t>(swapchainImages.size());
-	poolCreateInfo.poolSizeCount = 1;
-	poolCreateInfo.pPoolSizes = &uboPoolSize;
+void VulkanBase::createCommandBuffers()
+{
+	allocateCommandBuffers();
+	for (uint32_t i = 0; i < commandBuffers.size(); i++)
+	{
+		recordCommandBuffer(i);
+	}
+	commandBufferDirty.assign(commandBuffers.size(), false);
+}
 
-	vkCreateDescriptorPool(device, &poolCreateInfo, nullptr, &descriptorPool);
+void VulkanBase::allocateCommandBuffers()
+{
+	/// Only images without a command buffer get one, they are recorded before their first submit
+	const size_t firstImage = commandBuffers.size();
+	commandBuffers.resize(swapchainImages.size());
+	commandBufferDirty.resize(commandBuffers.size(), true);
+
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = commandPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = (uint32_t)(commandBuffers.size() - firstImage);
+
+	if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data() + firstImage) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate command buffers!");
+	}
 }
 
 void VulkanBase::createUniformBuffer(VkDeviceSize bufferSize)
 {
+	/// Creates buffers for the images that have none yet
+	uniformBufferSize = bufferSize;
+	const size_t firstImage = uniformBuffers.size();
 	uniformBuffers.resize(swapchainImages.size());
 	uniformBufferAllocation.resize(swapchainImages.size());
-	for (size_t i = 0; i < swapchainImages.size(); i++)
+	for (size_t i = firstImage; i < swapchainImages.size(); i++)
 	{
 		createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU,
 		             uniformBuffers[i], uniformBufferAllocation[i]);
@@ -431,12 +945,37 @@ void VulkanBase::createUniformBuffer(VkDeviceSize bufferSize)
 void VulkanBase::drawFrame()
 {
 	vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
-	vkResetFences(device, 1, &inFlightFences[currentFrame]);
+	destroyRetiredSwapchains();
+	descriptorAllocator->beginFrame(static_cast<uint32_t>(currentFrame));
+
+	if (shaderHotReload)
+	{
+		destroyRetiredShaderObjects();
+		updateShaderHotReload();
+	}
+	resolveCompilingPipelines();
 
 	uint32_t imageIndex;
-	vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE,
-	                      &imageIndex);
+	VkResult result = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, imageAvailableSemaphores[currentFrame],
+	                                        VK_NULL_HANDLE, &imageIndex);
+	if (result == VK_ERROR_OUT_OF_DATE_KHR)
+	{
+		recreateSwapchain();
+		return;
+	}
+
+	if (imagesInFlight[imageIndex] != VK_NULL_HANDLE)
+	{
+		vkWaitForFences(device, 1, &imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+	}
+	imagesInFlight[imageIndex] = inFlightFences[currentFrame];
+
 	updateUniformBuffer(imageIndex);
+	if (recordEveryFrame || commandBufferDirty[imageIndex])
+	{
+		recordCommandBuffer(imageIndex);
+		commandBufferDirty[imageIndex] = false;
+	}
 
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -453,6 +992,7 @@ void VulkanBase::drawFrame()
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores = signalSemaphores;
 
+	vkResetFences(device, 1, &inFlightFences[currentFrame]);
 	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to submit draw command buffer!");
@@ -466,9 +1006,14 @@ void VulkanBase::drawFrame()
 	presentInfo.pSwapchains = &swapchain;
 	presentInfo.pImageIndices = &imageIndex;
 
-	vkQueuePresentKHR(presentQueue, &presentInfo);
+	result = vkQueuePresentKHR(presentQueue, &presentInfo);
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized)
+	{
+		recreateSwapchain();
+	}
 
 	currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+	frameNumber++;
 }
 
 VkBool32 VulkanBase::debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
@@ -545,6 +1090,21 @@ void VulkanBase::findQueueFamilyIndex()
 		}
 	}
 
+	/// Find async compute queue family index, the graphics family can do compute too
+	for (size_t i = 0; i < queueFamilyProperties.size(); i++)
+	{
+		if ((queueFamilyProperties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) &&
+			!(queueFamilyProperties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT))
+		{
+			queueFamilyIndex.computeFamily = i;
+			break;
+		}
+	}
+	if (!queueFamilyIndex.computeFamily.has_value())
+	{
+		queueFamilyIndex.computeFamily = queueFamilyIndex.graphicsFamily;
+	}
+
 	if (!queueFamilyIndex.isComplete())
 	{
 		throw std::runtime_error("queue family incomplete");
@@ -585,6 +1145,27 @@ VkSurfaceFormatKHR VulkanBase::chooseSurfaceFormat()
 	return surfaceFormat;
 }
 
+VkPresentModeKHR VulkanBase::choosePresentMode()
+{
+	uint32_t presentModeCount;
+	vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, nullptr);
+	std::vector<VkPresentModeKHR> presentModes(presentModeCount);
+	vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, presentModes.data());
+
+	// FIFO is the only mode every device has to support
+	if (std::find(presentModes.begin(), presentModes.end(), VK_PRESENT_MODE_MAILBOX_KHR) != presentModes.end())
+	{
+		return VK_PRESENT_MODE_MAILBOX_KHR;
+	}
+	return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+void VulkanBase::retireQueryPool(VkQueryPool queryPool)
+{
+	/// Pools are only replaced while a swapchain is recreated, they go with the swapchain they were sized for
+	retiredSwapchains.back().queryPools.push_back(queryPool);
+}
+
 void VulkanBase::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, VkBuffer& buffer,
                               VmaAllocation& allocation)
 {
@@ -604,9 +1185,10 @@ void VulkanBase::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VmaMe
 	vmaCreateBuffer(allocator, &bufferCreateInfo, &allocationCreateInfo, &buffer, &allocation, nullptr);
 }
 
-void VulkanBase::createImage(uint32_t width, uint32_t height, uint32_t mipLevelCount, VkSampleCountFlagBits sampleCount,
-                             VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VmaMemoryUsage memoryUsage,
-                             VkImage& image, VmaAllocation& allocation)
+VkResult VulkanBase::createImage(uint32_t width, uint32_t height, uint32_t mipLevelCount,
+                                 VkSampleCountFlagBits sampleCount, VkFormat format, VkImageTiling tiling,
+                                 VkImageUsageFlags usage, VmaMemoryUsage memoryUsage, VkImage& image,
+                                 VmaAllocation& allocation, VmaAllocationCreateFlags allocationFlags)
 {
 	VkImageCreateInfo imageCreateInfo;
 	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -629,28 +1211,53 @@ void VulkanBase::createImage(uint32_t width, uint32_t height, uint32_t mipLevelC
 
 	VmaAllocationCreateInfo allocationCreateInfo = {};
 	allocationCreateInfo.usage = memoryUsage;
+	allocationCreateInfo.flags = allocationFlags;
 
-	vmaCreateImage(allocator, &imageCreateInfo, &allocationCreateInfo, &image, &allocation, nullptr);
+	return vmaCreateImage(allocator, &imageCreateInfo, &allocationCreateInfo, &image, &allocation, nullptr);
 }
 
 VkShaderModule VulkanBase::createShaderModule(const std::string& filename)
 {
-	const std::vector<char>& code = readFile(filename);
+	auto it = shaderModulesByName.find(filename);
+	if (it != shaderModulesByName.end())
+	{
+		return it->second;
+	}
+
+	VkShaderModule shaderModule;
+	const EmbeddedShader* embeddedShader = loadShadersFromDisk ? nullptr : findEmbeddedShader(filename);
+	if (embeddedShader != nullptr)
+	{
+		shaderModule = createShaderModule(embeddedShader->code, embeddedShader->codeSize);
+	}
+	else
+	{
+		const std::vector<uint32_t> code = readShaderFile(filename);
+		shaderModule = createShaderModule(code.data(), code.size() * sizeof(uint32_t));
+	}
+
+	shaderModulesByName[filename] = shaderModule;
+	return shaderModule;
+}
+
+VkShaderModule VulkanBase::createShaderModule(const uint32_t* code, size_t codeSize)
+{
 	VkShaderModuleCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.codeSize = code.size();
-	createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+	createInfo.codeSize = codeSize;
+	createInfo.pCode = code;
 
 	VkShaderModule shaderModule;
 	if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create shader module!");
 	}
+	shaderReflections[shaderModule] = reflectShader(code, codeSize / sizeof(uint32_t));
 
 	return shaderModule;
 }
 
-std::vector<char> VulkanBase::readFile(const std::string& filename)
+std::vector<uint32_t> VulkanBase::readShaderFile(const std::string& filename)
 {
 	std::ifstream file(filename, std::ios::ate | std::ios::binary);
 
@@ -660,10 +1267,16 @@ std::vector<char> VulkanBase::readFile(const std::string& filename)
 	}
 
 	size_t fileSize = (size_t)file.tellg();
-	std::vector<char> buffer(fileSize);
+	if (fileSize % sizeof(uint32_t) != 0)
+	{
+		throw std::runtime_error("SPIR-V file size is not a multiple of 4!");
+	}
+
+	// Read straight into uint32_t storage so pCode is correctly aligned
+	std::vector<uint32_t> buffer(fileSize / sizeof(uint32_t));
 
 	file.seekg(0);
-	file.read(buffer.data(), fileSize);
+	file.read(reinterpret_cast<char*>(buffer.data()), fileSize);
 
 	file.close();
 
@@ -3,19 +3,29 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 #include <vk_mem_alloc.h>
+#include "PipelineCache.h"
+#include "DescriptorAllocator.h"
+#include "ShaderReflection.h"
+#include "ShaderHotReload.h"
 #include <string>
+#include <memory>
 #include <vector>
 #include <optional>
+#include <deque>
+#include <unordered_map>
 
 struct QueueFamilyIndex
 {
 	std::optional<uint32_t> graphicsFamily;
 	std::optional<uint32_t> presentFamily;
 	std::optional<uint32_t> transferFamily;
+	/// A compute family without graphics where the device has one, so work there runs beside the frame
+	std::optional<uint32_t> computeFamily;
 
 	bool isComplete()
 	{
-		return graphicsFamily.has_value() && presentFamily.has_value() && transferFamily.has_value();
+		return graphicsFamily.has_value() && presentFamily.has_value() && transferFamily.has_value() &&
+			computeFamily.has_value();
 	}
 };
 
@@ -25,6 +35,54 @@ const std::vector<const char*> deviceExtensions = {
 
 const int MAX_FRAMES_IN_FLIGHT = 2;
 
+struct RetiredSwapchain
+{
+	uint64_t retireFrame;
+	VkSwapchainKHR swapchain;
+	std::vector<VkImageView> imageViews;
+	std::vector<VkFramebuffer> framebuffers;
+	VkImage colorImage;
+	VmaAllocation colorImageAllocation;
+	VkImageView colorImageView;
+	VkImage depthImage;
+	VmaAllocation depthImageAllocation;
+	VkImageView depthImageView;
+	std::vector<VkQueryPool> queryPools;
+};
+
+struct AttachmentMemory
+{
+	VkFormat format;
+	/// Size of the allocation, what the attachment costs in device local memory
+	VkDeviceSize allocatedBytes;
+	/// Memory the driver has actually backed, less than allocated only for lazily allocated memory
+	VkDeviceSize committedBytes;
+	bool lazilyAllocated;
+};
+
+struct ReloadablePipeline
+{
+	VkPipeline* pipeline;
+	/// What the app binds the pipeline's descriptor sets with, swapped along with the pipeline
+	VkPipelineLayout* layout;
+	/// Files the shaders were created from, so a reload finds the pipeline whichever module it holds
+	std::string vertFile;
+	std::string fragFile;
+	PipelineDescription description;
+	std::vector<VkDescriptorSetLayout> setLayouts;
+	PipelineDescription pendingDescription;
+	std::vector<VkDescriptorSetLayout> pendingSetLayouts;
+	bool pending = false;
+};
+
+/// Replaced by a shader hot reload, either handle may be null
+struct RetiredShaderObjects
+{
+	uint64_t retireFrame;
+	VkShaderModule shaderModule;
+	VkPipeline pipeline;
+};
+
 class VulkanBase
 {
 public:
@@ -39,6 +97,9 @@ public:
 	const uint32_t appVersion = VK_MAKE_VERSION(0, 0, 1);
 	const uint32_t engineVersion = VK_MAKE_VERSION(0, 0, 1);
 	bool enableValidation = true;
+	bool loadShadersFromDisk = false;
+	bool enableShaderHotReload = false;
+	std::string shaderCompilerPath = "glslc";
 	QueueFamilyIndex queueFamilyIndex;
 
 private:
@@ -48,9 +109,16 @@ public:
 	VmaAllocator allocator;
 	VkInstance instance;
 	VkPhysicalDevice physicalDevice;
+	VkPhysicalDeviceFeatures enabledFeatures = {};
+	bool drawIndirectCountSupported = false;
+	PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount = nullptr;
 	VkDevice device;
 	VkSurfaceKHR surface;
-	VkSwapchainKHR swapchain;
+	VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+	std::deque<RetiredSwapchain> retiredSwapchains;
+	bool framebufferResized = false;
+	float lastSwapchainRecreateTime = 0.f;
+	uint32_t swapchainRecreateCount = 0;
 	std::vector<VkImage> swapchainImages;
 	std::vector<VkImageView> swapchainImageViews;
 	VkRenderPass renderPass;
@@ -62,25 +130,51 @@ public:
 	VkImage depthImage;
 	VmaAllocation depthImageAllocation;
 	VkImageView depthImageView;
+	/// Requested count, lowered by init to the highest one color and depth framebuffers of the device support
 	VkSampleCountFlagBits sampleCount = VK_SAMPLE_COUNT_8_BIT;
+	/// Picked by init as the smallest format with at least minDepthBits that supports depthImageUsage
 	VkFormat depthImageFormat = VK_FORMAT_D32_SFLOAT;
+	uint32_t minDepthBits = 16;
+	/// Transient attachments go to lazily allocated memory where the device has it, so tilers that keep
+	/// them on chip never back them with real memory
+	bool lazyAttachments = true;
+	/// Apps that read depth after the pass swap the transient bit for VK_IMAGE_USAGE_SAMPLED_BIT before init
+	VkImageUsageFlags depthImageUsage =
+		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
 	std::vector<VkFramebuffer> swapchainFramebuffers;
 	VkCommandPool commandPool;
 	std::vector<VkSemaphore> imageAvailableSemaphores;
 	std::vector<VkSemaphore> renderFinishedSemaphores;
 	std::vector<VkFence> inFlightFences;
+	std::vector<VkFence> imagesInFlight;
 	VkPipeline pipeline;
 	VkPipelineLayout pipelineLayout;
 	std::vector<VkCommandBuffer> commandBuffers;
+	std::vector<bool> commandBufferDirty;
+	/// Per-draw data is pushed while recording, so apps that animate it re-record every frame
+	bool recordEveryFrame = false;
 	VkQueue graphicsQueue;
 	VkQueue transferQueue;
 	VkQueue presentQueue;
+	VkQueue computeQueue;
 	VkDescriptorSetLayout descriptorSetLayout;
-	VkDescriptorPool descriptorPool;
+	std::unique_ptr<DescriptorAllocator> descriptorAllocator;
 	std::vector<VkDescriptorSet> descriptorSets;
 	std::vector<VkBuffer> uniformBuffers;
 	std::vector<VmaAllocation> uniformBufferAllocation;
+	VkDeviceSize uniformBufferSize = 0;
+	std::unique_ptr<PipelineCache> pipelineCache;
+	std::unique_ptr<LayoutCache> layoutCache;
+	std::unordered_map<VkShaderModule, ShaderReflection> shaderReflections;
+	/// One module per file, shared by everything built from it so hot reload swaps it everywhere
+	std::unordered_map<std::string, VkShaderModule> shaderModulesByName;
+	std::unique_ptr<ShaderHotReload> shaderHotReload;
+	std::vector<ReloadablePipeline> reloadablePipelines;
+	/// Reloaded away, but kept until no pipeline is left to be created from them
+	std::vector<VkShaderModule> supersededModules;
+	std::deque<RetiredShaderObjects> retiredShaderObjects;
 	size_t currentFrame = 0;
+	uint64_t frameNumber = 0;
 
 public:
 
@@ -104,25 +198,72 @@ private:
 	void createLogicalDevice();
 	void createMemoryAllocator();
 	void createSwapchain();
+	void recreateSwapchain();
+	void addSwapchainImages();
+	void destroyRetiredSwapchains();
 	void createSwapchainImageViews();
 	void createRenderPass();
 	void createColorResources();
 	void createDepthResources();
+	void createAttachmentImage(VkFormat format, VkImageUsageFlags usage, VkImage& image, VmaAllocation& allocation);
+	VkSampleCountFlagBits findSampleCount(VkSampleCountFlagBits requested) const;
 	void createFramebuffers();
 	void createCommandPool();
 	void createSyncObjects();
-	void createDescriptorSetLayout();
-	void createDescriptorPool();
+	void createDescriptorAllocator();
+	void createPipelineCache();
+	void createShaderHotReload();
+	void updateShaderHotReload();
+	void resolveCompilingPipelines();
+	void retireShaderObjects(VkShaderModule shaderModule, VkPipeline pipeline);
+	void destroyRetiredShaderObjects();
+	ReflectedPipelineLayout reflectPipelineLayout(const PipelineDescription& description);
 
 public:
 	void drawFrame();
 	void createUniformBuffer(VkDeviceSize bufferSize);
+	/// Destroys a query pool sized for the old swapchain once its frames retired, only from onSwapchainImagesAdded
+	void retireQueryPool(VkQueryPool queryPool);
+	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage,
+	                  VkBuffer& buffer, VmaAllocation& allocation);
+	void createPipelineLayout(const std::vector<VkShaderModule>& shaderModules);
+	void createCommandBuffers();
+	void allocateCommandBuffers();
+	/// layout is what the app binds with, it must have been reflected from the description's shaders. A pipeline
+	/// still compiling may be registered as VK_NULL_HANDLE, it is filled in by the first frame after it is done.
+	void registerReloadablePipeline(VkPipeline& pipeline, VkPipelineLayout& layout,
+	                                const PipelineDescription& description);
+	VkPipeline createComputePipeline(VkShaderModule shaderModule, VkPipelineLayout layout);
+	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlagBits aspectFlags, uint32_t mipLevels);
+	VkResult createImage(uint32_t width, uint32_t height, uint32_t mipLevelCount, VkSampleCountFlagBits sampleCount,
+	                     VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VmaMemoryUsage memoryUsage,
+	                     VkImage& image, VmaAllocation& allocation, VmaAllocationCreateFlags allocationFlags = 0);
+	/// Smallest depth format with at least minDepthBits that supports usage at sampleCount
+	VkFormat findDepthFormat(VkImageUsageFlags usage) const;
+	/// Committed bytes change as the driver backs lazily allocated memory, so this queries them anew
+	AttachmentMemory getAttachmentMemory(VmaAllocation allocation, VkFormat format) const;
 
 	virtual void createGraphicsPipeline() = 0;
-	virtual void createCommandBuffers() = 0;
+	virtual void recordCommandBuffer(uint32_t imageIndex) = 0;
 	virtual void updateUniformBuffer(uint32_t currentImage) = 0;
+	/// Called after the swapchain and its attachments were recreated at a new size
+	virtual void onSwapchainRecreated()
+	{
+	}
+	/// Called when a recreated swapchain has more images than any before it, while earlier frames may still be
+	/// in flight. Whatever is kept per image has to be created for the new images, what the others have stays in
+	/// use and anything replaced goes through retireQueryPool or the module's own retiring.
+	virtual void onSwapchainImagesAdded()
+	{
+	}
+	/// Called when reloaded shaders changed a set layout, before their pipelines are swapped in. Sets allocated
+	/// with the old layout cannot be bound with them, throwing keeps the previous pipelines.
+	virtual void onDescriptorSetLayoutChanged(VkDescriptorSetLayout oldLayout, VkDescriptorSetLayout newLayout)
+	{
+	}
 
 private:
+	static void framebufferResizeCallback(GLFWwindow* window, int width, int height);
 	static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
 		VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
 		VkDebugUtilsMessageTypeFlagsEXT messageType,
@@ -130,15 +271,12 @@ private:
 		void* pUserData);
 	std::vector<const char*> getRequiredExtensions();
 	std::vector<const char*> getRequiredLayers();
-	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlagBits aspectFlags, uint32_t mipLevels);
 	VkSurfaceFormatKHR chooseSurfaceFormat();
-	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage,
-	                  VkBuffer& buffer, VmaAllocation& allocation);
-	void createImage(uint32_t width, uint32_t height, uint32_t mipLevelCount, VkSampleCountFlagBits sampleCount,
-	                 VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VmaMemoryUsage memoryUsage,
-	                 VkImage& image, VmaAllocation& allocation);
-	static std::vector<char> readFile(const std::string& filename);
+	VkPresentModeKHR choosePresentMode();
 
 public:
+	static std::vector<uint32_t> readShaderFile(const std::string& filename);
+	/// Returns the module already created from this file, if any
 	VkShaderModule createShaderModule(const std::string& filename);
+	VkShaderModule createShaderModule(const uint32_t* code, size_t codeSize);
 };
@@ -1,12 +1,31 @@
 #pragma once
 
-struct UniformBufferObject
+/// Updated once per frame, shared by every draw
+struct FrameUniforms
 {
-	glm::mat4 model;
 	glm::mat4 view;
 	glm::mat4 proj;
 };
 
+/// Pushed before each draw, so drawing more objects needs no descriptor updates
+struct DrawPushConstants
+{
+	glm::mat4 model;
+};
+
+/// Set 0 contents, written in one call through its update template
+struct FrameDescriptors
+{
+	DescriptorInfo frameUniforms;
+};
+
+/// Set 0 of the GPU-driven pipeline, objects are fetched by gl_InstanceIndex
+struct IndirectDescriptors
+{
+	DescriptorInfo frameUniforms;
+	DescriptorInfo objects;
+};
+
 struct Vertex
 {
 	glm::vec2 pos;
@@ -17,4 +36,12 @@ const std::vector<Vertex> vertices = {
 	{{0.0f, -0.5f}, {1.0f, 0.0f, 0.0f}},
 	{{0.5f, 0.5f}, {0.0f, 1.0f, 0.0f}},
 	{{-0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}}
-};
\ No newline at end of file
+};
+
+const std::vector<uint32_t> indices = {0, 1, 2};
+
+/// Distance of the farthest triangle corner from its center, in model space
+const float triangleBoundingRadius = 0.70711f;
+
+/// Number of material tints in shaders/instanced.vert
+const uint32_t materialCount = 4;
\ No newline at end of file
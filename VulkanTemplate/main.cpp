@@ -9,6 +9,27 @@
 #include <glm/gtx/hash.hpp>
 #include <iostream>
 #include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <deque>
+#include "GpuCulling.h"
+#include "OcclusionCulling.h"
+#include "FrustumCulling.h"
+#include "Bvh.h"
+#include "SoftwareOcclusion.h"
+#include "TransformHierarchy.h"
+#include "InstancedDrawList.h"
+#include "SortedDrawList.h"
+#include "RenderGraph.h"
+#include "DynamicResolution.h"
+#include "AntiAliasing.h"
+#include "MipGenerator.h"
+#include "ClusteredLighting.h"
+#include "DeferredShading.h"
+#include "CascadedShadows.h"
+#include "JobSystem.h"
 #include "data.h"
 
 class Triangle : public VulkanBase
@@ -17,255 +38,2431 @@ public:
 	explicit Triangle(bool enableValidation)
 		: VulkanBase(enableValidation)
 	{
+		recordEveryFrame = true;
+	}
+
+	~Triangle()
+	{
+		if (gpuCulling || !instanceBuffers.empty() || renderGraph || dynamicResolution || antiAliasing ||
+			clusteredLighting || deferredShading || cascadedShadows)
+		{
+			// These buffers may still be in use by frames in flight
+			vkDeviceWaitIdle(device);
+		}
+		renderGraph.reset();
+		retiredRenderGraphs.clear();
+		dynamicResolution.reset();
+		antiAliasing.reset();
+		deferredShading.reset();
+		clusteredLighting.reset();
+		cascadedShadows.reset();
+		occlusionCulling.reset();
+		if (gpuCulling)
+		{
+			gpuCulling.reset();
+			vmaDestroyBuffer(allocator, indexBuffer, indexBufferAllocation);
+		}
+		for (size_t i = 0; i < instanceBuffers.size(); i++)
+		{
+			vmaUnmapMemory(allocator, instanceBufferAllocations[i]);
+			vmaDestroyBuffer(allocator, instanceBuffers[i], instanceBufferAllocations[i]);
+		}
 	}
 
 public:
-	void createCommandBuffers() override;
+	uint32_t objectCount = 1;
+	std::vector<DrawPushConstants> drawData;
+	TypedUpdateTemplate<FrameDescriptors> frameDescriptorTemplate;
+	float gridExtent = 1.f;
+	/// Objects are split over this many grids stacked below each other, so upper ones hide lower ones
+	uint32_t gridLayers = 1;
+	float objectScale = 1.f;
+	/// Every n-th object spins, the others stand still and are cached as static shadow casters
+	uint32_t dynamicObjectInterval = 1;
+	glm::mat4 viewProj;
+
+	bool gpuDriven = false;
+	std::unique_ptr<GpuCulling> gpuCulling;
+	VkPipeline indirectPipeline;
+	VkPipelineLayout indirectPipelineLayout;
+	VkDescriptorSetLayout indirectSetLayout;
+	std::vector<VkDescriptorSet> indirectDescriptorSets;
+	VkBuffer indexBuffer;
+	VmaAllocation indexBufferAllocation;
+	uint32_t visibleCount = 0;
+
+	bool occlusion = false;
+	std::unique_ptr<OcclusionCulling> occlusionCulling;
+	OcclusionStats occlusionStats;
+
+	bool cpuCulling = false;
+	std::unique_ptr<JobSystem> jobSystem;
+	FrustumCuller frustumCuller;
+	BoundsSoA objectBounds;
+	std::vector<uint32_t> visibleObjects;
+
+	/// Needs cpuCulling, the top grid layer is rasterized and hides what is behind it
+	std::unique_ptr<SoftwareOcclusion> softwareOcclusion;
+	std::vector<glm::vec3> occluderPositions;
+	std::vector<Aabb> occludeeBounds;
+	bool dumpOcclusionDepth = false;
+
+	bool instanced = false;
+	InstancedDrawList drawList;
+	uint32_t maxInstances = 0;
+	VkPipeline instancedPipeline;
+	VkPipelineLayout instancedPipelineLayout;
+	std::vector<VkBuffer> instanceBuffers;
+	std::vector<VmaAllocation> instanceBufferAllocations;
+	std::vector<InstanceData*> mappedInstances;
+
+	bool sortedDraws = false;
+	SortedDrawList sortedDrawList;
+
+	/// When set the main pass is recorded through the graph instead of the base render pass
+	std::unique_ptr<RenderGraph> renderGraph;
+	/// Graphs of old swapchains and the frame they were replaced in
+	std::deque<std::pair<uint64_t, std::unique_ptr<RenderGraph>>> retiredRenderGraphs;
+
+	/// When set the scene is rendered at a scale that follows the GPU time and upscaled into the swapchain
+	std::unique_ptr<DynamicResolution> dynamicResolution;
+
+	/// Has to exist before the pipelines are created, so each gets a single-sample variant for its scene pass
+	std::unique_ptr<AntiAliasing> antiAliasing;
+	VkPipeline singleSamplePipeline = VK_NULL_HANDLE;
+	VkPipeline singleSampleIndirectPipeline = VK_NULL_HANDLE;
+	VkPipeline singleSampleInstancedPipeline = VK_NULL_HANDLE;
+
+	/// When set the basic draw path is lit by its lights, except at a dynamic scale or single-sample
+	std::unique_ptr<ClusteredLighting> clusteredLighting;
+	/// Shades the basic draw path with the same clusters through a G-buffer, while deferred is set
+	std::unique_ptr<DeferredShading> deferredShading;
+	bool deferred = false;
+
+	/// When set the basic draw path is shadowed by a slowly turning sun, unless lit by clusters
+	std::unique_ptr<CascadedShadows> cascadedShadows;
+	float sunDegreesPerSecond = 1.f;
+	std::vector<uint32_t> staticCasters;
+	std::vector<uint32_t> dynamicCasters;
+
+	void recordCommandBuffer(uint32_t imageIndex) override;
+	void recordDraws(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	void recordOcclusionCulledDraws(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	void recordSceneDraws(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	void beginMainPass(VkCommandBuffer commandBuffer, uint32_t imageIndex, VkRenderPass pass);
+	void setMainViewport(VkCommandBuffer commandBuffer);
+	bool drawsSingleSample() const;
+	bool drawsDeferred() const;
+	bool drawsShadowed() const;
+	void createSingleSampleVariant(VkPipeline& variant, VkPipelineLayout& layout, PipelineDescription description);
 	void createGraphicsPipeline() override;
 	void createDescriptorSets();
+	void createIndirectDescriptorSets();
+	void createInstanceBuffers();
+	void createGpuDrivenResources(uint32_t maxObjects);
+	void createInstancedResources(uint32_t instanceCapacity);
+	void createOcclusionResources();
+	void buildRenderGraph();
+	void destroyRetiredRenderGraphs();
+	void onSwapchainRecreated() override;
+	void onSwapchainImagesAdded() override;
+	void onDescriptorSetLayoutChanged(VkDescriptorSetLayout oldLayout, VkDescriptorSetLayout newLayout) override;
+	void updateTransforms(float time);
+	void cullSoftwareOccluded();
+	void uploadObjects(uint32_t imageIndex);
+	void uploadInstances(uint32_t imageIndex);
+	void buildSortedDraws(uint32_t imageIndex);
+	void placeLights(uint32_t count);
 	void updateUniformBuffer(uint32_t currentImage) override;
+	void benchmarkDraws();
+	void benchmarkDescriptorUpdates();
+	void benchmarkIndirect();
+	void benchmarkInstancing();
+	void benchmarkOcclusion();
+	void benchmarkRenderGraph();
+	void benchmarkAttachmentMemory();
+	void benchmarkDynamicResolution();
+	void benchmarkAntiAliasing();
+	void benchmarkMipGeneration();
+	void benchmarkClusteredLighting();
+	void benchmarkDeferredShading();
+	void benchmarkShadows();
 };
 
-void Triangle::createCommandBuffers()
+void Triangle::recordCommandBuffer(uint32_t imageIndex)
 {
-	commandBuffers.resize(swapchainFramebuffers.size());
+	recordDraws(commandBuffers[imageIndex], imageIndex);
+}
 
-	VkCommandBufferAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.commandPool = commandPool;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandBufferCount = (uint32_t)commandBuffers.size();
+void Triangle::recordDraws(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
-	if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS)
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
 	{
-		throw std::runtime_error("failed to allocate command buffers!");
+		throw std::runtime_error("failed to begin recording command buffer!");
 	}
 
-	for (size_t i = 0; i < commandBuffers.size(); i++)
+	if (occlusion)
 	{
-		VkCommandBufferBeginInfo beginInfo = {};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-
-		if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) != VK_SUCCESS)
+		recordOcclusionCulledDraws(commandBuffer, imageIndex);
+	}
+	else
+	{
+		if (gpuDriven)
 		{
-			throw std::runtime_error("failed to begin recording command buffer!");
+			gpuCulling->recordCulling(commandBuffer, imageIndex, viewProj, objectCount);
+		}
+		if (clusteredLighting)
+		{
+			clusteredLighting->recordBinning(commandBuffer, imageIndex);
+		}
+		if (drawsShadowed())
+		{
+			cascadedShadows->recordShadows(commandBuffer, imageIndex, drawData, staticCasters, dynamicCasters);
 		}
 
-		std::vector<VkClearValue> clearValues(3);
-		clearValues[0].color = {1, 1, 1};
-		clearValues[1].color = {0, 0, 0};
-		clearValues[2].depthStencil = {1, 0};
-
-		VkRenderPassBeginInfo renderPassInfo = {};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = renderPass;
-		renderPassInfo.framebuffer = swapchainFramebuffers[i];
-		renderPassInfo.renderArea.offset = {0, 0};
-		renderPassInfo.renderArea.extent.width = windowWidth;
-		renderPassInfo.renderArea.extent.height = windowHeight;
-		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-		renderPassInfo.pClearValues = clearValues.data();
-
-		vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		if (drawsDeferred())
+		{
+			deferredShading->beginGBuffer(commandBuffer, imageIndex);
+			recordSceneDraws(commandBuffer, imageIndex);
+			deferredShading->recordLighting(commandBuffer, imageIndex);
+		}
+		else if (renderGraph)
+		{
+			renderGraph->execute(commandBuffer, imageIndex);
+		}
+		else if (dynamicResolution)
+		{
+			dynamicResolution->beginScene(commandBuffer, imageIndex);
+			recordSceneDraws(commandBuffer, imageIndex);
+			dynamicResolution->endScene(commandBuffer, imageIndex);
+		}
+		else if (antiAliasing)
+		{
+			antiAliasing->beginScene(commandBuffer, imageIndex);
+			recordSceneDraws(commandBuffer, imageIndex);
+			antiAliasing->endScene(commandBuffer, imageIndex);
+		}
+		else
+		{
+			beginMainPass(commandBuffer, imageIndex, renderPass);
+			recordSceneDraws(commandBuffer, imageIndex);
+			vkCmdEndRenderPass(commandBuffer);
+		}
 
-		vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-		vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
-		                        &descriptorSets[i], 0, nullptr);
-		vkCmdDraw(commandBuffers[i], 3, 1, 0, 0);
+		if (clusteredLighting)
+		{
+			clusteredLighting->recordShadingEnd(commandBuffer, imageIndex);
+		}
+	}
 
-		vkCmdEndRenderPass(commandBuffers[i]);
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to record command buffer!");
+	}
+}
 
-		if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS)
+void Triangle::recordSceneDraws(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	// Variants still compiling on the pipeline cache workers leave the pass empty
+	const bool singleSample = drawsSingleSample();
+	if (gpuDriven)
+	{
+		const VkPipeline drawPipeline = singleSample ? singleSampleIndirectPipeline : indirectPipeline;
+		if (drawPipeline == VK_NULL_HANDLE)
+		{
+			return;
+		}
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, drawPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, indirectPipelineLayout, 0, 1,
+		                        &indirectDescriptorSets[imageIndex], 0, nullptr);
+		vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+		gpuCulling->recordDraws(commandBuffer, imageIndex, objectCount);
+	}
+	else if (instanced)
+	{
+		const VkPipeline drawPipeline = singleSample ? singleSampleInstancedPipeline : instancedPipeline;
+		if (drawPipeline == VK_NULL_HANDLE)
+		{
+			return;
+		}
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, drawPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, instancedPipelineLayout, 0, 1,
+		                        &descriptorSets[imageIndex], 0, nullptr);
+		const VkDeviceSize offset = 0;
+		vkCmdBindVertexBuffers(commandBuffer, 1, 1, &instanceBuffers[imageIndex], &offset);
+		for (const InstancedDraw& draw : drawList.getDraws())
+		{
+			vkCmdDraw(commandBuffer, 3, draw.instanceCount, 0, draw.firstInstance);
+		}
+	}
+	else if (sortedDraws)
+	{
+		sortedDrawList.record(commandBuffer, 0);
+	}
+	else
+	{
+		// The lit pipeline only exists for the multisampled base render pass, and finds its cluster by the
+		// pixel position in a window sized target
+		const bool lit = clusteredLighting && !singleSample && !dynamicResolution;
+		VkPipelineLayout drawLayout = lit ? clusteredLighting->getPipelineLayout() : pipelineLayout;
+		VkDescriptorSet drawSet = lit ? clusteredLighting->getDescriptorSet(imageIndex) : descriptorSets[imageIndex];
+		VkPipeline drawPipeline = lit ? clusteredLighting->getPipeline() : singleSample ? singleSamplePipeline
+		                                                                                : pipeline;
+		if (drawsDeferred())
 		{
-			throw std::runtime_error("failed to record command buffer!");
+			drawLayout = deferredShading->getGBufferPipelineLayout();
+			drawSet = deferredShading->getGBufferDescriptorSet(imageIndex);
+			drawPipeline = deferredShading->getGBufferPipeline();
+		}
+		else if (drawsShadowed())
+		{
+			drawLayout = cascadedShadows->getPipelineLayout();
+			drawSet = cascadedShadows->getDescriptorSet(imageIndex);
+			drawPipeline = cascadedShadows->getPipeline();
+		}
+		if (drawPipeline == VK_NULL_HANDLE)
+		{
+			return;
+		}
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, drawPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, drawLayout, 0, 1, &drawSet, 0,
+		                        nullptr);
+		if (cpuCulling)
+		{
+			for (uint32_t index : visibleObjects)
+			{
+				vkCmdPushConstants(commandBuffer, drawLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+				                   sizeof(DrawPushConstants), &drawData[index]);
+				vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+			}
+		}
+		else
+		{
+			for (const DrawPushConstants& draw : drawData)
+			{
+				vkCmdPushConstants(commandBuffer, drawLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+				                   sizeof(DrawPushConstants), &draw);
+				vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+			}
 		}
 	}
 }
 
-void Triangle::createGraphicsPipeline()
+void Triangle::beginMainPass(VkCommandBuffer commandBuffer, uint32_t imageIndex, VkRenderPass pass)
 {
-	VkShaderModule vertShaderModule = createShaderModule("shaders/vert.spv");
-	VkShaderModule fragShaderModule = createShaderModule("shaders/frag.spv");
-
-	VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
-	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	vertShaderStageInfo.module = vertShaderModule;
-	vertShaderStageInfo.pName = "main";
-
-	VkPipelineShaderStageCreateInfo fragShaderStageInfo = {};
-	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	fragShaderStageInfo.module = fragShaderModule;
-	fragShaderStageInfo.pName = "main";
-
-	VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
+	std::vector<VkClearValue> clearValues(3);
+	clearValues[0].color = {1, 1, 1};
+	clearValues[1].color = {0, 0, 0};
+	clearValues[2].depthStencil = {1, 0};
 
-	VkPipelineVertexInputStateCreateInfo inputState = {};
-	inputState.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	inputState.vertexBindingDescriptionCount = 0;
-	inputState.vertexAttributeDescriptionCount = 0;
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = pass;
+	renderPassInfo.framebuffer = swapchainFramebuffers[imageIndex];
+	renderPassInfo.renderArea.offset = {0, 0};
+	renderPassInfo.renderArea.extent.width = windowWidth;
+	renderPassInfo.renderArea.extent.height = windowHeight;
+	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	renderPassInfo.pClearValues = clearValues.data();
 
-	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
-	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-	inputAssembly.primitiveRestartEnable = VK_FALSE;
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	setMainViewport(commandBuffer);
+}
 
+void Triangle::setMainViewport(VkCommandBuffer commandBuffer)
+{
 	VkViewport viewport = {};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
 	viewport.width = static_cast<float>(windowWidth);
 	viewport.height = static_cast<float>(windowHeight);
 	viewport.minDepth = 0.0f;
 	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
 	VkRect2D scissor = {};
-	scissor.offset = {0, 0};
 	scissor.extent.width = windowWidth;
 	scissor.extent.height = windowHeight;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
+
+bool Triangle::drawsSingleSample() const
+{
+	// Only when the anti-aliasing pass records the frame, every other main pass is multisampled
+	return antiAliasing && antiAliasing->isSingleSample() && !occlusion && !drawsDeferred() && !renderGraph &&
+		!dynamicResolution;
+}
 
-	VkPipelineViewportStateCreateInfo viewportState = {};
-	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportState.viewportCount = 1;
-	viewportState.pViewports = &viewport;
-	viewportState.scissorCount = 1;
-	viewportState.pScissors = &scissor;
-
-	VkPipelineRasterizationStateCreateInfo rasterizer = {};
-	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizer.depthClampEnable = VK_FALSE;
-	rasterizer.rasterizerDiscardEnable = VK_FALSE;
-	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-	rasterizer.lineWidth = 1.0f;
-	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-	rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-	rasterizer.depthBiasEnable = VK_FALSE;
-
-	VkPipelineMultisampleStateCreateInfo multiSampleInfo = {};
-	multiSampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multiSampleInfo.sampleShadingEnable = VK_FALSE;
-	multiSampleInfo.rasterizationSamples = sampleCount;
-
-	VkPipelineDepthStencilStateCreateInfo depthInfo = {};
-	depthInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depthInfo.depthTestEnable = VK_TRUE;
-	depthInfo.depthWriteEnable = VK_TRUE;
-	depthInfo.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-	depthInfo.depthBoundsTestEnable = VK_FALSE;
-	depthInfo.stencilTestEnable = VK_FALSE;
-
-	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
-	colorBlendAttachment.colorWriteMask =
-		VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colorBlendAttachment.blendEnable = VK_FALSE;
-
-	VkPipelineColorBlendStateCreateInfo colorBlending = {};
-	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colorBlending.logicOpEnable = VK_FALSE;
-	colorBlending.logicOp = VK_LOGIC_OP_COPY;
-	colorBlending.attachmentCount = 1;
-	colorBlending.pAttachments = &colorBlendAttachment;
-	colorBlending.blendConstants[0] = 0.0f;
-	colorBlending.blendConstants[1] = 0.0f;
-	colorBlending.blendConstants[2] = 0.0f;
-	colorBlending.blendConstants[3] = 0.0f;
-
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
-	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = 1;
-	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-
-	vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout);
-
-	VkGraphicsPipelineCreateInfo pipelineCreateInfo;
-	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipelineCreateInfo.pNext = nullptr;
-	pipelineCreateInfo.flags = VK_NULL_HANDLE;
-	pipelineCreateInfo.stageCount = 2;
-	pipelineCreateInfo.pStages = shaderStages;
-	pipelineCreateInfo.pVertexInputState = &inputState;
-	pipelineCreateInfo.pInputAssemblyState = &inputAssembly;
-	pipelineCreateInfo.pTessellationState = nullptr;
-	pipelineCreateInfo.pViewportState = &viewportState;
-	pipelineCreateInfo.pRasterizationState = &rasterizer;
-	pipelineCreateInfo.pMultisampleState = &multiSampleInfo;
-	pipelineCreateInfo.pDepthStencilState = &depthInfo;
-	pipelineCreateInfo.pColorBlendState = &colorBlending;
-	pipelineCreateInfo.pDynamicState = nullptr;
-	pipelineCreateInfo.layout = pipelineLayout;
-	pipelineCreateInfo.renderPass = renderPass;
-	pipelineCreateInfo.subpass = 0;
-	pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
-	pipelineCreateInfo.basePipelineIndex = 0;
-
-
-	vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipeline);
+bool Triangle::drawsDeferred() const
+{
+	// Only the basic draw path has a G-buffer pipeline
+	return deferredShading && deferred && !gpuDriven && !instanced && !sortedDraws;
 }
 
-void Triangle::createDescriptorSets()
+bool Triangle::drawsShadowed() const
 {
-	std::vector<VkDescriptorSetLayout> layouts(swapchainImages.size(), descriptorSetLayout);
+	// The shadowed pipeline exists for the multisampled base render pass only, like the lit one
+	return cascadedShadows && !clusteredLighting && !occlusion && !gpuDriven && !instanced && !sortedDraws &&
+		!drawsSingleSample() && !dynamicResolution;
+}
+
+void Triangle::recordOcclusionCulledDraws(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	occlusionCulling->recordFirstPhase(commandBuffer, imageIndex, viewProj, objectCount);
+	for (uint32_t phase = 0; phase < 2; phase++)
+	{
+		if (phase == 1)
+		{
+			occlusionCulling->recordSecondPhase(commandBuffer, imageIndex, objectCount);
+		}
 
-	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo;
-	descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	descriptorSetAllocateInfo.descriptorPool = descriptorPool;
-	descriptorSetAllocateInfo.descriptorSetCount = static_cast<uint32_t>(swapchainImages.size());
-	descriptorSetAllocateInfo.pNext = nullptr;
-	descriptorSetAllocateInfo.pSetLayouts = layouts.data();
+		beginMainPass(commandBuffer, imageIndex, occlusionCulling->getRenderPass(phase));
+		if (indirectPipeline != VK_NULL_HANDLE)
+		{
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, indirectPipeline);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, indirectPipelineLayout, 0, 1,
+			                        &indirectDescriptorSets[imageIndex], 0, nullptr);
+			vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+			occlusionCulling->recordDraws(commandBuffer, imageIndex, phase, objectCount);
+		}
+		vkCmdEndRenderPass(commandBuffer);
+	}
+	occlusionCulling->recordEnd(commandBuffer, imageIndex);
+}
 
-	descriptorSets.resize(swapchainImages.size());
-	vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo, descriptorSets.data());
+void Triangle::createGraphicsPipeline()
+{
+	PipelineDescription description;
+	description.vertShader = createShaderModule("shaders/vert.spv");
+	description.fragShader = createShaderModule("shaders/frag.spv");
+	createPipelineLayout({description.vertShader, description.fragShader});
+
+	shaderReflections[description.vertShader].getVertexInput(0, description.vertexBindings,
+	                                                         description.vertexAttributes);
+	description.sampleCount = sampleCount;
+	// The projection flips Y, which flips the winding too
+	description.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	description.layout = pipelineLayout;
+	description.renderPass = renderPass;
+
+	pipeline = pipelineCache->getPipelineBlocking(description);
+	if (pipeline == VK_NULL_HANDLE)
+	{
+		throw std::runtime_error("failed to create graphics pipeline!");
+	}
 
-	for (size_t i = 0; i < swapchainImages.size(); i++)
+	registerReloadablePipeline(pipeline, pipelineLayout, description);
+	if (antiAliasing)
+	{
+		createSingleSampleVariant(singleSamplePipeline, pipelineLayout, description);
+	}
+	if (shaderHotReload)
 	{
-		VkDescriptorBufferInfo bufferInfo = {};
-		bufferInfo.buffer = uniformBuffers[i];
-		bufferInfo.offset = 0;
-		bufferInfo.range = sizeof(UniformBufferObject);
-		VkWriteDescriptorSet descriptorWrite = {};
-		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrite.descriptorCount = 1;
-		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptorWrite.pBufferInfo = &bufferInfo;
-		descriptorWrite.dstBinding = 0;
-		descriptorWrite.dstSet = descriptorSets[i];
-		vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+		shaderHotReload->watch("shaders/shader.vert", "shaders/vert.spv");
+		shaderHotReload->watch("shaders/shader.frag", "shaders/frag.spv");
 	}
 }
 
-void Triangle::updateUniformBuffer(uint32_t currentImage)
+void Triangle::createSingleSampleVariant(VkPipeline& variant, VkPipelineLayout& layout, PipelineDescription description)
 {
-	static auto startTime = std::chrono::high_resolution_clock::now();
-	auto currentTime = std::chrono::high_resolution_clock::now();
-	float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+	description.sampleCount = VK_SAMPLE_COUNT_1_BIT;
+	description.renderPass = antiAliasing->getSceneRenderPass();
+	// No other pipeline fits the single-sample pass, its draws are skipped until the workers are done
+	variant = pipelineCache->getPipeline(description);
+	registerReloadablePipeline(variant, layout, description);
+}
+
+void Triangle::createDescriptorSets()
+{
+	frameDescriptorTemplate = TypedUpdateTemplate<FrameDescriptors>(
+		device, layoutCache->getDescriptorUpdateTemplate(descriptorSetLayout));
+
+	const size_t firstImage = descriptorSets.size();
+	descriptorSets.resize(swapchainImages.size());
+	for (size_t i = firstImage; i < swapchainImages.size(); i++)
+	{
+		FrameDescriptors descriptors = {};
+		descriptors.frameUniforms.buffer.buffer = uniformBuffers[i];
+		descriptors.frameUniforms.buffer.offset = 0;
+		descriptors.frameUniforms.buffer.range = sizeof(FrameUniforms);
 
-	UniformBufferObject ubo = {};
-	ubo.model = glm::rotate(glm::mat4(1.f), time * glm::radians(90.f), glm::vec3(0.f, 0.f, 1.f));
-	ubo.view = glm::lookAt(glm::vec3(2.f, 2.f, 2.f), glm::vec3(0.f, 0.f, 0.f), glm::vec3(0.f, 0.f, 1.f));
-	ubo.proj = glm::perspective(glm::radians(45.f), (float)windowWidth / windowHeight, 0.1f, 10.f);
+		// Each swapchain image owns its frame uniforms, so these sets live as long as the images
+		descriptorSets[i] = descriptorAllocator->allocatePersistent(descriptorSetLayout);
+		frameDescriptorTemplate.update(descriptorSets[i], descriptors);
+	}
+}
 
-	ubo.proj[1][1] *= -1;
+void Triangle::createGpuDrivenResources(uint32_t maxObjects)
+{
+	gpuCulling = std::make_unique<GpuCulling>(*this, maxObjects);
 
+	const VkDeviceSize indexBufferSize = sizeof(uint32_t) * indices.size();
+	createBuffer(indexBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, indexBuffer,
+	             indexBufferAllocation);
 	void* data;
-	vmaMapMemory(allocator, uniformBufferAllocation[currentImage], &data);
-	memcpy(data, &ubo, sizeof(ubo));
-	vmaUnmapMemory(allocator, uniformBufferAllocation[currentImage]);
+	vmaMapMemory(allocator, indexBufferAllocation, &data);
+	memcpy(data, indices.data(), indexBufferSize);
+	vmaUnmapMemory(allocator, indexBufferAllocation);
+
+	PipelineDescription description;
+	description.vertShader = createShaderModule("shaders/indirect_vert.spv");
+	description.fragShader = createShaderModule("shaders/frag.spv");
+	ReflectedPipelineLayout layout = layoutCache->getPipelineLayout({
+		&shaderReflections.at(description.vertShader), &shaderReflections.at(description.fragShader)
+	});
+	indirectPipelineLayout = layout.pipelineLayout;
+	indirectSetLayout = layout.setLayouts[0];
+	description.sampleCount = sampleCount;
+	description.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	description.layout = indirectPipelineLayout;
+	description.renderPass = renderPass;
+
+	// The base pipeline reads other inputs, so indirect draws are skipped until this one is compiled
+	indirectPipeline = pipelineCache->getPipeline(description);
+	registerReloadablePipeline(indirectPipeline, indirectPipelineLayout, description);
+	if (antiAliasing)
+	{
+		createSingleSampleVariant(singleSampleIndirectPipeline, indirectPipelineLayout, description);
+	}
+	createIndirectDescriptorSets();
 }
 
+void Triangle::createIndirectDescriptorSets()
+{
+	TypedUpdateTemplate<IndirectDescriptors> updateTemplate(
+		device, layoutCache->getDescriptorUpdateTemplate(indirectSetLayout));
+	const size_t firstImage = indirectDescriptorSets.size();
+	indirectDescriptorSets.resize(swapchainImages.size());
+	for (size_t i = firstImage; i < swapchainImages.size(); i++)
+	{
+		IndirectDescriptors descriptors = {};
+		descriptors.frameUniforms.buffer = {uniformBuffers[i], 0, sizeof(FrameUniforms)};
+		descriptors.objects.buffer = {gpuCulling->getObjectBuffer(static_cast<uint32_t>(i)), 0, VK_WHOLE_SIZE};
+		indirectDescriptorSets[i] = descriptorAllocator->allocatePersistent(indirectSetLayout);
+		updateTemplate.update(indirectDescriptorSets[i], descriptors);
+	}
+}
 
-int main(int argc, char* argv[])
+void Triangle::createInstancedResources(uint32_t instanceCapacity)
 {
-	Triangle app(true);
-	app.init();
-	app.createUniformBuffer(sizeof(UniformBufferObject));
-	app.createDescriptorSets();
-	app.createGraphicsPipeline();
-	app.createCommandBuffers();
+	maxInstances = instanceCapacity;
 
+	PipelineDescription description;
+	description.vertShader = createShaderModule("shaders/instanced_vert.spv");
+	description.fragShader = createShaderModule("shaders/frag.spv");
+	ReflectedPipelineLayout layout = layoutCache->getPipelineLayout({
+		&shaderReflections.at(description.vertShader), &shaderReflections.at(description.fragShader)
+	});
+	instancedPipelineLayout = layout.pipelineLayout;
 
-	while (!glfwWindowShouldClose(app.window))
+	// Every input of the instanced shader is per instance, read from binding 1
+	shaderReflections.at(description.vertShader).getVertexInput(0, 1, 0, description.vertexBindings,
+	                                                             description.vertexAttributes);
+	description.sampleCount = sampleCount;
+	description.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	description.layout = instancedPipelineLayout;
+	description.renderPass = renderPass;
+
+	// Instanced draws are skipped until it is compiled, nothing else reads the per-instance binding
+	instancedPipeline = pipelineCache->getPipeline(description);
+	registerReloadablePipeline(instancedPipeline, instancedPipelineLayout, description);
+	if (antiAliasing)
 	{
-		glfwPollEvents();
-		app.drawFrame();
+		createSingleSampleVariant(singleSampleInstancedPipeline, instancedPipelineLayout, description);
+	}
+
+	createInstanceBuffers();
+}
+
+void Triangle::createInstanceBuffers()
+{
+	const size_t firstImage = instanceBuffers.size();
+	instanceBuffers.resize(swapchainImages.size());
+	instanceBufferAllocations.resize(swapchainImages.size());
+	mappedInstances.resize(swapchainImages.size());
+	for (size_t i = firstImage; i < swapchainImages.size(); i++)
+	{
+		createBuffer(sizeof(InstanceData) * maxInstances, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		             VMA_MEMORY_USAGE_CPU_TO_GPU, instanceBuffers[i], instanceBufferAllocations[i]);
+		void* data;
+		vmaMapMemory(allocator, instanceBufferAllocations[i], &data);
+		mappedInstances[i] = static_cast<InstanceData*>(data);
+	}
+}
+
+void Triangle::createOcclusionResources()
+{
+	occlusionCulling = std::make_unique<OcclusionCulling>(*this, *gpuCulling, gpuCulling->getMaxObjects());
+}
+
+void Triangle::buildRenderGraph()
+{
+	// Same attachments as the base render pass, so the pipelines made for it can draw in the graph's pass
+	renderGraph = std::make_unique<RenderGraph>(*this);
+	const RenderGraphResource swapchainImage = renderGraph->importImage(
+		"swapchain", swapchainImages, swapchainImageViews, surfaceFormat.format, VK_SAMPLE_COUNT_1_BIT,
+		VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+	const RenderGraphResource color = renderGraph->createImage("color", {surfaceFormat.format, sampleCount});
+	const RenderGraphResource depth = renderGraph->createImage("depth", {depthImageFormat, sampleCount});
+
+	const uint32_t scenePass = renderGraph->addGraphicsPass("scene", [this](VkCommandBuffer commandBuffer,
+	                                                                        uint32_t imageIndex)
+	{
+		setMainViewport(commandBuffer);
+		recordSceneDraws(commandBuffer, imageIndex);
+	});
+	renderGraph->writeColor(scenePass, color, VK_ATTACHMENT_LOAD_OP_CLEAR, {0, 0, 0});
+	renderGraph->writeDepth(scenePass, depth, VK_ATTACHMENT_LOAD_OP_CLEAR);
+	renderGraph->resolveColor(scenePass, color, swapchainImage);
+	renderGraph->markOutput(swapchainImage);
+	renderGraph->compile(windowWidth, windowHeight);
+}
+
+void Triangle::destroyRetiredRenderGraphs()
+{
+	while (!retiredRenderGraphs.empty() && frameNumber >= retiredRenderGraphs.front().first + MAX_FRAMES_IN_FLIGHT)
+	{
+		retiredRenderGraphs.pop_front();
+	}
+}
+
+void Triangle::onSwapchainRecreated()
+{
+	if (occlusionCulling)
+	{
+		occlusionCulling->resize();
+	}
+	if (renderGraph)
+	{
+		// Frames in flight may still use the old graph's images and framebuffers
+		retiredRenderGraphs.emplace_back(frameNumber, std::move(renderGraph));
+		buildRenderGraph();
+	}
+	if (dynamicResolution)
+	{
+		dynamicResolution->resize();
+	}
+	if (antiAliasing)
+	{
+		antiAliasing->resize();
+	}
+	if (deferredShading)
+	{
+		deferredShading->resize();
+	}
+}
+
+void Triangle::onSwapchainImagesAdded()
+{
+	// Everything kept per image, in the order it was created in
+	createDescriptorSets();
+	if (gpuCulling)
+	{
+		gpuCulling->addSwapchainImages();
+		createIndirectDescriptorSets();
+	}
+	if (occlusionCulling)
+	{
+		occlusionCulling->addSwapchainImages();
+	}
+	if (!instanceBuffers.empty())
+	{
+		createInstanceBuffers();
+	}
+	if (antiAliasing)
+	{
+		antiAliasing->addSwapchainImages();
+	}
+	if (dynamicResolution)
+	{
+		dynamicResolution->addSwapchainImages();
+	}
+	if (clusteredLighting)
+	{
+		clusteredLighting->addSwapchainImages();
+	}
+	if (deferredShading)
+	{
+		deferredShading->addSwapchainImages();
+	}
+	if (cascadedShadows)
+	{
+		cascadedShadows->addSwapchainImages();
+	}
+}
+
+void Triangle::onDescriptorSetLayoutChanged(VkDescriptorSetLayout oldLayout, VkDescriptorSetLayout newLayout)
+{
+	// The old sets stay with the persistent pools, the new ones are written the same way. The templates throw
+	// before anything changes if the descriptor structs no longer match the reloaded bindings.
+	if (oldLayout == descriptorSetLayout)
+	{
+		TypedUpdateTemplate<FrameDescriptors>(device, layoutCache->getDescriptorUpdateTemplate(newLayout));
+		descriptorSetLayout = newLayout;
+		descriptorSets.clear();
+		createDescriptorSets();
+	}
+	if (gpuCulling && oldLayout == indirectSetLayout)
+	{
+		TypedUpdateTemplate<IndirectDescriptors>(device, layoutCache->getDescriptorUpdateTemplate(newLayout));
+		indirectSetLayout = newLayout;
+		indirectDescriptorSets.clear();
+		createIndirectDescriptorSets();
+	}
+}
+
+void Triangle::updateTransforms(float time)
+{
+	drawData.resize(objectCount);
+
+	// Lay the objects out on grids spanning -gridExtent..gridExtent, 1 fits the view
+	const uint32_t layerCount = (objectCount + gridLayers - 1) / gridLayers;
+	const uint32_t gridSize = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(layerCount))));
+	const float spacing = 2.f * gridExtent / gridSize;
+	const glm::mat4 rotation = glm::rotate(glm::mat4(1.f), time * glm::radians(90.f), glm::vec3(0.f, 0.f, 1.f));
+	const glm::mat4 scale = glm::scale(glm::mat4(1.f), glm::vec3(objectScale / gridSize));
+	staticCasters.clear();
+	dynamicCasters.clear();
+	for (uint32_t i = 0; i < objectCount; i++)
+	{
+		const uint32_t cell = i % layerCount;
+		const uint32_t layer = i / layerCount;
+		glm::vec3 position((cell % gridSize + 0.5f) * spacing - gridExtent,
+		                   (cell / gridSize + 0.5f) * spacing - gridExtent, -0.2f * gridExtent * layer);
+		const bool spins = i % dynamicObjectInterval == 0;
+		drawData[i].model = glm::translate(glm::mat4(1.f), position) * (spins ? rotation : glm::mat4(1.f)) * scale;
+		if (cascadedShadows)
+		{
+			(spins ? dynamicCasters : staticCasters).push_back(i);
+		}
+	}
+}
+
+void Triangle::cullSoftwareOccluded()
+{
+	if (occluderPositions.empty())
+	{
+		for (const Vertex& vertex : vertices)
+		{
+			occluderPositions.emplace_back(vertex.pos, 0.f);
+		}
+	}
+
+	const uint32_t layerCount = (objectCount + gridLayers - 1) / gridLayers;
+	softwareOcclusion->beginFrame(viewProj);
+	for (uint32_t i = 0; i < layerCount; i++)
+	{
+		softwareOcclusion->addOccluder(occluderPositions, indices, drawData[i].model);
+	}
+	softwareOcclusion->rasterize();
+
+	occludeeBounds.resize(objectCount);
+	for (uint32_t i = 0; i < objectCount; i++)
+	{
+		const glm::mat4& model = drawData[i].model;
+		const float radius = triangleBoundingRadius * glm::length(glm::vec3(model[0]));
+		occludeeBounds[i].min = glm::vec3(model[3]) - radius;
+		occludeeBounds[i].max = glm::vec3(model[3]) + radius;
+	}
+	softwareOcclusion->cullOccluded(occludeeBounds, visibleObjects);
+
+	if (dumpOcclusionDepth)
+	{
+		softwareOcclusion->writeDepthImage("software_occlusion_depth.pgm");
+		dumpOcclusionDepth = false;
+	}
+}
+
+void Triangle::uploadObjects(uint32_t imageIndex)
+{
+	GpuObject* objects = gpuCulling->getObjects(imageIndex);
+	for (uint32_t i = 0; i < objectCount; i++)
+	{
+		const glm::mat4& model = drawData[i].model;
+		objects[i].model = model;
+		objects[i].boundingSphere = glm::vec4(glm::vec3(model[3]),
+		                                      triangleBoundingRadius * glm::length(glm::vec3(model[0])));
+		objects[i].indexCount = static_cast<uint32_t>(indices.size());
+		objects[i].firstIndex = 0;
+		objects[i].vertexOffset = 0;
+	}
+}
+
+void Triangle::uploadInstances(uint32_t imageIndex)
+{
+	drawList.clear();
+	if (cpuCulling)
+	{
+		for (uint32_t index : visibleObjects)
+		{
+			drawList.add(0, index % materialCount, drawData[index].model);
+		}
+	}
+	else
+	{
+		for (uint32_t i = 0; i < objectCount; i++)
+		{
+			drawList.add(0, i % materialCount, drawData[i].model);
+		}
+	}
+	drawList.build();
+
+	const std::vector<InstanceData>& instances = drawList.getInstances();
+	if (instances.size() > maxInstances)
+	{
+		throw std::runtime_error("too many instances for the instance buffer!");
+	}
+	memcpy(mappedInstances[imageIndex], instances.data(), sizeof(InstanceData) * instances.size());
+	vmaFlushAllocation(allocator, instanceBufferAllocations[imageIndex], 0, sizeof(InstanceData) * instances.size());
+}
+
+void Triangle::buildSortedDraws(uint32_t imageIndex)
+{
+	// The pipeline changes on hot reload, so everything is registered again every frame
+	sortedDrawList.clear();
+	const VkPipeline basePipeline = drawsSingleSample() ? singleSamplePipeline : pipeline;
+	if (basePipeline == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	const uint32_t drawPipeline = sortedDrawList.addPipeline(basePipeline, pipelineLayout);
+	const uint32_t material = sortedDrawList.addMaterial(descriptorSets[imageIndex]);
+	const uint32_t mesh = sortedDrawList.addMesh(VK_NULL_HANDLE, 3);
+	auto addObject = [&](uint32_t index)
+	{
+		const glm::mat4& model = drawData[index].model;
+		const glm::vec4 clip = viewProj * model[3];
+		sortedDrawList.add(0, drawPipeline, material, mesh, clip.w > 0.f ? clip.z / clip.w : 0.f, model);
+	};
+	if (cpuCulling)
+	{
+		for (uint32_t index : visibleObjects)
+		{
+			addObject(index);
+		}
+	}
+	else
+	{
+		for (uint32_t i = 0; i < objectCount; i++)
+		{
+			addObject(i);
+		}
+	}
+	sortedDrawList.sort();
+}
+
+void Triangle::placeLights(uint32_t count)
+{
+	// Spread over the grid and the layers below it, fewer lights are larger so coverage stays similar
+	std::mt19937 random(11);
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+	const float depth = 0.2f * gridExtent * gridLayers;
+	const float radius = 0.3f * gridExtent * std::sqrt(1000.f / std::max(count, 1u));
+	std::vector<PointLight>& lights = clusteredLighting->lights;
+	lights.resize(count);
+	for (PointLight& light : lights)
+	{
+		light.position = glm::vec3((unit(random) * 2.f - 1.f) * gridExtent, (unit(random) * 2.f - 1.f) * gridExtent,
+		                           0.1f * gridExtent - unit(random) * depth);
+		light.radius = radius;
+		light.color = glm::vec3(unit(random), unit(random), unit(random));
+		light.padding = 0.f;
+	}
+}
+
+void Triangle::updateUniformBuffer(uint32_t currentImage)
+{
+	static auto startTime = std::chrono::high_resolution_clock::now();
+	auto currentTime = std::chrono::high_resolution_clock::now();
+	float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+
+	destroyRetiredRenderGraphs();
+	updateTransforms(time);
+	if (dynamicResolution)
+	{
+		// This image's previous frame has finished, so its GPU time is final
+		dynamicResolution->update(currentImage);
+	}
+
+	FrameUniforms frame = {};
+	frame.view = glm::lookAt(glm::vec3(2.f, 2.f, 2.f), glm::vec3(0.f, 0.f, 0.f), glm::vec3(0.f, 0.f, 1.f));
+	frame.proj = glm::perspective(glm::radians(45.f), (float)windowWidth / windowHeight, 0.1f, 10.f);
+
+	frame.proj[1][1] *= -1;
+	viewProj = frame.proj * frame.view;
+	if (clusteredLighting)
+	{
+		clusteredLighting->update(currentImage, frame.view, frame.proj);
+	}
+	if (deferredShading)
+	{
+		deferredShading->setCamera(frame.view, frame.proj);
+	}
+	if (cascadedShadows)
+	{
+		const float sunAngle = glm::radians(time * sunDegreesPerSecond);
+		const glm::vec3 sunDirection = glm::normalize(glm::vec3(std::cos(sunAngle), std::sin(sunAngle), -2.f));
+		// Around the grids and the deepest layer, with room for the largest triangle
+		const float depth = 0.2f * gridExtent * (gridLayers - 1);
+		const float sceneRadius = glm::length(glm::vec3(gridExtent, gridExtent, 0.5f * depth)) +
+			objectScale * triangleBoundingRadius;
+		cascadedShadows->update(currentImage, frame.view, frame.proj, sunDirection,
+		                        glm::vec4(0.f, 0.f, -0.5f * depth, sceneRadius));
+	}
+	if (antiAliasing)
+	{
+		// Culling and reprojection use the unjittered matrices, only the scene is drawn jittered
+		antiAliasing->update(currentImage, viewProj);
+		if (drawsSingleSample())
+		{
+			// Any other path would draw the frame jittered without a resolve to take it out
+			antiAliasing->jitterProjection(frame.proj);
+		}
+	}
+
+	if (occlusion)
+	{
+		occlusionStats = occlusionCulling->readStats(currentImage);
+		visibleCount = occlusionStats.drawn;
+		uploadObjects(currentImage);
+	}
+	else if (gpuDriven)
+	{
+		// This image's previous frame has finished, so its count is final
+		visibleCount = gpuCulling->readVisibleCount(currentImage);
+		uploadObjects(currentImage);
+	}
+	else if (cpuCulling)
+	{
+		objectBounds.resize(objectCount);
+		for (uint32_t i = 0; i < objectCount; i++)
+		{
+			const glm::mat4& model = drawData[i].model;
+			objectBounds.setSphere(i, glm::vec3(model[3]), triangleBoundingRadius * glm::length(glm::vec3(model[0])));
+		}
+		frustumCuller.cull(objectBounds, BoundingVolume::Sphere, viewProj, visibleObjects);
+		if (softwareOcclusion)
+		{
+			cullSoftwareOccluded();
+		}
+		visibleCount = static_cast<uint32_t>(visibleObjects.size());
+	}
+	if (instanced)
+	{
+		uploadInstances(currentImage);
+	}
+	else if (sortedDraws)
+	{
+		buildSortedDraws(currentImage);
+	}
+
+	void* data;
+	vmaMapMemory(allocator, uniformBufferAllocation[currentImage], &data);
+	memcpy(data, &frame, sizeof(frame));
+	vmaUnmapMemory(allocator, uniformBufferAllocation[currentImage]);
+}
+
+void Triangle::benchmarkDraws()
+{
+	VkCommandBufferAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocateInfo.commandPool = commandPool;
+	allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocateInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	vkAllocateCommandBuffers(device, &allocateInfo, &commandBuffer);
+
+	for (uint32_t count : {1u, 1000u, 100000u})
+	{
+		objectCount = count;
+		const uint32_t iterations = std::max(10u, 1000000u / count);
+
+		auto startTime = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			updateTransforms(static_cast<float>(i));
+		}
+		auto updateTime = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			recordDraws(commandBuffer, 0);
+		}
+		auto recordTime = std::chrono::high_resolution_clock::now();
+
+		const double drawCount = static_cast<double>(count) * iterations;
+		std::cout << count << " objects: " <<
+			std::chrono::duration<double, std::nano>(updateTime - startTime).count() / drawCount <<
+			" ns/draw transform update, " <<
+			std::chrono::duration<double, std::nano>(recordTime - updateTime).count() / drawCount <<
+			" ns/draw recording" << std::endl;
+	}
+
+	vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+}
+
+void Triangle::benchmarkDescriptorUpdates()
+{
+	const uint32_t setCount = 1000;
+	const uint32_t iterations = 100;
+
+	std::vector<VkDescriptorSet> sets(setCount);
+	for (auto& set : sets)
+	{
+		set = descriptorAllocator->allocatePersistent(descriptorSetLayout);
+	}
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < iterations; i++)
+	{
+		for (uint32_t j = 0; j < setCount; j++)
+		{
+			// Built on the stack, so the baseline times vkUpdateDescriptorSets and not a heap allocation
+			VkDescriptorBufferInfo bufferInfo = {};
+			bufferInfo.buffer = uniformBuffers[j % uniformBuffers.size()];
+			bufferInfo.range = sizeof(FrameUniforms);
+
+			VkWriteDescriptorSet descriptorWrite = {};
+			descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrite.dstSet = sets[j];
+			descriptorWrite.dstBinding = 0;
+			descriptorWrite.descriptorCount = 1;
+			descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			descriptorWrite.pBufferInfo = &bufferInfo;
+			vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+		}
+	}
+	auto writeTime = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < iterations; i++)
+	{
+		for (uint32_t j = 0; j < setCount; j++)
+		{
+			FrameDescriptors descriptors = {};
+			descriptors.frameUniforms.buffer.buffer = uniformBuffers[j % uniformBuffers.size()];
+			descriptors.frameUniforms.buffer.range = sizeof(FrameUniforms);
+			frameDescriptorTemplate.update(sets[j], descriptors);
+		}
+	}
+	auto templateTime = std::chrono::high_resolution_clock::now();
+
+	const double updateCount = static_cast<double>(setCount) * iterations;
+	std::cout << "vkUpdateDescriptorSets: " <<
+		std::chrono::duration<double, std::nano>(writeTime - startTime).count() / updateCount << " ns/set" <<
+		std::endl;
+	std::cout << "Update template: " <<
+		std::chrono::duration<double, std::nano>(templateTime - writeTime).count() / updateCount << " ns/set" <<
+		std::endl;
+
+	// What a frame of the passes currently enabled costs the allocator, the sets above included in the pools
+	for (uint32_t frame = 0; frame < 60; frame++)
+	{
+		glfwPollEvents();
+		drawFrame();
+	}
+	const DescriptorAllocatorStats stats = descriptorAllocator->getStats();
+	std::cout << "Per frame: " << stats.allocationsLastFrame << " sets allocated, " << stats.cacheHitsLastFrame <<
+		" cache hits, " << stats.poolCount << " pools" << std::endl;
+}
+
+void Triangle::benchmarkIndirect()
+{
+	VkCommandBufferAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocateInfo.commandPool = commandPool;
+	allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocateInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	vkAllocateCommandBuffers(device, &allocateInfo, &commandBuffer);
+
+	VkFenceCreateInfo fenceCreateInfo = {};
+	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	VkFence fence;
+	vkCreateFence(device, &fenceCreateInfo, nullptr, &fence);
+
+	// Spread the grid past the view so part of it gets culled
+	gridExtent = 4.f;
+	for (uint32_t count : {1000u, 10000u, 100000u})
+	{
+		objectCount = count;
+		gpuDriven = true;
+		updateUniformBuffer(0);
+
+		const uint32_t iterations = 100;
+		double recordTimes[2];
+		for (int mode = 0; mode < 2; mode++)
+		{
+			gpuDriven = mode == 1;
+			auto startTime = std::chrono::high_resolution_clock::now();
+			for (uint32_t i = 0; i < iterations; i++)
+			{
+				recordDraws(commandBuffer, 0);
+			}
+			auto endTime = std::chrono::high_resolution_clock::now();
+			recordTimes[mode] = std::chrono::duration<double, std::micro>(endTime - startTime).count() / iterations;
+		}
+
+		// Run only the culling pass and check it against the same test on the CPU
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+		gpuCulling->recordCulling(commandBuffer, 0, viewProj, objectCount);
+		vkEndCommandBuffer(commandBuffer);
+
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		vkQueueSubmit(graphicsQueue, 1, &submitInfo, fence);
+		vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+		vkResetFences(device, 1, &fence);
+
+		glm::vec4 planes[6];
+		extractFrustumPlanes(viewProj, planes);
+		uint32_t cpuVisibleCount = 0;
+		for (uint32_t i = 0; i < objectCount; i++)
+		{
+			cpuVisibleCount += isSphereVisible(planes, gpuCulling->getObjects(0)[i].boundingSphere) ? 1 : 0;
+		}
+
+		std::cout << count << " objects: direct recording " << recordTimes[0] << " us, indirect recording " <<
+			recordTimes[1] << " us, visible " << gpuCulling->readVisibleCount(0) << " on gpu / " <<
+			cpuVisibleCount << " on cpu" << std::endl;
+	}
+
+	vkDestroyFence(device, fence, nullptr);
+	vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+}
+
+void Triangle::benchmarkInstancing()
+{
+	VkCommandBufferAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocateInfo.commandPool = commandPool;
+	allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocateInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	vkAllocateCommandBuffers(device, &allocateInfo, &commandBuffer);
+
+	objectCount = std::min(10000u, maxInstances);
+	instanced = false;
+	updateUniformBuffer(0);
+
+	const uint32_t iterations = 100;
+	auto startTime = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < iterations; i++)
+	{
+		recordDraws(commandBuffer, 0);
+	}
+	auto individualTime = std::chrono::high_resolution_clock::now();
+
+	instanced = true;
+	for (uint32_t i = 0; i < iterations; i++)
+	{
+		uploadInstances(0);
+		recordDraws(commandBuffer, 0);
+	}
+	auto instancedTime = std::chrono::high_resolution_clock::now();
+
+	std::cout << objectCount << " objects: individual draws " <<
+		std::chrono::duration<double, std::micro>(individualTime - startTime).count() / iterations << " us/frame, " <<
+		objectCount << " draw calls" << std::endl;
+	std::cout << objectCount << " objects: instanced " <<
+		std::chrono::duration<double, std::micro>(instancedTime - individualTime).count() / iterations <<
+		" us/frame including merge and upload, " << drawList.getDraws().size() << " draw calls" << std::endl;
+
+	vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+}
+
+void Triangle::benchmarkOcclusion()
+{
+	// Stacked, overlapping grids so most of each lower layer is hidden by the ones above
+	objectCount = std::min(100000u, gpuCulling->getMaxObjects());
+	gridExtent = 1.f;
+	gridLayers = 8;
+	objectScale = 3.f;
+	occlusion = true;
+
+	const uint32_t warmupFrames = 30;
+	const uint32_t measuredFrames = 300;
+	double frameMilliseconds[2];
+	double passMilliseconds[2];
+	for (int mode = 0; mode < 2; mode++)
+	{
+		occlusionCulling->occlusionEnabled = mode == 1;
+		OcclusionStats total;
+		for (uint32_t frame = 0; frame < warmupFrames + measuredFrames; frame++)
+		{
+			glfwPollEvents();
+			drawFrame();
+			// Stats are read back for the image being recorded, so they lag a few frames behind
+			if (frame >= warmupFrames)
+			{
+				total.frustumCulled += occlusionStats.frustumCulled;
+				total.occluded += occlusionStats.occluded;
+				total.recovered += occlusionStats.recovered;
+				total.drawn += occlusionStats.drawn;
+				total.frameMilliseconds += occlusionStats.frameMilliseconds;
+				total.firstPassMilliseconds += occlusionStats.firstPassMilliseconds;
+				total.pyramidMilliseconds += occlusionStats.pyramidMilliseconds;
+				total.secondPassMilliseconds += occlusionStats.secondPassMilliseconds;
+			}
+		}
+
+		frameMilliseconds[mode] = total.frameMilliseconds / measuredFrames;
+		passMilliseconds[mode] = (total.firstPassMilliseconds + total.secondPassMilliseconds) / measuredFrames;
+		std::cout << "Occlusion culling " << (mode == 1 ? "on" : "off") << ", " << objectCount << " objects: " <<
+			total.drawn / measuredFrames << " drawn, " << total.frustumCulled / measuredFrames << " frustum culled, " <<
+			total.occluded / measuredFrames << " occluded, " << total.recovered / measuredFrames <<
+			" recovered by the second phase" << std::endl;
+		std::cout << "  GPU frame " << frameMilliseconds[mode] << " ms, passes " << passMilliseconds[mode] <<
+			" ms, pyramid and second cull " << total.pyramidMilliseconds / measuredFrames << " ms" << std::endl;
+	}
+	std::cout << "GPU time saved " << frameMilliseconds[0] - frameMilliseconds[1] << " ms/frame, " <<
+		passMilliseconds[0] - passMilliseconds[1] << " ms/frame in the render passes" << std::endl;
+}
+
+void Triangle::benchmarkRenderGraph()
+{
+	// A deferred frame with bloom, declared in one order with a debug view nothing reads
+	auto buildFrame = [this](RenderGraph& graph)
+	{
+		const RenderGraphResource backbuffer = graph.importImage(
+			"swapchain", swapchainImages, swapchainImageViews, surfaceFormat.format, VK_SAMPLE_COUNT_1_BIT,
+			VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+		const RenderGraphResource albedo = graph.createImage("albedo", {VK_FORMAT_R8G8B8A8_UNORM});
+		const RenderGraphResource normal = graph.createImage("normal", {VK_FORMAT_R16G16B16A16_SFLOAT});
+		const RenderGraphResource depth = graph.createImage("depth", {depthImageFormat});
+		const RenderGraphResource hdr = graph.createImage("hdr", {VK_FORMAT_R16G16B16A16_SFLOAT});
+		const RenderGraphResource bloom = graph.createImage("bloom", {VK_FORMAT_R16G16B16A16_SFLOAT,
+		                                                              VK_SAMPLE_COUNT_1_BIT, 0.5f});
+		const RenderGraphResource bloomBlur = graph.createImage("bloomBlur", {VK_FORMAT_R16G16B16A16_SFLOAT,
+		                                                                      VK_SAMPLE_COUNT_1_BIT, 0.5f});
+		const RenderGraphResource debugView = graph.createImage("debugView", {VK_FORMAT_R8G8B8A8_UNORM});
+
+		const uint32_t gbuffer = graph.addGraphicsPass("gbuffer", nullptr);
+		graph.writeColor(gbuffer, albedo, VK_ATTACHMENT_LOAD_OP_CLEAR);
+		graph.writeColor(gbuffer, normal, VK_ATTACHMENT_LOAD_OP_CLEAR);
+		graph.writeDepth(gbuffer, depth, VK_ATTACHMENT_LOAD_OP_CLEAR);
+		const uint32_t debug = graph.addGraphicsPass("debug", nullptr);
+		graph.readSampled(debug, normal);
+		graph.writeColor(debug, debugView, VK_ATTACHMENT_LOAD_OP_DONT_CARE);
+		const uint32_t lighting = graph.addComputePass("lighting", nullptr);
+		graph.readSampled(lighting, albedo);
+		graph.readSampled(lighting, normal);
+		graph.readSampled(lighting, depth);
+		graph.writeStorage(lighting, hdr);
+		const uint32_t bloomDownsample = graph.addGraphicsPass("bloomDownsample", nullptr);
+		graph.readSampled(bloomDownsample, hdr);
+		graph.writeColor(bloomDownsample, bloom, VK_ATTACHMENT_LOAD_OP_DONT_CARE);
+		const uint32_t blur = graph.addGraphicsPass("bloomBlur", nullptr);
+		graph.readSampled(blur, bloom);
+		graph.writeColor(blur, bloomBlur, VK_ATTACHMENT_LOAD_OP_DONT_CARE);
+		const uint32_t tonemap = graph.addGraphicsPass("tonemap", nullptr);
+		graph.readSampled(tonemap, hdr);
+		graph.readSampled(tonemap, bloomBlur);
+		graph.writeColor(tonemap, backbuffer, VK_ATTACHMENT_LOAD_OP_DONT_CARE);
+		graph.markOutput(backbuffer);
+	};
+
+	auto printStats = [](const char* name, const RenderGraphStats& stats)
+	{
+		std::cout << name << ": " << stats.declaredPasses - stats.culledPasses << " of " << stats.declaredPasses <<
+			" passes, " << stats.imageBarriers << " image barriers in " << stats.pipelineBarriers <<
+			" pipeline barriers per frame, compiled in " << stats.compileMilliseconds << " ms" << std::endl;
+		std::cout << "  " << stats.transientImages << " transient images, " << stats.transientBytes / (1024 * 1024) <<
+			" MB unaliased, " << stats.allocatedBytes / (1024 * 1024) << " MB in " << stats.memoryBlocks <<
+			" blocks, " << (stats.transientBytes - stats.allocatedBytes) / (1024 * 1024) << " MB saved" << std::endl;
+	};
+
+	printStats("Main pass", renderGraph ? renderGraph->getStats() : RenderGraphStats());
+	for (int aliasing = 0; aliasing < 2; aliasing++)
+	{
+		RenderGraph graph(*this);
+		graph.aliasingEnabled = aliasing == 1;
+		buildFrame(graph);
+		graph.compile(windowWidth, windowHeight);
+		printStats(aliasing == 1 ? "Deferred frame, aliased" : "Deferred frame, not aliased", graph.getStats());
+	}
+}
+
+void Triangle::benchmarkAttachmentMemory()
+{
+	// Lazily allocated memory is only backed once a pass needs it, so measure after some frames
+	for (uint32_t frame = 0; frame < 60; frame++)
+	{
+		glfwPollEvents();
+		drawFrame();
+	}
+
+	auto printAttachment = [](const char* name, const AttachmentMemory& memory)
+	{
+		std::cout << name << " (format " << memory.format << "): " << memory.allocatedBytes / 1024 <<
+			" KB allocated, " << memory.committedBytes / 1024 << " KB committed, " <<
+			(memory.lazilyAllocated ? "lazily allocated" : "device local") << std::endl;
+	};
+	const AttachmentMemory color = getAttachmentMemory(colorImageAllocation, surfaceFormat.format);
+	const AttachmentMemory depth = getAttachmentMemory(depthImageAllocation, depthImageFormat);
+	std::cout << windowWidth << "x" << windowHeight << ", " << sampleCount << "x MSAA" << std::endl;
+	printAttachment("Color", color);
+	printAttachment("Depth", depth);
+	std::cout << "Total " << (color.committedBytes + depth.committedBytes) / 1024 << " KB committed of " <<
+		(color.allocatedBytes + depth.allocatedBytes) / 1024 << " KB allocated" << std::endl;
+}
+
+void Triangle::benchmarkDynamicResolution()
+{
+	// Large, overlapping objects so the frame is bound by fragment work, which is what the scale cuts
+	objectCount = 20000;
+	objectScale = 4.f;
+	gridLayers = 8;
+
+	auto runFrames = [this](uint32_t frameCount, bool print)
+	{
+		double gpuMilliseconds = 0.0;
+		for (uint32_t frame = 0; frame < frameCount; frame++)
+		{
+			glfwPollEvents();
+			drawFrame();
+			const DynamicResolutionStats stats = dynamicResolution->getStats();
+			gpuMilliseconds += stats.gpuMilliseconds;
+			if (print && frame % 30 == 0)
+			{
+				std::cout << "  frame " << frame << ": scale " << stats.scale << " (" << stats.renderWidth << "x" <<
+					stats.renderHeight << "), GPU " << stats.gpuMilliseconds << " ms, predicted " <<
+					stats.predictedMilliseconds << " ms" << std::endl;
+			}
+		}
+		return gpuMilliseconds / frameCount;
+	};
+
+	// Full resolution first, the upscale pass included, then a target the scene cannot meet at that size
+	dynamicResolution->scalingEnabled = false;
+	runFrames(30, false);
+	const double fullMilliseconds = runFrames(120, false);
+	std::cout << windowWidth << "x" << windowHeight << ", " << sampleCount << "x MSAA, full resolution: " <<
+		fullMilliseconds << " ms GPU" << std::endl;
+	if (fullMilliseconds == 0.0)
+	{
+		std::cout << "No timestamp support, the scale cannot follow the GPU time" << std::endl;
+		return;
+	}
+
+	dynamicResolution->scalingEnabled = true;
+	dynamicResolution->targetMilliseconds = static_cast<float>(fullMilliseconds * 0.6);
+	std::cout << "Target " << dynamicResolution->targetMilliseconds << " ms:" << std::endl;
+	runFrames(300, true);
+	const double scaledMilliseconds = runFrames(120, false);
+	const DynamicResolutionStats stats = dynamicResolution->getStats();
+	std::cout << "Settled at scale " << stats.scale << ", " << scaledMilliseconds << " ms GPU, " << stats.adjustments <<
+		" adjustments, " << stats.saturatedFrames << " frames held at a limit" << std::endl;
+}
+
+void Triangle::benchmarkAntiAliasing()
+{
+	if (dynamicResolution)
+	{
+		// It would take the main pass over
+		vkDeviceWaitIdle(device);
+		dynamicResolution.reset();
+	}
+	// Many small objects, so there are edges everywhere for the resolve to work on
+	objectCount = 20000;
+	gridLayers = 8;
+
+	std::cout << windowWidth << "x" << windowHeight << ", MSAA at " << sampleCount << "x" << std::endl;
+	for (AntiAliasingMode mode : {AntiAliasingMode::Msaa, AntiAliasingMode::Fxaa, AntiAliasingMode::Taa})
+	{
+		antiAliasing->mode = mode;
+		for (uint32_t frame = 0; frame < 30; frame++)
+		{
+			glfwPollEvents();
+			drawFrame();
+		}
+		const uint32_t frameCount = 300;
+		double gpuMilliseconds = 0.0;
+		for (uint32_t frame = 0; frame < frameCount; frame++)
+		{
+			glfwPollEvents();
+			drawFrame();
+			gpuMilliseconds += antiAliasing->getStats().gpuMilliseconds;
+		}
+		const AntiAliasingMemory memory = antiAliasing->getAttachmentMemory(mode);
+		std::cout << getAntiAliasingModeName(mode) << ": " << gpuMilliseconds / frameCount << " ms GPU, " <<
+			memory.allocatedBytes / (1024 * 1024) << " MB allocated, " << memory.committedBytes / (1024 * 1024) <<
+			" MB committed" << std::endl;
+	}
+}
+
+void Triangle::benchmarkMipGeneration()
+{
+	const uint32_t size = 4096;
+	const uint32_t levelCount = 13;
+	VkImage image;
+	VmaAllocation imageAllocation;
+	createImage(size, size, levelCount, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
+	            VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+	            VK_IMAGE_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY, image, imageAllocation);
+
+	VkBuffer stagingBuffer;
+	VmaAllocation stagingAllocation;
+	const VkDeviceSize imageSize = static_cast<VkDeviceSize>(size) * size * 4;
+	createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, stagingBuffer,
+	             stagingAllocation);
+	void* data;
+	vmaMapMemory(allocator, stagingAllocation, &data);
+	std::mt19937 random(7);
+	uint32_t* texels = static_cast<uint32_t*>(data);
+	for (VkDeviceSize i = 0; i < imageSize / 4; i++)
+	{
+		texels[i] = random();
+	}
+	vmaUnmapMemory(allocator, stagingAllocation);
+
+	const bool separateComputeFamily = queueFamilyIndex.computeFamily != queueFamilyIndex.graphicsFamily;
+	std::cout << size << "x" << size << " RGBA8, " << levelCount << " levels, " <<
+		(separateComputeFamily ? "separate compute queue family" : "no separate compute queue family") << std::endl;
+
+	MipGenerator generator(*this, MipReduction::Average);
+	auto run = [&](const char* name, bool blits, bool asyncCompute)
+	{
+		generator.useBlits = blits;
+		generator.useAsyncCompute = asyncCompute;
+		const uint32_t runs = 20;
+		double gpuMilliseconds = 0.0;
+		double cpuMilliseconds = 0.0;
+		double wallMilliseconds = 0.0;
+		for (uint32_t i = 0; i < runs + 1; i++)
+		{
+			// Every run writes the same image, so each one is waited for before the next
+			const auto start = std::chrono::high_resolution_clock::now();
+			generator.upload(image, stagingBuffer, size, size, levelCount);
+			generator.waitForUploads();
+			const auto end = std::chrono::high_resolution_clock::now();
+			// The first one pays for pipeline and pool warm-up
+			if (i > 0)
+			{
+				gpuMilliseconds += generator.getStats().gpuMilliseconds;
+				cpuMilliseconds += generator.getStats().cpuMilliseconds;
+				wallMilliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+			}
+		}
+		std::cout << name << ": " << gpuMilliseconds / runs << " ms GPU for the levels, " << cpuMilliseconds / runs <<
+			" ms to submit, " << wallMilliseconds / runs << " ms for the whole upload" <<
+			(generator.getStats().asyncCompute ? " on the compute queue" : "") << std::endl;
+	};
+	run("Blit per level", true, false);
+	run("Single pass compute", false, false);
+	if (separateComputeFamily)
+	{
+		run("Single pass async compute", false, true);
+	}
+
+	vmaDestroyBuffer(allocator, stagingBuffer, stagingAllocation);
+	vmaDestroyImage(allocator, image, imageAllocation);
+}
+
+void Triangle::benchmarkClusteredLighting()
+{
+	// Overlapping objects over the whole view, so every pixel is shaded a few times
+	objectCount = 10000;
+	objectScale = 2.f;
+
+	std::cout << windowWidth << "x" << windowHeight << ", " << sampleCount << "x MSAA, " << objectCount <<
+		" objects" << std::endl;
+	for (uint32_t lightCount : {0u, 1000u, 10000u})
+	{
+		placeLights(lightCount);
+		for (bool gpu : {false, true})
+		{
+			clusteredLighting->gpuBinning = gpu;
+			for (uint32_t frame = 0; frame < 30; frame++)
+			{
+				glfwPollEvents();
+				drawFrame();
+			}
+			const uint32_t frameCount = 300;
+			double cpuBinningMilliseconds = 0.0;
+			double binningGpuMilliseconds = 0.0;
+			double shadingGpuMilliseconds = 0.0;
+			for (uint32_t frame = 0; frame < frameCount; frame++)
+			{
+				glfwPollEvents();
+				drawFrame();
+				const ClusteredLightingStats stats = clusteredLighting->getStats();
+				cpuBinningMilliseconds += stats.cpuBinningMilliseconds;
+				binningGpuMilliseconds += stats.binningGpuMilliseconds;
+				shadingGpuMilliseconds += stats.shadingGpuMilliseconds;
+			}
+			const ClusteredLightingStats stats = clusteredLighting->getStats();
+			std::cout << lightCount << " lights, " << (gpu ? "GPU" : "CPU") << " binning: " <<
+				cpuBinningMilliseconds / frameCount << " ms CPU binning, " << binningGpuMilliseconds / frameCount <<
+				" ms GPU binning or upload, " << shadingGpuMilliseconds / frameCount << " ms GPU shading";
+			if (!gpu)
+			{
+				std::cout << ", " << stats.averageLightsPerCluster << " lights per cluster, " << stats.droppedCount <<
+					" dropped";
+			}
+			std::cout << std::endl;
+		}
+	}
+}
+
+void Triangle::benchmarkDeferredShading()
+{
+	// Same scene as the clustered lighting benchmark, so every pixel is covered a few times
+	objectCount = 10000;
+	objectScale = 2.f;
+	clusteredLighting->gpuBinning = true;
+
+	std::cout << windowWidth << "x" << windowHeight << ", " << objectCount << " objects" << std::endl;
+	const AttachmentMemory color = getAttachmentMemory(colorImageAllocation, surfaceFormat.format);
+	const AttachmentMemory depth = getAttachmentMemory(depthImageAllocation, depthImageFormat);
+	std::cout << "Forward, " << sampleCount << "x MSAA: attachments " <<
+		(color.allocatedBytes + depth.allocatedBytes) / (1024 * 1024) << " MB allocated, " <<
+		(color.committedBytes + depth.committedBytes) / (1024 * 1024) << " MB committed" << std::endl;
+	for (uint32_t lightCount : {1000u, 10000u})
+	{
+		placeLights(lightCount);
+		for (bool deferredPath : {false, true})
+		{
+			deferred = deferredPath;
+			for (uint32_t frame = 0; frame < 30; frame++)
+			{
+				glfwPollEvents();
+				drawFrame();
+			}
+			const uint32_t frameCount = 300;
+			double shadingGpuMilliseconds = 0.0;
+			const auto start = std::chrono::high_resolution_clock::now();
+			for (uint32_t frame = 0; frame < frameCount; frame++)
+			{
+				glfwPollEvents();
+				drawFrame();
+				shadingGpuMilliseconds += clusteredLighting->getStats().shadingGpuMilliseconds;
+			}
+			vkDeviceWaitIdle(device);
+			const auto end = std::chrono::high_resolution_clock::now();
+			const double frameMilliseconds =
+				std::chrono::duration<double, std::milli>(end - start).count() / frameCount;
+			std::cout << lightCount << " lights, " << (deferredPath ? "deferred" : "forward") << ": " <<
+				frameMilliseconds << " ms per frame, " << shadingGpuMilliseconds / frameCount << " ms GPU shading";
+			if (deferredPath)
+			{
+				const DeferredShadingStats stats = deferredShading->getStats();
+				std::cout << ", G-buffer " << stats.gBufferAllocatedBytes / (1024 * 1024) << " MB allocated, " <<
+					stats.gBufferCommittedBytes / (1024 * 1024) << " MB committed" <<
+					(stats.lazilyAllocated ? " (lazily allocated)" : "") << ", " <<
+					stats.spilledBytesPerFrame / (1024 * 1024) << " MB per frame if it left tile memory";
+			}
+			std::cout << std::endl;
+		}
+	}
+	deferred = false;
+}
+
+void Triangle::benchmarkShadows()
+{
+	// Two layers so the upper grid shadows the lower one, a tenth of the objects spin
+	objectCount = 10000;
+	gridLayers = 2;
+	objectScale = 2.f;
+	dynamicObjectInterval = 10;
+	if (!drawsShadowed())
+	{
+		std::cout << "Shadows are only drawn by the basic draw path without clustered lighting" << std::endl;
+		return;
+	}
+
+	std::cout << windowWidth << "x" << windowHeight << ", " << objectCount << " objects, " <<
+		objectCount / dynamicObjectInterval << " dynamic, " << SHADOW_CASCADE_COUNT << " cascades, sun turning " <<
+		sunDegreesPerSecond << " degrees per second" << std::endl;
+	for (bool caching : {false, true})
+	{
+		cascadedShadows->caching = caching;
+		for (uint32_t frame = 0; frame < 30; frame++)
+		{
+			glfwPollEvents();
+			drawFrame();
+		}
+		const uint32_t frameCount = 300;
+		uint64_t staticDraws = 0;
+		uint64_t dynamicDraws = 0;
+		uint32_t cascadesRedrawn = 0;
+		double gpuMilliseconds = 0.0;
+		for (uint32_t frame = 0; frame < frameCount; frame++)
+		{
+			glfwPollEvents();
+			drawFrame();
+			const CascadedShadowStats stats = cascadedShadows->getStats();
+			staticDraws += stats.staticDraws;
+			dynamicDraws += stats.dynamicDraws;
+			cascadesRedrawn += stats.cascadesRedrawn;
+			gpuMilliseconds += stats.gpuMilliseconds;
+		}
+		std::cout << (caching ? "Cached" : "Uncached") << ": " << (staticDraws + dynamicDraws) / frameCount <<
+			" shadow draws per frame (" << staticDraws / frameCount << " static, " << dynamicDraws / frameCount <<
+			" dynamic), static layers drawn " << cascadesRedrawn << " times in " << frameCount << " frames, " <<
+			gpuMilliseconds / frameCount << " ms GPU" << std::endl;
+	}
+}
+
+/// Culls random spheres and boxes around a camera with the scalar, SIMD and threaded SIMD paths.
+void benchmarkFrustumCulling()
+{
+	JobSystem jobSystem(std::max(1u, std::thread::hardware_concurrency()) - 1);
+	FrustumCuller singleThreaded;
+	FrustumCuller multiThreaded(&jobSystem);
+
+	const glm::mat4 viewProj = glm::perspective(glm::radians(60.f), 16.f / 9.f, 0.1f, 200.f) *
+		glm::lookAt(glm::vec3(0.f), glm::vec3(1.f, 0.f, 0.f), glm::vec3(0.f, 0.f, 1.f));
+	glm::vec4 planes[6];
+	extractFrustumPlanes(viewProj, planes);
+
+	std::cout << "SIMD width " << CULL_SIMD_WIDTH << ", " << jobSystem.getThreadCount() << " threads" << std::endl;
+	for (uint32_t count : {10000u, 100000u, 1000000u})
+	{
+		std::mt19937 random(count);
+		std::uniform_real_distribution<float> position(-100.f, 100.f);
+		std::uniform_real_distribution<float> radius(0.5f, 2.f);
+
+		std::vector<glm::vec4> spheres(count);
+		BoundsSoA bounds;
+		bounds.resize(count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			spheres[i] = glm::vec4(position(random), position(random), position(random), radius(random));
+			bounds.setSphere(i, glm::vec3(spheres[i]), spheres[i].w);
+			bounds.setAabb(i, glm::vec3(spheres[i]) - spheres[i].w, glm::vec3(spheres[i]) + spheres[i].w);
+		}
+
+		const uint32_t iterations = std::max(10u, 10000000u / count);
+		std::vector<uint32_t> visible;
+		visible.reserve(count);
+
+		auto startTime = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			visible.clear();
+			for (uint32_t j = 0; j < count; j++)
+			{
+				if (isSphereVisible(planes, spheres[j]))
+				{
+					visible.push_back(j);
+				}
+			}
+		}
+		auto scalarTime = std::chrono::high_resolution_clock::now();
+		const size_t scalarVisible = visible.size();
+
+		double objectsPerMs[4];
+		size_t simdVisible[4];
+		auto sectionStart = scalarTime;
+		for (int mode = 0; mode < 4; mode++)
+		{
+			FrustumCuller& culler = mode < 2 ? singleThreaded : multiThreaded;
+			const BoundingVolume volume = mode % 2 == 0 ? BoundingVolume::Sphere : BoundingVolume::Aabb;
+			for (uint32_t i = 0; i < iterations; i++)
+			{
+				culler.cull(bounds, volume, viewProj, visible);
+			}
+			auto sectionEnd = std::chrono::high_resolution_clock::now();
+			objectsPerMs[mode] = static_cast<double>(count) * iterations /
+				std::chrono::duration<double, std::milli>(sectionEnd - sectionStart).count();
+			simdVisible[mode] = visible.size();
+			sectionStart = sectionEnd;
+		}
+
+		std::cout << count << " objects, " << scalarVisible << " visible spheres, " << simdVisible[1] <<
+			" visible boxes" << std::endl;
+		std::cout << "  scalar spheres " << static_cast<double>(count) * iterations /
+			std::chrono::duration<double, std::milli>(scalarTime - startTime).count() << " objects/ms" << std::endl;
+		std::cout << "  SIMD spheres " << objectsPerMs[0] << ", boxes " << objectsPerMs[1] << " objects/ms" <<
+			std::endl;
+		std::cout << "  threaded SIMD spheres " << objectsPerMs[2] << ", boxes " << objectsPerMs[3] <<
+			" objects/ms" << std::endl;
+		if (simdVisible[0] != scalarVisible || simdVisible[2] != scalarVisible || simdVisible[3] != simdVisible[1])
+		{
+			std::cout << "  culling paths disagree!" << std::endl;
+		}
+	}
+}
+
+/// Builds BVHs over random boxes and a generated terrain mesh and measures queries against brute force.
+void benchmarkBvh()
+{
+	const glm::mat4 viewProj = glm::perspective(glm::radians(60.f), 16.f / 9.f, 0.1f, 200.f) *
+		glm::lookAt(glm::vec3(0.f), glm::vec3(1.f, 0.f, 0.f), glm::vec3(0.f, 0.f, 1.f));
+	const uint32_t rayCount = 100000;
+
+	for (uint32_t count : {10000u, 100000u, 1000000u})
+	{
+		std::mt19937 random(count);
+		std::uniform_real_distribution<float> position(-100.f, 100.f);
+		std::uniform_real_distribution<float> size(0.5f, 2.f);
+		std::uniform_real_distribution<float> unit(-1.f, 1.f);
+
+		std::vector<Aabb> bounds(count);
+		BoundsSoA soaBounds;
+		soaBounds.resize(count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const glm::vec3 center(position(random), position(random), position(random));
+			bounds[i].min = center - size(random);
+			bounds[i].max = center + size(random);
+			soaBounds.setAabb(i, bounds[i].min, bounds[i].max);
+		}
+
+		Bvh bvh;
+		bvh.build(bounds);
+		const BvhStats stats = bvh.getStats();
+
+		const uint32_t queryIterations = std::max(10u, 1000000u / count);
+		std::vector<uint32_t> visible;
+		auto startTime = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < queryIterations; i++)
+		{
+			visible.clear();
+			bvh.queryFrustum(viewProj, visible);
+		}
+		auto bvhTime = std::chrono::high_resolution_clock::now();
+		const size_t bvhVisible = visible.size();
+
+		FrustumCuller culler;
+		for (uint32_t i = 0; i < queryIterations; i++)
+		{
+			culler.cull(soaBounds, BoundingVolume::Aabb, viewProj, visible);
+		}
+		auto bruteForceTime = std::chrono::high_resolution_clock::now();
+
+		uint32_t rayHits = 0;
+		RayHit hit;
+		for (uint32_t i = 0; i < rayCount; i++)
+		{
+			const glm::vec3 origin(position(random), position(random), position(random));
+			rayHits += bvh.raycast(origin, glm::vec3(unit(random), unit(random), unit(random)), 1000.f, hit) ? 1 : 0;
+		}
+		auto rayTime = std::chrono::high_resolution_clock::now();
+
+		for (auto& box : bounds)
+		{
+			const glm::vec3 offset(unit(random), unit(random), unit(random));
+			box.min += offset;
+			box.max += offset;
+		}
+		auto refitStartTime = std::chrono::high_resolution_clock::now();
+		bvh.refit(bounds);
+		auto refitTime = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < count; i += 100)
+		{
+			bvh.updatePrimitive(i, bounds[i]);
+		}
+		auto updateTime = std::chrono::high_resolution_clock::now();
+
+		std::cout << count << " objects: build " << stats.buildMilliseconds << " ms, " << stats.nodeCount <<
+			" nodes, depth " << stats.maxDepth << std::endl;
+		std::cout << "  frustum query " << std::chrono::duration<double, std::micro>(bvhTime - startTime).count() /
+			queryIterations << " us, brute force SIMD " <<
+			std::chrono::duration<double, std::micro>(bruteForceTime - bvhTime).count() / queryIterations <<
+			" us, " << bvhVisible << " / " << visible.size() << " visible" << std::endl;
+		std::cout << "  raycast " << rayCount / std::chrono::duration<double, std::milli>(rayTime - bruteForceTime).
+			count() << " rays/ms, " << rayHits << " hits" << std::endl;
+		std::cout << "  full refit " << std::chrono::duration<double, std::milli>(refitTime - refitStartTime).count()
+			<< " ms, 1% incremental " << std::chrono::duration<double, std::milli>(updateTime - refitTime).count() <<
+			" ms" << std::endl;
+	}
+
+	// Rolling terrain, rays cast down onto it
+	const uint32_t gridSize = 512;
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> indices;
+	for (uint32_t y = 0; y <= gridSize; y++)
+	{
+		for (uint32_t x = 0; x <= gridSize; x++)
+		{
+			positions.emplace_back(x, y, 4.f * std::sin(x * 0.05f) * std::cos(y * 0.07f));
+		}
+	}
+	for (uint32_t y = 0; y < gridSize; y++)
+	{
+		for (uint32_t x = 0; x < gridSize; x++)
+		{
+			const uint32_t corner = y * (gridSize + 1) + x;
+			indices.insert(indices.end(), {
+				               corner, corner + 1, corner + gridSize + 2, corner, corner + gridSize + 2,
+				               corner + gridSize + 1
+			               });
+		}
+	}
+
+	Bvh terrain;
+	terrain.buildTriangles(positions, indices);
+	std::mt19937 random(gridSize);
+	std::uniform_real_distribution<float> position(0.f, static_cast<float>(gridSize));
+	std::uniform_real_distribution<float> unit(-1.f, 1.f);
+	uint32_t rayHits = 0;
+	RayHit hit;
+	auto startTime = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < rayCount; i++)
+	{
+		const glm::vec3 origin(position(random), position(random), 20.f);
+		rayHits += terrain.raycast(origin, glm::vec3(unit(random), unit(random), -1.f), 1000.f, hit) ? 1 : 0;
+	}
+	auto endTime = std::chrono::high_resolution_clock::now();
+	std::cout << indices.size() / 3 << " triangles: build " << terrain.getStats().buildMilliseconds << " ms, raycast "
+		<< rayCount / std::chrono::duration<double, std::milli>(endTime - startTime).count() << " rays/ms, " <<
+		rayHits << " hits" << std::endl;
+}
+
+/// Rasterizes about 100k occluder triangles of a city of boxes and tests random boxes against them, single
+/// threaded and on the job system, then writes the depth buffer to software_occlusion_depth.pgm.
+void benchmarkSoftwareOcclusion()
+{
+	JobSystem jobSystem(std::max(1u, std::thread::hardware_concurrency()) - 1);
+	SoftwareOcclusion singleThreaded;
+	SoftwareOcclusion multiThreaded(512, 256, &jobSystem);
+
+	const glm::mat4 viewProj = glm::perspective(glm::radians(60.f), 2.f, 0.1f, 500.f) *
+		glm::lookAt(glm::vec3(0.f, 0.f, 30.f), glm::vec3(100.f, 0.f, 0.f), glm::vec3(0.f, 0.f, 1.f));
+
+	// Unit cube, every building is a scaled copy of it
+	std::vector<glm::vec3> positions;
+	for (uint32_t i = 0; i < 8; i++)
+	{
+		positions.emplace_back((i & 1) ? 0.5f : -0.5f, (i & 2) ? 0.5f : -0.5f, (i & 4) ? 1.f : 0.f);
+	}
+	const std::vector<uint32_t> cubeIndices = {
+		0, 1, 3, 0, 3, 2, 4, 6, 7, 4, 7, 5, 0, 4, 5, 0, 5, 1, 2, 3, 7, 2, 7, 6, 0, 2, 6, 0, 6, 4, 1, 5, 7, 1, 7, 3
+	};
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> footprint(1.f, 4.f);
+	std::uniform_real_distribution<float> height(2.f, 20.f);
+	std::uniform_real_distribution<float> forward(20.f, 400.f);
+	std::uniform_real_distribution<float> side(-200.f, 200.f);
+	std::uniform_real_distribution<float> up(0.5f, 10.f);
+	std::vector<glm::mat4> buildings(8334);
+	for (auto& model : buildings)
+	{
+		model = glm::scale(glm::translate(glm::mat4(1.f), glm::vec3(forward(random), side(random), 0.f)),
+		                   glm::vec3(footprint(random), footprint(random), height(random)));
+	}
+	std::vector<Aabb> bounds(100000);
+	for (auto& box : bounds)
+	{
+		const glm::vec3 center(forward(random), side(random), up(random));
+		box.min = center - 0.5f;
+		box.max = center + 0.5f;
+	}
+
+	const uint32_t iterations = 20;
+	std::vector<uint32_t> visible[2];
+	std::cout << jobSystem.getThreadCount() << " threads" << std::endl;
+	for (int mode = 0; mode < 2; mode++)
+	{
+		SoftwareOcclusion& occlusion = mode == 0 ? singleThreaded : multiThreaded;
+		double setupMilliseconds = 0.0;
+		double rasterMilliseconds = 0.0;
+		double testMilliseconds = 0.0;
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			occlusion.beginFrame(viewProj);
+			for (const auto& model : buildings)
+			{
+				occlusion.addOccluder(positions, cubeIndices, model);
+			}
+			occlusion.rasterize();
+			setupMilliseconds += occlusion.getStats().setupMilliseconds;
+			rasterMilliseconds += occlusion.getStats().rasterMilliseconds;
+
+			auto startTime = std::chrono::high_resolution_clock::now();
+			visible[mode].resize(bounds.size());
+			for (uint32_t j = 0; j < bounds.size(); j++)
+			{
+				visible[mode][j] = j;
+			}
+			occlusion.cullOccluded(bounds, visible[mode]);
+			testMilliseconds += std::chrono::duration<double, std::milli>(
+				std::chrono::high_resolution_clock::now() - startTime).count();
+		}
+
+		const SoftwareOcclusionStats stats = occlusion.getStats();
+		std::cout << (mode == 0 ? "single threaded: " : "threaded: ") << stats.occluderTriangles <<
+			" occluder triangles, " << stats.rasterizedTriangles << " on screen" << std::endl;
+		std::cout << "  setup " << setupMilliseconds / iterations << " ms, raster " << rasterMilliseconds / iterations
+			<< " ms, " << bounds.size() << " box tests " << testMilliseconds / iterations << " ms, " <<
+			visible[mode].size() << " visible" << std::endl;
+	}
+	if (visible[0] != visible[1])
+	{
+		std::cout << "  single threaded and threaded results disagree!" << std::endl;
+	}
+	if (singleThreaded.writeDepthImage("software_occlusion_depth.pgm"))
+	{
+		std::cout << "depth written to software_occlusion_depth.pgm" << std::endl;
+	}
+}
+
+/// Updates a random tree of 100k nodes with 1% and 100% of the local matrices changed, single
+/// threaded and on the job system, against recomputing every world matrix in creation order.
+void benchmarkTransforms()
+{
+	JobSystem jobSystem(std::max(1u, std::thread::hardware_concurrency()) - 1);
+	TransformHierarchy singleThreaded;
+	TransformHierarchy multiThreaded(&jobSystem);
+
+	const uint32_t nodeCount = 100000;
+	const uint32_t rootCount = 16;
+	std::mt19937 random(nodeCount);
+	std::uniform_real_distribution<float> unit(-1.f, 1.f);
+	std::vector<uint32_t> parents(nodeCount);
+	std::vector<glm::mat4> locals(nodeCount);
+	for (uint32_t i = 0; i < nodeCount; i++)
+	{
+		// Every node hangs off a random earlier one, which gives a few dozen levels
+		parents[i] = i < rootCount ? TransformHierarchy::NO_PARENT : static_cast<uint32_t>(random() % i);
+		locals[i] = glm::rotate(glm::translate(glm::mat4(1.f), glm::vec3(unit(random), unit(random), unit(random))),
+		                        unit(random), glm::vec3(0.f, 0.f, 1.f));
+		singleThreaded.addNode(parents[i], locals[i]);
+		multiThreaded.addNode(parents[i], locals[i]);
+	}
+	singleThreaded.update();
+	multiThreaded.update();
+	std::cout << nodeCount << " nodes, " << singleThreaded.getStats().levelCount << " levels, " <<
+		jobSystem.getThreadCount() << " threads" << std::endl;
+
+	const uint32_t iterations = 20;
+	std::vector<glm::mat4> worlds(nodeCount);
+	auto startTime = std::chrono::high_resolution_clock::now();
+	for (uint32_t iteration = 0; iteration < iterations; iteration++)
+	{
+		for (uint32_t i = 0; i < nodeCount; i++)
+		{
+			worlds[i] = parents[i] == TransformHierarchy::NO_PARENT ? locals[i] : worlds[parents[i]] * locals[i];
+		}
+	}
+	std::cout << "  recompute all in creation order " << std::chrono::duration<double, std::milli>(
+		std::chrono::high_resolution_clock::now() - startTime).count() / iterations << " ms" << std::endl;
+
+	for (uint32_t dirtyPercent : {1u, 100u})
+	{
+		const uint32_t dirtyCount = nodeCount / 100 * dirtyPercent;
+		for (int mode = 0; mode < 2; mode++)
+		{
+			TransformHierarchy& hierarchy = mode == 0 ? singleThreaded : multiThreaded;
+			double milliseconds = 0.0;
+			uint32_t updatedNodes = 0;
+			for (uint32_t iteration = 0; iteration < iterations; iteration++)
+			{
+				for (uint32_t i = 0; i < dirtyCount; i++)
+				{
+					const uint32_t node = dirtyCount == nodeCount ? i : static_cast<uint32_t>(random() % nodeCount);
+					hierarchy.setLocal(node, locals[node]);
+				}
+				hierarchy.update();
+				milliseconds += hierarchy.getStats().milliseconds;
+				updatedNodes += hierarchy.getStats().updatedNodes;
+			}
+			std::cout << "  " << dirtyPercent << "% dirty, " << (mode == 0 ? "single threaded " : "threaded ") <<
+				milliseconds / iterations << " ms, " << updatedNodes / iterations << " nodes recomputed" << std::endl;
+		}
+	}
+
+	// Products may be evaluated in another order or with FMA, so matrices only have to agree to a relative tolerance
+	auto nearlyEqual = [](const glm::mat4& a, const glm::mat4& b)
+	{
+		for (int column = 0; column < 4; column++)
+		{
+			const glm::vec4 tolerance = 1e-4f * glm::max(glm::abs(b[column]), glm::vec4(1.f));
+			if (!glm::all(glm::lessThanEqual(glm::abs(a[column] - b[column]), tolerance)))
+			{
+				return false;
+			}
+		}
+		return true;
+	};
+	for (uint32_t i = 0; i < nodeCount; i++)
+	{
+		if (!nearlyEqual(singleThreaded.getWorld(i), worlds[i]) || !nearlyEqual(multiThreaded.getWorld(i), worlds[i]))
+		{
+			std::cout << "  world matrices disagree!" << std::endl;
+			break;
+		}
+	}
+}
+
+/// Sorts random draws over 16 pipelines, 256 materials and 64 meshes and counts the binds recording
+/// them takes in submission order and sorted. Handles are only compared, so numbered ones stand in.
+void benchmarkDrawSorting()
+{
+	JobSystem jobSystem(std::max(1u, std::thread::hardware_concurrency()) - 1);
+	auto fakeHandle = [](uint64_t value, auto handle)
+	{
+		memcpy(&handle, &value, sizeof(handle));
+		return handle;
+	};
+
+	std::cout << jobSystem.getThreadCount() << " threads" << std::endl;
+	for (uint32_t count : {10000u, 100000u, 250000u})
+	{
+		SortedDrawList lists[2] = {SortedDrawList(), SortedDrawList(&jobSystem)};
+		std::mt19937 random(count);
+		std::uniform_real_distribution<float> depth(0.f, 1.f);
+		for (SortedDrawList& list : lists)
+		{
+			for (uint32_t i = 0; i < 16; i++)
+			{
+				// Four pipelines share each layout
+				list.addPipeline(fakeHandle(i + 1, VkPipeline()), fakeHandle(i / 4 + 1, VkPipelineLayout()));
+			}
+			for (uint32_t i = 0; i < 256; i++)
+			{
+				list.addMaterial(fakeHandle(i + 1, VkDescriptorSet()));
+			}
+			for (uint32_t i = 0; i < 64; i++)
+			{
+				list.addMesh(fakeHandle(i + 1, VkBuffer()), 36);
+			}
+		}
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const uint32_t pass = random() % 2;
+			const uint32_t pipeline = random() % 16;
+			const uint32_t material = random() % 256;
+			const uint32_t mesh = random() % 64;
+			const float drawDepth = depth(random);
+			for (SortedDrawList& list : lists)
+			{
+				list.add(pass, pipeline, material, mesh, drawDepth, glm::mat4(1.f));
+			}
+		}
+
+		std::vector<uint64_t> keys(count);
+		for (uint64_t& key : keys)
+		{
+			key = static_cast<uint64_t>(random()) << 32 | random();
+		}
+		auto startTime = std::chrono::high_resolution_clock::now();
+		std::sort(keys.begin(), keys.end());
+		const double stdSortMilliseconds = std::chrono::duration<double, std::milli>(
+			std::chrono::high_resolution_clock::now() - startTime).count();
+
+		lists[0].sortingEnabled = false;
+		lists[0].sort();
+		const DrawSortStats unsorted = lists[0].getStats();
+		lists[0].sortingEnabled = true;
+		lists[0].sort();
+		const DrawSortStats sorted = lists[0].getStats();
+		lists[1].sort();
+		std::cout << count << " draws: radix sort " << sorted.sortMilliseconds << " ms, threaded " <<
+			lists[1].getStats().sortMilliseconds << " ms, std::sort of as many keys " << stdSortMilliseconds << " ms"
+			<< std::endl;
+		std::cout << "  submission order: " << unsorted.pipelineBinds << " pipeline, " <<
+			unsorted.descriptorSetBinds << " descriptor set, " << unsorted.vertexBufferBinds <<
+			" vertex buffer binds, " << unsorted.bindsSaved << " saved" << std::endl;
+		std::cout << "  sorted: " << sorted.pipelineBinds << " pipeline, " << sorted.descriptorSetBinds <<
+			" descriptor set, " << sorted.vertexBufferBinds << " vertex buffer binds, " << sorted.bindsSaved <<
+			" saved" << std::endl;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	bool benchmarkDraws = false;
+	bool benchmarkDescriptors = false;
+	bool benchmarkIndirect = false;
+	bool benchmarkInstancing = false;
+	bool instanced = false;
+	bool benchmarkCulling = false;
+	bool benchmarkBvhQueries = false;
+	bool benchmarkSoftwareOcclusionQueries = false;
+	bool benchmarkTransformUpdates = false;
+	bool benchmarkDrawSort = false;
+	bool sortedDraws = false;
+	bool cpuCulling = false;
+	bool softwareOcclusion = false;
+	bool dumpOcclusionDepth = false;
+	bool gpuDriven = false;
+	bool occlusion = false;
+	bool benchmarkOcclusion = false;
+	bool renderGraph = false;
+	bool benchmarkRenderGraph = false;
+	bool lazyAttachments = true;
+	bool benchmarkAttachments = false;
+	bool dynamicResolution = false;
+	bool benchmarkDynamicResolution = false;
+	float targetGpuMilliseconds = 16.f;
+	bool antiAliasing = false;
+	AntiAliasingMode antiAliasingMode = AntiAliasingMode::Msaa;
+	bool benchmarkAntiAliasing = false;
+	bool benchmarkMips = false;
+	uint32_t clusteredLights = 0;
+	bool gpuLightBinning = false;
+	bool benchmarkClusteredLighting = false;
+	bool deferred = false;
+	bool benchmarkDeferred = false;
+	bool shadows = false;
+	bool shadowCache = true;
+	bool benchmarkShadows = false;
+	bool hotReload = false;
+	uint32_t objectCount = 1;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--hot-reload")
+		{
+			hotReload = true;
+		}
+		else if (arg == "--benchmark-draws")
+		{
+			benchmarkDraws = true;
+		}
+		else if (arg == "--benchmark-descriptors")
+		{
+			benchmarkDescriptors = true;
+		}
+		else if (arg == "--benchmark-indirect")
+		{
+			benchmarkIndirect = true;
+		}
+		else if (arg == "--benchmark-instancing")
+		{
+			benchmarkInstancing = true;
+		}
+		else if (arg == "--instanced")
+		{
+			instanced = true;
+		}
+		else if (arg == "--gpu-driven")
+		{
+			gpuDriven = true;
+		}
+		else if (arg == "--benchmark-culling")
+		{
+			benchmarkCulling = true;
+		}
+		else if (arg == "--benchmark-bvh")
+		{
+			benchmarkBvhQueries = true;
+		}
+		else if (arg == "--occlusion")
+		{
+			occlusion = true;
+		}
+		else if (arg == "--benchmark-occlusion")
+		{
+			benchmarkOcclusion = true;
+		}
+		else if (arg == "--cpu-culling")
+		{
+			cpuCulling = true;
+		}
+		else if (arg == "--software-occlusion")
+		{
+			softwareOcclusion = true;
+		}
+		else if (arg == "--dump-occlusion-depth")
+		{
+			dumpOcclusionDepth = true;
+		}
+		else if (arg == "--benchmark-software-occlusion")
+		{
+			benchmarkSoftwareOcclusionQueries = true;
+		}
+		else if (arg == "--benchmark-transforms")
+		{
+			benchmarkTransformUpdates = true;
+		}
+		else if (arg == "--benchmark-draw-sort")
+		{
+			benchmarkDrawSort = true;
+		}
+		else if (arg == "--sorted-draws")
+		{
+			sortedDraws = true;
+		}
+		else if (arg == "--render-graph")
+		{
+			renderGraph = true;
+		}
+		else if (arg == "--benchmark-render-graph")
+		{
+			benchmarkRenderGraph = true;
+		}
+		else if (arg == "--no-lazy-attachments")
+		{
+			lazyAttachments = false;
+		}
+		else if (arg == "--benchmark-attachment-memory")
+		{
+			benchmarkAttachments = true;
+		}
+		else if (arg == "--dynamic-resolution")
+		{
+			dynamicResolution = true;
+		}
+		else if (arg == "--target-gpu-ms" && i + 1 < argc)
+		{
+			targetGpuMilliseconds = std::stof(argv[++i]);
+		}
+		else if (arg == "--benchmark-dynamic-resolution")
+		{
+			benchmarkDynamicResolution = true;
+		}
+		else if (arg == "--aa" && i + 1 < argc)
+		{
+			const std::string mode = argv[++i];
+			antiAliasing = true;
+			antiAliasingMode = mode == "fxaa" ? AntiAliasingMode::Fxaa :
+				mode == "taa" ? AntiAliasingMode::Taa : AntiAliasingMode::Msaa;
+		}
+		else if (arg == "--benchmark-aa")
+		{
+			benchmarkAntiAliasing = true;
+		}
+		else if (arg == "--benchmark-mips")
+		{
+			benchmarkMips = true;
+		}
+		else if (arg == "--clustered-lights" && i + 1 < argc)
+		{
+			clusteredLights = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--gpu-light-binning")
+		{
+			gpuLightBinning = true;
+		}
+		else if (arg == "--benchmark-clustered-lighting")
+		{
+			benchmarkClusteredLighting = true;
+		}
+		else if (arg == "--deferred")
+		{
+			deferred = true;
+		}
+		else if (arg == "--benchmark-deferred")
+		{
+			benchmarkDeferred = true;
+		}
+		else if (arg == "--shadows")
+		{
+			shadows = true;
+		}
+		else if (arg == "--no-shadow-cache")
+		{
+			shadowCache = false;
+		}
+		else if (arg == "--benchmark-shadows")
+		{
+			benchmarkShadows = true;
+		}
+		else if (arg == "--objects" && i + 1 < argc)
+		{
+			objectCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+	}
+
+	if (benchmarkCulling || benchmarkBvhQueries || benchmarkSoftwareOcclusionQueries || benchmarkTransformUpdates ||
+		benchmarkDrawSort)
+	{
+		// These run on the CPU only, no device needed
+		if (benchmarkCulling)
+		{
+			benchmarkFrustumCulling();
+		}
+		if (benchmarkBvhQueries)
+		{
+			benchmarkBvh();
+		}
+		if (benchmarkSoftwareOcclusionQueries)
+		{
+			benchmarkSoftwareOcclusion();
+		}
+		if (benchmarkTransformUpdates)
+		{
+			benchmarkTransforms();
+		}
+		if (benchmarkDrawSort)
+		{
+			benchmarkDrawSorting();
+		}
+		return 0;
+	}
+
+	// Validation would dominate the measured recording cost
+	const bool benchmark = benchmarkDraws || benchmarkDescriptors || benchmarkIndirect || benchmarkInstancing ||
+		benchmarkOcclusion || benchmarkRenderGraph || benchmarkAttachments || benchmarkDynamicResolution ||
+		benchmarkAntiAliasing || benchmarkMips || benchmarkClusteredLighting || benchmarkDeferred || benchmarkShadows;
+	Triangle app(!benchmark);
+	app.enableShaderHotReload = hotReload;
+	app.lazyAttachments = lazyAttachments;
+	app.objectCount = objectCount;
+	if (cpuCulling || softwareOcclusion)
+	{
+		app.jobSystem = std::make_unique<JobSystem>(std::max(1u, std::thread::hardware_concurrency()) - 1);
+		app.frustumCuller = FrustumCuller(app.jobSystem.get());
+		app.cpuCulling = true;
+	}
+	if (sortedDraws)
+	{
+		if (!app.jobSystem)
+		{
+			app.jobSystem = std::make_unique<JobSystem>(std::max(1u, std::thread::hardware_concurrency()) - 1);
+		}
+		app.sortedDrawList = SortedDrawList(app.jobSystem.get());
+		app.sortedDraws = true;
+	}
+	if (softwareOcclusion)
+	{
+		app.softwareOcclusion = std::make_unique<SoftwareOcclusion>(512, 256, app.jobSystem.get());
+		app.dumpOcclusionDepth = dumpOcclusionDepth;
+		app.gridLayers = 8;
+		app.objectScale = 3.f;
+	}
+	if (occlusion || benchmarkOcclusion)
+	{
+		// The depth pyramid is built from the depth buffer, so it has to outlive the pass
+		app.depthImageUsage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		app.gridLayers = 8;
+		app.objectScale = 3.f;
+	}
+	app.init();
+	if (antiAliasing || benchmarkAntiAliasing)
+	{
+		app.antiAliasing = std::make_unique<AntiAliasing>(app);
+		app.antiAliasing->mode = antiAliasingMode;
+	}
+	app.createUniformBuffer(sizeof(FrameUniforms));
+	app.createGraphicsPipeline();
+	app.createDescriptorSets();
+	if (gpuDriven || benchmarkIndirect || occlusion || benchmarkOcclusion)
+	{
+		app.createGpuDrivenResources(std::max(objectCount, 100000u));
+		app.gpuDriven = gpuDriven;
+	}
+	if (occlusion || benchmarkOcclusion)
+	{
+		app.createOcclusionResources();
+		app.occlusion = occlusion;
+	}
+	if (instanced || benchmarkInstancing)
+	{
+		app.createInstancedResources(std::max(objectCount, 10000u));
+		app.instanced = instanced;
+	}
+	if (renderGraph || benchmarkRenderGraph)
+	{
+		app.buildRenderGraph();
+	}
+	if (dynamicResolution || benchmarkDynamicResolution)
+	{
+		app.dynamicResolution = std::make_unique<DynamicResolution>(app);
+		app.dynamicResolution->targetMilliseconds = targetGpuMilliseconds;
+	}
+	if (clusteredLights > 0 || benchmarkClusteredLighting || deferred || benchmarkDeferred)
+	{
+		if (!app.jobSystem)
+		{
+			app.jobSystem = std::make_unique<JobSystem>(std::max(1u, std::thread::hardware_concurrency()) - 1);
+		}
+		app.clusteredLighting = std::make_unique<ClusteredLighting>(app, std::max(clusteredLights, 10000u),
+		                                                            app.jobSystem.get());
+		app.clusteredLighting->gpuBinning = gpuLightBinning;
+		app.placeLights(clusteredLights);
+	}
+	if (deferred || benchmarkDeferred)
+	{
+		app.deferredShading = std::make_unique<DeferredShading>(app, *app.clusteredLighting);
+		app.deferred = deferred;
+	}
+	if (shadows || benchmarkShadows)
+	{
+		app.cascadedShadows = std::make_unique<CascadedShadows>(app);
+		app.cascadedShadows->caching = shadowCache;
+		app.dynamicObjectInterval = 10;
+		app.gridLayers = std::max(app.gridLayers, 2u);
+	}
+	app.createCommandBuffers();
+
+	if (benchmark)
+	{
+		// Variants compile in the background, measuring starts once they are all in
+		app.pipelineCache->waitIdle();
+		if (benchmarkDraws)
+		{
+			app.benchmarkDraws();
+		}
+		if (benchmarkDescriptors)
+		{
+			app.benchmarkDescriptorUpdates();
+		}
+		if (benchmarkIndirect)
+		{
+			app.benchmarkIndirect();
+		}
+		if (benchmarkInstancing)
+		{
+			app.benchmarkInstancing();
+		}
+		if (benchmarkOcclusion)
+		{
+			app.benchmarkOcclusion();
+		}
+		if (benchmarkRenderGraph)
+		{
+			app.benchmarkRenderGraph();
+		}
+		if (benchmarkAttachments)
+		{
+			app.benchmarkAttachmentMemory();
+		}
+		if (benchmarkDynamicResolution)
+		{
+			app.benchmarkDynamicResolution();
+		}
+		if (benchmarkAntiAliasing)
+		{
+			app.benchmarkAntiAliasing();
+		}
+		if (benchmarkMips)
+		{
+			app.benchmarkMipGeneration();
+		}
+		if (benchmarkClusteredLighting)
+		{
+			app.benchmarkClusteredLighting();
+		}
+		if (benchmarkDeferred)
+		{
+			app.benchmarkDeferredShading();
+		}
+		if (benchmarkShadows)
+		{
+			app.benchmarkShadows();
+		}
+		return 0;
+	}
+
+	bool modeKeyDown = false;
+	while (!glfwWindowShouldClose(app.window))
+	{
+		glfwPollEvents();
+		// A steps through the anti-aliasing modes
+		const bool keyDown = glfwGetKey(app.window, GLFW_KEY_A) == GLFW_PRESS;
+		if (app.antiAliasing && keyDown && !modeKeyDown)
+		{
+			const int next = (static_cast<int>(app.antiAliasing->mode) + 1) % 3;
+			app.antiAliasing->mode = static_cast<AntiAliasingMode>(next);
+			std::cout << "Anti-aliasing: " << getAntiAliasingModeName(app.antiAliasing->mode) << std::endl;
+		}
+		modeKeyDown = keyDown;
+		app.drawFrame();
+	}
+	if (app.swapchainRecreateCount > 0)
+	{
+		std::cout << "Swapchain recreated " << app.swapchainRecreateCount << " times, last at " << app.windowWidth <<
+			"x" << app.windowHeight << " in " << app.lastSwapchainRecreateTime << " ms" << std::endl;
 	}
 }
@@ -0,0 +1,63 @@
+#version 450
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec3 worldPosition;
+layout(location = 2) in vec3 worldNormal;
+layout(location = 3) in float viewDepth;
+
+layout(location = 0) out vec4 outColor;
+
+struct PointLight {
+    vec3 position;
+    float radius;
+    vec3 color;
+    float padding;
+};
+
+layout(binding = 1) uniform ClusterUniforms {
+    mat4 view;
+    // Tiles across, tiles down, depth slices and the light count
+    uvec4 gridSize;
+    // Near, far, then scale and bias turning log(depth) into a slice
+    vec4 depthSlicing;
+    vec2 screenSize;
+} clusterGrid;
+
+layout(std430, binding = 2) readonly buffer Lights {
+    PointLight lights[];
+};
+
+// Offset into the light index list and light count, per cluster
+layout(std430, binding = 3) readonly buffer Clusters {
+    uvec2 clusters[];
+};
+
+layout(std430, binding = 4) readonly buffer LightIndices {
+    uint lightIndices[];
+};
+
+const vec3 AMBIENT = vec3(0.05);
+
+uint findCluster() {
+    uvec3 gridSize = clusterGrid.gridSize.xyz;
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / clusterGrid.screenSize * vec2(gridSize.xy)), gridSize.xy - 1);
+    float slice = log(viewDepth) * clusterGrid.depthSlicing.z + clusterGrid.depthSlicing.w;
+    uint depthSlice = uint(clamp(slice, 0.0, float(gridSize.z - 1)));
+    return (depthSlice * gridSize.y + tile.y) * gridSize.x + tile.x;
+}
+
+void main() {
+    uvec2 range = clusters[findCluster()];
+    vec3 normal = normalize(worldNormal);
+    vec3 lighting = AMBIENT;
+    for (uint i = 0; i < range.y; i++) {
+        PointLight light = lights[lightIndices[range.x + i]];
+        vec3 toLight = light.position - worldPosition;
+        float distance = length(toLight);
+        // Falls to zero at the radius the light was binned with, so clipping it at the cluster is invisible
+        float falloff = clamp(1.0 - distance / light.radius, 0.0, 1.0);
+        float diffuse = max(dot(normal, toLight / max(distance, 0.0001)), 0.0);
+        lighting += light.color * falloff * falloff * diffuse;
+    }
+    outColor = vec4(fragColor * lighting, 1.0);
+}
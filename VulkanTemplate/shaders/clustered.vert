@@ -0,0 +1,37 @@
+#version 450
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec3 worldPosition;
+layout(location = 2) out vec3 worldNormal;
+layout(location = 3) out float viewDepth;
+layout(binding = 0) uniform FrameUniforms {
+    mat4 view;
+    mat4 proj;
+} frame;
+
+layout(push_constant) uniform DrawPushConstants {
+    mat4 model;
+} draw;
+
+vec2 positions[3] = vec2[](
+    vec2(0.0, -0.5),
+    vec2(0.5, 0.5),
+    vec2(-0.5, 0.5)
+);
+
+vec3 colors[3] = vec3[](
+    vec3(1.0, 0.0, 0.0),
+    vec3(0.0, 1.0, 0.0),
+    vec3(0.0, 0.0, 1.0)
+);
+
+void main() {
+    vec4 world = draw.model * vec4(positions[gl_VertexIndex], 0.0, 1.0);
+    vec4 viewPosition = frame.view * world;
+    gl_Position = frame.proj * viewPosition;
+    fragColor = colors[gl_VertexIndex];
+    worldPosition = world.xyz;
+    // The triangles lie in the XY plane of their model space
+    worldNormal = mat3(draw.model) * vec3(0.0, 0.0, 1.0);
+    viewDepth = -viewPosition.z;
+}
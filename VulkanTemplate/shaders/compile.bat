@@ -1,3 +1,24 @@
 glslc.exe shader.vert -o vert.spv
 glslc.exe shader.frag -o frag.spv
+glslc.exe indirect.vert -o indirect_vert.spv
+glslc.exe cull.comp -o cull_comp.spv
+glslc.exe instanced.vert -o instanced_vert.spv
+glslc.exe hiz_init.comp -o hiz_init_comp.spv
+glslc.exe hiz_init.comp -DMULTISAMPLED -o hiz_init_ms_comp.spv
+glslc.exe occlusion_cull.comp -o occlusion_cull_comp.spv
+glslc.exe upscale.vert -o upscale_vert.spv
+glslc.exe upscale.frag -o upscale_frag.spv
+glslc.exe fxaa.frag -o fxaa_frag.spv
+glslc.exe taa.frag -o taa_frag.spv
+glslc.exe downsample.comp -o downsample_comp.spv
+glslc.exe downsample.comp -DREDUCE_MAX -o downsample_max_comp.spv
+glslc.exe downsample.comp -DSPLIT_DISPATCH -o downsample_split_comp.spv
+glslc.exe downsample.comp -DREDUCE_MAX -DSPLIT_DISPATCH -o downsample_max_split_comp.spv
+glslc.exe clustered.vert -o clustered_vert.spv
+glslc.exe clustered.frag -o clustered_frag.spv
+glslc.exe light_cluster.comp -o light_cluster_comp.spv
+glslc.exe gbuffer.frag -o gbuffer_frag.spv
+glslc.exe deferred_lighting.frag -o deferred_lighting_frag.spv
+glslc.exe shadow.vert -o shadow_vert.spv
+glslc.exe shadowed.frag -o shadowed_frag.spv
 pause
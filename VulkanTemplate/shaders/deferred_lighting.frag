@@ -0,0 +1,77 @@
+#version 450
+
+// Reads the G-buffer of the pixel it shades from input attachments, so on tilers it never leaves the tile
+layout(location = 0) in vec2 screenUv;
+
+layout(location = 0) out vec4 outColor;
+
+struct PointLight {
+    vec3 position;
+    float radius;
+    vec3 color;
+    float padding;
+};
+
+layout(binding = 0) uniform ClusterUniforms {
+    mat4 view;
+    uvec4 gridSize;
+    vec4 depthSlicing;
+    vec2 screenSize;
+} clusterGrid;
+
+layout(std430, binding = 1) readonly buffer Lights {
+    PointLight lights[];
+};
+
+layout(std430, binding = 2) readonly buffer Clusters {
+    uvec2 clusters[];
+};
+
+layout(std430, binding = 3) readonly buffer LightIndices {
+    uint lightIndices[];
+};
+
+layout(input_attachment_index = 0, binding = 4) uniform subpassInput albedo;
+layout(input_attachment_index = 1, binding = 5) uniform subpassInput normal;
+layout(input_attachment_index = 2, binding = 6) uniform subpassInput depth;
+
+layout(push_constant) uniform DeferredLightingPushConstants {
+    mat4 inverseProj;
+    mat4 inverseView;
+} camera;
+
+const vec3 AMBIENT = vec3(0.05);
+
+uint findCluster(float viewDepth) {
+    uvec3 gridSize = clusterGrid.gridSize.xyz;
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / clusterGrid.screenSize * vec2(gridSize.xy)), gridSize.xy - 1);
+    float slice = log(viewDepth) * clusterGrid.depthSlicing.z + clusterGrid.depthSlicing.w;
+    uint depthSlice = uint(clamp(slice, 0.0, float(gridSize.z - 1)));
+    return (depthSlice * gridSize.y + tile.y) * gridSize.x + tile.x;
+}
+
+void main() {
+    float fragmentDepth = subpassLoad(depth).r;
+    if (fragmentDepth >= 1.0) {
+        outColor = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+
+    // Back from depth to the view and world space position the G-buffer pass drew at
+    vec4 viewPosition = camera.inverseProj * vec4(screenUv * 2.0 - 1.0, fragmentDepth, 1.0);
+    viewPosition /= viewPosition.w;
+    vec3 worldPosition = (camera.inverseView * viewPosition).xyz;
+
+    vec3 worldNormal = normalize(subpassLoad(normal).xyz * 2.0 - 1.0);
+    uvec2 range = clusters[findCluster(-viewPosition.z)];
+    vec3 lighting = AMBIENT;
+    for (uint i = 0; i < range.y; i++) {
+        PointLight light = lights[lightIndices[range.x + i]];
+        vec3 toLight = light.position - worldPosition;
+        float distance = length(toLight);
+        float falloff = clamp(1.0 - distance / light.radius, 0.0, 1.0);
+        float diffuse = max(dot(worldNormal, toLight / max(distance, 0.0001)), 0.0);
+        lighting += light.color * falloff * falloff * diffuse;
+    }
+    outColor = vec4(subpassLoad(albedo).rgb * lighting, 1.0);
+}
@@ -0,0 +1,44 @@
+#version 450
+
+layout(location = 0) in vec2 screenUv;
+
+layout(location = 0) out vec4 outColor;
+
+layout(binding = 0) uniform sampler2D sceneColor;
+
+layout(push_constant) uniform FxaaPushConstants {
+    vec2 texelSize;
+} fxaa;
+
+const float SPAN_MAX = 8.0;
+const float REDUCE_MUL = 1.0 / 8.0;
+const float REDUCE_MIN = 1.0 / 128.0;
+
+float luma(vec3 color) {
+    return dot(color, vec3(0.299, 0.587, 0.114));
+}
+
+void main() {
+    vec3 colorM = texture(sceneColor, screenUv).rgb;
+    float lumaNW = luma(texture(sceneColor, screenUv + vec2(-1.0, -1.0) * fxaa.texelSize).rgb);
+    float lumaNE = luma(texture(sceneColor, screenUv + vec2(1.0, -1.0) * fxaa.texelSize).rgb);
+    float lumaSW = luma(texture(sceneColor, screenUv + vec2(-1.0, 1.0) * fxaa.texelSize).rgb);
+    float lumaSE = luma(texture(sceneColor, screenUv + vec2(1.0, 1.0) * fxaa.texelSize).rgb);
+    float lumaM = luma(colorM);
+    float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));
+    float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));
+
+    // Blur along the edge, which runs across the luma gradient
+    vec2 direction = vec2(-((lumaNW + lumaNE) - (lumaSW + lumaSE)), (lumaNW + lumaSW) - (lumaNE + lumaSE));
+    float directionReduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * 0.25 * REDUCE_MUL, REDUCE_MIN);
+    float inverseDirectionMin = 1.0 / (min(abs(direction.x), abs(direction.y)) + directionReduce);
+    direction = clamp(direction * inverseDirectionMin, -SPAN_MAX, SPAN_MAX) * fxaa.texelSize;
+
+    vec3 colorA = 0.5 * (texture(sceneColor, screenUv + direction * (1.0 / 3.0 - 0.5)).rgb +
+                         texture(sceneColor, screenUv + direction * (2.0 / 3.0 - 0.5)).rgb);
+    vec3 colorB = colorA * 0.5 + 0.25 * (texture(sceneColor, screenUv - direction * 0.5).rgb +
+                                         texture(sceneColor, screenUv + direction * 0.5).rgb);
+    // The wider blur crossed into something else, keep the narrow one
+    float lumaB = luma(colorB);
+    outColor = vec4(lumaB < lumaMin || lumaB > lumaMax ? colorA : colorB, 1.0);
+}
@@ -0,0 +1,39 @@
+#version 450
+
+layout(location = 0) out vec3 fragColor;
+layout(binding = 0) uniform FrameUniforms {
+    mat4 view;
+    mat4 proj;
+} frame;
+
+struct GpuObject {
+    mat4 model;
+    vec4 boundingSphere;
+    uint indexCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint padding;
+};
+
+layout(std430, binding = 1) readonly buffer Objects {
+    GpuObject objects[];
+};
+
+vec2 positions[3] = vec2[](
+    vec2(0.0, -0.5),
+    vec2(0.5, 0.5),
+    vec2(-0.5, 0.5)
+);
+
+vec3 colors[3] = vec3[](
+    vec3(1.0, 0.0, 0.0),
+    vec3(0.0, 1.0, 0.0),
+    vec3(0.0, 0.0, 1.0)
+);
+
+void main() {
+    // The culling pass stores the object index in firstInstance
+    mat4 model = objects[gl_InstanceIndex].model;
+    gl_Position = frame.proj * frame.view * model * vec4(positions[gl_VertexIndex % 3], 0.0, 1.0);
+    fragColor = colors[gl_VertexIndex % 3];
+}
\ No newline at end of file
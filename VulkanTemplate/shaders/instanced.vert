@@ -0,0 +1,34 @@
+#version 450
+
+layout(location = 0) in mat4 instanceModel;
+layout(location = 4) in uint instanceMaterial;
+
+layout(location = 0) out vec3 fragColor;
+layout(binding = 0) uniform FrameUniforms {
+    mat4 view;
+    mat4 proj;
+} frame;
+
+vec2 positions[3] = vec2[](
+    vec2(0.0, -0.5),
+    vec2(0.5, 0.5),
+    vec2(-0.5, 0.5)
+);
+
+vec3 colors[3] = vec3[](
+    vec3(1.0, 0.0, 0.0),
+    vec3(0.0, 1.0, 0.0),
+    vec3(0.0, 0.0, 1.0)
+);
+
+vec3 materialTints[4] = vec3[](
+    vec3(1.0, 1.0, 1.0),
+    vec3(1.0, 0.6, 0.6),
+    vec3(0.6, 1.0, 0.6),
+    vec3(0.6, 0.6, 1.0)
+);
+
+void main() {
+    gl_Position = frame.proj * frame.view * instanceModel * vec4(positions[gl_VertexIndex], 0.0, 1.0);
+    fragColor = colors[gl_VertexIndex] * materialTints[instanceMaterial % 4];
+}
\ No newline at end of file
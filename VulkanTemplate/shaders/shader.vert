@@ -1,11 +1,14 @@
 #version 450
 
 layout(location = 0) out vec3 fragColor;
-layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
+layout(binding = 0) uniform FrameUniforms {
     mat4 view;
     mat4 proj;
-} ubo;
+} frame;
+
+layout(push_constant) uniform DrawPushConstants {
+    mat4 model;
+} draw;
 
 vec2 positions[3] = vec2[](
     vec2(0.0, -0.5),
@@ -20,6 +23,6 @@ vec3 colors[3] = vec3[](
 );
 
 void main() {
-    gl_Position = ubo.model * vec4(positions[gl_VertexIndex], 0.0, 1.0);
+    gl_Position = frame.proj * frame.view * draw.model * vec4(positions[gl_VertexIndex], 0.0, 1.0);
     fragColor = colors[gl_VertexIndex];
 }
\ No newline at end of file
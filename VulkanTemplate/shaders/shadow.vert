@@ -0,0 +1,17 @@
+#version 450
+
+// Depth only, the same triangles as the scene drawn from the light of one cascade
+layout(push_constant) uniform ShadowPushConstants {
+    mat4 model;
+    mat4 lightViewProj;
+} draw;
+
+vec2 positions[3] = vec2[](
+    vec2(0.0, -0.5),
+    vec2(0.5, 0.5),
+    vec2(-0.5, 0.5)
+);
+
+void main() {
+    gl_Position = draw.lightViewProj * draw.model * vec4(positions[gl_VertexIndex], 0.0, 1.0);
+}
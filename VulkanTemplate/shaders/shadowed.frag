@@ -0,0 +1,37 @@
+#version 450
+
+// Lit by one directional light, shadowed by the cascade the fragment's view depth falls in
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec3 worldPosition;
+layout(location = 2) in vec3 worldNormal;
+layout(location = 3) in float viewDepth;
+
+layout(location = 0) out vec4 outColor;
+
+layout(binding = 1) uniform ShadowUniforms {
+    mat4 lightViewProj[4];
+    vec4 splitDepths;
+    vec4 lightDirection;
+} shadow;
+
+layout(binding = 2) uniform sampler2DArrayShadow shadowMap;
+
+const vec3 AMBIENT = vec3(0.2);
+
+void main() {
+    // The first cascade reaching past the fragment, the last one covers the rest of the view
+    uint cascade = 3;
+    for (uint i = 0; i < 3; i++) {
+        if (viewDepth <= shadow.splitDepths[i]) {
+            cascade = i;
+            break;
+        }
+    }
+    vec4 lightClip = shadow.lightViewProj[cascade] * vec4(worldPosition, 1.0);
+    vec3 lightNdc = lightClip.xyz / lightClip.w;
+    // The compare sampler filters linearly, a 2x2 PCF for free
+    float lit = texture(shadowMap, vec4(lightNdc.xy * 0.5 + 0.5, float(cascade), lightNdc.z));
+
+    float diffuse = max(dot(normalize(worldNormal), -shadow.lightDirection.xyz), 0.0);
+    outColor = vec4(fragColor * (AMBIENT + diffuse * lit), 1.0);
+}
@@ -0,0 +1,46 @@
+#version 450
+
+layout(location = 0) in vec2 screenUv;
+
+layout(location = 0) out vec4 outColor;
+layout(location = 1) out vec4 outHistory;
+
+layout(binding = 0) uniform sampler2D sceneColor;
+layout(binding = 1) uniform sampler2D sceneDepth;
+layout(binding = 2) uniform sampler2D history;
+
+layout(push_constant) uniform TaaPushConstants {
+    mat4 reprojection;
+    vec2 texelSize;
+    float historyWeight;
+} taa;
+
+void main() {
+    vec3 current = texture(sceneColor, screenUv).rgb;
+
+    // History outside the range of the current neighborhood belongs to something that moved away
+    vec3 neighborhoodMin = current;
+    vec3 neighborhoodMax = current;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            vec3 neighbor = texture(sceneColor, screenUv + vec2(x, y) * taa.texelSize).rgb;
+            neighborhoodMin = min(neighborhoodMin, neighbor);
+            neighborhoodMax = max(neighborhoodMax, neighbor);
+        }
+    }
+
+    // Where this pixel's surface was on screen last frame, from its depth and the camera matrices
+    float depth = texture(sceneDepth, screenUv).r;
+    vec4 previousClip = taa.reprojection * vec4(screenUv * 2.0 - 1.0, depth, 1.0);
+    vec2 previousUv = previousClip.xy / previousClip.w * 0.5 + 0.5;
+
+    float weight = taa.historyWeight;
+    if (any(lessThan(previousUv, vec2(0.0))) || any(greaterThan(previousUv, vec2(1.0)))) {
+        weight = 0.0;
+    }
+    vec3 previous = clamp(texture(history, previousUv).rgb, neighborhoodMin, neighborhoodMax);
+    vec3 resolved = mix(current, previous, weight);
+
+    outColor = vec4(resolved, 1.0);
+    outHistory = vec4(resolved, 1.0);
+}
@@ -0,0 +1,18 @@
+#version 450
+
+layout(location = 0) in vec2 screenUv;
+
+layout(location = 0) out vec4 outColor;
+
+layout(binding = 0) uniform sampler2D sceneColor;
+
+layout(push_constant) uniform UpscalePushConstants {
+    vec2 uvScale;
+    vec2 uvMax;
+} upscale;
+
+void main() {
+    // The scene only covers the top left of the target, bilinear filtering must not reach past it
+    vec2 uv = min(screenUv * upscale.uvScale, upscale.uvMax);
+    outColor = texture(sceneColor, uv);
+}
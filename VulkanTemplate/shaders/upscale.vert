@@ -0,0 +1,9 @@
+#version 450
+
+layout(location = 0) out vec2 screenUv;
+
+void main() {
+    // One triangle covering the screen, uv runs 0..1 across it
+    screenUv = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+    gl_Position = vec4(screenUv * 2.0 - 1.0, 0.0, 1.0);
+}